@@ -0,0 +1,251 @@
+#include "allocationtracker.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(TRACK_ALLOCATIONS) && defined(__cpp_aligned_new) && defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// Plain thread-locals: no constructors, so they are safe to touch from
+// operator new at any point of a thread's life.
+static thread_local unsigned long long threadAllocations = 0;
+static thread_local unsigned long long threadFrees = 0;
+static thread_local unsigned long long threadBytes = 0;
+
+static std::atomic<unsigned long long> totalAllocations(0);
+static std::atomic<unsigned long long> totalFrees(0);
+static std::atomic<unsigned long long> totalBytes(0);
+
+#ifdef TRACK_ALLOCATIONS
+
+static void* trackedAllocate(std::size_t size) {
+	threadAllocations++;
+	threadBytes += size;
+	totalAllocations.fetch_add(1, std::memory_order_relaxed);
+	totalBytes.fetch_add(size, std::memory_order_relaxed);
+
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+static void trackedFree(void* pointer) {
+	if (pointer == NULL) {
+		return;
+	}
+
+	threadFrees++;
+	totalFrees.fetch_add(1, std::memory_order_relaxed);
+
+	std::free(pointer);
+}
+
+void* operator new(std::size_t size) {
+	void* pointer = trackedAllocate(size);
+
+	if (pointer == NULL) {
+		throw std::bad_alloc();
+	}
+
+	return pointer;
+}
+
+void* operator new[](std::size_t size) {
+	void* pointer = trackedAllocate(size);
+
+	if (pointer == NULL) {
+		throw std::bad_alloc();
+	}
+
+	return pointer;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return trackedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return trackedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+	trackedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+	trackedFree(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+	trackedFree(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+	trackedFree(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+	trackedFree(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+	trackedFree(pointer);
+}
+
+// Over-aligned types go through these since C++17. They need a matching
+// aligned free on Windows, so they cannot share trackedAllocate().
+#ifdef __cpp_aligned_new
+
+static void* trackedAllocateAligned(std::size_t size, std::align_val_t alignment) {
+	threadAllocations++;
+	threadBytes += size;
+	totalAllocations.fetch_add(1, std::memory_order_relaxed);
+	totalBytes.fetch_add(size, std::memory_order_relaxed);
+
+#ifdef _WIN32
+	return _aligned_malloc(size == 0 ? 1 : size, (std::size_t)alignment);
+#else
+	void* pointer = NULL;
+	return posix_memalign(&pointer, std::max((std::size_t)alignment, sizeof(void*)), size == 0 ? 1 : size) == 0 ? pointer : NULL;
+#endif
+}
+
+static void trackedFreeAligned(void* pointer) {
+	if (pointer == NULL) {
+		return;
+	}
+
+	threadFrees++;
+	totalFrees.fetch_add(1, std::memory_order_relaxed);
+
+#ifdef _WIN32
+	_aligned_free(pointer);
+#else
+	std::free(pointer);
+#endif
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	void* pointer = trackedAllocateAligned(size, alignment);
+
+	if (pointer == NULL) {
+		throw std::bad_alloc();
+	}
+
+	return pointer;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	void* pointer = trackedAllocateAligned(size, alignment);
+
+	if (pointer == NULL) {
+		throw std::bad_alloc();
+	}
+
+	return pointer;
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return trackedAllocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return trackedAllocateAligned(size, alignment);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+	trackedFreeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+	trackedFreeAligned(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+	trackedFreeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept {
+	trackedFreeAligned(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+	trackedFreeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+	trackedFreeAligned(pointer);
+}
+
+#endif
+
+#endif
+
+bool allocationTrackingEnabled() {
+#ifdef TRACK_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+AllocationCounters threadAllocationCounters() {
+	AllocationCounters counters = { threadAllocations, threadFrees, threadBytes };
+	return counters;
+}
+
+AllocationCounters processAllocationCounters() {
+	AllocationCounters counters = { totalAllocations.load(), totalFrees.load(), totalBytes.load() };
+	return counters;
+}
+
+AllocationMonitor::AllocationMonitor(int warmupFrames)
+	: warmup(warmupFrames), frames(0), frameStart(), last(), steadyAllocations(0), steadyFramesAllocating(0) {
+	frameStart = threadAllocationCounters();
+	last.allocations = 0;
+	last.frees = 0;
+	last.bytes = 0;
+}
+
+void AllocationMonitor::beginFrame() {
+	frameStart = threadAllocationCounters();
+}
+
+void AllocationMonitor::endFrame() {
+	AllocationCounters now = threadAllocationCounters();
+
+	last.allocations = now.allocations - frameStart.allocations;
+	last.frees = now.frees - frameStart.frees;
+	last.bytes = now.bytes - frameStart.bytes;
+
+	if (isWarmedUp()) {
+		steadyAllocations += last.allocations;
+
+		if (last.allocations > 0) {
+			steadyFramesAllocating++;
+		}
+	}
+
+	frames++;
+	frameStart = now;
+}
+
+AllocationCounters AllocationMonitor::lastFrame() const {
+	return last;
+}
+
+int AllocationMonitor::frameCount() const {
+	return frames;
+}
+
+bool AllocationMonitor::isWarmedUp() const {
+	return frames >= warmup;
+}
+
+unsigned long long AllocationMonitor::steadyStateAllocations() const {
+	return steadyAllocations;
+}
+
+int AllocationMonitor::steadyStateFramesAllocating() const {
+	return steadyFramesAllocating;
+}
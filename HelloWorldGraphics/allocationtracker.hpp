@@ -0,0 +1,49 @@
+#ifndef CUSTOM_ALLOCATIONTRACKER_H
+#define CUSTOM_ALLOCATIONTRACKER_H
+
+// Counts heap allocations by replacing the global operator new and delete,
+// including the C++17 aligned forms, when the build defines TRACK_ALLOCATIONS
+// (only the Benchmark configurations do).
+// Counters are kept per thread, so a render loop can be checked without
+// noise from capture or loader threads. Direct malloc calls, including those
+// inside GLFW and the driver, are not seen.
+struct AllocationCounters {
+	unsigned long long allocations;
+	unsigned long long frees;
+	unsigned long long bytes;
+};
+
+bool allocationTrackingEnabled();
+
+// Totals of the calling thread.
+AllocationCounters threadAllocationCounters();
+
+// Totals over all threads.
+AllocationCounters processAllocationCounters();
+
+// Measures the calling thread's allocations frame by frame. Frames after
+// warmupFrames are the steady state, which should not allocate at all.
+class AllocationMonitor {
+public:
+	AllocationMonitor(int warmupFrames);
+
+	void beginFrame();
+	void endFrame();
+
+	AllocationCounters lastFrame() const;
+	int frameCount() const;
+	bool isWarmedUp() const;
+
+	unsigned long long steadyStateAllocations() const;
+	int steadyStateFramesAllocating() const;
+
+private:
+	int warmup;
+	int frames;
+	AllocationCounters frameStart;
+	AllocationCounters last;
+	unsigned long long steadyAllocations;
+	int steadyFramesAllocating;
+};
+
+#endif // !CUSTOM_ALLOCATIONTRACKER_H
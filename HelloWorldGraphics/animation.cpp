@@ -0,0 +1,585 @@
+#include "animation.hpp"
+#include "jobsystem.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+// Dequantizing needs SSE2 integer conversions.
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define ANIMATION_USE_SSE
+#endif
+
+static const float rotationScale = 1.0f / 32767.0f;
+static const float translationScale = 1.0f / 65535.0f;
+
+Skeleton buildSkeleton(const std::vector<int>& parents, const std::vector<JointTransform>& bindPose) {
+	Skeleton skeleton;
+	std::vector<Mat4> model(parents.size());
+
+	skeleton.parents = parents;
+	skeleton.inverseBind.resize(parents.size());
+
+	for (size_t joint = 0; joint < parents.size(); joint++) {
+		Mat4 local = rigidTransform(bindPose[joint].rotation, bindPose[joint].translation);
+		model[joint] = parents[joint] < 0 ? local : multiply(model[parents[joint]], local);
+		skeleton.inverseBind[joint] = inverse(model[joint]);
+	}
+
+	return skeleton;
+}
+
+void resizePose(Pose& pose, int jointCount) {
+	PoseBlock identityBlock = {};
+
+	for (int lane = 0; lane < 4; lane++) {
+		identityBlock.rotation[3][lane] = 1.0f;
+	}
+
+	pose.jointCount = jointCount;
+	pose.blocks.assign((jointCount + 3) / 4, identityBlock);
+}
+
+JointTransform poseJoint(const Pose& pose, int joint) {
+	const PoseBlock& block = pose.blocks[joint / 4];
+	int lane = joint % 4;
+	JointTransform transform;
+
+	transform.rotation = vec4(block.rotation[0][lane], block.rotation[1][lane], block.rotation[2][lane], block.rotation[3][lane]);
+	transform.translation = vec3(block.translation[0][lane], block.translation[1][lane], block.translation[2][lane]);
+
+	return transform;
+}
+
+// out = normalize(a + (b - a) * t) for four quaternions, with b negated in
+// lanes where it lies in the other hemisphere.
+static void nlerpBlock(const float a[4][4], const float b[4][4], const float* t, float out[4][4]) {
+#ifdef ANIMATION_USE_SSE
+	__m128 alpha = _mm_loadu_ps(t);
+	__m128 ca[4];
+	__m128 cb[4];
+
+	for (int c = 0; c < 4; c++) {
+		ca[c] = _mm_loadu_ps(a[c]);
+		cb[c] = _mm_loadu_ps(b[c]);
+	}
+
+	__m128 cosine = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ca[0], cb[0]), _mm_mul_ps(ca[1], cb[1])),
+		_mm_add_ps(_mm_mul_ps(ca[2], cb[2]), _mm_mul_ps(ca[3], cb[3])));
+	__m128 flip = _mm_and_ps(_mm_cmplt_ps(cosine, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+	__m128 r[4];
+
+	for (int c = 0; c < 4; c++) {
+		r[c] = _mm_add_ps(ca[c], _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(cb[c], flip), ca[c]), alpha));
+	}
+
+	__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[0], r[0]), _mm_mul_ps(r[1], r[1])),
+		_mm_add_ps(_mm_mul_ps(r[2], r[2]), _mm_mul_ps(r[3], r[3])));
+	__m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared));
+
+	for (int c = 0; c < 4; c++) {
+		_mm_storeu_ps(out[c], _mm_mul_ps(r[c], inverseLength));
+	}
+#else
+	for (int lane = 0; lane < 4; lane++) {
+		float cosine = a[0][lane] * b[0][lane] + a[1][lane] * b[1][lane] + a[2][lane] * b[2][lane] + a[3][lane] * b[3][lane];
+		float sign = cosine < 0.0f ? -1.0f : 1.0f;
+		float r[4];
+		float lengthSquared = 0.0f;
+
+		for (int c = 0; c < 4; c++) {
+			r[c] = a[c][lane] + (b[c][lane] * sign - a[c][lane]) * t[lane];
+			lengthSquared += r[c] * r[c];
+		}
+
+		float inverseLength = 1.0f / std::sqrt(lengthSquared);
+
+		for (int c = 0; c < 4; c++) {
+			out[c][lane] = r[c] * inverseLength;
+		}
+	}
+#endif
+}
+
+static void lerpBlock(const float a[3][4], const float b[3][4], const float* t, float out[3][4]) {
+#ifdef ANIMATION_USE_SSE
+	__m128 alpha = _mm_loadu_ps(t);
+
+	for (int c = 0; c < 3; c++) {
+		__m128 ca = _mm_loadu_ps(a[c]);
+		_mm_storeu_ps(out[c], _mm_add_ps(ca, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b[c]), ca), alpha)));
+	}
+#else
+	for (int c = 0; c < 3; c++) {
+		for (int lane = 0; lane < 4; lane++) {
+			out[c][lane] = a[c][lane] + (b[c][lane] - a[c][lane]) * t[lane];
+		}
+	}
+#endif
+}
+
+// out = offset + quantized * scale, four lanes of count components.
+static void dequantizeBlock(const int32_t (*quantized)[4], const float (*offset)[4], const float (*scale)[4], int count, float (*out)[4]) {
+	for (int c = 0; c < count; c++) {
+#ifdef ANIMATION_USE_SSE
+		__m128 values = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)quantized[c]));
+		_mm_storeu_ps(out[c], _mm_add_ps(_mm_loadu_ps(offset[c]), _mm_mul_ps(values, _mm_loadu_ps(scale[c]))));
+#else
+		for (int lane = 0; lane < 4; lane++) {
+			out[c][lane] = offset[c][lane] + quantized[c][lane] * scale[c][lane];
+		}
+#endif
+	}
+}
+
+void blendPoses(const Pose& a, const Pose& b, float weight, Pose& out) {
+	if (out.jointCount != a.jointCount) {
+		resizePose(out, a.jointCount);
+	}
+
+	float weights[4] = { weight, weight, weight, weight };
+
+	for (size_t i = 0; i < a.blocks.size(); i++) {
+		nlerpBlock(a.blocks[i].rotation, b.blocks[i].rotation, weights, out.blocks[i].rotation);
+		lerpBlock(a.blocks[i].translation, b.blocks[i].translation, weights, out.blocks[i].translation);
+	}
+}
+
+void poseToSkinMatrices(const Skeleton& skeleton, const Pose& pose, Mat4* model, Mat4* skin) {
+	for (int joint = 0; joint < pose.jointCount; joint++) {
+		JointTransform transform = poseJoint(pose, joint);
+		Mat4 local = rigidTransform(transform.rotation, transform.translation);
+		int parent = skeleton.parents[joint];
+
+		model[joint] = parent < 0 ? local : multiply(model[parent], local);
+		skin[joint] = multiply(model[joint], skeleton.inverseBind[joint]);
+	}
+}
+
+static float quaternionAngle(const Vec4& a, const Vec4& b) {
+	float cosine = std::fabs(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+	return 2.0f * std::acos(std::min(cosine, 1.0f));
+}
+
+static Vec4 nlerp(const Vec4& a, const Vec4& b, float t) {
+	Vec4 r = vec4(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t);
+	float inverseLength = 1.0f / std::sqrt(r.x * r.x + r.y * r.y + r.z * r.z + r.w * r.w);
+	return vec4(r.x * inverseLength, r.y * inverseLength, r.z * inverseLength, r.w * inverseLength);
+}
+
+// Greedy linear key reduction: a segment grows until interpolating between
+// its ends misses some frame in between by more than the tolerance.
+template <typename Fits>
+static void fitKeys(int frameCount, const Fits& fits, std::vector<int>& keys) {
+	int start = 0;
+
+	keys.clear();
+	keys.push_back(0);
+
+	for (int end = 2; end < frameCount; end++) {
+		bool ok = true;
+
+		for (int i = start + 1; i < end && ok; i++) {
+			ok = fits(start, end, i);
+		}
+
+		if (!ok) {
+			start = end - 1;
+			keys.push_back(start);
+		}
+	}
+
+	if (frameCount > 1) {
+		keys.push_back(frameCount - 1);
+	}
+}
+
+AnimationClip::AnimationClip(const JointTransform* source, int jointCount, int frameCount, float framesPerSecond,
+	float rotationTolerance, float translationTolerance)
+	: joints(jointCount), frames(frameCount), rate(framesPerSecond), rotationTracks(jointCount), translationTracks(jointCount),
+	ranges(jointCount), rotationFrames(), rotationKeys(), translationFrames(), translationKeys() {
+	if (frames > 65536) {
+		std::cerr << "ERROR::ANIMATION::CLIP_TOO_LONG: " << frames << " frames, keeping 65536" << std::endl;
+		frames = 65536;
+	}
+
+	std::vector<Vec4> rotations(frames);
+	std::vector<Vec3> translations(frames);
+	std::vector<int> keys;
+
+	for (int joint = 0; joint < joints; joint++) {
+		for (int frame = 0; frame < frames; frame++) {
+			const JointTransform& transform = source[(size_t)frame * joints + joint];
+			Vec4 q = transform.rotation;
+
+			// Keeps neighbouring keys in one hemisphere so interpolation takes the short arc.
+			if (frame > 0) {
+				const Vec4& previous = rotations[frame - 1];
+
+				if (q.x * previous.x + q.y * previous.y + q.z * previous.z + q.w * previous.w < 0.0f) {
+					q = vec4(-q.x, -q.y, -q.z, -q.w);
+				}
+			}
+
+			rotations[frame] = q;
+			translations[frame] = transform.translation;
+		}
+
+		fitKeys(frames, [&](int start, int end, int i) {
+			float t = (float)(i - start) / (end - start);
+			return quaternionAngle(nlerp(rotations[start], rotations[end], t), rotations[i]) <= rotationTolerance;
+		}, keys);
+
+		rotationTracks[joint].firstKey = (uint32_t)rotationFrames.size();
+		rotationTracks[joint].keyCount = (uint32_t)keys.size();
+
+		for (size_t k = 0; k < keys.size(); k++) {
+			const Vec4& q = rotations[keys[k]];
+			float components[4] = { q.x, q.y, q.z, q.w };
+
+			rotationFrames.push_back((uint16_t)keys[k]);
+
+			for (int c = 0; c < 4; c++) {
+				rotationKeys.push_back((int16_t)std::floor(std::min(std::max(components[c], -1.0f), 1.0f) * 32767.0f + 0.5f));
+			}
+		}
+
+		fitKeys(frames, [&](int start, int end, int i) {
+			float t = (float)(i - start) / (end - start);
+			Vec3 interpolated = add(translations[start], scale(sub(translations[end], translations[start]), t));
+			return length(sub(interpolated, translations[i])) <= translationTolerance;
+		}, keys);
+
+		TranslationRange& range = ranges[joint];
+
+		for (int c = 0; c < 3; c++) {
+			float low = 1e30f;
+			float high = -1e30f;
+
+			for (int frame = 0; frame < frames; frame++) {
+				const float* v = &translations[frame].x;
+				low = std::min(low, v[c]);
+				high = std::max(high, v[c]);
+			}
+
+			range.minimum[c] = low;
+			range.extent[c] = high - low;
+		}
+
+		translationTracks[joint].firstKey = (uint32_t)translationFrames.size();
+		translationTracks[joint].keyCount = (uint32_t)keys.size();
+
+		for (size_t k = 0; k < keys.size(); k++) {
+			const float* v = &translations[keys[k]].x;
+
+			translationFrames.push_back((uint16_t)keys[k]);
+
+			for (int c = 0; c < 3; c++) {
+				float fraction = range.extent[c] > 0.0f ? (v[c] - range.minimum[c]) / range.extent[c] : 0.0f;
+				translationKeys.push_back((uint16_t)std::floor(fraction * 65535.0f + 0.5f));
+			}
+		}
+	}
+}
+
+int AnimationClip::jointCount() const {
+	return joints;
+}
+
+float AnimationClip::duration() const {
+	return frames > 1 ? (frames - 1) / rate : 0.0f;
+}
+
+// Index of the key at or before position and the fraction towards the next one.
+static float findKey(const uint16_t* keyFrames, uint32_t count, float position, uint32_t& key) {
+	key = (uint32_t)(std::upper_bound(keyFrames, keyFrames + count, (uint16_t)position) - keyFrames);
+	key = key > 0 ? key - 1 : 0;
+
+	if (key + 1 >= count) {
+		key = count - 1;
+		return 0.0f;
+	}
+
+	return (position - keyFrames[key]) / (keyFrames[key + 1] - keyFrames[key]);
+}
+
+void AnimationClip::sample(float time, Pose& pose) const {
+	if (pose.jointCount != joints) {
+		resizePose(pose, joints);
+	}
+
+	float length = duration();
+	float wrapped = length > 0.0f ? std::fmod(time, length) : 0.0f;
+	float position = std::min(std::max((wrapped < 0.0f ? wrapped + length : wrapped) * rate, 0.0f), (float)(frames - 1));
+
+	static const float rotationScales[4][4] = {
+		{ rotationScale, rotationScale, rotationScale, rotationScale },
+		{ rotationScale, rotationScale, rotationScale, rotationScale },
+		{ rotationScale, rotationScale, rotationScale, rotationScale },
+		{ rotationScale, rotationScale, rotationScale, rotationScale }
+	};
+	static const float zeros[4][4] = {};
+
+	for (size_t block = 0; block < pose.blocks.size(); block++) {
+		int32_t rotation0[4][4];
+		int32_t rotation1[4][4];
+		int32_t translation0[3][4];
+		int32_t translation1[3][4];
+		float rotationAlpha[4];
+		float translationAlpha[4];
+		float minimum[3][4];
+		float extent[3][4];
+
+		// Gathers each lane's key pair; the arithmetic below runs on all four lanes at once.
+		for (int lane = 0; lane < 4; lane++) {
+			int joint = (int)block * 4 + lane;
+
+			if (joint >= joints) {
+				for (int c = 0; c < 4; c++) {
+					rotation0[c][lane] = rotation1[c][lane] = c == 3 ? 32767 : 0;
+				}
+
+				for (int c = 0; c < 3; c++) {
+					translation0[c][lane] = translation1[c][lane] = 0;
+					minimum[c][lane] = 0.0f;
+					extent[c][lane] = 0.0f;
+				}
+
+				rotationAlpha[lane] = 0.0f;
+				translationAlpha[lane] = 0.0f;
+				continue;
+			}
+
+			const Track& rotationTrack = rotationTracks[joint];
+			uint32_t key;
+			rotationAlpha[lane] = findKey(&rotationFrames[rotationTrack.firstKey], rotationTrack.keyCount, position, key);
+
+			const int16_t* first = &rotationKeys[(size_t)(rotationTrack.firstKey + key) * 4];
+			const int16_t* second = key + 1 < rotationTrack.keyCount ? first + 4 : first;
+
+			for (int c = 0; c < 4; c++) {
+				rotation0[c][lane] = first[c];
+				rotation1[c][lane] = second[c];
+			}
+
+			const Track& translationTrack = translationTracks[joint];
+			translationAlpha[lane] = findKey(&translationFrames[translationTrack.firstKey], translationTrack.keyCount, position, key);
+
+			const uint16_t* from = &translationKeys[(size_t)(translationTrack.firstKey + key) * 3];
+			const uint16_t* to = key + 1 < translationTrack.keyCount ? from + 3 : from;
+
+			for (int c = 0; c < 3; c++) {
+				translation0[c][lane] = from[c];
+				translation1[c][lane] = to[c];
+				minimum[c][lane] = ranges[joint].minimum[c];
+				extent[c][lane] = ranges[joint].extent[c] * translationScale;
+			}
+		}
+
+		float decoded0[4][4];
+		float decoded1[4][4];
+		PoseBlock& out = pose.blocks[block];
+
+		dequantizeBlock(rotation0, zeros, rotationScales, 4, decoded0);
+		dequantizeBlock(rotation1, zeros, rotationScales, 4, decoded1);
+		nlerpBlock(decoded0, decoded1, rotationAlpha, out.rotation);
+
+		dequantizeBlock(translation0, minimum, extent, 3, decoded0);
+		dequantizeBlock(translation1, minimum, extent, 3, decoded1);
+		lerpBlock(decoded0, decoded1, translationAlpha, out.translation);
+	}
+}
+
+size_t AnimationClip::keyCount() const {
+	return rotationFrames.size() + translationFrames.size();
+}
+
+size_t AnimationClip::compressedBytes() const {
+	return (rotationTracks.size() + translationTracks.size()) * sizeof(Track) + ranges.size() * sizeof(TranslationRange)
+		+ (rotationFrames.size() + translationFrames.size()) * sizeof(uint16_t) + rotationKeys.size() * sizeof(int16_t)
+		+ translationKeys.size() * sizeof(uint16_t);
+}
+
+size_t AnimationClip::uncompressedBytes() const {
+	return (size_t)frames * joints * sizeof(JointTransform);
+}
+
+static const int benchChains = 8;
+static const int benchChainLength = 8;
+
+// A spine with seven limbs hanging off it, every chain benchChainLength joints.
+static void buildBenchSkeleton(std::vector<int>& parents, std::vector<JointTransform>& bindPose) {
+	for (int chain = 0; chain < benchChains; chain++) {
+		for (int link = 0; link < benchChainLength; link++) {
+			int joint = chain * benchChainLength + link;
+			JointTransform transform;
+
+			transform.rotation = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+			if (chain == 0) {
+				parents.push_back(joint - 1);
+				transform.translation = vec3(0.0f, link == 0 ? 1.0f : 0.15f, 0.0f);
+			}
+			else {
+				float side = chain % 2 == 0 ? 1.0f : -1.0f;
+				parents.push_back(link == 0 ? chain - 1 : joint - 1);
+				transform.translation = vec3(side * (link == 0 ? 0.1f : 0.12f), 0.0f, 0.0f);
+			}
+
+			bindPose.push_back(transform);
+		}
+	}
+}
+
+// Swings every joint about one axis; the last two joints of each chain stay
+// in bind pose and compress to two keys. cycles whole periods keep the loop seamless.
+static void buildBenchClip(const std::vector<JointTransform>& bindPose, int frameCount, int cycles, float amplitude, float phaseStep,
+	std::vector<JointTransform>& frames) {
+	static const Vec3 axes[3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f } };
+	int jointCount = (int)bindPose.size();
+
+	frames.resize((size_t)frameCount * jointCount);
+
+	for (int frame = 0; frame < frameCount; frame++) {
+		float phase = 6.28318531f * cycles * frame / (frameCount - 1);
+
+		for (int joint = 0; joint < jointCount; joint++) {
+			JointTransform transform = bindPose[joint];
+
+			if (joint % benchChainLength < benchChainLength - 2) {
+				float angle = amplitude * std::sin(phase + joint * phaseStep);
+				transform.rotation = multiplyQuaternions(transform.rotation, axisAngleQuaternion(axes[joint % 3], angle));
+			}
+
+			if (joint == 0) {
+				transform.translation.y += 0.05f * std::sin(phase * 2.0f);
+			}
+
+			frames[(size_t)frame * jointCount + joint] = transform;
+		}
+	}
+}
+
+// Largest rotation and translation error of clip over the source frames.
+static void measureClipError(const AnimationClip& clip, const std::vector<JointTransform>& frames, int frameCount, float framesPerSecond,
+	float& rotationError, float& translationError) {
+	Pose pose;
+	int jointCount = clip.jointCount();
+
+	rotationError = 0.0f;
+	translationError = 0.0f;
+
+	// The last frame wraps to the first, which equals it.
+	for (int frame = 0; frame + 1 < frameCount; frame++) {
+		clip.sample(frame / framesPerSecond, pose);
+
+		for (int joint = 0; joint < jointCount; joint++) {
+			JointTransform sampled = poseJoint(pose, joint);
+			const JointTransform& expected = frames[(size_t)frame * jointCount + joint];
+
+			rotationError = std::max(rotationError, quaternionAngle(sampled.rotation, expected.rotation));
+			translationError = std::max(translationError, length(sub(sampled.translation, expected.translation)));
+		}
+	}
+}
+
+int runAnimationBenchmark(int characterCount, int frames) {
+	const int clipFrames = 61;
+	const float framesPerSecond = 30.0f;
+	const int warmupFrames = 10;
+
+	std::vector<int> parents;
+	std::vector<JointTransform> bindPose;
+	buildBenchSkeleton(parents, bindPose);
+
+	Skeleton skeleton = buildSkeleton(parents, bindPose);
+	int jointCount = (int)parents.size();
+
+	std::vector<JointTransform> walkFrames;
+	std::vector<JointTransform> runFrames;
+	buildBenchClip(bindPose, clipFrames, 1, 0.5f, 0.4f, walkFrames);
+	buildBenchClip(bindPose, clipFrames, 2, 0.8f, 0.7f, runFrames);
+
+	AnimationClip walk(walkFrames.data(), jointCount, clipFrames, framesPerSecond, 0.002f, 0.0005f);
+	AnimationClip run(runFrames.data(), jointCount, clipFrames, framesPerSecond, 0.002f, 0.0005f);
+
+	std::cout << "ANIMATION BENCHMARK " << characterCount << " characters of " << jointCount << " joints blending two clips, "
+		<< frames << " frames" << std::endl;
+
+	const AnimationClip* clips[2] = { &walk, &run };
+	const std::vector<JointTransform>* sources[2] = { &walkFrames, &runFrames };
+	static const char* clipNames[2] = { "walk", "run" };
+
+	for (int i = 0; i < 2; i++) {
+		float rotationError;
+		float translationError;
+		measureClipError(*clips[i], *sources[i], clipFrames, framesPerSecond, rotationError, translationError);
+
+		std::cout << clipNames[i] << " clip: " << clips[i]->keyCount() << " of " << 2 * clipFrames * jointCount << " keys, "
+			<< clips[i]->compressedBytes() << " of " << clips[i]->uncompressedBytes() << " bytes, max error " << rotationError
+			<< " rad, " << translationError << " units" << std::endl;
+	}
+
+	std::vector<Mat4> skin((size_t)characterCount * jointCount);
+	double checksums[2] = { 0.0, 0.0 };
+
+	for (int parallel = 0; parallel < 2; parallel++) {
+		JobSystem jobs(parallel != 0 ? std::max((int)std::thread::hardware_concurrency() - 1, 1) : 0);
+		int lanes = jobs.laneCount();
+
+		// Per lane: walk pose, run pose, blended pose and model matrices.
+		std::vector<Pose> poses(lanes * 3);
+		std::vector<std::vector<Mat4> > models(lanes, std::vector<Mat4>(jointCount));
+
+		for (size_t i = 0; i < poses.size(); i++) {
+			resizePose(poses[i], jointCount);
+		}
+
+		double milliseconds = 0.0;
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				milliseconds = 0.0;
+			}
+
+			float time = frame / 60.0f;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			jobs.parallelFor((size_t)characterCount, 16, [&](size_t begin, size_t end, int lane) {
+				Pose& walkPose = poses[lane * 3];
+				Pose& runPose = poses[lane * 3 + 1];
+				Pose& blended = poses[lane * 3 + 2];
+
+				for (size_t c = begin; c < end; c++) {
+					float localTime = time + c * 0.37f;
+					float weight = 0.5f + 0.5f * std::sin(localTime * 0.5f + c);
+
+					walk.sample(localTime, walkPose);
+					run.sample(localTime * 1.25f, runPose);
+					blendPoses(walkPose, runPose, weight, blended);
+					poseToSkinMatrices(skeleton, blended, models[lane].data(), &skin[c * jointCount]);
+				}
+			});
+
+			milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		for (size_t i = 0; i < skin.size(); i++) {
+			checksums[parallel] += skin[i].m[12] + skin[i].m[13] + skin[i].m[14];
+		}
+
+		double perFrame = milliseconds / frames;
+
+		std::cout << lanes << (lanes == 1 ? " lane: " : " lanes: ") << perFrame << " ms per frame, "
+			<< (perFrame > 0.0 ? characterCount / perFrame : 0.0) << " characters/ms" << std::endl;
+	}
+
+	if (checksums[0] != checksums[1]) {
+		std::cerr << "ERROR::ANIMATION::LANES_DISAGREE: " << checksums[0] << " vs " << checksums[1] << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
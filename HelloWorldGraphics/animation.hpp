@@ -0,0 +1,106 @@
+#ifndef CUSTOM_ANIMATION_H
+#define CUSTOM_ANIMATION_H
+
+#include "vecmath.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Local transform of a joint relative to its parent; rotation is a unit quaternion.
+struct JointTransform {
+	Vec4 rotation;
+	Vec3 translation;
+};
+
+// Parents precede their children; roots have parent -1.
+struct Skeleton {
+	std::vector<int> parents;
+	std::vector<Mat4> inverseBind;
+};
+
+Skeleton buildSkeleton(const std::vector<int>& parents, const std::vector<JointTransform>& bindPose);
+
+// Four joints in SoA order, so one SSE register holds the same component
+// of all four: rotation[component][lane] with components x, y, z, w.
+struct PoseBlock {
+	float rotation[4][4];
+	float translation[3][4];
+};
+
+// Local joint transforms of a skeleton. Lanes past jointCount in the last
+// block hold the identity.
+struct Pose {
+	int jointCount = 0;
+	std::vector<PoseBlock> blocks;
+};
+
+void resizePose(Pose& pose, int jointCount);
+
+JointTransform poseJoint(const Pose& pose, int joint);
+
+// Per joint, rotations nlerped along the shorter arc and translations lerped.
+void blendPoses(const Pose& a, const Pose& b, float weight, Pose& out);
+
+// Model-space joint matrices and skin matrices (model times inverse bind),
+// ready for GpuSkinning::writePalette(). Both arrays hold jointCount entries.
+void poseToSkinMatrices(const Skeleton& skeleton, const Pose& pose, Mat4* model, Mat4* skin);
+
+// A looping keyframe clip, compressed at construction. Every track keeps
+// only the keys linear interpolation needs to stay within the tolerances
+// (before quantization, which adds about 1e-4 radians),
+// and stores them quantized: rotations as four signed 16-bit components,
+// translations as three 16-bit fractions of the track's range. Keys of a
+// track are contiguous, frame numbers apart from values.
+//
+// Sampling finds each joint's key pair and decodes and interpolates four
+// joints at a time with SSE.
+class AnimationClip {
+public:
+	// frames holds frameCount poses of jointCount joints, frame-major,
+	// sampled at framesPerSecond. The last frame should equal the first for
+	// a seamless loop. Tolerances are in radians and units.
+	AnimationClip(const JointTransform* frames, int jointCount, int frameCount, float framesPerSecond,
+		float rotationTolerance, float translationTolerance);
+
+	int jointCount() const;
+	float duration() const;
+
+	// Wraps time into the clip.
+	void sample(float time, Pose& pose) const;
+
+	size_t keyCount() const;
+	size_t compressedBytes() const;
+	// Bytes of the source frames as JointTransforms.
+	size_t uncompressedBytes() const;
+
+private:
+	struct Track {
+		uint32_t firstKey;
+		uint32_t keyCount;
+	};
+
+	struct TranslationRange {
+		float minimum[3];
+		float extent[3];
+	};
+
+	int joints;
+	int frames;
+	float rate;
+
+	std::vector<Track> rotationTracks;
+	std::vector<Track> translationTracks;
+	std::vector<TranslationRange> ranges;
+	std::vector<uint16_t> rotationFrames;
+	std::vector<int16_t> rotationKeys;
+	std::vector<uint16_t> translationFrames;
+	std::vector<uint16_t> translationKeys;
+};
+
+// Animates characterCount characters of a 64-joint skeleton, each blending
+// two clips at its own time and weight, on one lane and then on every core.
+// Prints compression ratio and error, then characters animated per
+// millisecond. Returns 0 on success, 1 when the lanes disagree.
+int runAnimationBenchmark(int characterCount, int frames);
+
+#endif // !CUSTOM_ANIMATION_H
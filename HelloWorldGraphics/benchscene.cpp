@@ -0,0 +1,162 @@
+#include "benchscene.hpp"
+#include <GL/glew.h>
+
+BenchScene::BenchScene(int gridSize, float spacing)
+	: vao(0), vertexBuffer(0), indexBuffer(0), instanceBuffer(0), instances(0), halfExtent(gridSize * spacing * 0.5f) {
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+
+	// Each face gets its own four vertices so normals stay flat.
+	for (int axis = 0; axis < 3; axis++) {
+		for (int side = -1; side <= 1; side += 2) {
+			float normal[3] = { 0.0f, 0.0f, 0.0f };
+			normal[axis] = (float)side;
+
+			int u = (axis + 1) % 3;
+			int v = (axis + 2) % 3;
+			unsigned int base = (unsigned int)(vertices.size() / 6);
+
+			for (int corner = 0; corner < 4; corner++) {
+				float position[3];
+				position[axis] = 0.4f * side;
+				position[u] = (corner == 1 || corner == 2) ? 0.4f : -0.4f;
+				position[v] = (corner >= 2) ? 0.4f : -0.4f;
+
+				vertices.insert(vertices.end(), position, position + 3);
+				vertices.insert(vertices.end(), normal, normal + 3);
+			}
+
+			if (side > 0) {
+				unsigned int face[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+				indices.insert(indices.end(), face, face + 6);
+			}
+			else {
+				unsigned int face[6] = { base, base + 2, base + 1, base, base + 3, base + 2 };
+				indices.insert(indices.end(), face, face + 6);
+			}
+		}
+	}
+
+	std::vector<float> instanceData;
+	unsigned int seed = 12345;
+
+	for (int z = 0; z < gridSize; z++) {
+		for (int x = 0; x < gridSize; x++) {
+			seed = seed * 1664525u + 1013904223u;
+
+			instanceData.push_back(x * spacing - halfExtent);
+			instanceData.push_back(0.4f);
+			instanceData.push_back(z * spacing - halfExtent);
+			instanceData.push_back(0.4f + 0.6f * ((seed >> 8) & 0xFF) / 255.0f);
+			instanceData.push_back(0.4f + 0.6f * ((seed >> 16) & 0xFF) / 255.0f);
+			instanceData.push_back(0.4f + 0.6f * ((seed >> 24) & 0xFF) / 255.0f);
+		}
+	}
+
+	instances = (unsigned int)(gridSize * gridSize);
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+
+	glGenBuffers(1, &instanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, instanceData.size() * sizeof(float), instanceData.data(), GL_STATIC_DRAW);
+
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (void*)0);
+	glVertexAttribDivisor(2, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (void*)(3 * sizeof(float)));
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(3);
+
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+}
+
+BenchScene::~BenchScene() {
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	glDeleteBuffers(1, &instanceBuffer);
+}
+
+void BenchScene::draw() const {
+	glBindVertexArray(vao);
+	glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void*)0, instances);
+}
+
+void BenchScene::updateInstances(const float* instanceData, unsigned int count) {
+	// Orphaning keeps the upload from waiting on draws still reading the old data.
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)count * 6 * sizeof(float), NULL, GL_STREAM_DRAW);
+
+	if (count > 0) {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)count * 6 * sizeof(float), instanceData);
+	}
+
+	instances = count;
+}
+
+std::vector<PointLight> BenchScene::makeLights(int count, float radius) const {
+	std::vector<PointLight> lights(count);
+	unsigned int seed = 67890;
+
+	for (int i = 0; i < count; i++) {
+		float values[6];
+
+		for (int v = 0; v < 6; v++) {
+			seed = seed * 1664525u + 1013904223u;
+			values[v] = ((seed >> 8) & 0xFFFF) / 65535.0f;
+		}
+
+		lights[i].positionRadius = vec4((values[0] * 2.0f - 1.0f) * halfExtent, 0.5f + values[1] * 2.0f,
+			(values[2] * 2.0f - 1.0f) * halfExtent, radius);
+		lights[i].color = vec4(values[3], values[4], values[5], 1.0f);
+	}
+
+	return lights;
+}
+
+Vec3 BenchScene::cameraPosition() const {
+	return vec3(0.0f, halfExtent * 0.8f, halfExtent * 1.6f);
+}
+
+Mat4 BenchScene::cameraView() const {
+	return lookAt(cameraPosition(), vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+}
+
+Mat4 BenchScene::cameraProjection(float aspect) const {
+	return perspective(1.0f, aspect, nearPlane(), farPlane());
+}
+
+Mat4 BenchScene::cameraViewProjection(float aspect) const {
+	return multiply(cameraProjection(aspect), cameraView());
+}
+
+float BenchScene::nearPlane() const {
+	return 0.1f;
+}
+
+float BenchScene::farPlane() const {
+	return halfExtent * 6.0f;
+}
+
+float BenchScene::extent() const {
+	return halfExtent;
+}
+
+unsigned int BenchScene::instanceCount() const {
+	return instances;
+}
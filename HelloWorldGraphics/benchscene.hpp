@@ -0,0 +1,49 @@
+#ifndef CUSTOM_BENCHSCENE_H
+#define CUSTOM_BENCHSCENE_H
+
+#include "vecmath.hpp"
+#include <vector>
+
+struct PointLight {
+	// xyz position, w radius of influence.
+	Vec4 positionRadius;
+	Vec4 color;
+};
+
+// Instanced grid of cubes used by the renderer benchmarks. Vertex layout:
+// 0 position, 1 normal, 2 per-instance offset, 3 per-instance color.
+class BenchScene {
+public:
+	BenchScene(int gridSize, float spacing);
+	~BenchScene();
+
+	BenchScene(const BenchScene&) = delete;
+	BenchScene& operator=(const BenchScene&) = delete;
+
+	void draw() const;
+
+	// Replaces the grid with count instances of six floats each: offset, color.
+	void updateInstances(const float* instanceData, unsigned int count);
+
+	// Deterministic set of lights hovering over the grid.
+	std::vector<PointLight> makeLights(int count, float radius) const;
+
+	Mat4 cameraView() const;
+	Mat4 cameraProjection(float aspect) const;
+	Mat4 cameraViewProjection(float aspect) const;
+	Vec3 cameraPosition() const;
+	float nearPlane() const;
+	float farPlane() const;
+	float extent() const;
+	unsigned int instanceCount() const;
+
+private:
+	unsigned int vao;
+	unsigned int vertexBuffer;
+	unsigned int indexBuffer;
+	unsigned int instanceBuffer;
+	unsigned int instances;
+	float halfExtent;
+};
+
+#endif // !CUSTOM_BENCHSCENE_H
@@ -0,0 +1,706 @@
+#include "bufferallocator.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static int highestBit(uint32_t value) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse(&index, value);
+	return (int)index;
+#else
+	return 31 - __builtin_clz(value);
+#endif
+}
+
+static int lowestBit(uint32_t value) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return (int)index;
+#else
+	return __builtin_ctz(value);
+#endif
+}
+
+const uint32_t TlsfAllocator::granularity;
+
+static const int smallBlockShift = 8;
+
+// First and second level bin of a block size, as in the TLSF paper.
+static void mapSize(uint32_t size, int& firstLevel, int& secondLevel) {
+	if (size < (1u << smallBlockShift)) {
+		firstLevel = 0;
+		secondLevel = (int)(size / TlsfAllocator::granularity);
+	}
+	else {
+		int bit = highestBit(size);
+		secondLevel = (int)(size >> (bit - 4)) - 16;
+		firstLevel = bit - smallBlockShift + 1;
+	}
+}
+
+TlsfAllocator::TlsfAllocator(uint32_t capacity)
+	: blocks(), unusedBlocks(), firstLevelMap(0), total(capacity / granularity * granularity), freeTotal(0) {
+	for (int i = 0; i < firstLevelCount; i++) {
+		secondLevelMaps[i] = 0;
+
+		for (int j = 0; j < secondLevelCount; j++) {
+			heads[i][j] = invalid;
+		}
+	}
+
+	if (total >= granularity) {
+		uint32_t block = newBlock();
+		blocks[block].size = total;
+		blocks[block].isFree = true;
+		insertFree(block);
+		freeTotal = total;
+	}
+}
+
+uint32_t TlsfAllocator::newBlock() {
+	uint32_t block;
+
+	if (!unusedBlocks.empty()) {
+		block = unusedBlocks.back();
+		unusedBlocks.pop_back();
+	}
+	else {
+		block = (uint32_t)blocks.size();
+		blocks.push_back(Block());
+	}
+
+	Block empty = { 0, 0, invalid, invalid, invalid, invalid, false };
+	blocks[block] = empty;
+
+	return block;
+}
+
+void TlsfAllocator::releaseBlock(uint32_t block) {
+	unusedBlocks.push_back(block);
+}
+
+void TlsfAllocator::insertFree(uint32_t block) {
+	int firstLevel;
+	int secondLevel;
+	mapSize(blocks[block].size, firstLevel, secondLevel);
+
+	uint32_t head = heads[firstLevel][secondLevel];
+
+	blocks[block].previousFree = invalid;
+	blocks[block].nextFree = head;
+
+	if (head != invalid) {
+		blocks[head].previousFree = block;
+	}
+
+	heads[firstLevel][secondLevel] = block;
+	firstLevelMap |= 1u << firstLevel;
+	secondLevelMaps[firstLevel] |= 1u << secondLevel;
+}
+
+void TlsfAllocator::removeFree(uint32_t block) {
+	int firstLevel;
+	int secondLevel;
+	mapSize(blocks[block].size, firstLevel, secondLevel);
+
+	uint32_t previous = blocks[block].previousFree;
+	uint32_t next = blocks[block].nextFree;
+
+	if (previous != invalid) {
+		blocks[previous].nextFree = next;
+	}
+	else {
+		heads[firstLevel][secondLevel] = next;
+	}
+
+	if (next != invalid) {
+		blocks[next].previousFree = previous;
+	}
+
+	if (heads[firstLevel][secondLevel] == invalid) {
+		secondLevelMaps[firstLevel] &= ~(1u << secondLevel);
+
+		if (secondLevelMaps[firstLevel] == 0) {
+			firstLevelMap &= ~(1u << firstLevel);
+		}
+	}
+}
+
+uint32_t TlsfAllocator::findFree(uint32_t size) const {
+	// Rounding up to the next subclass makes any block of the found bin fit.
+	uint64_t rounded = size;
+
+	if (size >= (1u << smallBlockShift)) {
+		rounded += (1ull << (highestBit(size) - 4)) - 1;
+	}
+
+	if (rounded > 0xFFFFFFFFull) {
+		return invalid;
+	}
+
+	int firstLevel;
+	int secondLevel;
+	mapSize((uint32_t)rounded, firstLevel, secondLevel);
+
+	uint32_t secondMap = secondLevelMaps[firstLevel] & (0xFFFFFFFFu << secondLevel);
+
+	if (secondMap == 0) {
+		uint32_t firstMap = firstLevel + 1 < 32 ? firstLevelMap & (0xFFFFFFFFu << (firstLevel + 1)) : 0;
+
+		if (firstMap == 0) {
+			return invalid;
+		}
+
+		firstLevel = lowestBit(firstMap);
+		secondMap = secondLevelMaps[firstLevel];
+	}
+
+	return heads[firstLevel][lowestBit(secondMap)];
+}
+
+uint32_t TlsfAllocator::allocate(uint32_t size) {
+	size = std::max((size + granularity - 1) / granularity * granularity, granularity);
+
+	if (size == 0) {
+		return invalid;
+	}
+
+	uint32_t block = findFree(size);
+
+	if (block == invalid) {
+		return invalid;
+	}
+
+	removeFree(block);
+
+	if (blocks[block].size - size >= granularity) {
+		uint32_t rest = newBlock();
+		uint32_t next = blocks[block].nextPhysical;
+
+		blocks[rest].offset = blocks[block].offset + size;
+		blocks[rest].size = blocks[block].size - size;
+		blocks[rest].previousPhysical = block;
+		blocks[rest].nextPhysical = next;
+		blocks[rest].isFree = true;
+
+		if (next != invalid) {
+			blocks[next].previousPhysical = rest;
+		}
+
+		blocks[block].nextPhysical = rest;
+		blocks[block].size = size;
+		insertFree(rest);
+	}
+
+	blocks[block].isFree = false;
+	freeTotal -= blocks[block].size;
+
+	return block;
+}
+
+void TlsfAllocator::free(uint32_t block) {
+	if (block >= blocks.size() || blocks[block].isFree) {
+		return;
+	}
+
+	blocks[block].isFree = true;
+	freeTotal += blocks[block].size;
+
+	uint32_t previous = blocks[block].previousPhysical;
+
+	if (previous != invalid && blocks[previous].isFree) {
+		removeFree(previous);
+		blocks[previous].size += blocks[block].size;
+		blocks[previous].nextPhysical = blocks[block].nextPhysical;
+
+		if (blocks[block].nextPhysical != invalid) {
+			blocks[blocks[block].nextPhysical].previousPhysical = previous;
+		}
+
+		releaseBlock(block);
+		block = previous;
+	}
+
+	uint32_t next = blocks[block].nextPhysical;
+
+	if (next != invalid && blocks[next].isFree) {
+		removeFree(next);
+		blocks[block].size += blocks[next].size;
+		blocks[block].nextPhysical = blocks[next].nextPhysical;
+
+		if (blocks[next].nextPhysical != invalid) {
+			blocks[blocks[next].nextPhysical].previousPhysical = block;
+		}
+
+		releaseBlock(next);
+	}
+
+	insertFree(block);
+}
+
+uint32_t TlsfAllocator::offset(uint32_t block) const {
+	return blocks[block].offset;
+}
+
+uint32_t TlsfAllocator::size(uint32_t block) const {
+	return blocks[block].size;
+}
+
+uint32_t TlsfAllocator::capacity() const {
+	return total;
+}
+
+uint32_t TlsfAllocator::freeBytes() const {
+	return freeTotal;
+}
+
+uint32_t TlsfAllocator::largestFreeBlock() const {
+	if (firstLevelMap == 0) {
+		return 0;
+	}
+
+	int firstLevel = highestBit(firstLevelMap);
+	uint32_t largest = 0;
+
+	for (uint32_t block = heads[firstLevel][highestBit(secondLevelMaps[firstLevel])]; block != invalid; block = blocks[block].nextFree) {
+		largest = std::max(largest, blocks[block].size);
+	}
+
+	return largest;
+}
+
+static const uint32_t entryIndexBits = 20;
+static const uint32_t entryIndexMask = (1u << entryIndexBits) - 1;
+static const size_t pageGranularity = 64 * 1024;
+
+BufferAllocator::BufferAllocator(size_t pageSize)
+	: pageSize(std::min(pageSize, (size_t)0x80000000u)), uniformAlignment(256), version(0), bytesMoved(0), pages(), entries(), freeEntries() {
+	int offsetAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+
+	if (offsetAlignment > 0) {
+		uniformAlignment = (size_t)offsetAlignment;
+	}
+}
+
+BufferAllocator::~BufferAllocator() {
+	for (size_t i = 0; i < pages.size(); i++) {
+		if (pages[i].buffer != 0) {
+			glDeleteBuffers(1, &pages[i].buffer);
+		}
+	}
+}
+
+int BufferAllocator::addPage(size_t size) {
+	size = (size + pageGranularity - 1) / pageGranularity * pageGranularity;
+
+	if (size > 0x80000000u) {
+		std::cerr << "ERROR::BUFFER_ALLOCATOR::ALLOCATION_TOO_LARGE" << std::endl;
+		return -1;
+	}
+
+	unsigned int buffer;
+
+	// GL_COPY_WRITE_BUFFER leaves vertex array and uniform bindings alone.
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+	if (GLEW_ARB_buffer_storage) {
+		glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)size, NULL, GL_DYNAMIC_STORAGE_BIT);
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)size, NULL, GL_STATIC_DRAW);
+	}
+
+	Page page = { buffer, TlsfAllocator((uint32_t)size), 0 };
+
+	// Reuse the slot of a released page so page indices in entries stay put.
+	for (size_t i = 0; i < pages.size(); i++) {
+		if (pages[i].buffer == 0) {
+			pages[i] = page;
+			return (int)i;
+		}
+	}
+
+	pages.push_back(page);
+
+	return (int)pages.size() - 1;
+}
+
+bool BufferAllocator::allocateIn(int page, size_t size, size_t alignment, uint32_t& block, size_t& offset) {
+	if (pages[page].buffer == 0) {
+		return false;
+	}
+
+	// Over-allocate so an aligned start always fits inside the block, whatever
+	// the alignment; blocks only start on granularity boundaries.
+	size_t padded = size + alignment - 1;
+
+	if (padded > pages[page].allocator.capacity()) {
+		return false;
+	}
+
+	block = pages[page].allocator.allocate((uint32_t)padded);
+
+	if (block == TlsfAllocator::invalid) {
+		return false;
+	}
+
+	size_t start = pages[page].allocator.offset(block);
+	offset = (start + alignment - 1) / alignment * alignment;
+	pages[page].allocations++;
+
+	return true;
+}
+
+BufferRange BufferAllocator::allocate(size_t size, size_t alignment, const void* data) {
+	BufferRange range = { 0 };
+
+	if (alignment == 0) {
+		alignment = uniformAlignment;
+	}
+
+	size = std::max(size, (size_t)1);
+
+	int page = -1;
+	uint32_t block = TlsfAllocator::invalid;
+	size_t offset = 0;
+
+	for (size_t i = 0; i < pages.size() && page < 0; i++) {
+		if (allocateIn((int)i, size, alignment, block, offset)) {
+			page = (int)i;
+		}
+	}
+
+	if (page < 0) {
+		int added = addPage(std::max(pageSize, size + alignment));
+
+		if (added < 0 || !allocateIn(added, size, alignment, block, offset)) {
+			return range;
+		}
+
+		page = added;
+	}
+
+	uint32_t index;
+
+	if (!freeEntries.empty()) {
+		index = freeEntries.back();
+		freeEntries.pop_back();
+	}
+	else if (entries.size() <= entryIndexMask) {
+		index = (uint32_t)entries.size();
+		Entry entry = { -1, TlsfAllocator::invalid, 0, 0, 0, 1 };
+		entries.push_back(entry);
+	}
+	else {
+		pages[page].allocator.free(block);
+		pages[page].allocations--;
+		std::cerr << "ERROR::BUFFER_ALLOCATOR::TOO_MANY_ALLOCATIONS" << std::endl;
+		return range;
+	}
+
+	Entry& entry = entries[index];
+	entry.page = page;
+	entry.block = block;
+	entry.offset = offset;
+	entry.size = size;
+	entry.alignment = alignment;
+
+	range.value = (entry.generation << entryIndexBits) | index;
+
+	if (data != NULL) {
+		upload(range, 0, size, data);
+	}
+
+	return range;
+}
+
+int BufferAllocator::findEntry(BufferRange range) const {
+	uint32_t index = range.value & entryIndexMask;
+
+	if (range.value == 0 || index >= entries.size() || entries[index].page < 0 || entries[index].generation != range.value >> entryIndexBits) {
+		return -1;
+	}
+
+	return (int)index;
+}
+
+void BufferAllocator::free(BufferRange range) {
+	int index = findEntry(range);
+
+	if (index < 0) {
+		return;
+	}
+
+	Entry& entry = entries[index];
+	pages[entry.page].allocator.free(entry.block);
+	pages[entry.page].allocations--;
+
+	uint32_t generation = (entry.generation + 1) & (0xFFFFFFFFu >> entryIndexBits);
+
+	entry.page = -1;
+	entry.generation = generation == 0 ? 1 : generation;
+	freeEntries.push_back((uint32_t)index);
+}
+
+void BufferAllocator::upload(BufferRange range, size_t offset, size_t size, const void* data) {
+	int index = findEntry(range);
+
+	if (index < 0 || offset + size > entries[index].size) {
+		std::cerr << "ERROR::BUFFER_ALLOCATOR::INVALID_UPLOAD" << std::endl;
+		return;
+	}
+
+	const Entry& entry = entries[index];
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pages[entry.page].buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)(entry.offset + offset), (GLsizeiptr)size, data);
+}
+
+BufferSlice BufferAllocator::slice(BufferRange range) const {
+	BufferSlice result = { 0, 0, 0 };
+	int index = findEntry(range);
+
+	if (index >= 0) {
+		const Entry& entry = entries[index];
+		result.buffer = pages[entry.page].buffer;
+		result.offset = entry.offset;
+		result.size = entry.size;
+	}
+
+	return result;
+}
+
+unsigned int BufferAllocator::layoutVersion() const {
+	return version;
+}
+
+void BufferAllocator::defragment(size_t maxBytes) {
+	bytesMoved = 0;
+
+	int victim = -1;
+	size_t victimUsed = 0;
+	size_t freeElsewhere = 0;
+
+	for (size_t i = 0; i < pages.size(); i++) {
+		if (pages[i].buffer == 0) {
+			continue;
+		}
+
+		const TlsfAllocator& allocator = pages[i].allocator;
+		size_t used = allocator.capacity() - allocator.freeBytes();
+		freeElsewhere += allocator.freeBytes();
+
+		if (victim < 0 || used * pages[victim].allocator.capacity() < victimUsed * allocator.capacity()) {
+			victim = (int)i;
+			victimUsed = used;
+		}
+	}
+
+	if (victim < 0) {
+		return;
+	}
+
+	freeElsewhere -= pages[victim].allocator.freeBytes();
+
+	// Only pages under half full, and only when the rest can take their data.
+	if (victimUsed * 2 > pages[victim].allocator.capacity() || victimUsed > freeElsewhere) {
+		return;
+	}
+
+	for (size_t i = 0; i < entries.size() && pages[victim].allocations > 0; i++) {
+		Entry& entry = entries[i];
+
+		if (entry.page != victim) {
+			continue;
+		}
+
+		if (bytesMoved + entry.size > maxBytes) {
+			break;
+		}
+
+		int target = -1;
+		uint32_t block = TlsfAllocator::invalid;
+		size_t offset = 0;
+
+		for (size_t j = 0; j < pages.size() && target < 0; j++) {
+			if ((int)j != victim && allocateIn((int)j, entry.size, entry.alignment, block, offset)) {
+				target = (int)j;
+			}
+		}
+
+		if (target < 0) {
+			break;
+		}
+
+		glBindBuffer(GL_COPY_READ_BUFFER, pages[victim].buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, pages[target].buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)entry.offset, (GLintptr)offset, (GLsizeiptr)entry.size);
+
+		pages[victim].allocator.free(entry.block);
+		pages[victim].allocations--;
+
+		entry.page = target;
+		entry.block = block;
+		entry.offset = offset;
+		bytesMoved += entry.size;
+	}
+
+	if (bytesMoved > 0) {
+		version++;
+	}
+
+	if (pages[victim].allocations == 0) {
+		glDeleteBuffers(1, &pages[victim].buffer);
+		pages[victim].buffer = 0;
+	}
+}
+
+BufferAllocatorStats BufferAllocator::stats() const {
+	BufferAllocatorStats result = { 0, 0, 0, 0, 0.0f, 0, 0, bytesMoved };
+
+	for (size_t i = 0; i < pages.size(); i++) {
+		if (pages[i].buffer == 0) {
+			continue;
+		}
+
+		const TlsfAllocator& allocator = pages[i].allocator;
+
+		result.committedBytes += allocator.capacity();
+		result.freeBytes += allocator.freeBytes();
+		result.largestFreeBlock = std::max(result.largestFreeBlock, (size_t)allocator.largestFreeBlock());
+		result.pages++;
+		result.allocations += pages[i].allocations;
+	}
+
+	result.usedBytes = result.committedBytes - result.freeBytes;
+
+	if (result.freeBytes > 0) {
+		result.fragmentation = 1.0f - (float)result.largestFreeBlock / result.freeBytes;
+	}
+
+	return result;
+}
+
+struct BenchRange {
+	int expires;
+	size_t size;
+	size_t alignment;
+	BufferRange range;
+	unsigned int buffer;
+};
+
+static unsigned int benchSeed = 24680;
+
+static unsigned int nextRandom() {
+	benchSeed = benchSeed * 1664525u + 1013904223u;
+	return benchSeed >> 8;
+}
+
+// A third each of vertex, index and uniform ranges with lifetimes of 1 to 300 frames.
+static BenchRange makeBenchRange(int frame) {
+	BenchRange range;
+	unsigned int kind = nextRandom() % 3;
+
+	range.expires = frame + 1 + (int)(nextRandom() % 300);
+	range.size = kind == 0 ? 4096 + nextRandom() % (252 * 1024) : kind == 1 ? 1024 + nextRandom() % (63 * 1024) : 256 + nextRandom() % 3840;
+	range.alignment = kind == 0 ? 16 : kind == 1 ? 4 : 0;
+	range.range.value = 0;
+	range.buffer = 0;
+
+	return range;
+}
+
+int runBufferAllocatorBenchmark(int frames) {
+	const int rangesPerFrame = 16;
+	const size_t defragmentBudget = 1024 * 1024;
+
+	std::vector<char> data(256 * 1024, 1);
+	double milliseconds[2] = { 0.0, 0.0 };
+	size_t peakObjects[2] = { 0, 0 };
+
+	std::cout << "BUFFER ALLOCATOR BENCHMARK " << frames << " frames, " << rangesPerFrame << " new ranges per frame" << std::endl;
+
+	for (int pass = 0; pass < 2; pass++) {
+		bool pooled = pass == 0;
+		BufferAllocator allocator(8 * 1024 * 1024);
+		std::vector<BenchRange> live;
+
+		benchSeed = 24680;
+		glFinish();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		for (int frame = 0; frame < frames; frame++) {
+			for (size_t i = 0; i < live.size();) {
+				if (live[i].expires > frame) {
+					i++;
+					continue;
+				}
+
+				if (pooled) {
+					allocator.free(live[i].range);
+				}
+				else {
+					glDeleteBuffers(1, &live[i].buffer);
+				}
+
+				live[i] = live.back();
+				live.pop_back();
+			}
+
+			for (int i = 0; i < rangesPerFrame; i++) {
+				BenchRange range = makeBenchRange(frame);
+
+				if (pooled) {
+					range.range = allocator.allocate(range.size, range.alignment, &data[0]);
+				}
+				else {
+					glGenBuffers(1, &range.buffer);
+					glBindBuffer(GL_COPY_WRITE_BUFFER, range.buffer);
+					glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)range.size, &data[0], GL_STATIC_DRAW);
+				}
+
+				live.push_back(range);
+			}
+
+			if (pooled) {
+				allocator.defragment(defragmentBudget);
+
+				BufferAllocatorStats stats = allocator.stats();
+				peakObjects[pass] = std::max(peakObjects[pass], (size_t)stats.pages);
+
+				if (frame % 100 == 0) {
+					std::cout << "frame " << frame << ": " << stats.allocations << " ranges in " << stats.pages << " buffers, "
+						<< stats.usedBytes / 1024 << " of " << stats.committedBytes / 1024 << " KB used, fragmentation "
+						<< stats.fragmentation << ", moved " << stats.bytesMovedLastDefragment / 1024 << " KB" << std::endl;
+				}
+			}
+			else {
+				peakObjects[pass] = std::max(peakObjects[pass], live.size());
+			}
+		}
+
+		glFinish();
+		milliseconds[pass] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		if (!pooled) {
+			for (size_t i = 0; i < live.size(); i++) {
+				glDeleteBuffers(1, &live[i].buffer);
+			}
+		}
+	}
+
+	std::cout << "sub-allocated: " << milliseconds[0] << " ms, peak " << peakObjects[0] << " buffer objects" << std::endl;
+	std::cout << "buffer per range: " << milliseconds[1] << " ms, peak " << peakObjects[1] << " buffer objects" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,162 @@
+#ifndef CUSTOM_BUFFERALLOCATOR_H
+#define CUSTOM_BUFFERALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Two-level segregated fit allocator over an abstract range of bytes. Only
+// offsets are tracked, so it can manage GPU memory it never touches. Blocks
+// are binned by size into power-of-two classes split into 16 linear
+// subclasses; bitmaps make allocate and free O(1), and freed blocks merge
+// with free neighbours right away.
+class TlsfAllocator {
+public:
+	static const uint32_t invalid = 0xFFFFFFFFu;
+	static const uint32_t granularity = 16;
+
+	TlsfAllocator(uint32_t capacity);
+
+	// Returns a block id, or invalid when no free block is large enough.
+	uint32_t allocate(uint32_t size);
+	void free(uint32_t block);
+
+	uint32_t offset(uint32_t block) const;
+	uint32_t size(uint32_t block) const;
+
+	uint32_t capacity() const;
+	uint32_t freeBytes() const;
+	uint32_t largestFreeBlock() const;
+
+private:
+	static const int secondLevelBits = 4;
+	static const int secondLevelCount = 1 << secondLevelBits;
+	static const int firstLevelCount = 25;
+
+	struct Block {
+		uint32_t offset;
+		uint32_t size;
+		uint32_t previousPhysical;
+		uint32_t nextPhysical;
+		uint32_t previousFree;
+		uint32_t nextFree;
+		bool isFree;
+	};
+
+	uint32_t newBlock();
+	void releaseBlock(uint32_t block);
+	void insertFree(uint32_t block);
+	void removeFree(uint32_t block);
+	uint32_t findFree(uint32_t size) const;
+
+	std::vector<Block> blocks;
+	std::vector<uint32_t> unusedBlocks;
+	uint32_t firstLevelMap;
+	uint32_t secondLevelMaps[firstLevelCount];
+	uint32_t heads[firstLevelCount][secondLevelCount];
+	uint32_t total;
+	uint32_t freeTotal;
+};
+
+// Handle to a sub-allocation; 0 means none.
+struct BufferRange {
+	uint32_t value;
+
+	bool isNull() const {
+		return value == 0;
+	}
+};
+
+// Where a sub-allocation currently lives.
+struct BufferSlice {
+	unsigned int buffer;
+	size_t offset;
+	size_t size;
+};
+
+struct BufferAllocatorStats {
+	size_t committedBytes;
+	size_t usedBytes;
+	size_t freeBytes;
+	size_t largestFreeBlock;
+	// 1 - largest free block / free bytes: 0 when free space is one block.
+	float fragmentation;
+	int pages;
+	int allocations;
+	size_t bytesMovedLastDefragment;
+};
+
+// Carves vertex, index and uniform data out of a few large buffers with a
+// TlsfAllocator per buffer. Buffers are immutable storage where
+// GL_ARB_buffer_storage exists and are never resized; a new one is added
+// when the existing ones are full. Writes go through glBufferSubData, which
+// the driver orders against earlier draws, so freed ranges can be reused at
+// once.
+//
+// defragment() evacuates the emptiest buffer into the others with
+// glCopyBufferSubData and releases it once empty, so committed memory
+// follows what is in use. Moved ranges change buffer and offset; callers
+// re-resolve slices when layoutVersion() changes, and should only call it
+// between frames.
+class BufferAllocator {
+public:
+	BufferAllocator(size_t pageSize);
+	~BufferAllocator();
+
+	BufferAllocator(const BufferAllocator&) = delete;
+	BufferAllocator& operator=(const BufferAllocator&) = delete;
+
+	// data may be NULL. alignment 0 means the uniform buffer offset alignment;
+	// other alignments need not be powers of two.
+	BufferRange allocate(size_t size, size_t alignment, const void* data);
+	void free(BufferRange range);
+
+	void upload(BufferRange range, size_t offset, size_t size, const void* data);
+
+	// buffer is 0 for stale handles.
+	BufferSlice slice(BufferRange range) const;
+
+	unsigned int layoutVersion() const;
+
+	// Moves at most maxBytes of data out of the emptiest buffer.
+	void defragment(size_t maxBytes);
+
+	BufferAllocatorStats stats() const;
+
+private:
+	struct Page {
+		unsigned int buffer;
+		TlsfAllocator allocator;
+		int allocations;
+	};
+
+	struct Entry {
+		int page;
+		uint32_t block;
+		size_t offset;
+		size_t size;
+		size_t alignment;
+		uint32_t generation;
+	};
+
+	bool allocateIn(int page, size_t size, size_t alignment, uint32_t& block, size_t& offset);
+	int addPage(size_t size);
+	int findEntry(BufferRange range) const;
+
+	size_t pageSize;
+	size_t uniformAlignment;
+	unsigned int version;
+	size_t bytesMoved;
+	std::vector<Page> pages;
+	std::vector<Entry> entries;
+	std::vector<uint32_t> freeEntries;
+};
+
+// Streams mesh-like vertex, index and uniform ranges in and out over frames,
+// once through a BufferAllocator with per-frame defragmentation and once
+// with a buffer object per range, and prints CPU time, buffer object count,
+// committed memory and fragmentation. Needs a current context. Returns 0 on
+// success.
+int runBufferAllocatorBenchmark(int frames);
+
+#endif // !CUSTOM_BUFFERALLOCATOR_H
@@ -0,0 +1,602 @@
+#include "clustered.hpp"
+#include "glprogram.hpp"
+#include "gputimer.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define CLUSTERED_USE_SSE
+#endif
+
+static_assert(sizeof(ClusterLight) == 48, "ClusterLight must match three RGBA32F texels and the std430 Light struct");
+
+struct ClusterFrame {
+	Mat4 viewProjection;
+	Mat4 view;
+	int grid[4];
+	float depth[4];
+};
+
+static const char* binComputeShaderSource = "#version 430 core\n"
+	"layout (local_size_x = 64) in;\n"
+	"struct Light { vec4 positionRadius; vec4 color; vec4 directionCone; };\n"
+	"layout (std430, binding = 0) readonly buffer Lights { Light lights[]; };\n"
+	"layout (std430, binding = 1) readonly buffer Bounds { vec4 bounds[]; };\n"
+	"layout (std430, binding = 2) writeonly buffer Grid { uvec2 grid[]; };\n"
+	"layout (std430, binding = 3) writeonly buffer Indices { uint indices[]; };\n"
+	"layout (std430, binding = 4) buffer Counter { uint indexCount; };\n"
+	"uniform mat4 view;\n"
+	"uniform uint lightCount;\n"
+	"uniform uint indexCapacity;\n"
+	"shared uint localCount;\n"
+	"shared uint localLights[256];\n"
+	"shared uint firstIndex;\n"
+	"shared uint storedCount;\n"
+	"void main() {\n"
+	"uint cluster = gl_WorkGroupID.x;\n"
+	"if (gl_LocalInvocationIndex == 0u) localCount = 0u;\n"
+	"barrier();\n"
+	"vec3 boundsMin = bounds[cluster * 2u].xyz;\n"
+	"vec3 boundsMax = bounds[cluster * 2u + 1u].xyz;\n"
+	"for (uint i = gl_LocalInvocationIndex; i < lightCount; i += 64u) {\n"
+	"vec4 sphere = lights[i].positionRadius;\n"
+	"vec3 center = (view * vec4(sphere.xyz, 1.0)).xyz;\n"
+	"vec3 d = max(max(boundsMin - center, center - boundsMax), 0.0);\n"
+	"if (dot(d, d) <= sphere.w * sphere.w) {\n"
+	"uint slot = atomicAdd(localCount, 1u);\n"
+	"if (slot < 256u) localLights[slot] = i;\n"
+	"}\n"
+	"}\n"
+	"barrier();\n"
+	"if (gl_LocalInvocationIndex == 0u) {\n"
+	"uint count = min(localCount, 256u);\n"
+	"firstIndex = atomicAdd(indexCount, count);\n"
+	"storedCount = firstIndex >= indexCapacity ? 0u : min(count, indexCapacity - firstIndex);\n"
+	"grid[cluster] = uvec2(firstIndex, storedCount);\n"
+	"}\n"
+	"barrier();\n"
+	"for (uint i = gl_LocalInvocationIndex; i < storedCount; i += 64u) {\n"
+	"indices[firstIndex + i] = localLights[i];\n"
+	"}\n"
+	"}\0";
+
+static const char* clusteredVertexShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec3 aPos;\n"
+	"layout (location = 1) in vec3 aNormal;\n"
+	"layout (location = 2) in vec3 aOffset;\n"
+	"layout (location = 3) in vec3 aColor;\n"
+	"layout (std140) uniform ClusterFrame {\n"
+	"mat4 viewProjection;\n"
+	"mat4 view;\n"
+	"ivec4 clusterGrid;\n"
+	"vec4 clusterDepth;\n"
+	"};\n"
+	"out vec3 worldPosition;\n"
+	"out vec3 worldNormal;\n"
+	"out vec3 baseColor;\n"
+	"out float viewDepth;\n"
+	"void main() {\n"
+	"worldPosition = aPos + aOffset;\n"
+	"worldNormal = aNormal;\n"
+	"baseColor = aColor;\n"
+	"viewDepth = -(view * vec4(worldPosition, 1.0)).z;\n"
+	"gl_Position = viewProjection * vec4(worldPosition, 1.0);\n"
+	"}\0";
+
+static const char* clusteredFragmentShaderSource = "#version 330 core\n"
+	"layout (std140) uniform ClusterFrame {\n"
+	"mat4 viewProjection;\n"
+	"mat4 view;\n"
+	"ivec4 clusterGrid;\n"
+	"vec4 clusterDepth;\n"
+	"};\n"
+	"uniform samplerBuffer clusterLights;\n"
+	"uniform usamplerBuffer clusterRanges;\n"
+	"uniform usamplerBuffer clusterIndices;\n"
+	"in vec3 worldPosition;\n"
+	"in vec3 worldNormal;\n"
+	"in vec3 baseColor;\n"
+	"in float viewDepth;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"ivec2 tile = min(ivec2(gl_FragCoord.xy) / clusterGrid.w, clusterGrid.xy - 1);\n"
+	"int slice = clamp(int(log(viewDepth) * clusterDepth.x + clusterDepth.y), 0, clusterGrid.z - 1);\n"
+	"uvec2 range = texelFetch(clusterRanges, (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x).xy;\n"
+	"vec3 normal = normalize(worldNormal);\n"
+	"vec3 result = baseColor * 0.03 + baseColor * 0.02;\n"
+	"for (uint i = 0u; i < range.y; i++) {\n"
+	"int light = int(texelFetch(clusterIndices, int(range.x + i)).r) * 3;\n"
+	"vec4 sphere = texelFetch(clusterLights, light);\n"
+	"vec4 color = texelFetch(clusterLights, light + 1);\n"
+	"vec4 cone = texelFetch(clusterLights, light + 2);\n"
+	"vec3 toLight = sphere.xyz - worldPosition;\n"
+	"float distance = length(toLight);\n"
+	"if (distance >= sphere.w) continue;\n"
+	"vec3 direction = toLight / distance;\n"
+	"float falloff = 1.0 - distance / sphere.w;\n"
+	"falloff *= falloff;\n"
+	"if (cone.w > -1.0) falloff *= smoothstep(cone.w, color.w, dot(-direction, cone.xyz));\n"
+	"result += baseColor * color.rgb * max(dot(normal, direction), 0.0) * falloff;\n"
+	"}\n"
+	"FragColor = vec4(result, 1.0);\n"
+	"}\0";
+
+LightClusterer::LightClusterer(bool allowGpuBinning)
+	: gpuBinning(false), gridX(0), gridY(0), paddedTiles(0), scale(0.0f), bias(0.0f), indexCount(0), indexCapacity(0),
+	boundsBuffer(0), counterBuffer(0), binProgram(0) {
+	if (allowGpuBinning && GLEW_VERSION_4_3) {
+		binProgram = createComputeProgram(binComputeShaderSource);
+		gpuBinning = binProgram != 0;
+	}
+
+	static const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+
+	glGenBuffers(3, buffers);
+	glGenTextures(3, textures);
+
+	for (int i = 0; i < 3; i++) {
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+
+	if (gpuBinning) {
+		glGenBuffers(1, &boundsBuffer);
+		glGenBuffers(1, &counterBuffer);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+	}
+}
+
+LightClusterer::~LightClusterer() {
+	glDeleteTextures(3, textures);
+	glDeleteBuffers(3, buffers);
+	glDeleteBuffers(1, &boundsBuffer);
+	glDeleteBuffers(1, &counterBuffer);
+	glDeleteProgram(binProgram);
+}
+
+bool LightClusterer::isGpuBinning() const {
+	return gpuBinning;
+}
+
+void LightClusterer::resize(int width, int height, const Mat4& projection, float nearPlane, float farPlane) {
+	gridX = (width + tileSize - 1) / tileSize;
+	gridY = (height + tileSize - 1) / tileSize;
+	paddedTiles = (gridX * gridY + 3) & ~3;
+	scale = depthSlices / std::log(farPlane / nearPlane);
+	bias = -std::log(nearPlane) * scale;
+
+	size_t total = (size_t)paddedTiles * depthSlices;
+
+	// Padding entries are empty boxes no sphere can touch.
+	boundsMinX.assign(total, 1e30f);
+	boundsMinY.assign(total, 1e30f);
+	boundsMinZ.assign(total, 1e30f);
+	boundsMaxX.assign(total, -1e30f);
+	boundsMaxY.assign(total, -1e30f);
+	boundsMaxZ.assign(total, -1e30f);
+
+	std::vector<float> gpuBounds((size_t)clusterCount() * 8);
+	float inverseX = 1.0f / projection.m[0];
+	float inverseY = 1.0f / projection.m[5];
+
+	for (int slice = 0; slice < depthSlices; slice++) {
+		float zNear = nearPlane * std::pow(farPlane / nearPlane, (float)slice / depthSlices);
+		float zFar = nearPlane * std::pow(farPlane / nearPlane, (float)(slice + 1) / depthSlices);
+
+		for (int y = 0; y < gridY; y++) {
+			for (int x = 0; x < gridX; x++) {
+				float x0 = (-1.0f + 2.0f * x * tileSize / width) * inverseX;
+				float x1 = std::min(-1.0f + 2.0f * (x + 1) * tileSize / width, 1.0f) * inverseX;
+				float y0 = (-1.0f + 2.0f * y * tileSize / height) * inverseY;
+				float y1 = std::min(-1.0f + 2.0f * (y + 1) * tileSize / height, 1.0f) * inverseY;
+
+				// The tile's view-space extent grows linearly with depth, so the box spans both slice planes.
+				size_t i = (size_t)slice * paddedTiles + y * gridX + x;
+				boundsMinX[i] = std::min(std::min(x0 * zNear, x0 * zFar), std::min(x1 * zNear, x1 * zFar));
+				boundsMaxX[i] = std::max(std::max(x0 * zNear, x0 * zFar), std::max(x1 * zNear, x1 * zFar));
+				boundsMinY[i] = std::min(std::min(y0 * zNear, y0 * zFar), std::min(y1 * zNear, y1 * zFar));
+				boundsMaxY[i] = std::max(std::max(y0 * zNear, y0 * zFar), std::max(y1 * zNear, y1 * zFar));
+				boundsMinZ[i] = -zFar;
+				boundsMaxZ[i] = -zNear;
+
+				float* bounds = &gpuBounds[((size_t)(slice * gridY + y) * gridX + x) * 8];
+				bounds[0] = boundsMinX[i];
+				bounds[1] = boundsMinY[i];
+				bounds[2] = boundsMinZ[i];
+				bounds[3] = 0.0f;
+				bounds[4] = boundsMaxX[i];
+				bounds[5] = boundsMaxY[i];
+				bounds[6] = boundsMaxZ[i];
+				bounds[7] = 0.0f;
+			}
+		}
+	}
+
+	grid.assign((size_t)clusterCount() * 2, 0);
+
+	if (gpuBinning) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, gpuBounds.size() * sizeof(float), gpuBounds.data(), GL_STATIC_DRAW);
+
+		// The GPU cannot grow its index list, so it gets a fixed budget of 32 lights per cluster on average.
+		indexCapacity = (size_t)clusterCount() * 32;
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, grid.size() * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[2]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, indexCapacity * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+	}
+}
+
+void LightClusterer::uploadLights(const std::vector<ClusterLight>& lights) {
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[0]);
+	glBufferData(GL_TEXTURE_BUFFER, std::max(lights.size(), (size_t)1) * sizeof(ClusterLight), NULL, GL_STREAM_DRAW);
+
+	if (!lights.empty()) {
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, lights.size() * sizeof(ClusterLight), lights.data());
+	}
+}
+
+void LightClusterer::bin(const Mat4& view, const std::vector<ClusterLight>& lights) {
+	uploadLights(lights);
+
+	if (gpuBinning) {
+		binOnGpu(view, lights);
+	}
+	else {
+		binOnCpu(view, lights);
+	}
+}
+
+void LightClusterer::binOnCpu(const Mat4& view, const std::vector<ClusterLight>& lights) {
+	int tilesPerSlice = gridX * gridY;
+	pairs.clear();
+
+	for (size_t light = 0; light < lights.size(); light++) {
+		const Vec4& sphere = lights[light].positionRadius;
+		Vec4 center = transform(view, vec4(sphere.x, sphere.y, sphere.z, 1.0f));
+		float nearest = -center.z - sphere.w;
+		float farthest = -center.z + sphere.w;
+
+		if (farthest <= 0.0f) {
+			continue;
+		}
+
+		int firstSlice = nearest <= 0.0f ? 0 : (int)std::floor(std::log(nearest) * scale + bias);
+		int lastSlice = (int)std::floor(std::log(farthest) * scale + bias);
+
+		if (lastSlice < 0 || firstSlice >= depthSlices) {
+			continue;
+		}
+
+		firstSlice = std::max(firstSlice, 0);
+		lastSlice = std::min(lastSlice, depthSlices - 1);
+		float radiusSquared = sphere.w * sphere.w;
+
+#ifdef CLUSTERED_USE_SSE
+		__m128 cx = _mm_set1_ps(center.x);
+		__m128 cy = _mm_set1_ps(center.y);
+		__m128 cz = _mm_set1_ps(center.z);
+		__m128 r2 = _mm_set1_ps(radiusSquared);
+		__m128 zero = _mm_setzero_ps();
+#endif
+
+		for (int slice = firstSlice; slice <= lastSlice; slice++) {
+			size_t base = (size_t)slice * paddedTiles;
+
+			for (int tile = 0; tile < paddedTiles; tile += 4) {
+				size_t i = base + tile;
+				int mask = 0;
+
+#ifdef CLUSTERED_USE_SSE
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boundsMinX[i]), cx), _mm_sub_ps(cx, _mm_loadu_ps(&boundsMaxX[i]))), zero);
+				__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boundsMinY[i]), cy), _mm_sub_ps(cy, _mm_loadu_ps(&boundsMaxY[i]))), zero);
+				__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boundsMinZ[i]), cz), _mm_sub_ps(cz, _mm_loadu_ps(&boundsMaxZ[i]))), zero);
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				mask = _mm_movemask_ps(_mm_cmple_ps(distance, r2));
+#else
+				for (int k = 0; k < 4; k++) {
+					float dx = std::max(std::max(boundsMinX[i + k] - center.x, center.x - boundsMaxX[i + k]), 0.0f);
+					float dy = std::max(std::max(boundsMinY[i + k] - center.y, center.y - boundsMaxY[i + k]), 0.0f);
+					float dz = std::max(std::max(boundsMinZ[i + k] - center.z, center.z - boundsMaxZ[i + k]), 0.0f);
+
+					if (dx * dx + dy * dy + dz * dz <= radiusSquared) {
+						mask |= 1 << k;
+					}
+				}
+#endif
+
+				for (int k = 0; mask != 0; k++, mask >>= 1) {
+					if (mask & 1) {
+						pairs.push_back((unsigned int)(slice * tilesPerSlice + tile + k));
+						pairs.push_back((unsigned int)light);
+					}
+				}
+			}
+		}
+	}
+
+	// Counting sort of the (cluster, light) pairs into one compact index list.
+	std::fill(grid.begin(), grid.end(), 0);
+
+	for (size_t p = 0; p < pairs.size(); p += 2) {
+		grid[pairs[p] * 2 + 1]++;
+	}
+
+	unsigned int offset = 0;
+
+	for (size_t c = 0; c < grid.size(); c += 2) {
+		grid[c] = offset;
+		offset += grid[c + 1];
+		grid[c + 1] = 0;
+	}
+
+	indexCount = pairs.size() / 2;
+	indices.resize(std::max(indexCount, (size_t)1));
+
+	for (size_t p = 0; p < pairs.size(); p += 2) {
+		unsigned int* range = &grid[pairs[p] * 2];
+		indices[range[0] + range[1]++] = pairs[p + 1];
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[1]);
+	glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(unsigned int), grid.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[2]);
+	glBufferData(GL_TEXTURE_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STREAM_DRAW);
+}
+
+void LightClusterer::binOnGpu(const Mat4& view, const std::vector<ClusterLight>& lights) {
+	indexCount = 0;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+	glUseProgram(binProgram);
+	glUniformMatrix4fv(glGetUniformLocation(binProgram, "view"), 1, GL_FALSE, view.m);
+	glUniform1ui(glGetUniformLocation(binProgram, "lightCount"), (unsigned int)lights.size());
+	glUniform1ui(glGetUniformLocation(binProgram, "indexCapacity"), (unsigned int)indexCapacity);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, boundsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buffers[1]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, buffers[2]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, counterBuffer);
+
+	glDispatchCompute(clusterCount(), 1, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void LightClusterer::bindTextures(unsigned int firstUnit) const {
+	for (unsigned int i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+}
+
+int LightClusterer::tilesX() const {
+	return gridX;
+}
+
+int LightClusterer::tilesY() const {
+	return gridY;
+}
+
+int LightClusterer::clusterCount() const {
+	return gridX * gridY * depthSlices;
+}
+
+float LightClusterer::depthScale() const {
+	return scale;
+}
+
+float LightClusterer::depthBias() const {
+	return bias;
+}
+
+size_t LightClusterer::lastIndexCount() const {
+	return indexCount;
+}
+
+ClusteredRenderer::ClusteredRenderer(bool allowGpuBinning) : lightClusterer(allowGpuBinning), program(0) {
+	program = createProgram(clusteredVertexShaderSource, clusteredFragmentShaderSource);
+
+	if (program == 0) {
+		return;
+	}
+
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "ClusterFrame"), frameBinding);
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "clusterLights"), 0);
+	glUniform1i(glGetUniformLocation(program, "clusterRanges"), 1);
+	glUniform1i(glGetUniformLocation(program, "clusterIndices"), 2);
+}
+
+ClusteredRenderer::~ClusteredRenderer() {
+	glDeleteProgram(program);
+}
+
+bool ClusteredRenderer::isValid() const {
+	return program != 0;
+}
+
+LightClusterer& ClusteredRenderer::clusterer() {
+	return lightClusterer;
+}
+
+void ClusteredRenderer::resize(int width, int height, const Mat4& projection, float nearPlane, float farPlane) {
+	lightClusterer.resize(width, height, projection, nearPlane, farPlane);
+}
+
+void ClusteredRenderer::setFrame(UniformRing& ring, const Mat4& view, const Mat4& projection, const std::vector<ClusterLight>& lights) {
+	lightClusterer.bin(view, lights);
+
+	ClusterFrame frame;
+	frame.viewProjection = multiply(projection, view);
+	frame.view = view;
+	frame.grid[0] = lightClusterer.tilesX();
+	frame.grid[1] = lightClusterer.tilesY();
+	frame.grid[2] = LightClusterer::depthSlices;
+	frame.grid[3] = LightClusterer::tileSize;
+	frame.depth[0] = lightClusterer.depthScale();
+	frame.depth[1] = lightClusterer.depthBias();
+	frame.depth[2] = frame.depth[3] = 0.0f;
+
+	UniformAllocation allocation = ring.push(frame);
+
+	if (allocation.data == NULL) {
+		return;
+	}
+
+	ring.flush();
+	ring.bind(frameBinding, allocation);
+}
+
+void ClusteredRenderer::addPass(RenderGraph& graph, RenderGraph::Resource output, const std::function<void()>& drawGeometry) {
+	const RenderTextureDesc& target = graph.desc(output);
+	RenderTextureDesc depthDesc = { target.width, target.height, GL_DEPTH24_STENCIL8 };
+
+	graph.addPass("clustered",
+		[&](RenderGraph::Builder& builder) {
+			RenderGraph::Resource depth = builder.create("clustered.depth", depthDesc);
+
+			builder.write(output, LoadOp::Clear);
+			builder.write(depth, LoadOp::Clear);
+			builder.setClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+		},
+		[this, drawGeometry](const RenderGraph&) {
+			lightClusterer.bindTextures(0);
+
+			glEnable(GL_DEPTH_TEST);
+			glDepthMask(GL_TRUE);
+			glUseProgram(program);
+			drawGeometry();
+			glDisable(GL_DEPTH_TEST);
+		});
+}
+
+std::vector<ClusterLight> toClusterLights(const std::vector<PointLight>& points, float intensity) {
+	std::vector<ClusterLight> lights(points.size());
+
+	for (size_t i = 0; i < points.size(); i++) {
+		lights[i].positionRadius = points[i].positionRadius;
+		lights[i].color = vec4(points[i].color.x * intensity, points[i].color.y * intensity, points[i].color.z * intensity, -1.0f);
+		lights[i].directionCone = vec4(0.0f, -1.0f, 0.0f, -1.0f);
+	}
+
+	return lights;
+}
+
+static std::vector<ClusterLight> makeBenchLights(const BenchScene& scene, int count) {
+	std::vector<ClusterLight> lights = toClusterLights(scene.makeLights(count, 4.0f), 1.0f);
+
+	// Every third light is a downward spot light with a longer reach.
+	for (size_t i = 0; i < lights.size(); i++) {
+		if (i % 3 == 2) {
+			lights[i].positionRadius.w *= 2.0f;
+			lights[i].color.w = 0.9f;
+			lights[i].directionCone.w = 0.75f;
+		}
+	}
+
+	return lights;
+}
+
+int runClusteredBenchmark(int width, int height, int lightCount, int frames) {
+	BenchScene scene(64, 2.0f);
+	std::vector<ClusterLight> lights = makeBenchLights(scene, lightCount);
+	float aspect = (float)width / height;
+	Mat4 view = scene.cameraView();
+	Mat4 projection = scene.cameraProjection(aspect);
+	UniformRing ring(4096, 3);
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	std::function<void()> drawScene = [&scene]() { scene.draw(); };
+	const int warmupFrames = 10;
+	int result = 0;
+
+	std::cout << "CLUSTERED BENCHMARK " << width << "x" << height << ", " << lights.size() << " lights, "
+		<< scene.instanceCount() << " cubes, " << frames << " frames" << std::endl;
+
+	for (int gpu = 0; gpu < 2; gpu++) {
+		ClusteredRenderer renderer(gpu != 0);
+
+		if (!renderer.isValid()) {
+			result = -1;
+			break;
+		}
+
+		if (gpu != 0 && !renderer.clusterer().isGpuBinning()) {
+			std::cout << "gpu binning: unavailable" << std::endl;
+			break;
+		}
+
+		renderer.resize(width, height, projection, scene.nearPlane(), scene.farPlane());
+
+		RenderGraph graph;
+		renderer.addPass(graph, graph.importTexture("output", outputTexture, outputDesc), drawScene);
+
+		if (!graph.compile()) {
+			result = -1;
+			break;
+		}
+
+		GpuTimer timer(4);
+		double binningMilliseconds = 0.0;
+		size_t indexTotal = 0;
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				timer.wait();
+				timer.resetAverage();
+				binningMilliseconds = 0.0;
+				indexTotal = 0;
+			}
+
+			ring.beginFrame();
+			timer.begin();
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			renderer.setFrame(ring, view, projection, lights);
+			binningMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			indexTotal += renderer.clusterer().lastIndexCount();
+
+			graph.execute();
+
+			timer.end();
+			ring.endFrame();
+			timer.poll();
+		}
+
+		timer.wait();
+
+		std::cout << (gpu != 0 ? "gpu binning: " : "cpu binning: ") << binningMilliseconds / frames << " ms CPU, "
+			<< timer.averageMilliseconds() << " ms GPU, " << renderer.clusterer().clusterCount() << " clusters";
+
+		if (gpu == 0) {
+			std::cout << ", " << (double)indexTotal / frames / renderer.clusterer().clusterCount() << " lights per cluster";
+		}
+
+		std::cout << std::endl;
+	}
+
+	glDeleteTextures(1, &outputTexture);
+
+	return result;
+}
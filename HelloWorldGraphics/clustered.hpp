@@ -0,0 +1,134 @@
+#ifndef CUSTOM_CLUSTERED_H
+#define CUSTOM_CLUSTERED_H
+
+#include "benchscene.hpp"
+#include "rendergraph.hpp"
+#include "uniformring.hpp"
+#include "vecmath.hpp"
+#include <functional>
+#include <vector>
+
+struct ClusterLight {
+	// xyz world position, w radius of influence.
+	Vec4 positionRadius;
+	// rgb color, w cosine of the inner cone angle for spot lights.
+	Vec4 color;
+	// xyz spot direction, w cosine of the outer cone angle; -1 for point lights.
+	Vec4 directionCone;
+};
+
+// Point lights with their color scaled by intensity.
+std::vector<ClusterLight> toClusterLights(const std::vector<PointLight>& points, float intensity);
+
+// Splits the view frustum into screen tiles times exponential depth slices
+// and builds a light index list per cluster. Binning runs on the CPU with
+// SSE sphere/AABB tests, or in a compute shader when GL 4.3 is available.
+// Shaders read the result through three buffer textures:
+//   lights   RGBA32F, three texels per ClusterLight
+//   grid     RG32UI, (first index, light count) per cluster
+//   indices  R32UI, light indices
+// Cluster (x, y, slice) is stored at (slice * tilesY + y) * tilesX + x, with
+// y counted from the bottom like gl_FragCoord. Spot lights are binned by
+// their bounding sphere.
+class LightClusterer {
+public:
+	static const int tileSize = 64;
+	static const int depthSlices = 24;
+	// Upper bound of lights per cluster on the GPU path, limited by shared memory.
+	static const int maxGpuLightsPerCluster = 256;
+
+	LightClusterer(bool allowGpuBinning);
+	~LightClusterer();
+
+	LightClusterer(const LightClusterer&) = delete;
+	LightClusterer& operator=(const LightClusterer&) = delete;
+
+	bool isGpuBinning() const;
+
+	// Rebuilds the cluster bounds. projection must be a symmetric perspective.
+	void resize(int width, int height, const Mat4& projection, float nearPlane, float farPlane);
+
+	void bin(const Mat4& view, const std::vector<ClusterLight>& lights);
+
+	// Binds lights, grid and indices to texture units firstUnit .. firstUnit + 2.
+	void bindTextures(unsigned int firstUnit) const;
+
+	int tilesX() const;
+	int tilesY() const;
+	int clusterCount() const;
+
+	// slice = floor(log(viewDepth) * depthScale() + depthBias())
+	float depthScale() const;
+	float depthBias() const;
+
+	// Index list length of the last CPU binning; 0 on the GPU path, which never reads back.
+	size_t lastIndexCount() const;
+
+private:
+	void binOnCpu(const Mat4& view, const std::vector<ClusterLight>& lights);
+	void binOnGpu(const Mat4& view, const std::vector<ClusterLight>& lights);
+	void uploadLights(const std::vector<ClusterLight>& lights);
+
+	bool gpuBinning;
+	int gridX;
+	int gridY;
+	// Tiles of one slice rounded up to a multiple of four for the SSE loop.
+	int paddedTiles;
+	float scale;
+	float bias;
+	size_t indexCount;
+	size_t indexCapacity;
+
+	// Cluster bounds in view space, SoA per slice with paddedTiles entries each.
+	std::vector<float> boundsMinX;
+	std::vector<float> boundsMinY;
+	std::vector<float> boundsMinZ;
+	std::vector<float> boundsMaxX;
+	std::vector<float> boundsMaxY;
+	std::vector<float> boundsMaxZ;
+
+	std::vector<unsigned int> pairs;
+	std::vector<unsigned int> grid;
+	std::vector<unsigned int> indices;
+
+	unsigned int buffers[3];
+	unsigned int textures[3];
+	unsigned int boundsBuffer;
+	unsigned int counterBuffer;
+	unsigned int binProgram;
+};
+
+// Forward renderer shading each fragment with the lights of its cluster.
+// Geometry must use the attribute layout of BenchScene.
+class ClusteredRenderer {
+public:
+	static const unsigned int frameBinding = 0;
+
+	ClusteredRenderer(bool allowGpuBinning);
+	~ClusteredRenderer();
+
+	ClusteredRenderer(const ClusteredRenderer&) = delete;
+	ClusteredRenderer& operator=(const ClusteredRenderer&) = delete;
+
+	bool isValid() const;
+	LightClusterer& clusterer();
+
+	void resize(int width, int height, const Mat4& projection, float nearPlane, float farPlane);
+
+	// Bins lights and writes this frame's camera into ring.
+	void setFrame(UniformRing& ring, const Mat4& view, const Mat4& projection, const std::vector<ClusterLight>& lights);
+
+	void addPass(RenderGraph& graph, RenderGraph::Resource output, const std::function<void()>& drawGeometry);
+
+private:
+	LightClusterer lightClusterer;
+	unsigned int program;
+};
+
+// Shades BenchScene with lightCount lights, a third of them spot lights,
+// binning on the CPU and, where supported, on the GPU. Prints binning and
+// GPU frame times and the average cluster occupancy. Needs a current
+// context. Returns 0 on success.
+int runClusteredBenchmark(int width, int height, int lightCount, int frames);
+
+#endif // !CUSTOM_CLUSTERED_H
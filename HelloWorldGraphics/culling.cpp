@@ -0,0 +1,782 @@
+#include "culling.hpp"
+#include "occlusion.hpp"
+#include "glprogram.hpp"
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define CULLING_USE_SSE
+#endif
+
+static_assert(sizeof(CullInstance) == 32, "CullInstance must match the std430 Instance struct");
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsIndirectCommand must be tightly packed");
+
+static const char* cullComputeShaderSource = "#version 430 core\n"
+	"layout (local_size_x = 64) in;\n"
+	"struct Instance { vec4 sphere; uint indexCount; uint firstIndex; int baseVertex; uint padding; };\n"
+	"struct Command { uint count; uint instanceCount; uint firstIndex; int baseVertex; uint baseInstance; };\n"
+	"layout (std430, binding = 0) readonly buffer Instances { Instance instances[]; };\n"
+	"layout (std430, binding = 1) writeonly buffer Commands { Command commands[]; };\n"
+	"layout (std430, binding = 2) writeonly buffer VisibleIds { uint visibleIds[]; };\n"
+	"layout (std430, binding = 3) buffer Counter { uint drawCount; uint frustumCulled; uint occlusionCulled; };\n"
+	"uniform vec4 frustumPlanes[6];\n"
+	"uniform uint instanceTotal;\n"
+	"uniform int hiZEnabled;\n"
+	"uniform sampler2D hiZ;\n"
+	"uniform vec2 hiZSize;\n"
+	"uniform mat4 viewProjection;\n"
+	"bool occluded(vec4 sphere) {\n"
+	"if (hiZEnabled == 0) return false;\n"
+	"vec3 minNdc = vec3(1.0);\n"
+	"vec3 maxNdc = vec3(-1.0);\n"
+	"for (int i = 0; i < 8; i++) {\n"
+	"vec3 corner = sphere.xyz + sphere.w * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);\n"
+	"vec4 clip = viewProjection * vec4(corner, 1.0);\n"
+	"if (clip.w <= 0.0) return false;\n"
+	"vec3 ndc = clip.xyz / clip.w;\n"
+	"minNdc = min(minNdc, ndc);\n"
+	"maxNdc = max(maxNdc, ndc);\n"
+	"}\n"
+	"vec2 pixelMin = clamp(minNdc.xy * 0.5 + 0.5, 0.0, 1.0) * hiZSize;\n"
+	"vec2 pixelMax = clamp(maxNdc.xy * 0.5 + 0.5, 0.0, 1.0) * hiZSize;\n"
+	"vec2 extent = pixelMax - pixelMin;\n"
+	"int level = min(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), textureQueryLevels(hiZ) - 1);\n"
+	// Texel i of a level covers level 0 pixels [i << level, (i + 1) << level), the last one up to the edge,
+	// so the rectangle spans at most two texels per axis. Normalized coordinates would round odd sizes the wrong way.
+	"ivec2 lastTexel = textureSize(hiZ, level) - 1;\n"
+	"ivec2 texelMin = min(ivec2(pixelMin) >> level, lastTexel);\n"
+	"ivec2 texelMax = min(ivec2(pixelMax) >> level, lastTexel);\n"
+	"float farthest = max(max(texelFetch(hiZ, texelMin, level).r, texelFetch(hiZ, ivec2(texelMax.x, texelMin.y), level).r),\n"
+	"max(texelFetch(hiZ, ivec2(texelMin.x, texelMax.y), level).r, texelFetch(hiZ, texelMax, level).r));\n"
+	"return minNdc.z * 0.5 + 0.5 > farthest;\n"
+	"}\n"
+	"void main() {\n"
+	"uint i = gl_GlobalInvocationID.x;\n"
+	"if (i >= instanceTotal) return;\n"
+	"Instance instance = instances[i];\n"
+	"for (int p = 0; p < 6; p++) {\n"
+	"if (dot(frustumPlanes[p].xyz, instance.sphere.xyz) + frustumPlanes[p].w < -instance.sphere.w) {\n"
+	"atomicAdd(frustumCulled, 1u);\n"
+	"return;\n"
+	"}\n"
+	"}\n"
+	"if (occluded(instance.sphere)) {\n"
+	"atomicAdd(occlusionCulled, 1u);\n"
+	"return;\n"
+	"}\n"
+	"uint slot = atomicAdd(drawCount, 1u);\n"
+	"commands[slot] = Command(instance.indexCount, 1u, instance.firstIndex, instance.baseVertex, slot);\n"
+	"visibleIds[slot] = i;\n"
+	"}\0";
+
+static Vec4 normalizePlane(float a, float b, float c, float d) {
+	float len = std::sqrt(a * a + b * b + c * c);
+	return vec4(a / len, b / len, c / len, d / len);
+}
+
+Frustum extractFrustum(const Mat4& viewProjection) {
+	const float* m = viewProjection.m;
+	Frustum frustum;
+
+	// Rows of the column-major matrix are m[i], m[4 + i], m[8 + i], m[12 + i].
+	frustum.planes[0] = normalizePlane(m[3] + m[0], m[7] + m[4], m[11] + m[8], m[15] + m[12]);
+	frustum.planes[1] = normalizePlane(m[3] - m[0], m[7] - m[4], m[11] - m[8], m[15] - m[12]);
+	frustum.planes[2] = normalizePlane(m[3] + m[1], m[7] + m[5], m[11] + m[9], m[15] + m[13]);
+	frustum.planes[3] = normalizePlane(m[3] - m[1], m[7] - m[5], m[11] - m[9], m[15] - m[13]);
+	frustum.planes[4] = normalizePlane(m[3] + m[2], m[7] + m[6], m[11] + m[10], m[15] + m[14]);
+	frustum.planes[5] = normalizePlane(m[3] - m[2], m[7] - m[6], m[11] - m[10], m[15] - m[14]);
+
+	return frustum;
+}
+
+bool sphereInFrustum(const Frustum& frustum, const BoundingSphere& sphere) {
+	for (int p = 0; p < 6; p++) {
+		const Vec4& plane = frustum.planes[p];
+
+		if (plane.x * sphere.center.x + plane.y * sphere.center.y + plane.z * sphere.center.z + plane.w < -sphere.radius) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void cullSpheres(const Frustum& frustum, const float* centerX, const float* centerY, const float* centerZ,
+	const float* radius, size_t count, std::vector<unsigned int>& visible) {
+	size_t i = 0;
+
+#ifdef CULLING_USE_SSE
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+
+	for (int p = 0; p < 6; p++) {
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+
+	__m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(centerX + i);
+		__m128 y = _mm_loadu_ps(centerY + i);
+		__m128 z = _mm_loadu_ps(centerZ + i);
+		__m128 r = _mm_loadu_ps(radius + i);
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, r), zero));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+
+		while (mask != 0) {
+			int lane = 0;
+
+			while ((mask & (1 << lane)) == 0) {
+				lane++;
+			}
+
+			visible.push_back((unsigned int)(i + lane));
+			mask &= mask - 1;
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		BoundingSphere sphere = { vec3(centerX[i], centerY[i], centerZ[i]), radius[i] };
+
+		if (sphereInFrustum(frustum, sphere)) {
+			visible.push_back((unsigned int)i);
+		}
+	}
+}
+
+InstanceCuller::InstanceCuller(bool allowCompute)
+	: gpuDriven(false), cullProgram(0), instanceBuffer(0), commandBuffer(0), visibleIdBuffer(0), counterBuffer(0),
+	statsBuffer(0), capacity(0), vao(0), instanceIdLocation(0), pyramidTexture(0), pyramidWidth(0), pyramidHeight(0),
+	occlusionBuffer(NULL), statsFence(NULL), lastStats() {
+	if (allowCompute && GLEW_VERSION_4_3) {
+		cullProgram = createComputeProgram(cullComputeShaderSource);
+		gpuDriven = cullProgram != 0;
+	}
+
+	glGenBuffers(1, &visibleIdBuffer);
+
+	if (gpuDriven) {
+		glGenBuffers(1, &instanceBuffer);
+		glGenBuffers(1, &commandBuffer);
+		glGenBuffers(1, &counterBuffer);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 3 * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+
+		glGenBuffers(1, &statsBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, statsBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, 3 * sizeof(unsigned int), NULL, GL_STREAM_READ);
+	}
+}
+
+InstanceCuller::~InstanceCuller() {
+	glDeleteBuffers(1, &visibleIdBuffer);
+	glDeleteBuffers(1, &instanceBuffer);
+	glDeleteBuffers(1, &commandBuffer);
+	glDeleteBuffers(1, &counterBuffer);
+	glDeleteBuffers(1, &statsBuffer);
+	glDeleteProgram(cullProgram);
+
+	if (statsFence != NULL) {
+		glDeleteSync((GLsync)statsFence);
+	}
+}
+
+bool InstanceCuller::isGpuDriven() const {
+	return gpuDriven;
+}
+
+void InstanceCuller::setInstances(const std::vector<CullInstance>& newInstances) {
+	instances = newInstances;
+
+	size_t count = instances.size();
+
+	centerX.resize(count);
+	centerY.resize(count);
+	centerZ.resize(count);
+	radius.resize(count);
+
+	for (size_t i = 0; i < count; i++) {
+		centerX[i] = instances[i].bounds.center.x;
+		centerY[i] = instances[i].bounds.center.y;
+		centerZ[i] = instances[i].bounds.center.z;
+		radius[i] = instances[i].bounds.radius;
+	}
+
+	visibleIds.reserve(count);
+	commands.reserve(count);
+
+	if (count > capacity) {
+		capacity = (unsigned int)count;
+
+		glBindBuffer(GL_ARRAY_BUFFER, visibleIdBuffer);
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+
+		if (gpuDriven) {
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+		}
+	}
+
+	if (gpuDriven) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(CullInstance), instances.data(), GL_STATIC_DRAW);
+	}
+}
+
+void InstanceCuller::attachInstanceIds(unsigned int targetVao, unsigned int location) {
+	vao = targetVao;
+	instanceIdLocation = location;
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, visibleIdBuffer);
+	glVertexAttribIPointer(location, 1, GL_UNSIGNED_INT, 0, (void*)0);
+	glVertexAttribDivisor(location, 1);
+	glEnableVertexAttribArray(location);
+}
+
+void InstanceCuller::setOcclusionPyramid(unsigned int texture, int width, int height) {
+	pyramidTexture = texture;
+	pyramidWidth = width;
+	pyramidHeight = height;
+}
+
+void InstanceCuller::setOcclusionBuffer(const SoftwareOcclusionBuffer* buffer) {
+	occlusionBuffer = buffer;
+}
+
+void InstanceCuller::cull(const Mat4& viewProjection) {
+	Frustum frustum = extractFrustum(viewProjection);
+
+	if (!gpuDriven) {
+		visibleIds.clear();
+		cullSpheres(frustum, centerX.data(), centerY.data(), centerZ.data(), radius.data(), instances.size(), visibleIds);
+
+		lastStats.tested = (unsigned int)instances.size();
+		lastStats.frustumCulled = lastStats.tested - (unsigned int)visibleIds.size();
+		lastStats.occlusionCulled = 0;
+
+		if (occlusionBuffer != NULL) {
+			size_t kept = 0;
+
+			for (size_t i = 0; i < visibleIds.size(); i++) {
+				if (occlusionBuffer->isVisible(instances[visibleIds[i]].bounds)) {
+					visibleIds[kept++] = visibleIds[i];
+				}
+			}
+
+			lastStats.occlusionCulled = (unsigned int)(visibleIds.size() - kept);
+			visibleIds.resize(kept);
+		}
+
+		lastStats.drawn = (unsigned int)visibleIds.size();
+		uploadCpuCommands();
+		return;
+	}
+
+	unsigned int instanceTotal = (unsigned int)instances.size();
+
+	if (instanceTotal == 0) {
+		return;
+	}
+
+	readGpuStats();
+
+	// Zeroed commands draw nothing, so slots past the compacted range are harmless.
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+	glUseProgram(cullProgram);
+	glUniform4fv(glGetUniformLocation(cullProgram, "frustumPlanes"), 6, &frustum.planes[0].x);
+	glUniform1ui(glGetUniformLocation(cullProgram, "instanceTotal"), instanceTotal);
+	glUniform1i(glGetUniformLocation(cullProgram, "hiZEnabled"), pyramidTexture != 0 ? 1 : 0);
+
+	if (pyramidTexture != 0) {
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+		glUniform1i(glGetUniformLocation(cullProgram, "hiZ"), 0);
+		glUniform2f(glGetUniformLocation(cullProgram, "hiZSize"), (float)pyramidWidth, (float)pyramidHeight);
+		glUniformMatrix4fv(glGetUniformLocation(cullProgram, "viewProjection"), 1, GL_FALSE, viewProjection.m);
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibleIdBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, counterBuffer);
+
+	glDispatchCompute((instanceTotal + 63) / 64, 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	// The counters are copied aside so later frames can keep overwriting them while the copy is in flight.
+	if (statsFence == NULL) {
+		glBindBuffer(GL_COPY_READ_BUFFER, counterBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, statsBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, 3 * sizeof(unsigned int));
+		statsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+void InstanceCuller::readGpuStats() {
+	if (statsFence == NULL) {
+		return;
+	}
+
+	GLenum status = glClientWaitSync((GLsync)statsFence, 0, 0);
+
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+		return;
+	}
+
+	unsigned int counters[3];
+
+	glBindBuffer(GL_COPY_READ_BUFFER, statsBuffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counters), counters);
+
+	lastStats.tested = counters[0] + counters[1] + counters[2];
+	lastStats.drawn = counters[0];
+	lastStats.frustumCulled = counters[1];
+	lastStats.occlusionCulled = counters[2];
+
+	glDeleteSync((GLsync)statsFence);
+	statsFence = NULL;
+}
+
+void InstanceCuller::uploadCpuCommands() {
+	commands.clear();
+
+	// Consecutive visible instances of the same mesh become one instanced draw.
+	for (size_t i = 0; i < visibleIds.size(); i++) {
+		const CullInstance& instance = instances[visibleIds[i]];
+
+		if (!commands.empty()) {
+			DrawElementsIndirectCommand& last = commands.back();
+
+			if (last.count == instance.indexCount && last.firstIndex == instance.firstIndex && last.baseVertex == instance.baseVertex) {
+				last.instanceCount++;
+				continue;
+			}
+		}
+
+		DrawElementsIndirectCommand command = { instance.indexCount, 1, instance.firstIndex, instance.baseVertex, (unsigned int)i };
+		commands.push_back(command);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, visibleIdBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, visibleIds.size() * sizeof(unsigned int), visibleIds.data());
+}
+
+void InstanceCuller::draw() {
+	if (vao == 0 || instances.empty()) {
+		return;
+	}
+
+	glBindVertexArray(vao);
+
+	if (gpuDriven) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+
+		if (GLEW_ARB_indirect_parameters) {
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, counterBuffer);
+			glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, 0, (GLsizei)instances.size(), 0);
+		}
+		else {
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, (GLsizei)instances.size(), 0);
+		}
+
+		return;
+	}
+
+	// GL 3.3 has no baseInstance, so the instance id attribute is re-pointed per draw instead.
+	glBindBuffer(GL_ARRAY_BUFFER, visibleIdBuffer);
+
+	for (size_t i = 0; i < commands.size(); i++) {
+		const DrawElementsIndirectCommand& command = commands[i];
+
+		glVertexAttribIPointer(instanceIdLocation, 1, GL_UNSIGNED_INT, 0, (void*)(command.baseInstance * sizeof(unsigned int)));
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+			(void*)(command.firstIndex * sizeof(unsigned int)), command.instanceCount, command.baseVertex);
+	}
+
+	glVertexAttribIPointer(instanceIdLocation, 1, GL_UNSIGNED_INT, 0, (void*)0);
+}
+
+const CullStats& InstanceCuller::stats() const {
+	return lastStats;
+}
+
+void InstanceCuller::readVisibleInstances(std::vector<unsigned int>& ids) const {
+	if (!gpuDriven) {
+		ids = visibleIds;
+		return;
+	}
+
+	unsigned int drawCount = 0;
+
+	if (!instances.empty()) {
+		glBindBuffer(GL_COPY_READ_BUFFER, counterBuffer);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(drawCount), &drawCount);
+	}
+
+	ids.resize(drawCount);
+
+	if (drawCount > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, visibleIdBuffer);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, drawCount * sizeof(unsigned int), ids.data());
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+static const char* cullBenchVertexShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec3 position;\n"
+	"layout (location = 1) in vec3 normal;\n"
+	"layout (location = 2) in uint instanceId;\n"
+	"uniform samplerBuffer instanceData;\n"
+	"uniform mat4 viewProjection;\n"
+	"out vec3 worldNormal;\n"
+	"out vec3 color;\n"
+	"void main() {\n"
+	"vec4 instance = texelFetch(instanceData, int(instanceId));\n"
+	"gl_Position = viewProjection * vec4(instance.xyz + position * instance.w, 1.0);\n"
+	"worldNormal = normal;\n"
+	"color = 0.55 + 0.45 * sin(float(instanceId) * vec3(0.37, 0.71, 1.13));\n"
+	"}\0";
+
+static const char* cullBenchFragmentShaderSource = "#version 330 core\n"
+	"in vec3 worldNormal;\n"
+	"in vec3 color;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"float light = 0.3 + 0.7 * max(dot(normalize(worldNormal), normalize(vec3(0.4, 0.8, 0.3))), 0.0);\n"
+	"FragColor = vec4(color * light, 1.0);\n"
+	"}\0";
+
+// Appends a flat-shaded convex mesh of unit scale, position and normal per vertex.
+static void addBenchFace(std::vector<float>& vertices, std::vector<unsigned int>& indices, const Vec3* corners, int cornerCount) {
+	Vec3 normal = normalize(cross(sub(corners[1], corners[0]), sub(corners[2], corners[0])));
+	unsigned int base = (unsigned int)(vertices.size() / 6);
+
+	for (int i = 0; i < cornerCount; i++) {
+		float vertex[6] = { corners[i].x, corners[i].y, corners[i].z, normal.x, normal.y, normal.z };
+		vertices.insert(vertices.end(), vertex, vertex + 6);
+	}
+
+	for (int i = 2; i < cornerCount; i++) {
+		unsigned int triangle[3] = { base, base + i - 1, base + i };
+		indices.insert(indices.end(), triangle, triangle + 3);
+	}
+}
+
+// Two meshes sharing one vertex and index buffer: a cube of half size 0.4 and
+// an octahedron of radius 0.5, in that order.
+static void buildCullBenchMeshes(std::vector<float>& vertices, std::vector<unsigned int>& indices, unsigned int* firstIndex,
+	int* baseVertex, unsigned int* indexCount) {
+	for (int axis = 0; axis < 3; axis++) {
+		for (int side = -1; side <= 1; side += 2) {
+			int u = (axis + (side > 0 ? 1 : 2)) % 3;
+			int v = (axis + (side > 0 ? 2 : 1)) % 3;
+			Vec3 corners[4];
+
+			for (int corner = 0; corner < 4; corner++) {
+				float position[3];
+				position[axis] = 0.4f * side;
+				position[u] = (corner == 1 || corner == 2) ? 0.4f : -0.4f;
+				position[v] = corner >= 2 ? 0.4f : -0.4f;
+				corners[corner] = vec3(position[0], position[1], position[2]);
+			}
+
+			addBenchFace(vertices, indices, corners, 4);
+		}
+	}
+
+	firstIndex[0] = 0;
+	baseVertex[0] = 0;
+	indexCount[0] = (unsigned int)indices.size();
+	firstIndex[1] = (unsigned int)indices.size();
+	baseVertex[1] = (int)(vertices.size() / 6);
+
+	// Indices are relative to each mesh's base vertex.
+	std::vector<float> octahedron;
+	std::vector<unsigned int> octahedronIndices;
+
+	for (int octant = 0; octant < 8; octant++) {
+		float x = (octant & 1) ? 0.5f : -0.5f;
+		float y = (octant & 2) ? 0.5f : -0.5f;
+		float z = (octant & 4) ? 0.5f : -0.5f;
+		Vec3 corners[3] = { vec3(x, 0.0f, 0.0f), vec3(0.0f, y, 0.0f), vec3(0.0f, 0.0f, z) };
+
+		// Keeps every face wound counter-clockwise seen from outside.
+		if (x * y * z < 0.0f) {
+			std::swap(corners[1], corners[2]);
+		}
+
+		addBenchFace(octahedron, octahedronIndices, corners, 3);
+	}
+
+	vertices.insert(vertices.end(), octahedron.begin(), octahedron.end());
+	indices.insert(indices.end(), octahedronIndices.begin(), octahedronIndices.end());
+	indexCount[1] = (unsigned int)octahedronIndices.size();
+}
+
+// Compares a visible set with sphereInFrustum() on every instance. Spheres
+// within tolerance of a plane may go either way and are not counted.
+static unsigned int countCullMismatches(const Frustum& frustum, const std::vector<CullInstance>& instances,
+	const std::vector<unsigned int>& visible, float tolerance) {
+	std::vector<char> kept(instances.size(), 0);
+	unsigned int mismatches = 0;
+
+	for (size_t i = 0; i < visible.size(); i++) {
+		if (visible[i] >= instances.size() || kept[visible[i]]) {
+			mismatches++;
+			continue;
+		}
+
+		kept[visible[i]] = 1;
+	}
+
+	for (size_t i = 0; i < instances.size(); i++) {
+		const BoundingSphere& sphere = instances[i].bounds;
+		float margin = 1e30f;
+
+		for (int p = 0; p < 6; p++) {
+			const Vec4& plane = frustum.planes[p];
+			margin = std::min(margin, plane.x * sphere.center.x + plane.y * sphere.center.y + plane.z * sphere.center.z + plane.w + sphere.radius);
+		}
+
+		if (std::fabs(margin) > tolerance && (kept[i] != 0) != sphereInFrustum(frustum, sphere)) {
+			mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+int runCullingBenchmark(int width, int height, int instanceCount, int frames) {
+	static const float meshRadius[2] = { 0.4f * 1.7320508f, 0.5f };
+	const int warmupFrames = 10;
+	const int checkDirections = 8;
+
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	unsigned int firstIndex[2];
+	int baseVertex[2];
+	unsigned int indexCount[2];
+	buildCullBenchMeshes(vertices, indices, firstIndex, baseVertex, indexCount);
+
+	// Instances fill a cube around the origin, sorted by mesh so the CPU path can batch them.
+	float side = std::cbrt((float)instanceCount) * 2.5f;
+	std::vector<CullInstance> instances(instanceCount);
+	std::vector<Vec4> instanceData(instanceCount);
+	unsigned int seed = 2024;
+
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) / 16777216.0f;
+	};
+
+	for (int i = 0; i < instanceCount; i++) {
+		int mesh = i < instanceCount / 2 ? 0 : 1;
+		float scale = 0.5f + random();
+		Vec3 center = vec3((random() - 0.5f) * side, (random() - 0.5f) * side, (random() - 0.5f) * side);
+
+		instances[i].bounds.center = center;
+		instances[i].bounds.radius = meshRadius[mesh] * scale;
+		instances[i].indexCount = indexCount[mesh];
+		instances[i].firstIndex = firstIndex[mesh];
+		instances[i].baseVertex = baseVertex[mesh];
+		instances[i].padding = 0;
+		instanceData[i] = vec4(center.x, center.y, center.z, scale);
+	}
+
+	unsigned int program = createProgram(cullBenchVertexShaderSource, cullBenchFragmentShaderSource);
+	int result = program != 0 ? 0 : -1;
+
+	unsigned int buffers[3];
+	unsigned int instanceTexture;
+	glGenBuffers(3, buffers);
+	glGenTextures(1, &instanceTexture);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[2]);
+	glBufferData(GL_TEXTURE_BUFFER, instanceData.size() * sizeof(Vec4), instanceData.data(), GL_STATIC_DRAW);
+	glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffers[2]);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	// One vertex array per culler, since each attaches its own instance id buffer.
+	std::unique_ptr<InstanceCuller> cullers[2] = {
+		std::unique_ptr<InstanceCuller>(new InstanceCuller(false)),
+		std::unique_ptr<InstanceCuller>(new InstanceCuller(true))
+	};
+	unsigned int vaos[2];
+	glGenVertexArrays(2, vaos);
+
+	for (int c = 0; c < 2; c++) {
+		glBindVertexArray(vaos[c]);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+
+		if (c == 0) {
+			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+		}
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+
+		if (c == 0) {
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+		}
+
+		cullers[c]->setInstances(instances);
+		cullers[c]->attachInstanceIds(vaos[c], 2);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	int pathCount = cullers[1]->isGpuDriven() ? 2 : 1;
+	InstanceCuller* culler = cullers[0].get();
+	Mat4 projection = perspective(1.0f, (float)width / height, 0.1f, side);
+	Mat4 viewProjection = identity();
+
+	// Turns in place at the center, tilted so the view crosses the volume diagonally.
+	auto aimCamera = [&](float angle) {
+		Vec3 forward = vec3(std::cos(angle), 0.35f * std::sin(angle * 0.5f), std::sin(angle));
+		viewProjection = multiply(projection, lookAt(vec3(0.0f, 0.0f, 0.0f), forward, vec3(0.0f, 1.0f, 0.0f)));
+	};
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	RenderTextureDesc depthDesc = { width, height, GL_DEPTH_COMPONENT24 };
+	RenderGraph graph;
+	RenderGraph::Resource output = graph.importTexture("output", outputTexture, outputDesc);
+
+	graph.addPass("instances",
+		[&](RenderGraph::Builder& builder) {
+			RenderGraph::Resource depth = builder.create("instances.depth", depthDesc);
+
+			builder.write(output, LoadOp::Clear);
+			builder.write(depth, LoadOp::Clear);
+			builder.setClearColor(0.08f, 0.09f, 0.12f, 1.0f);
+		},
+		[&](const RenderGraph&) {
+			glEnable(GL_DEPTH_TEST);
+			glDepthMask(GL_TRUE);
+			glUseProgram(program);
+			glUniformMatrix4fv(glGetUniformLocation(program, "viewProjection"), 1, GL_FALSE, viewProjection.m);
+			glUniform1i(glGetUniformLocation(program, "instanceData"), 0);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+			culler->draw();
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+			glDisable(GL_DEPTH_TEST);
+		});
+
+	if (result == 0 && !graph.compile()) {
+		result = -1;
+	}
+
+	if (result == 0) {
+		std::cout << "CULLING BENCHMARK " << width << "x" << height << ", " << instanceCount << " instances in a " << side << " unit cube, "
+			<< (pathCount == 2 ? "CPU and compute" : "CPU only (no GL 4.3)") << ", " << frames << " frames" << std::endl;
+	}
+
+	for (int path = 0; path < pathCount && result == 0; path++) {
+		culler = cullers[path].get();
+
+		GpuTimer timer(4);
+		double cullMilliseconds = 0.0;
+		unsigned long long drawn = 0;
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				timer.wait();
+				timer.resetAverage();
+				cullMilliseconds = 0.0;
+				drawn = 0;
+			}
+
+			aimCamera(frame * 0.02f);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			timer.begin();
+			culler->cull(viewProjection);
+			cullMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			graph.execute();
+			timer.end();
+			timer.poll();
+
+			drawn += culler->stats().drawn;
+		}
+
+		timer.wait();
+
+		std::cout << (path == 0 ? "CPU culling: " : "compute culling: ") << cullMilliseconds / frames << " ms CPU in cull(), "
+			<< timer.averageMilliseconds() << " ms GPU for cull and draw, " << (double)drawn / frames << " of " << instanceCount
+			<< " instances drawn per frame" << (path == 1 ? " (counters lag a frame or two)" : "") << std::endl;
+	}
+
+	// Every path against the brute-force test, for directions all around.
+	std::vector<unsigned int> visible;
+
+	for (int path = 0; path < pathCount && result == 0; path++) {
+		unsigned int mismatches = 0;
+		size_t visibleTotal = 0;
+
+		for (int direction = 0; direction < checkDirections; direction++) {
+			aimCamera(direction * 6.2831853f / checkDirections);
+			cullers[path]->cull(viewProjection);
+			cullers[path]->readVisibleInstances(visible);
+
+			visibleTotal += visible.size();
+			mismatches += countCullMismatches(extractFrustum(viewProjection), instances, visible, 1e-4f * side);
+		}
+
+		std::cout << (path == 0 ? "CPU" : "compute") << " culling vs brute force: " << visibleTotal << " visible in " << checkDirections
+			<< " directions, " << mismatches << " mismatches" << std::endl;
+
+		if (mismatches != 0) {
+			std::cerr << "ERROR::CULLING::MISMATCH: " << (path == 0 ? "CPU" : "compute") << " path" << std::endl;
+			result = 1;
+		}
+	}
+
+	cullers[0].reset();
+	cullers[1].reset();
+
+	glDeleteVertexArrays(2, vaos);
+	glDeleteBuffers(3, buffers);
+	glDeleteTextures(1, &instanceTexture);
+	glDeleteTextures(1, &outputTexture);
+	glDeleteProgram(program);
+
+	return result;
+}
@@ -0,0 +1,140 @@
+#ifndef CUSTOM_CULLING_H
+#define CUSTOM_CULLING_H
+
+#include "vecmath.hpp"
+#include <vector>
+#include <cstddef>
+
+struct BoundingSphere {
+	Vec3 center;
+	float radius;
+};
+
+// Planes point inwards: a point p is inside when dot(xyz, p) + w >= 0.
+struct Frustum {
+	Vec4 planes[6];
+};
+
+// Same layout as the command read by glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand {
+	unsigned int count;
+	unsigned int instanceCount;
+	unsigned int firstIndex;
+	int baseVertex;
+	unsigned int baseInstance;
+};
+
+// One cullable object. Laid out to match the std430 struct in the cull shader.
+struct CullInstance {
+	BoundingSphere bounds;
+	unsigned int indexCount;
+	unsigned int firstIndex;
+	int baseVertex;
+	unsigned int padding;
+};
+
+struct CullStats {
+	unsigned int tested;
+	unsigned int frustumCulled;
+	unsigned int occlusionCulled;
+	unsigned int drawn;
+};
+
+class SoftwareOcclusionBuffer;
+
+Frustum extractFrustum(const Mat4& viewProjection);
+
+bool sphereInFrustum(const Frustum& frustum, const BoundingSphere& sphere);
+
+// Tests count spheres given in SoA layout, four at a time with SSE, and
+// appends the indices of the visible ones to visible.
+void cullSpheres(const Frustum& frustum, const float* centerX, const float* centerY, const float* centerZ,
+	const float* radius, size_t count, std::vector<unsigned int>& visible);
+
+// Culls a set of instances and submits the survivors.
+//
+// On a GL 4.3+ context, unless allowCompute is false, a compute shader does
+// the test and writes a compacted indirect buffer consumed by
+// glMultiDrawElementsIndirect, so the CPU never touches individual objects.
+// On the 3.3 core context requested by configureAsCurrentAndCreateWindow()
+// it falls back to cullSpheres().
+//
+// Either way the vertex shader receives the original instance index through
+// the attribute given to attachInstanceIds().
+class InstanceCuller {
+public:
+	InstanceCuller(bool allowCompute);
+	~InstanceCuller();
+
+	InstanceCuller(const InstanceCuller&) = delete;
+	InstanceCuller& operator=(const InstanceCuller&) = delete;
+
+	bool isGpuDriven() const;
+
+	void setInstances(const std::vector<CullInstance>& newInstances);
+
+	// Adds a per-instance unsigned int attribute to vao that holds the index
+	// of the instance being drawn. vao must already have its element buffer.
+	void attachInstanceIds(unsigned int vao, unsigned int location);
+
+	// Optional max-depth pyramid used to reject occluded instances on the GPU path.
+	void setOcclusionPyramid(unsigned int texture, int width, int height);
+
+	// Optional software depth buffer used to reject occluded instances on the CPU path.
+	void setOcclusionBuffer(const SoftwareOcclusionBuffer* buffer);
+
+	void cull(const Mat4& viewProjection);
+
+	void draw();
+
+	// Counters of the last cull. The GPU path reads them back once a fence
+	// signals, so they lag a frame or two behind instead of stalling.
+	const CullStats& stats() const;
+
+	// Indices of the instances the last cull() kept, in draw order. The GPU
+	// path reads them back and stalls, so this is for verification only.
+	void readVisibleInstances(std::vector<unsigned int>& ids) const;
+
+private:
+	void uploadCpuCommands();
+	void readGpuStats();
+
+	bool gpuDriven;
+	unsigned int cullProgram;
+	unsigned int instanceBuffer;
+	unsigned int commandBuffer;
+	unsigned int visibleIdBuffer;
+	unsigned int counterBuffer;
+	unsigned int statsBuffer;
+	unsigned int capacity;
+
+	unsigned int vao;
+	unsigned int instanceIdLocation;
+
+	unsigned int pyramidTexture;
+	int pyramidWidth;
+	int pyramidHeight;
+	const SoftwareOcclusionBuffer* occlusionBuffer;
+
+	void* statsFence;
+	CullStats lastStats;
+
+	std::vector<CullInstance> instances;
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+	std::vector<unsigned int> visibleIds;
+	std::vector<DrawElementsIndirectCommand> commands;
+};
+
+// Culls instanceCount cubes and octahedra scattered through a volume around a
+// camera turning in place and draws the survivors at width x height, once
+// culled on the CPU and, on GL 4.3, once with the compute shader. Prints CPU
+// and GPU time per frame and how many instances survive, then compares each
+// path's visible set with testing every sphere on its own for a few camera
+// directions. Needs a current context. Returns 0 on success, 1 when a path
+// disagrees with the brute-force test.
+int runCullingBenchmark(int width, int height, int instanceCount, int frames);
+
+#endif // !CUSTOM_CULLING_H
@@ -0,0 +1,552 @@
+#include "debugdraw.hpp"
+#include "bufferallocator.hpp"
+#include "glprogram.hpp"
+#include "gputimer.hpp"
+#include "jobsystem.hpp"
+#include "rendergraph.hpp"
+#include "textrenderer.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#ifdef DEBUG_DRAW_ENABLED
+
+static const char* debugVertexShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec3 aPos;\n"
+	"layout (location = 1) in vec4 aColor;\n"
+	"uniform mat4 viewProjection;\n"
+	"out vec4 vertexColor;\n"
+	"void main() {\n"
+	"vertexColor = aColor;\n"
+	"gl_Position = viewProjection * vec4(aPos, 1.0);\n"
+	"}\0";
+
+static const char* debugFragmentShaderSource = "#version 330 core\n"
+	"in vec4 vertexColor;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"FragColor = vertexColor;\n"
+	"}\0";
+
+static const int sphereSegments = 16;
+static const size_t labelLength = 64;
+
+struct DebugVertex {
+	float x, y, z;
+	uint32_t color;
+};
+
+struct DebugLabel {
+	Vec3 position;
+	uint32_t color;
+	char text[labelLength];
+};
+
+// Depth-tested lines in lines[0], overlay lines in lines[1], both as vertex pairs.
+struct DebugThreadBuffer {
+	DebugThreadBuffer(unsigned int lineCapacity, unsigned int labelCapacity)
+		: labels(labelCapacity), labelCount(0), dropped(0) {
+		for (int i = 0; i < 2; i++) {
+			lines[i].resize((size_t)lineCapacity * 2);
+			lineCount[i] = 0;
+		}
+	}
+
+	// Room for count more lines, or NULL when they do not fit.
+	DebugVertex* reserve(unsigned int count, bool overlay) {
+		int list = overlay ? 1 : 0;
+
+		if ((size_t)(lineCount[list] + count) * 2 > lines[list].size()) {
+			dropped++;
+			return NULL;
+		}
+
+		DebugVertex* vertices = &lines[list][(size_t)lineCount[list] * 2];
+		lineCount[list] += count;
+
+		return vertices;
+	}
+
+	std::vector<DebugVertex> lines[2];
+	unsigned int lineCount[2];
+	std::vector<DebugLabel> labels;
+	unsigned int labelCount;
+	unsigned int dropped;
+};
+
+static DebugDraw* activeDebugDraw = NULL;
+static unsigned int lastGeneration = 0;
+
+// Slots belong to one DebugDraw; a thread takes a new one when the
+// generation it last submitted to is gone.
+static thread_local unsigned int threadGeneration = 0;
+static thread_local int threadSlot = -1;
+
+DebugThreadBuffer* debugThreadBuffer() {
+	DebugDraw* debugDraw = activeDebugDraw;
+
+	if (debugDraw == NULL) {
+		return NULL;
+	}
+
+	if (threadGeneration != debugDraw->generation) {
+		threadGeneration = debugDraw->generation;
+		threadSlot = debugDraw->nextThreadSlot++;
+
+		if (threadSlot >= DebugDraw::maxThreads) {
+			std::cerr << "ERROR::DEBUG_DRAW::TOO_MANY_THREADS" << std::endl;
+		}
+	}
+
+	if (threadSlot >= DebugDraw::maxThreads) {
+		return NULL;
+	}
+
+	std::unique_ptr<DebugThreadBuffer>& buffer = debugDraw->threads[threadSlot];
+
+	if (!buffer) {
+		buffer.reset(new DebugThreadBuffer(debugDraw->lineCapacity, debugDraw->labelCapacity));
+	}
+
+	return buffer.get();
+}
+
+static void setVertex(DebugVertex& vertex, const Vec3& position, uint32_t color) {
+	vertex.x = position.x;
+	vertex.y = position.y;
+	vertex.z = position.z;
+	vertex.color = color;
+}
+
+// The twelve edges of a box given by its corners, corner i taking x, y and z
+// from bits 0, 1 and 2 of i.
+static void debugBoxCorners(const Vec3* corners, uint32_t color, bool overlay) {
+	DebugThreadBuffer* buffer = debugThreadBuffer();
+	DebugVertex* vertices = buffer != NULL ? buffer->reserve(12, overlay) : NULL;
+
+	if (vertices == NULL) {
+		return;
+	}
+
+	for (int i = 0; i < 8; i++) {
+		for (int bit = 1; bit < 8; bit <<= 1) {
+			if ((i & bit) == 0) {
+				setVertex(*vertices++, corners[i], color);
+				setVertex(*vertices++, corners[i | bit], color);
+			}
+		}
+	}
+}
+
+void debugLine(const Vec3& from, const Vec3& to, uint32_t color, bool overlay) {
+	DebugThreadBuffer* buffer = debugThreadBuffer();
+	DebugVertex* vertices = buffer != NULL ? buffer->reserve(1, overlay) : NULL;
+
+	if (vertices != NULL) {
+		setVertex(vertices[0], from, color);
+		setVertex(vertices[1], to, color);
+	}
+}
+
+void debugArrow(const Vec3& from, const Vec3& to, uint32_t color, bool overlay) {
+	DebugThreadBuffer* buffer = debugThreadBuffer();
+	DebugVertex* vertices = buffer != NULL ? buffer->reserve(5, overlay) : NULL;
+
+	if (vertices == NULL) {
+		return;
+	}
+
+	Vec3 shaft = sub(to, from);
+	float headLength = length(shaft) * 0.2f;
+	Vec3 direction = normalize(shaft);
+	Vec3 up = std::fabs(direction.y) < 0.9f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+	Vec3 side = scale(normalize(cross(direction, up)), headLength * 0.4f);
+	Vec3 normal = scale(normalize(cross(direction, side)), headLength * 0.4f);
+	Vec3 base = sub(to, scale(direction, headLength));
+
+	setVertex(*vertices++, from, color);
+	setVertex(*vertices++, to, color);
+
+	Vec3 barbs[4] = { add(base, side), sub(base, side), add(base, normal), sub(base, normal) };
+
+	for (int i = 0; i < 4; i++) {
+		setVertex(*vertices++, to, color);
+		setVertex(*vertices++, barbs[i], color);
+	}
+}
+
+void debugBox(const Vec3& minimum, const Vec3& maximum, uint32_t color, bool overlay) {
+	Vec3 corners[8];
+
+	for (int i = 0; i < 8; i++) {
+		corners[i] = vec3(i & 1 ? maximum.x : minimum.x, i & 2 ? maximum.y : minimum.y, i & 4 ? maximum.z : minimum.z);
+	}
+
+	debugBoxCorners(corners, color, overlay);
+}
+
+void debugSphere(const Vec3& center, float radius, uint32_t color, bool overlay) {
+	DebugThreadBuffer* buffer = debugThreadBuffer();
+	DebugVertex* vertices = buffer != NULL ? buffer->reserve(3 * sphereSegments, overlay) : NULL;
+
+	if (vertices == NULL) {
+		return;
+	}
+
+	float sines[sphereSegments + 1];
+	float cosines[sphereSegments + 1];
+
+	for (int i = 0; i <= sphereSegments; i++) {
+		float angle = 6.28318531f * i / sphereSegments;
+		sines[i] = std::sin(angle) * radius;
+		cosines[i] = std::cos(angle) * radius;
+	}
+
+	for (int i = 0; i < sphereSegments; i++) {
+		setVertex(*vertices++, vec3(center.x + cosines[i], center.y + sines[i], center.z), color);
+		setVertex(*vertices++, vec3(center.x + cosines[i + 1], center.y + sines[i + 1], center.z), color);
+		setVertex(*vertices++, vec3(center.x + cosines[i], center.y, center.z + sines[i]), color);
+		setVertex(*vertices++, vec3(center.x + cosines[i + 1], center.y, center.z + sines[i + 1]), color);
+		setVertex(*vertices++, vec3(center.x, center.y + cosines[i], center.z + sines[i]), color);
+		setVertex(*vertices++, vec3(center.x, center.y + cosines[i + 1], center.z + sines[i + 1]), color);
+	}
+}
+
+void debugFrustum(const Mat4& viewProjection, uint32_t color, bool overlay) {
+	Mat4 clipToWorld = inverse(viewProjection);
+	Vec3 corners[8];
+
+	for (int i = 0; i < 8; i++) {
+		Vec4 corner = transform(clipToWorld, vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f, 1.0f));
+		corners[i] = vec3(corner.x / corner.w, corner.y / corner.w, corner.z / corner.w);
+	}
+
+	debugBoxCorners(corners, color, overlay);
+}
+
+void debugText(const Vec3& position, const char* text, uint32_t color) {
+	DebugThreadBuffer* buffer = debugThreadBuffer();
+
+	if (buffer == NULL) {
+		return;
+	}
+
+	if (buffer->labelCount == buffer->labels.size()) {
+		buffer->dropped++;
+		return;
+	}
+
+	DebugLabel& label = buffer->labels[buffer->labelCount++];
+	label.position = position;
+	label.color = color;
+	std::strncpy(label.text, text, labelLength - 1);
+	label.text[labelLength - 1] = '\0';
+}
+
+DebugDraw::DebugDraw(unsigned int maxLinesPerThread, unsigned int maxLabelsPerThread)
+	: lineCapacity(maxLinesPerThread), labelCapacity(maxLabelsPerThread), stats(), generation(++lastGeneration), nextThreadSlot(0), threads(),
+	vertexBuffer(0), vertexArray(0), program(0) {
+	if (activeDebugDraw != NULL) {
+		std::cerr << "ERROR::DEBUG_DRAW::ALREADY_EXISTS" << std::endl;
+		return;
+	}
+
+	program = createProgram(debugVertexShaderSource, debugFragmentShaderSource);
+
+	if (program == 0) {
+		return;
+	}
+
+	glGenVertexArrays(1, &vertexArray);
+	glGenBuffers(1, &vertexBuffer);
+
+	glBindVertexArray(vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DebugVertex), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	activeDebugDraw = this;
+}
+
+DebugDraw::~DebugDraw() {
+	if (activeDebugDraw == this) {
+		activeDebugDraw = NULL;
+	}
+
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteVertexArrays(1, &vertexArray);
+	glDeleteProgram(program);
+}
+
+bool DebugDraw::isValid() const {
+	return program != 0 && activeDebugDraw == this;
+}
+
+void DebugDraw::draw(const Mat4& viewProjection, int width, int height, TextRenderer* text) {
+	size_t listVertices[2] = { 0, 0 };
+
+	stats.lines = 0;
+	stats.labels = 0;
+	stats.drawCalls = 0;
+	stats.dropped = 0;
+
+	for (int i = 0; i < maxThreads; i++) {
+		if (threads[i]) {
+			listVertices[0] += (size_t)threads[i]->lineCount[0] * 2;
+			listVertices[1] += (size_t)threads[i]->lineCount[1] * 2;
+			stats.dropped += threads[i]->dropped;
+		}
+	}
+
+	size_t totalVertices = listVertices[0] + listVertices[1];
+
+	if (totalVertices > 0) {
+		// Orphaned every frame; depth-tested lines of all threads first, then overlay lines.
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, totalVertices * sizeof(DebugVertex), NULL, GL_STREAM_DRAW);
+
+		size_t offset = 0;
+
+		for (int list = 0; list < 2; list++) {
+			for (int i = 0; i < maxThreads; i++) {
+				if (threads[i] && threads[i]->lineCount[list] > 0) {
+					size_t bytes = (size_t)threads[i]->lineCount[list] * 2 * sizeof(DebugVertex);
+					glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, threads[i]->lines[list].data());
+					offset += bytes;
+				}
+			}
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		glUseProgram(program);
+		glUniformMatrix4fv(glGetUniformLocation(program, "viewProjection"), 1, GL_FALSE, viewProjection.m);
+		glBindVertexArray(vertexArray);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDepthMask(GL_FALSE);
+
+		if (listVertices[0] > 0) {
+			glEnable(GL_DEPTH_TEST);
+			glDrawArrays(GL_LINES, 0, (GLsizei)listVertices[0]);
+			stats.drawCalls++;
+		}
+
+		glDisable(GL_DEPTH_TEST);
+
+		if (listVertices[1] > 0) {
+			glDrawArrays(GL_LINES, (GLint)listVertices[0], (GLsizei)listVertices[1]);
+			stats.drawCalls++;
+		}
+
+		glDepthMask(GL_TRUE);
+		glDisable(GL_BLEND);
+		glBindVertexArray(0);
+	}
+
+	stats.lines = (unsigned int)(totalVertices / 2);
+
+	if (text != NULL) {
+		text->begin(width, height);
+
+		for (int i = 0; i < maxThreads; i++) {
+			if (!threads[i]) {
+				continue;
+			}
+
+			for (unsigned int l = 0; l < threads[i]->labelCount; l++) {
+				const DebugLabel& label = threads[i]->labels[l];
+				Vec4 clip = transform(viewProjection, vec4(label.position.x, label.position.y, label.position.z, 1.0f));
+
+				// Behind the camera or outside the view.
+				if (clip.w <= 0.0f || std::fabs(clip.x) > clip.w || std::fabs(clip.y) > clip.w) {
+					continue;
+				}
+
+				float x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+				float y = (0.5f - clip.y / clip.w * 0.5f) * height;
+
+				text->drawText(label.text, x, y, 14.0f, label.color);
+				stats.labels++;
+			}
+		}
+
+		text->end();
+	}
+
+	for (int i = 0; i < maxThreads; i++) {
+		if (threads[i]) {
+			threads[i]->lineCount[0] = 0;
+			threads[i]->lineCount[1] = 0;
+			threads[i]->labelCount = 0;
+			threads[i]->dropped = 0;
+		}
+	}
+}
+
+const DebugDrawStats& DebugDraw::lastStats() const {
+	return stats;
+}
+
+int runDebugDrawBenchmark(int width, int height, int primitiveCount, int frames) {
+	JobSystem jobs(std::max((int)std::thread::hardware_concurrency() - 1, 1));
+
+	// Lanes claim ranges dynamically, so leave each room for twice its share.
+	// Primitives average 17 lines: a box, a sphere, an arrow and a line.
+	unsigned int linesPerThread = (unsigned int)((size_t)primitiveCount * 17 * 2 / jobs.laneCount() + 4096);
+	DebugDraw debugDraw(linesPerThread, 1024);
+	BufferAllocator buffers(1 << 20);
+	TextRenderer text(buffers, 32, 256, 4);
+
+	if (!debugDraw.isValid() || !text.isValid()) {
+		return -1;
+	}
+
+	int side = 1;
+
+	while (side * side < primitiveCount) {
+		side++;
+	}
+
+	float spacing = 2.0f;
+	float extent = side * spacing * 0.5f;
+	float aspect = (float)width / height;
+	Mat4 view = lookAt(vec3(0.0f, extent, extent * 1.6f), vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+	Mat4 viewProjection = multiply(perspective(1.0f, aspect, 0.5f, extent * 6.0f), view);
+	Mat4 observed = multiply(perspective(0.6f, aspect, 1.0f, extent), lookAt(vec3(-extent, 4.0f, 0.0f), vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f)));
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	RenderGraph graph;
+	RenderGraph::Resource output = graph.importTexture("output", outputTexture, outputDesc);
+
+	graph.addPass("debug",
+		[&](RenderGraph::Builder& builder) {
+			builder.write(output, LoadOp::Clear);
+			builder.setClearColor(0.05f, 0.05f, 0.08f, 1.0f);
+		},
+		[&](const RenderGraph&) {
+			debugDraw.draw(viewProjection, width, height, &text);
+		});
+
+	if (!graph.compile()) {
+		glDeleteTextures(1, &outputTexture);
+		return -1;
+	}
+
+	std::cout << "DEBUG DRAW BENCHMARK " << width << "x" << height << ", " << primitiveCount << " primitives from " << jobs.laneCount()
+		<< " lanes, " << frames << " frames" << std::endl;
+
+	const int warmupFrames = 10;
+	GpuTimer timer(4);
+	double submitMilliseconds = 0.0;
+	double drawMilliseconds = 0.0;
+
+	for (int frame = 0; frame < warmupFrames + frames; frame++) {
+		if (frame == warmupFrames) {
+			timer.wait();
+			timer.resetAverage();
+			submitMilliseconds = 0.0;
+			drawMilliseconds = 0.0;
+		}
+
+		float time = frame * 0.016f;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		jobs.parallelFor((size_t)primitiveCount, 256, [&](size_t begin, size_t end, int lane) {
+			for (size_t i = begin; i < end; i++) {
+				Vec3 center = vec3(((int)i % side) * spacing - extent, 0.0f, ((int)i / side) * spacing - extent);
+				float bob = 0.3f * std::sin(time * 2.0f + i * 0.1f);
+
+				switch (i % 4) {
+				case 0:
+					debugBox(vec3(center.x - 0.5f, center.y + bob - 0.5f, center.z - 0.5f), vec3(center.x + 0.5f, center.y + bob + 0.5f, center.z + 0.5f), 0xFF40C0FFu, false);
+					break;
+				case 1:
+					debugSphere(vec3(center.x, center.y + bob, center.z), 0.6f, 0xFF60FF60u, false);
+					break;
+				case 2:
+					debugArrow(center, vec3(center.x, center.y + 1.0f + bob, center.z), 0xFF4040FFu, true);
+					break;
+				default:
+					debugLine(vec3(center.x - 0.5f, center.y, center.z), vec3(center.x + 0.5f, center.y, center.z), 0x80FFFFFFu, false);
+					break;
+				}
+
+				if (i % 256 == 0) {
+					char label[32];
+					std::snprintf(label, sizeof(label), "lane %d #%d", lane, (int)i);
+					debugText(center, label, 0xFFFFFFFFu);
+				}
+			}
+		});
+
+		debugFrustum(observed, 0xFF00FFFFu, true);
+
+		std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+
+		timer.begin();
+		graph.execute();
+		timer.end();
+
+		std::chrono::steady_clock::time_point drawn = std::chrono::steady_clock::now();
+		submitMilliseconds += std::chrono::duration<double, std::milli>(submitted - start).count();
+		drawMilliseconds += std::chrono::duration<double, std::milli>(drawn - submitted).count();
+		timer.poll();
+	}
+
+	timer.wait();
+
+	const DebugDrawStats& stats = debugDraw.lastStats();
+
+	std::cout << "submit " << submitMilliseconds / frames << " ms, draw " << drawMilliseconds / frames << " ms CPU, "
+		<< timer.averageMilliseconds() << " ms GPU, " << stats.lines << " lines in " << stats.drawCalls << " draws, " << stats.labels
+		<< " labels, " << stats.dropped << " dropped" << std::endl;
+
+	glDeleteTextures(1, &outputTexture);
+
+	return 0;
+}
+
+#else
+
+DebugDraw::DebugDraw(unsigned int, unsigned int) : stats() {
+}
+
+DebugDraw::~DebugDraw() {
+}
+
+bool DebugDraw::isValid() const {
+	return true;
+}
+
+void DebugDraw::draw(const Mat4&, int, int, TextRenderer*) {
+}
+
+const DebugDrawStats& DebugDraw::lastStats() const {
+	return stats;
+}
+
+int runDebugDrawBenchmark(int, int, int, int) {
+	std::cout << "DEBUG DRAW BENCHMARK: debug drawing is compiled out of this build" << std::endl;
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef CUSTOM_DEBUGDRAW_H
+#define CUSTOM_DEBUGDRAW_H
+
+#include "vecmath.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Debug drawing exists in builds without NDEBUG, unless DEBUG_DRAW_DISABLED
+// is defined. Otherwise the debug*() calls below are empty inline functions
+// and DebugDraw draws nothing and owns no GL objects.
+#if !defined(NDEBUG) && !defined(DEBUG_DRAW_DISABLED)
+#define DEBUG_DRAW_ENABLED
+#endif
+
+class TextRenderer;
+struct DebugThreadBuffer;
+
+struct DebugDrawStats {
+	unsigned int lines;
+	unsigned int labels;
+	unsigned int drawCalls;
+	// Primitives that did not fit their thread's buffer.
+	unsigned int dropped;
+};
+
+// Collects world-space lines and labels submitted through the debug*()
+// functions from any thread and draws them in one frame: depth-tested lines
+// in one draw, overlay lines in another, labels through a TextRenderer.
+//
+// Every thread submits into its own fixed-size buffer, found through a
+// thread-local slot like FrameArena, so submission takes no lock and never
+// allocates after a thread's first call. draw() must be called while no
+// thread is submitting; it consumes everything submitted since the last one.
+// At most one DebugDraw exists at a time, and at most maxThreads distinct
+// threads can submit to it; a new DebugDraw hands out its slots afresh.
+class DebugDraw {
+public:
+	static const int maxThreads = 32;
+
+	// Capacities per submitting thread.
+	DebugDraw(unsigned int maxLinesPerThread, unsigned int maxLabelsPerThread);
+	~DebugDraw();
+
+	DebugDraw(const DebugDraw&) = delete;
+	DebugDraw& operator=(const DebugDraw&) = delete;
+
+	bool isValid() const;
+
+	// Draws into the bound framebuffer, then empties every thread buffer.
+	// Labels are only drawn when text is not NULL; they are projected to
+	// pixels of a width x height viewport, and text is begun and ended here.
+	// Leaves depth testing and blending disabled.
+	void draw(const Mat4& viewProjection, int width, int height, TextRenderer* text);
+
+	const DebugDrawStats& lastStats() const;
+
+private:
+#ifdef DEBUG_DRAW_ENABLED
+	// The calling thread's buffer in the current DebugDraw, created on first use.
+	friend DebugThreadBuffer* debugThreadBuffer();
+
+	unsigned int lineCapacity;
+	unsigned int labelCapacity;
+	DebugDrawStats stats;
+	// Distinguishes this DebugDraw from earlier ones in threads' cached slots.
+	unsigned int generation;
+	std::atomic<int> nextThreadSlot;
+	std::unique_ptr<DebugThreadBuffer> threads[maxThreads];
+
+	unsigned int vertexBuffer;
+	unsigned int vertexArray;
+	unsigned int program;
+#else
+	DebugDrawStats stats;
+#endif
+};
+
+// Colors are RGBA8 with red in the lowest byte. Overlay primitives ignore depth.
+#ifdef DEBUG_DRAW_ENABLED
+void debugLine(const Vec3& from, const Vec3& to, uint32_t color, bool overlay);
+void debugArrow(const Vec3& from, const Vec3& to, uint32_t color, bool overlay);
+void debugBox(const Vec3& minimum, const Vec3& maximum, uint32_t color, bool overlay);
+// Three great circles.
+void debugSphere(const Vec3& center, float radius, uint32_t color, bool overlay);
+// The volume a view-projection matrix sees.
+void debugFrustum(const Mat4& viewProjection, uint32_t color, bool overlay);
+// Copies text; at most 63 bytes are kept.
+void debugText(const Vec3& position, const char* text, uint32_t color);
+#else
+inline void debugLine(const Vec3&, const Vec3&, uint32_t, bool) {
+}
+
+inline void debugArrow(const Vec3&, const Vec3&, uint32_t, bool) {
+}
+
+inline void debugBox(const Vec3&, const Vec3&, uint32_t, bool) {
+}
+
+inline void debugSphere(const Vec3&, float, uint32_t, bool) {
+}
+
+inline void debugFrustum(const Mat4&, uint32_t, bool) {
+}
+
+inline void debugText(const Vec3&, const char*, uint32_t) {
+}
+#endif
+
+// Submits primitiveCount boxes, spheres and arrows per frame from every core
+// through a JobSystem and draws them at width x height, and prints submission
+// and draw CPU time, GPU time and draws per frame. Prints a note and returns
+// 0 in builds where debug drawing is compiled out. Needs a current context.
+// Returns 0 on success.
+int runDebugDrawBenchmark(int width, int height, int primitiveCount, int frames);
+
+#endif // !CUSTOM_DEBUGDRAW_H
@@ -0,0 +1,417 @@
+#include "deferred.hpp"
+#include "glprogram.hpp"
+#include "gputimer.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+const int DeferredRenderer::maxLights;
+
+struct FrameConstants {
+	Mat4 viewProjection;
+	Mat4 inverseViewProjection;
+	Vec4 cameraPosition;
+	int lightCount[4];
+};
+
+struct LightBlock {
+	Vec4 positionRadius[DeferredRenderer::maxLights];
+	Vec4 color[DeferredRenderer::maxLights];
+};
+
+static const char* frameBlockSource =
+	"layout (std140) uniform FrameConstants {\n"
+	"mat4 viewProjection;\n"
+	"mat4 inverseViewProjection;\n"
+	"vec4 cameraPosition;\n"
+	"ivec4 lightCount;\n"
+	"};\n"
+	"layout (std140) uniform Lights {\n"
+	"vec4 lightPositionRadius[256];\n"
+	"vec4 lightColor[256];\n"
+	"};\n"
+	"vec2 signNotZero(vec2 v) {\n"
+	"return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);\n"
+	"}\n"
+	"vec3 shade(vec3 position, vec3 normal, vec3 albedo) {\n"
+	"vec3 result = albedo * 0.03;\n"
+	"for (int i = 0; i < lightCount.x; i++) {\n"
+	"vec3 toLight = lightPositionRadius[i].xyz - position;\n"
+	"float distance = length(toLight);\n"
+	"float radius = lightPositionRadius[i].w;\n"
+	"if (distance >= radius) continue;\n"
+	"float falloff = 1.0 - distance / radius;\n"
+	"result += albedo * lightColor[i].rgb * max(dot(normal, toLight / distance), 0.0) * falloff * falloff;\n"
+	"}\n"
+	"return result;\n"
+	"}\n";
+
+static const char* geometryVertexShaderSource =
+	"layout (location = 0) in vec3 aPos;\n"
+	"layout (location = 1) in vec3 aNormal;\n"
+	"layout (location = 2) in vec3 aOffset;\n"
+	"layout (location = 3) in vec3 aColor;\n"
+	"out vec3 worldPosition;\n"
+	"out vec3 worldNormal;\n"
+	"out vec3 baseColor;\n"
+	"void main() {\n"
+	"worldPosition = aPos + aOffset;\n"
+	"worldNormal = aNormal;\n"
+	"baseColor = aColor;\n"
+	"gl_Position = viewProjection * vec4(worldPosition, 1.0);\n"
+	"}\n";
+
+static const char* gbufferFragmentShaderSource =
+	"in vec3 worldPosition;\n"
+	"in vec3 worldNormal;\n"
+	"in vec3 baseColor;\n"
+	"layout (location = 0) out vec2 packedNormal;\n"
+	"layout (location = 1) out vec4 albedo;\n"
+	"layout (location = 2) out vec3 emissive;\n"
+	"vec2 encodeOctahedral(vec3 n) {\n"
+	"n /= abs(n.x) + abs(n.y) + abs(n.z);\n"
+	"vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signNotZero(n.xy);\n"
+	"return e * 0.5 + 0.5;\n"
+	"}\n"
+	"void main() {\n"
+	"packedNormal = encodeOctahedral(normalize(worldNormal));\n"
+	"albedo = vec4(baseColor, 1.0);\n"
+	"emissive = baseColor * 0.02;\n"
+	"}\n";
+
+static const char* lightingVertexShaderSource =
+	"void main() {\n"
+	"vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+	"gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+static const char* lightingFragmentShaderSource =
+	"uniform sampler2D gNormal;\n"
+	"uniform sampler2D gAlbedo;\n"
+	"uniform sampler2D gEmissive;\n"
+	"uniform sampler2D gDepth;\n"
+	"out vec4 FragColor;\n"
+	"vec3 decodeOctahedral(vec2 e) {\n"
+	"e = e * 2.0 - 1.0;\n"
+	"vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+	"if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);\n"
+	"return normalize(n);\n"
+	"}\n"
+	"void main() {\n"
+	"ivec2 coord = ivec2(gl_FragCoord.xy);\n"
+	"float depth = texelFetch(gDepth, coord, 0).r;\n"
+	"if (depth == 1.0) {\n"
+	"FragColor = vec4(0.2, 0.2, 0.2, 1.0);\n"
+	"return;\n"
+	"}\n"
+	"vec2 uv = gl_FragCoord.xy / vec2(textureSize(gDepth, 0));\n"
+	"vec4 position = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);\n"
+	"vec3 normal = decodeOctahedral(texelFetch(gNormal, coord, 0).rg);\n"
+	"vec3 albedo = texelFetch(gAlbedo, coord, 0).rgb;\n"
+	"FragColor = vec4(shade(position.xyz / position.w, normal, albedo) + texelFetch(gEmissive, coord, 0).rgb, 1.0);\n"
+	"}\n";
+
+static const char* forwardFragmentShaderSource =
+	"in vec3 worldPosition;\n"
+	"in vec3 worldNormal;\n"
+	"in vec3 baseColor;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"FragColor = vec4(shade(worldPosition, normalize(worldNormal), baseColor) + baseColor * 0.02, 1.0);\n"
+	"}\n";
+
+static unsigned int createShadingProgram(const char* vertexBody, const char* fragmentBody) {
+	std::string header = std::string("#version 330 core\n") + frameBlockSource;
+	std::string vertexSource = header + vertexBody;
+	std::string fragmentSource = header + fragmentBody;
+
+	unsigned int program = createProgram(vertexSource.c_str(), fragmentSource.c_str());
+
+	if (program == 0) {
+		return 0;
+	}
+
+	unsigned int frameIndex = glGetUniformBlockIndex(program, "FrameConstants");
+	unsigned int lightIndex = glGetUniformBlockIndex(program, "Lights");
+
+	if (frameIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, frameIndex, DeferredRenderer::frameBinding);
+	}
+
+	if (lightIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, lightIndex, DeferredRenderer::lightBinding);
+	}
+
+	return program;
+}
+
+DeferredRenderer::DeferredRenderer()
+	: geometryProgram(0), lightingProgram(0), forwardProgram(0), emptyVao(0), geometryTimer(NULL), lightingTimer(NULL) {
+	geometryProgram = createShadingProgram(geometryVertexShaderSource, gbufferFragmentShaderSource);
+	lightingProgram = createShadingProgram(lightingVertexShaderSource, lightingFragmentShaderSource);
+	forwardProgram = createShadingProgram(geometryVertexShaderSource, forwardFragmentShaderSource);
+
+	if (lightingProgram != 0) {
+		glUseProgram(lightingProgram);
+		glUniform1i(glGetUniformLocation(lightingProgram, "gNormal"), 0);
+		glUniform1i(glGetUniformLocation(lightingProgram, "gAlbedo"), 1);
+		glUniform1i(glGetUniformLocation(lightingProgram, "gEmissive"), 2);
+		glUniform1i(glGetUniformLocation(lightingProgram, "gDepth"), 3);
+	}
+
+	glGenVertexArrays(1, &emptyVao);
+}
+
+DeferredRenderer::~DeferredRenderer() {
+	glDeleteProgram(geometryProgram);
+	glDeleteProgram(lightingProgram);
+	glDeleteProgram(forwardProgram);
+	glDeleteVertexArrays(1, &emptyVao);
+}
+
+bool DeferredRenderer::isValid() const {
+	return geometryProgram != 0 && lightingProgram != 0 && forwardProgram != 0;
+}
+
+void DeferredRenderer::setPassTimers(GpuTimer* geometry, GpuTimer* lighting) {
+	geometryTimer = geometry;
+	lightingTimer = lighting;
+}
+
+size_t DeferredRenderer::gbufferBytesPerPixel() {
+	return bytesPerPixel(GL_RG16) + bytesPerPixel(GL_RGBA8) + bytesPerPixel(GL_R11F_G11F_B10F) + bytesPerPixel(GL_DEPTH24_STENCIL8);
+}
+
+void DeferredRenderer::setFrame(UniformRing& ring, const Mat4& viewProjection, const Vec3& cameraPosition, const std::vector<PointLight>& lights) {
+	UniformAllocation frame = ring.allocate(sizeof(FrameConstants));
+	UniformAllocation lightBlock = ring.allocate(sizeof(LightBlock));
+
+	if (frame.data == NULL || lightBlock.data == NULL) {
+		return;
+	}
+
+	FrameConstants* constants = (FrameConstants*)frame.data;
+	constants->viewProjection = viewProjection;
+	constants->inverseViewProjection = inverse(viewProjection);
+	constants->cameraPosition = vec4(cameraPosition.x, cameraPosition.y, cameraPosition.z, 1.0f);
+	constants->lightCount[0] = (int)std::min(lights.size(), (size_t)maxLights);
+
+	LightBlock* block = (LightBlock*)lightBlock.data;
+
+	for (int i = 0; i < constants->lightCount[0]; i++) {
+		block->positionRadius[i] = lights[i].positionRadius;
+		block->color[i] = lights[i].color;
+	}
+
+	ring.flush();
+	ring.bind(frameBinding, frame);
+	ring.bind(lightBinding, lightBlock);
+}
+
+void DeferredRenderer::addPasses(RenderGraph& graph, RenderGraph::Resource output, const std::function<void()>& drawGeometry) {
+	const RenderTextureDesc& target = graph.desc(output);
+	RenderTextureDesc normalDesc = { target.width, target.height, GL_RG16 };
+	RenderTextureDesc albedoDesc = { target.width, target.height, GL_RGBA8 };
+	RenderTextureDesc emissiveDesc = { target.width, target.height, GL_R11F_G11F_B10F };
+	RenderTextureDesc depthDesc = { target.width, target.height, GL_DEPTH24_STENCIL8 };
+
+	RenderGraph::Resource normal = 0, albedo = 0, emissive = 0, depth = 0;
+
+	graph.addPass("gbuffer",
+		[&](RenderGraph::Builder& builder) {
+			normal = builder.create("gbuffer.normal", normalDesc);
+			albedo = builder.create("gbuffer.albedo", albedoDesc);
+			emissive = builder.create("gbuffer.emissive", emissiveDesc);
+			depth = builder.create("gbuffer.depth", depthDesc);
+
+			builder.write(normal, LoadOp::Clear);
+			builder.write(albedo, LoadOp::Clear);
+			builder.write(emissive, LoadOp::Clear);
+			builder.write(depth, LoadOp::Clear);
+			builder.setClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		},
+		[this, drawGeometry](const RenderGraph&) {
+			if (geometryTimer != NULL) {
+				geometryTimer->begin();
+			}
+
+			glEnable(GL_DEPTH_TEST);
+			glDepthMask(GL_TRUE);
+			glUseProgram(geometryProgram);
+			drawGeometry();
+			glDisable(GL_DEPTH_TEST);
+
+			if (geometryTimer != NULL) {
+				geometryTimer->end();
+			}
+		});
+
+	graph.addPass("lighting",
+		[&](RenderGraph::Builder& builder) {
+			builder.read(normal);
+			builder.read(albedo);
+			builder.read(emissive);
+			builder.read(depth);
+			builder.write(output, LoadOp::DontCare);
+		},
+		[this, normal, albedo, emissive, depth](const RenderGraph& frame) {
+			if (lightingTimer != NULL) {
+				lightingTimer->begin();
+			}
+
+			RenderGraph::Resource inputs[4] = { normal, albedo, emissive, depth };
+
+			for (int i = 0; i < 4; i++) {
+				glActiveTexture(GL_TEXTURE0 + i);
+				glBindTexture(GL_TEXTURE_2D, frame.texture(inputs[i]));
+			}
+
+			glActiveTexture(GL_TEXTURE0);
+			glUseProgram(lightingProgram);
+			glBindVertexArray(emptyVao);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+
+			if (lightingTimer != NULL) {
+				lightingTimer->end();
+			}
+		});
+}
+
+void DeferredRenderer::addForwardPass(RenderGraph& graph, RenderGraph::Resource output, const std::function<void()>& drawGeometry) {
+	const RenderTextureDesc& target = graph.desc(output);
+	RenderTextureDesc depthDesc = { target.width, target.height, GL_DEPTH24_STENCIL8 };
+
+	graph.addPass("forward",
+		[&](RenderGraph::Builder& builder) {
+			RenderGraph::Resource depth = builder.create("forward.depth", depthDesc);
+
+			builder.write(output, LoadOp::Clear);
+			builder.write(depth, LoadOp::Clear);
+			builder.setClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+		},
+		[this, drawGeometry](const RenderGraph&) {
+			glEnable(GL_DEPTH_TEST);
+			glDepthMask(GL_TRUE);
+			glUseProgram(forwardProgram);
+			drawGeometry();
+			glDisable(GL_DEPTH_TEST);
+		});
+}
+
+// passTimers are the timers inside the graph's passes; their averages restart
+// with timer's after warm-up.
+static double measureGraph(RenderGraph& graph, DeferredRenderer& renderer, UniformRing& ring, const BenchScene& scene,
+	const std::vector<PointLight>& lights, float aspect, int frames, GpuTimer& timer, const std::vector<GpuTimer*>& passTimers) {
+	Mat4 viewProjection = scene.cameraViewProjection(aspect);
+	const int warmupFrames = 10;
+
+	for (int frame = 0; frame < warmupFrames + frames; frame++) {
+		if (frame == warmupFrames) {
+			timer.wait();
+			timer.resetAverage();
+
+			for (size_t i = 0; i < passTimers.size(); i++) {
+				passTimers[i]->wait();
+				passTimers[i]->resetAverage();
+			}
+		}
+
+		ring.beginFrame();
+		renderer.setFrame(ring, viewProjection, scene.cameraPosition(), lights);
+
+		timer.begin();
+		graph.execute();
+		timer.end();
+
+		ring.endFrame();
+		timer.poll();
+
+		for (size_t i = 0; i < passTimers.size(); i++) {
+			passTimers[i]->poll();
+		}
+	}
+
+	timer.wait();
+
+	for (size_t i = 0; i < passTimers.size(); i++) {
+		passTimers[i]->wait();
+	}
+
+	return timer.averageMilliseconds();
+}
+
+int runDeferredBenchmark(int width, int height, int lightCount, int frames) {
+	DeferredRenderer renderer;
+
+	if (!renderer.isValid()) {
+		return -1;
+	}
+
+	BenchScene scene(64, 2.0f);
+	std::vector<PointLight> lights = scene.makeLights(std::min(lightCount, DeferredRenderer::maxLights), 8.0f);
+	UniformRing ring(sizeof(FrameConstants) + sizeof(LightBlock) + 1024, 3);
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	std::function<void()> drawScene = [&scene]() { scene.draw(); };
+	float aspect = (float)width / height;
+
+	GpuTimer forwardTimer(4);
+	GpuTimer deferredTimer(4);
+	GpuTimer geometryTimer(4);
+	GpuTimer lightingTimer(4);
+
+	double forwardMilliseconds = 0.0;
+	double deferredMilliseconds = 0.0;
+
+	{
+		RenderGraph graph;
+		renderer.addForwardPass(graph, graph.importTexture("output", outputTexture, outputDesc), drawScene);
+
+		if (graph.compile()) {
+			forwardMilliseconds = measureGraph(graph, renderer, ring, scene, lights, aspect, frames, forwardTimer, std::vector<GpuTimer*>());
+		}
+	}
+
+	{
+		RenderGraph graph;
+		renderer.setPassTimers(&geometryTimer, &lightingTimer);
+		renderer.addPasses(graph, graph.importTexture("output", outputTexture, outputDesc), drawScene);
+
+		if (graph.compile()) {
+			std::vector<GpuTimer*> passTimers;
+			passTimers.push_back(&geometryTimer);
+			passTimers.push_back(&lightingTimer);
+
+			deferredMilliseconds = measureGraph(graph, renderer, ring, scene, lights, aspect, frames, deferredTimer, passTimers);
+		}
+
+		renderer.setPassTimers(NULL, NULL);
+	}
+
+	// Every G-buffer byte is written once by the geometry pass and read once by the lighting pass.
+	double gbufferMegabytes = 2.0 * DeferredRenderer::gbufferBytesPerPixel() * width * height / (1024.0 * 1024.0);
+
+	std::cout << "SHADING BENCHMARK " << width << "x" << height << ", " << lights.size() << " lights, "
+		<< scene.instanceCount() << " cubes, " << frames << " frames" << std::endl;
+	std::cout << "forward:  " << forwardMilliseconds << " ms" << std::endl;
+	std::cout << "deferred: " << deferredMilliseconds << " ms (geometry " << geometryTimer.averageMilliseconds()
+		<< " ms, lighting " << lightingTimer.averageMilliseconds() << " ms)" << std::endl;
+	std::cout << "g-buffer: " << DeferredRenderer::gbufferBytesPerPixel() << " bytes/pixel, " << gbufferMegabytes << " MB/frame";
+
+	if (deferredMilliseconds > 0.0) {
+		std::cout << ", " << gbufferMegabytes / deferredMilliseconds << " GB/s";
+	}
+
+	std::cout << std::endl;
+
+	glDeleteTextures(1, &outputTexture);
+
+	return 0;
+}
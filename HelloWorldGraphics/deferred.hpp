@@ -0,0 +1,61 @@
+#ifndef CUSTOM_DEFERRED_H
+#define CUSTOM_DEFERRED_H
+
+#include "benchscene.hpp"
+#include "rendergraph.hpp"
+#include "uniformring.hpp"
+#include <functional>
+#include <vector>
+
+class GpuTimer;
+
+// Deferred shading on top of RenderGraph. The G-buffer is 16 bytes per pixel:
+//   RG16            octahedral-encoded world normal
+//   RGBA8           albedo
+//   R11F_G11F_B10F  emissive
+//   DEPTH24_STENCIL8 depth, from which the lighting pass rebuilds position.
+// Geometry must use the attribute layout of BenchScene.
+class DeferredRenderer {
+public:
+	static const int maxLights = 256;
+
+	// Uniform block bindings shared by the geometry, lighting and forward programs.
+	static const unsigned int frameBinding = 0;
+	static const unsigned int lightBinding = 1;
+
+	DeferredRenderer();
+	~DeferredRenderer();
+
+	DeferredRenderer(const DeferredRenderer&) = delete;
+	DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+	bool isValid() const;
+
+	// Writes this frame's camera and lights into ring and binds them.
+	void setFrame(UniformRing& ring, const Mat4& viewProjection, const Vec3& cameraPosition, const std::vector<PointLight>& lights);
+
+	// Adds a G-buffer pass and a lighting pass writing output.
+	void addPasses(RenderGraph& graph, RenderGraph::Resource output, const std::function<void()>& drawGeometry);
+
+	// Adds a single forward pass shading every light per fragment, for comparison.
+	void addForwardPass(RenderGraph& graph, RenderGraph::Resource output, const std::function<void()>& drawGeometry);
+
+	static size_t gbufferBytesPerPixel();
+
+	void setPassTimers(GpuTimer* geometry, GpuTimer* lighting);
+
+private:
+	unsigned int geometryProgram;
+	unsigned int lightingProgram;
+	unsigned int forwardProgram;
+	unsigned int emptyVao;
+	GpuTimer* geometryTimer;
+	GpuTimer* lightingTimer;
+};
+
+// Renders BenchScene with lightCount lights at width x height through both
+// paths and prints G-buffer traffic and GPU frame time for each. Needs a
+// current context. Returns 0 on success.
+int runDeferredBenchmark(int width, int height, int lightCount, int frames);
+
+#endif // !CUSTOM_DEFERRED_H
@@ -0,0 +1,224 @@
+#include "dynamicresolution.hpp"
+#include "clustered.hpp"
+#include "glprogram.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+static const char* upscaleVertexShaderSource = "#version 330 core\n"
+	"void main() {\n"
+	"vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+	"gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\0";
+
+// Catmull-Rom in nine bilinear taps; taps are clamped to the rendered region
+// because the rest of the target holds stale pixels from larger frames.
+static const char* upscaleFragmentShaderSource = "#version 330 core\n"
+	"uniform sampler2D source;\n"
+	"uniform vec2 renderSize;\n"
+	"uniform vec2 outputSize;\n"
+	"out vec4 FragColor;\n"
+	"vec3 sampleClamped(vec2 texel) {\n"
+	"return texture(source, clamp(texel, vec2(0.5), renderSize - 0.5) / vec2(textureSize(source, 0))).rgb;\n"
+	"}\n"
+	"void main() {\n"
+	"vec2 position = gl_FragCoord.xy / outputSize * renderSize;\n"
+	"vec2 center = floor(position - 0.5) + 0.5;\n"
+	"vec2 f = position - center;\n"
+	"vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));\n"
+	"vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);\n"
+	"vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));\n"
+	"vec2 w3 = f * f * (-0.5 + 0.5 * f);\n"
+	"vec2 w12 = w1 + w2;\n"
+	"vec2 p0 = center - 1.0;\n"
+	"vec2 p12 = center + w2 / w12;\n"
+	"vec2 p3 = center + 2.0;\n"
+	"vec3 color =\n"
+	"(sampleClamped(vec2(p0.x, p0.y)) * w0.x + sampleClamped(vec2(p12.x, p0.y)) * w12.x + sampleClamped(vec2(p3.x, p0.y)) * w3.x) * w0.y +\n"
+	"(sampleClamped(vec2(p0.x, p12.y)) * w0.x + sampleClamped(vec2(p12.x, p12.y)) * w12.x + sampleClamped(vec2(p3.x, p12.y)) * w3.x) * w12.y +\n"
+	"(sampleClamped(vec2(p0.x, p3.y)) * w0.x + sampleClamped(vec2(p12.x, p3.y)) * w12.x + sampleClamped(vec2(p3.x, p3.y)) * w3.x) * w3.y;\n"
+	"FragColor = vec4(max(color, 0.0), 1.0);\n"
+	"}\0";
+
+DynamicResolution::DynamicResolution(double targetMilliseconds, float minScale, float maxScale)
+	: timer(4), target(targetMilliseconds), minimum(minScale), maximum(maxScale), current(maxScale), filtered(0.0), last(0.0),
+	upscaleProgram(0), emptyVao(0) {
+	upscaleProgram = createProgram(upscaleVertexShaderSource, upscaleFragmentShaderSource);
+	glGenVertexArrays(1, &emptyVao);
+}
+
+DynamicResolution::~DynamicResolution() {
+	glDeleteProgram(upscaleProgram);
+	glDeleteVertexArrays(1, &emptyVao);
+}
+
+bool DynamicResolution::isValid() const {
+	return upscaleProgram != 0;
+}
+
+void DynamicResolution::beginFrame() {
+	timer.begin();
+}
+
+void DynamicResolution::endFrame() {
+	timer.end();
+}
+
+void DynamicResolution::update() {
+	if (timer.poll()) {
+		feed(timer.lastMilliseconds());
+	}
+}
+
+void DynamicResolution::feed(double gpuMilliseconds) {
+	last = gpuMilliseconds;
+	filtered = filtered <= 0.0 ? gpuMilliseconds : filtered * 0.8 + gpuMilliseconds * 0.2;
+
+	// Spikes act on the raw time, recovery goes through the filter.
+	double measured = std::max(gpuMilliseconds > target ? gpuMilliseconds : filtered, 0.01);
+	float desired = current * (float)std::sqrt(target * 0.9 / measured);
+
+	if (desired < current) {
+		current = std::max(desired, current * 0.85f);
+	}
+	else if (desired > current * 1.01f) {
+		current = std::min(desired, current * 1.02f);
+	}
+
+	current = std::min(std::max(current, minimum), maximum);
+}
+
+float DynamicResolution::scale() const {
+	return current;
+}
+
+double DynamicResolution::lastMilliseconds() const {
+	return last;
+}
+
+int DynamicResolution::renderWidth(int fullWidth) const {
+	int width = (int)std::ceil(fullWidth * current / 8.0f) * 8;
+	return std::max(std::min(width, fullWidth), 1);
+}
+
+int DynamicResolution::renderHeight(int fullHeight) const {
+	int height = (int)std::ceil(fullHeight * current / 8.0f) * 8;
+	return std::max(std::min(height, fullHeight), 1);
+}
+
+void DynamicResolution::setSceneViewport(int fullWidth, int fullHeight) const {
+	glViewport(0, 0, renderWidth(fullWidth), renderHeight(fullHeight));
+}
+
+void DynamicResolution::addUpscalePass(RenderGraph& graph, RenderGraph::Resource source, RenderGraph::Resource output) {
+	graph.addPass("upscale",
+		[&](RenderGraph::Builder& builder) {
+			builder.read(source);
+			builder.write(output, LoadOp::DontCare);
+		},
+		[this, source, output](const RenderGraph& frame) {
+			const RenderTextureDesc& sourceDesc = frame.desc(source);
+			const RenderTextureDesc& outputDesc = frame.desc(output);
+
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, frame.texture(source));
+
+			glUseProgram(upscaleProgram);
+			glUniform1i(glGetUniformLocation(upscaleProgram, "source"), 0);
+			glUniform2f(glGetUniformLocation(upscaleProgram, "renderSize"), (float)renderWidth(sourceDesc.width), (float)renderHeight(sourceDesc.height));
+			glUniform2f(glGetUniformLocation(upscaleProgram, "outputSize"), (float)outputDesc.width, (float)outputDesc.height);
+
+			glBindVertexArray(emptyVao);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+		});
+}
+
+int runDynamicResolutionBenchmark(int width, int height, int frames, double targetMilliseconds) {
+	DynamicResolution resolution(targetMilliseconds, 0.5f, 1.0f);
+	ClusteredRenderer renderer(true);
+
+	if (!resolution.isValid() || !renderer.isValid()) {
+		return -1;
+	}
+
+	BenchScene scene(64, 2.0f);
+	std::vector<ClusterLight> calmLights = toClusterLights(scene.makeLights(128, 6.0f), 1.0f);
+	std::vector<ClusterLight> spikeLights = toClusterLights(scene.makeLights(4096, 6.0f), 1.0f);
+
+	float aspect = (float)width / height;
+	Mat4 view = scene.cameraView();
+	Mat4 projection = scene.cameraProjection(aspect);
+	UniformRing ring(4096, 3);
+
+	unsigned int textures[2];
+	glGenTextures(2, textures);
+
+	for (int i = 0; i < 2; i++) {
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	RenderTextureDesc desc = { width, height, GL_RGBA8 };
+	std::function<void()> drawScene = [&]() {
+		resolution.setSceneViewport(width, height);
+		scene.draw();
+	};
+
+	RenderGraph graph;
+	RenderGraph::Resource sceneTarget = graph.importTexture("scene", textures[0], desc);
+	RenderGraph::Resource output = graph.importTexture("output", textures[1], desc);
+
+	renderer.addPass(graph, sceneTarget, drawScene);
+	resolution.addUpscalePass(graph, sceneTarget, output);
+
+	if (!graph.compile()) {
+		glDeleteTextures(2, textures);
+		return -1;
+	}
+
+	int clusterWidth = 0;
+	int clusterHeight = 0;
+	int overBudget = 0;
+
+	std::cout << "DYNAMIC RESOLUTION BENCHMARK " << width << "x" << height << ", target " << targetMilliseconds << " ms, "
+		<< frames << " frames, light spikes from " << calmLights.size() << " to " << spikeLights.size() << std::endl;
+
+	for (int frame = 0; frame < frames; frame++) {
+		// Every 200 frames, 50 frames run with 32 times the lights.
+		bool spike = frame % 200 >= 100 && frame % 200 < 150;
+
+		resolution.update();
+
+		if (resolution.renderWidth(width) != clusterWidth || resolution.renderHeight(height) != clusterHeight) {
+			clusterWidth = resolution.renderWidth(width);
+			clusterHeight = resolution.renderHeight(height);
+			renderer.resize(clusterWidth, clusterHeight, projection, scene.nearPlane(), scene.farPlane());
+		}
+
+		ring.beginFrame();
+		resolution.beginFrame();
+		renderer.setFrame(ring, view, projection, spike ? spikeLights : calmLights);
+		graph.execute();
+		resolution.endFrame();
+		ring.endFrame();
+
+		if (resolution.lastMilliseconds() > targetMilliseconds) {
+			overBudget++;
+		}
+
+		if (frame % 10 == 0) {
+			std::cout << "frame " << frame << (spike ? " (spike)" : "") << ": scale " << resolution.scale() << ", "
+				<< clusterWidth << "x" << clusterHeight << ", " << resolution.lastMilliseconds() << " ms" << std::endl;
+		}
+	}
+
+	std::cout << overBudget << " of " << frames << " frames reported over budget" << std::endl;
+
+	glDeleteTextures(2, textures);
+
+	return 0;
+}
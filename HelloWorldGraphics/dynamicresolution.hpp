@@ -0,0 +1,63 @@
+#ifndef CUSTOM_DYNAMICRESOLUTION_H
+#define CUSTOM_DYNAMICRESOLUTION_H
+
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+
+// Picks a render scale each frame from GPU frame times so the frame stays
+// within a time budget, and upscales the scaled image to the output.
+//
+// The scene renders into the bottom-left renderWidth() x renderHeight() of a
+// full-size target, so scale changes never reallocate anything. Cost is taken
+// to grow with pixel count, i.e. with scale squared. The controller drops the
+// scale quickly when a frame goes over budget and raises it slowly, and
+// sizes are rounded to 8 pixels so small jitter does not change them.
+class DynamicResolution {
+public:
+	DynamicResolution(double targetMilliseconds, float minScale, float maxScale);
+	~DynamicResolution();
+
+	DynamicResolution(const DynamicResolution&) = delete;
+	DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+	bool isValid() const;
+
+	// Brackets the GPU work the budget applies to.
+	void beginFrame();
+	void endFrame();
+
+	// Collects finished timings and picks the scale for the next frame.
+	void update();
+
+	// Feeds one GPU frame time by hand, for callers with their own timers.
+	void feed(double gpuMilliseconds);
+
+	float scale() const;
+	double lastMilliseconds() const;
+	int renderWidth(int fullWidth) const;
+	int renderHeight(int fullHeight) const;
+
+	// For scene passes: restricts drawing to the scaled region of a full-size target.
+	void setSceneViewport(int fullWidth, int fullHeight) const;
+
+	// Adds a pass upscaling the scaled region of source to output with a Catmull-Rom filter.
+	void addUpscalePass(RenderGraph& graph, RenderGraph::Resource source, RenderGraph::Resource output);
+
+private:
+	GpuTimer timer;
+	double target;
+	float minimum;
+	float maximum;
+	float current;
+	double filtered;
+	double last;
+	unsigned int upscaleProgram;
+	unsigned int emptyVao;
+};
+
+// Renders the clustered BenchScene under a budget of targetMilliseconds
+// with periodic load spikes, printing the scale and GPU time as it adapts.
+// Needs a current context. Returns 0 on success.
+int runDynamicResolutionBenchmark(int width, int height, int frames, double targetMilliseconds);
+
+#endif // !CUSTOM_DYNAMICRESOLUTION_H
@@ -0,0 +1,302 @@
+#include "ecs.hpp"
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+
+struct ComponentType {
+	size_t size;
+	size_t alignment;
+};
+
+static std::mutex componentTypesMutex;
+static ComponentType componentTypes[maxComponentTypes];
+static int componentTypeCount = 0;
+
+int registerComponentType(size_t size, size_t alignment) {
+	std::lock_guard<std::mutex> lock(componentTypesMutex);
+
+	if (componentTypeCount == maxComponentTypes) {
+		std::cerr << "ERROR::ECS::TOO_MANY_COMPONENT_TYPES" << std::endl;
+		return maxComponentTypes - 1;
+	}
+
+	ComponentType type = { size, alignment };
+	componentTypes[componentTypeCount] = type;
+
+	return componentTypeCount++;
+}
+
+const size_t Archetype::chunkBytes;
+const size_t Archetype::cacheLine;
+
+static size_t alignUp(size_t value, size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+Archetype::Archetype(ComponentMask mask) : componentMask(mask), rowsPerChunk(0), bytesPerChunk(chunkBytes), chunkAlignment(cacheLine), chunks() {
+	size_t rowBytes = sizeof(Entity);
+
+	for (int i = 0; i < maxComponentTypes; i++) {
+		offsets[i] = 0;
+
+		if (has(i)) {
+			rowBytes += componentTypes[i].size;
+			chunkAlignment = std::max(chunkAlignment, componentTypes[i].alignment);
+		}
+	}
+
+	// Guess from the row size, then back off until the aligned columns fit.
+	// Rows too large for a chunk get a chunk each.
+	for (rowsPerChunk = std::max(chunkBytes / rowBytes, (size_t)1);; rowsPerChunk--) {
+		size_t end = sizeof(Entity) * rowsPerChunk;
+
+		for (int i = 0; i < maxComponentTypes; i++) {
+			if (has(i)) {
+				offsets[i] = alignUp(end, std::max(componentTypes[i].alignment, cacheLine));
+				end = offsets[i] + componentTypes[i].size * rowsPerChunk;
+			}
+		}
+
+		if (end <= chunkBytes || rowsPerChunk == 1) {
+			bytesPerChunk = std::max(end, chunkBytes);
+			break;
+		}
+	}
+}
+
+Archetype::~Archetype() {
+	for (size_t i = 0; i < chunks.size(); i++) {
+		::operator delete(chunks[i].allocation);
+	}
+}
+
+ComponentMask Archetype::mask() const {
+	return componentMask;
+}
+
+size_t Archetype::capacity() const {
+	return rowsPerChunk;
+}
+
+size_t Archetype::chunkCount() const {
+	return chunks.size();
+}
+
+Archetype::Chunk& Archetype::chunk(size_t index) {
+	return chunks[index];
+}
+
+bool Archetype::has(int component) const {
+	return (componentMask >> component) & 1;
+}
+
+Entity* Archetype::entities(const Chunk& chunk) const {
+	return (Entity*)chunk.data;
+}
+
+void* Archetype::column(const Chunk& chunk, int component) const {
+	return chunk.data + offsets[component];
+}
+
+void Archetype::pushRow(Entity entity, uint32_t& chunkIndex, uint32_t& row) {
+	if (chunks.empty() || chunks.back().count == rowsPerChunk) {
+		// operator new only guarantees fundamental alignment, so the chunk is aligned by hand.
+		char* allocation = (char*)::operator new(bytesPerChunk + chunkAlignment - 1);
+		Chunk chunk = { allocation + (alignUp((size_t)allocation, chunkAlignment) - (size_t)allocation), allocation, 0 };
+		chunks.push_back(chunk);
+	}
+
+	Chunk& last = chunks.back();
+
+	chunkIndex = (uint32_t)(chunks.size() - 1);
+	row = (uint32_t)last.count;
+	entities(last)[row] = entity;
+	last.count++;
+}
+
+Entity Archetype::removeRow(uint32_t chunkIndex, uint32_t row) {
+	Chunk& last = chunks.back();
+	Chunk& target = chunks[chunkIndex];
+	size_t lastRow = last.count - 1;
+	Entity moved = { 0, 0 };
+
+	if (&last != &target || lastRow != row) {
+		moved = entities(last)[lastRow];
+		entities(target)[row] = moved;
+
+		for (int i = 0; i < maxComponentTypes; i++) {
+			if (has(i)) {
+				size_t size = componentTypes[i].size;
+				std::memcpy((char*)column(target, i) + size * row, (char*)column(last, i) + size * lastRow, size);
+			}
+		}
+	}
+
+	last.count--;
+
+	if (last.count == 0) {
+		::operator delete(last.allocation);
+		chunks.pop_back();
+	}
+
+	return moved;
+}
+
+World::World() : archetypes(), archetypesByMask(), records(), freeRecords(), chunkRefs(), liveEntities(0) {
+}
+
+World::~World() {
+}
+
+Archetype* World::archetypeFor(ComponentMask mask) {
+	std::unordered_map<ComponentMask, Archetype*>::iterator found = archetypesByMask.find(mask);
+
+	if (found != archetypesByMask.end()) {
+		return found->second;
+	}
+
+	archetypes.push_back(std::unique_ptr<Archetype>(new Archetype(mask)));
+	archetypesByMask[mask] = archetypes.back().get();
+
+	return archetypes.back().get();
+}
+
+Entity World::createWithMask(ComponentMask mask) {
+	uint32_t index;
+
+	if (!freeRecords.empty()) {
+		index = freeRecords.back();
+		freeRecords.pop_back();
+	}
+	else {
+		index = (uint32_t)records.size();
+		Record record = { NULL, 0, 0, 1 };
+		records.push_back(record);
+	}
+
+	Record& record = records[index];
+	Entity entity = { index, record.generation };
+
+	record.archetype = archetypeFor(mask);
+	record.archetype->pushRow(entity, record.chunk, record.row);
+	liveEntities++;
+
+	return entity;
+}
+
+void World::removeFromArchetype(const Record& record) {
+	Entity moved = record.archetype->removeRow(record.chunk, record.row);
+
+	if (moved.generation != 0) {
+		records[moved.index].chunk = record.chunk;
+		records[moved.index].row = record.row;
+	}
+}
+
+bool World::isAlive(Entity entity) const {
+	return entity.index < records.size() && records[entity.index].generation == entity.generation && records[entity.index].archetype != NULL;
+}
+
+void World::destroy(Entity entity) {
+	if (!isAlive(entity)) {
+		return;
+	}
+
+	Record& record = records[entity.index];
+
+	removeFromArchetype(record);
+
+	record.archetype = NULL;
+	record.generation = record.generation + 1 == 0 ? 1 : record.generation + 1;
+	freeRecords.push_back(entity.index);
+	liveEntities--;
+}
+
+void* World::componentData(Entity entity, int component) {
+	if (!isAlive(entity)) {
+		return NULL;
+	}
+
+	const Record& record = records[entity.index];
+
+	if (!record.archetype->has(component)) {
+		return NULL;
+	}
+
+	Archetype::Chunk& chunk = record.archetype->chunk(record.chunk);
+
+	return (char*)record.archetype->column(chunk, component) + componentTypes[component].size * record.row;
+}
+
+bool World::changeMask(Entity entity, int component, bool adding) {
+	if (!isAlive(entity)) {
+		return false;
+	}
+
+	Record& record = records[entity.index];
+	Archetype* from = record.archetype;
+	ComponentMask bit = (ComponentMask)1 << component;
+	ComponentMask mask = adding ? from->mask() | bit : from->mask() & ~bit;
+
+	if (mask == from->mask()) {
+		return adding;
+	}
+
+	Archetype* to = archetypeFor(mask);
+	uint32_t chunkIndex;
+	uint32_t row;
+
+	to->pushRow(entity, chunkIndex, row);
+
+	// Copy what both archetypes share; an added component is written by the caller.
+	Archetype::Chunk& source = from->chunk(record.chunk);
+	Archetype::Chunk& target = to->chunk(chunkIndex);
+
+	for (int i = 0; i < maxComponentTypes; i++) {
+		if (from->has(i) && to->has(i)) {
+			size_t size = componentTypes[i].size;
+			std::memcpy((char*)to->column(target, i) + size * row, (char*)from->column(source, i) + size * record.row, size);
+		}
+	}
+
+	removeFromArchetype(record);
+
+	record.archetype = to;
+	record.chunk = chunkIndex;
+	record.row = row;
+
+	return true;
+}
+
+void World::gatherChunks(ComponentMask required) {
+	chunkRefs.clear();
+
+	for (size_t a = 0; a < archetypes.size(); a++) {
+		if ((archetypes[a]->mask() & required) != required) {
+			continue;
+		}
+
+		for (size_t c = 0; c < archetypes[a]->chunkCount(); c++) {
+			ChunkRef ref = { archetypes[a].get(), c };
+			chunkRefs.push_back(ref);
+		}
+	}
+}
+
+size_t World::entityCount() const {
+	return liveEntities;
+}
+
+size_t World::archetypeCount() const {
+	return archetypes.size();
+}
+
+size_t World::chunkCount() const {
+	size_t count = 0;
+
+	for (size_t i = 0; i < archetypes.size(); i++) {
+		count += archetypes[i]->chunkCount();
+	}
+
+	return count;
+}
@@ -0,0 +1,211 @@
+#ifndef CUSTOM_ECS_H
+#define CUSTOM_ECS_H
+
+#include "jobsystem.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+typedef uint64_t ComponentMask;
+
+static const int maxComponentTypes = 64;
+
+struct Entity {
+	uint32_t index;
+	uint32_t generation;
+};
+
+// Ids are handed out on first use of a type, in no particular order.
+int registerComponentType(size_t size, size_t alignment);
+
+template <typename T>
+int componentId() {
+	static_assert(std::is_trivially_copyable<T>::value, "components are moved with memcpy");
+	static const int id = registerComponentType(sizeof(T), alignof(T));
+	return id;
+}
+
+template <typename... Ts>
+ComponentMask componentMask() {
+	ComponentMask mask = 0;
+	int ids[] = { 0, componentId<Ts>()... };
+
+	for (size_t i = 1; i < sizeof(ids) / sizeof(ids[0]); i++) {
+		mask |= (ComponentMask)1 << ids[i];
+	}
+
+	return mask;
+}
+
+// All entities with exactly one set of component types. Entities live in
+// fixed-size chunks; inside a chunk every component type has its own
+// contiguous array, so a query walks memory linearly. Chunks and columns
+// start on a cache line (or the component's alignment, when larger), so
+// columns never share a line and lanes working on different chunks never
+// write to the same one.
+class Archetype {
+public:
+	static const size_t chunkBytes = 16 * 1024;
+	static const size_t cacheLine = 64;
+
+	struct Chunk {
+		// Aligned to cacheLine inside allocation.
+		char* data;
+		char* allocation;
+		size_t count;
+	};
+
+	Archetype(ComponentMask mask);
+	~Archetype();
+
+	Archetype(const Archetype&) = delete;
+	Archetype& operator=(const Archetype&) = delete;
+
+	ComponentMask mask() const;
+	size_t capacity() const;
+	size_t chunkCount() const;
+	Chunk& chunk(size_t index);
+
+	bool has(int component) const;
+	Entity* entities(const Chunk& chunk) const;
+	void* column(const Chunk& chunk, int component) const;
+
+	// Appends an uninitialized row and returns its chunk and row.
+	void pushRow(Entity entity, uint32_t& chunkIndex, uint32_t& row);
+
+	// Fills the hole with the last row; returns the entity moved into it, or
+	// one with generation 0 when the removed row was the last.
+	Entity removeRow(uint32_t chunkIndex, uint32_t row);
+
+private:
+	ComponentMask componentMask;
+	size_t rowsPerChunk;
+	size_t bytesPerChunk;
+	// Of chunk data and every column: the cache line or the largest component alignment.
+	size_t chunkAlignment;
+	size_t offsets[maxComponentTypes];
+	std::vector<Chunk> chunks;
+};
+
+// Entity storage grouped by archetype. Structural changes (create, destroy,
+// add, remove) must not happen while a query is running.
+class World {
+public:
+	World();
+	~World();
+
+	World(const World&) = delete;
+	World& operator=(const World&) = delete;
+
+	template <typename... Ts>
+	Entity create(const Ts&... components) {
+		Entity entity = createWithMask(componentMask<Ts...>());
+		int ids[] = { 0, (std::memcpy(componentData(entity, componentId<Ts>()), &components, sizeof(Ts)), 0)... };
+		(void)ids;
+		return entity;
+	}
+
+	void destroy(Entity entity);
+	bool isAlive(Entity entity) const;
+
+	// NULL when the entity is dead or lacks T. Valid until the next structural change.
+	template <typename T>
+	T* get(Entity entity) {
+		return (T*)componentData(entity, componentId<T>());
+	}
+
+	template <typename T>
+	void add(Entity entity, const T& component) {
+		if (changeMask(entity, componentId<T>(), true)) {
+			std::memcpy(componentData(entity, componentId<T>()), &component, sizeof(T));
+		}
+	}
+
+	template <typename T>
+	void remove(Entity entity) {
+		changeMask(entity, componentId<T>(), false);
+	}
+
+	// fn(count, entities, Ts* arrays...) per chunk holding all of Ts.
+	template <typename... Ts, typename Function>
+	void eachChunk(Function fn) {
+		ComponentMask required = componentMask<Ts...>();
+
+		for (size_t a = 0; a < archetypes.size(); a++) {
+			Archetype& archetype = *archetypes[a];
+
+			if ((archetype.mask() & required) != required) {
+				continue;
+			}
+
+			for (size_t c = 0; c < archetype.chunkCount(); c++) {
+				Archetype::Chunk& chunk = archetype.chunk(c);
+				fn(chunk.count, archetype.entities(chunk), (Ts*)archetype.column(chunk, componentId<Ts>())...);
+			}
+		}
+	}
+
+	// fn(Ts&...) per entity holding all of Ts.
+	template <typename... Ts, typename Function>
+	void each(Function fn) {
+		eachChunk<Ts...>([&fn](size_t count, const Entity*, Ts*... arrays) {
+			for (size_t i = 0; i < count; i++) {
+				fn(arrays[i]...);
+			}
+		});
+	}
+
+	// Like eachChunk(), with chunks spread over the job system's lanes:
+	// fn(lane, count, entities, Ts* arrays...).
+	template <typename... Ts, typename Function>
+	void parallelEachChunk(JobSystem& jobs, Function fn) {
+		gatherChunks(componentMask<Ts...>());
+
+		const std::vector<ChunkRef>& refs = chunkRefs;
+
+		jobs.parallelFor(refs.size(), 1, [&](size_t begin, size_t end, int lane) {
+			for (size_t i = begin; i < end; i++) {
+				Archetype& archetype = *refs[i].archetype;
+				Archetype::Chunk& chunk = archetype.chunk(refs[i].chunk);
+				fn(lane, chunk.count, archetype.entities(chunk), (Ts*)archetype.column(chunk, componentId<Ts>())...);
+			}
+		});
+	}
+
+	size_t entityCount() const;
+	size_t archetypeCount() const;
+	size_t chunkCount() const;
+
+private:
+	struct Record {
+		Archetype* archetype;
+		uint32_t chunk;
+		uint32_t row;
+		uint32_t generation;
+	};
+
+	struct ChunkRef {
+		Archetype* archetype;
+		size_t chunk;
+	};
+
+	Entity createWithMask(ComponentMask mask);
+	void* componentData(Entity entity, int component);
+	bool changeMask(Entity entity, int component, bool adding);
+	Archetype* archetypeFor(ComponentMask mask);
+	void removeFromArchetype(const Record& record);
+	void gatherChunks(ComponentMask required);
+
+	std::vector<std::unique_ptr<Archetype> > archetypes;
+	std::unordered_map<ComponentMask, Archetype*> archetypesByMask;
+	std::vector<Record> records;
+	std::vector<uint32_t> freeRecords;
+	std::vector<ChunkRef> chunkRefs;
+	size_t liveEntities;
+};
+
+#endif // !CUSTOM_ECS_H
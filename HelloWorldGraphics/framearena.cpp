@@ -0,0 +1,325 @@
+#include "framearena.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+LinearArena::LinearArena(size_t initialSize)
+	: chunks(), currentChunk(0), head(0), used(0), allocations(0), heapCount(0) {
+	chunks.reserve(16);
+	addChunk(std::max(initialSize, (size_t)4096));
+}
+
+LinearArena::~LinearArena() {
+	for (size_t i = 0; i < chunks.size(); i++) {
+		::operator delete(chunks[i].data);
+	}
+}
+
+void LinearArena::addChunk(size_t size) {
+	Chunk chunk = { (char*)::operator new(size), size };
+	chunks.push_back(chunk);
+	heapCount++;
+}
+
+void* LinearArena::allocate(size_t size, size_t alignment) {
+	if (alignment == 0) {
+		alignment = 1;
+	}
+
+	for (;;) {
+		Chunk& chunk = chunks[currentChunk];
+		uintptr_t base = (uintptr_t)chunk.data;
+		uintptr_t start = (base + head + alignment - 1) / alignment * alignment;
+
+		if (start + size <= base + chunk.size) {
+			used += (size_t)(start + size - base) - head;
+			head = (size_t)(start + size - base);
+			allocations++;
+
+			return (void*)start;
+		}
+
+		if (currentChunk + 1 == chunks.size()) {
+			addChunk(std::max(chunk.size * 2, size + alignment));
+		}
+
+		currentChunk++;
+		head = 0;
+	}
+}
+
+void LinearArena::reset() {
+	if (chunks.size() > 1) {
+		size_t total = capacity();
+
+		for (size_t i = 0; i < chunks.size(); i++) {
+			::operator delete(chunks[i].data);
+		}
+
+		chunks.clear();
+		addChunk(total);
+	}
+
+	currentChunk = 0;
+	head = 0;
+	used = 0;
+	allocations = 0;
+}
+
+size_t LinearArena::bytesUsed() const {
+	return used;
+}
+
+size_t LinearArena::allocationCount() const {
+	return allocations;
+}
+
+size_t LinearArena::capacity() const {
+	size_t total = 0;
+
+	for (size_t i = 0; i < chunks.size(); i++) {
+		total += chunks[i].size;
+	}
+
+	return total;
+}
+
+size_t LinearArena::heapAllocations() const {
+	return heapCount;
+}
+
+static std::atomic<unsigned int> lastGeneration(0);
+
+// Slots belong to one FrameArena; each thread caches its slot in the last
+// few arenas it allocated from, keyed by their generation.
+struct ThreadSlot {
+	unsigned int generation;
+	int slot;
+};
+
+static const int cachedSlots = 4;
+static thread_local ThreadSlot threadSlots[cachedSlots] = {};
+static thread_local int nextCachedSlot = 0;
+
+FrameArena::FrameArena(size_t bytesPerThread)
+	: initialSize(bytesPerThread), generation(++lastGeneration), nextThreadSlot(0), current(0), heapAtFrameStart(0), finished() {
+	finished.bytes = 0;
+	finished.allocations = 0;
+	finished.heapAllocations = 0;
+}
+
+LinearArena* FrameArena::threadArena() {
+	int threadSlot = -1;
+
+	for (int i = 0; i < cachedSlots; i++) {
+		if (threadSlots[i].generation == generation) {
+			threadSlot = threadSlots[i].slot;
+			break;
+		}
+	}
+
+	if (threadSlot < 0) {
+		threadSlot = nextThreadSlot++;
+
+		ThreadSlot& cached = threadSlots[nextCachedSlot];
+		cached.generation = generation;
+		cached.slot = threadSlot;
+		nextCachedSlot = (nextCachedSlot + 1) % cachedSlots;
+
+		if (threadSlot >= maxThreads) {
+			std::cerr << "ERROR::FRAME_ARENA::TOO_MANY_THREADS" << std::endl;
+		}
+	}
+
+	if (threadSlot >= maxThreads) {
+		return NULL;
+	}
+
+	std::unique_ptr<LinearArena>& arena = arenas[current][threadSlot];
+
+	if (!arena) {
+		arena.reset(new LinearArena(initialSize));
+	}
+
+	return arena.get();
+}
+
+FrameArenaStats FrameArena::endFrame() {
+	FrameArenaStats stats = { 0, 0, 0 };
+
+	for (int i = 0; i < maxThreads; i++) {
+		if (arenas[current][i]) {
+			stats.bytes += arenas[current][i]->bytesUsed();
+			stats.allocations += arenas[current][i]->allocationCount();
+		}
+	}
+
+	current = 1 - current;
+
+	// The buffer coming up held the frame before last; nothing may read it any more.
+	for (int i = 0; i < maxThreads; i++) {
+		if (arenas[current][i]) {
+			arenas[current][i]->reset();
+		}
+	}
+
+	// Includes chunks merged by the resets above.
+	size_t heap = 0;
+
+	for (int buffer = 0; buffer < 2; buffer++) {
+		for (int i = 0; i < maxThreads; i++) {
+			if (arenas[buffer][i]) {
+				heap += arenas[buffer][i]->heapAllocations();
+			}
+		}
+	}
+
+	stats.heapAllocations = heap - heapAtFrameStart;
+	heapAtFrameStart = heap;
+	finished = stats;
+
+	return stats;
+}
+
+FrameArenaStats FrameArena::lastFrame() const {
+	return finished;
+}
+
+struct BenchDrawItem {
+	uint64_t key;
+	unsigned int drawIndex;
+};
+
+static bool operator<(const BenchDrawItem& a, const BenchDrawItem& b) {
+	return a.key < b.key;
+}
+
+// Sort keys as a renderer would build them: pass, material, depth.
+template <typename Vector>
+static void buildDrawList(Vector& items, int worker, int frame, size_t count) {
+	unsigned int seed = (unsigned int)(worker * 7919 + frame * 104729);
+
+	items.reserve(count);
+
+	for (size_t i = 0; i < count; i++) {
+		seed = seed * 1664525u + 1013904223u;
+
+		BenchDrawItem item;
+		item.key = ((uint64_t)(seed >> 29) << 56) | ((uint64_t)((seed >> 8) & 0xFFF) << 32) | (seed & 0xFFFFFF);
+		item.drawIndex = (unsigned int)i;
+		items.push_back(item);
+	}
+
+	std::sort(items.begin(), items.end());
+}
+
+int runFrameArenaBenchmark(int frames, int workers) {
+	const size_t itemsPerWorker = 16384;
+
+	FrameArena arena(itemsPerWorker * sizeof(BenchDrawItem));
+	std::mutex mutex;
+	std::condition_variable frameStarted;
+	std::condition_variable frameDone;
+	int frameIndex = -1;
+	int finishedWorkers = 0;
+	bool useArena = false;
+	bool quit = false;
+	std::atomic<unsigned long long> checksum(0);
+	std::vector<std::thread> threads;
+
+	// Persistent workers; each frame they build and sort one draw list.
+	for (int w = 0; w < workers; w++) {
+		threads.push_back(std::thread([&, w]() {
+			int seen = -1;
+
+			for (;;) {
+				bool arenaFrame;
+
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					frameStarted.wait(lock, [&]() { return quit || frameIndex != seen; });
+
+					if (quit) {
+						return;
+					}
+
+					seen = frameIndex;
+					arenaFrame = useArena;
+				}
+
+				LinearArena* threadArena = arenaFrame ? arena.threadArena() : NULL;
+
+				if (threadArena != NULL) {
+					FrameVector<BenchDrawItem> items{ ArenaAllocator<BenchDrawItem>(*threadArena) };
+					buildDrawList(items, w, seen, itemsPerWorker);
+					checksum += items.front().drawIndex;
+				}
+				else {
+					std::vector<BenchDrawItem> items;
+					buildDrawList(items, w, seen, itemsPerWorker);
+					checksum += items.front().drawIndex;
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+
+				if (++finishedWorkers == workers) {
+					frameDone.notify_one();
+				}
+			}
+		}));
+	}
+
+	std::cout << "FRAME ARENA BENCHMARK " << frames << " frames, " << workers << " workers, " << itemsPerWorker << " draw items each" << std::endl;
+
+	double milliseconds[2] = { 0.0, 0.0 };
+	size_t steadyHeapAllocations = 0;
+	size_t arenaBytes = 0;
+
+	for (int pass = 0; pass < 2; pass++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		for (int frame = 0; frame < frames; frame++) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				useArena = pass == 1;
+				finishedWorkers = 0;
+				frameIndex = pass * frames + frame;
+				frameStarted.notify_all();
+				frameDone.wait(lock, [&]() { return finishedWorkers == workers; });
+			}
+
+			if (pass == 1) {
+				FrameArenaStats stats = arena.endFrame();
+				arenaBytes = stats.bytes;
+
+				// Both buffers have grown to size after the first few frames.
+				if (frame >= 4) {
+					steadyHeapAllocations += stats.heapAllocations;
+				}
+			}
+		}
+
+		milliseconds[pass] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+		frameStarted.notify_all();
+	}
+
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+
+	std::cout << "std::vector: " << milliseconds[0] << " ms per frame" << std::endl;
+	std::cout << "frame arena: " << milliseconds[1] << " ms per frame, " << arenaBytes / 1024 << " KB per frame, "
+		<< steadyHeapAllocations << " heap allocations after warm-up (checksum " << checksum << ")" << std::endl;
+
+	return steadyHeapAllocations == 0 ? 0 : 1;
+}
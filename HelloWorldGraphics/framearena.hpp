@@ -0,0 +1,152 @@
+#ifndef CUSTOM_FRAMEARENA_H
+#define CUSTOM_FRAMEARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocator over heap chunks. Individual allocations are never freed;
+// reset() releases everything at once. When a frame needed more than one
+// chunk, reset() replaces them with a single chunk of the combined size, so
+// after a few frames of a steady workload the arena stops touching the heap.
+class LinearArena {
+public:
+	LinearArena(size_t initialSize);
+	~LinearArena();
+
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	// Never returns NULL; grows by a new chunk when the current one is full.
+	void* allocate(size_t size, size_t alignment);
+
+	template <typename T>
+	T* allocateArray(size_t count) {
+		return (T*)allocate(sizeof(T) * count, alignof(T));
+	}
+
+	void reset();
+
+	// Since the last reset.
+	size_t bytesUsed() const;
+	size_t allocationCount() const;
+
+	size_t capacity() const;
+	// Chunks taken from the heap over the arena's lifetime.
+	size_t heapAllocations() const;
+
+private:
+	struct Chunk {
+		char* data;
+		size_t size;
+	};
+
+	void addChunk(size_t size);
+
+	std::vector<Chunk> chunks;
+	size_t currentChunk;
+	size_t head;
+	size_t used;
+	size_t allocations;
+	size_t heapCount;
+};
+
+// STL allocator drawing from a LinearArena. deallocate() is a no-op, so a
+// growing container leaves its old storage behind until the arena resets;
+// reserve up front where the size is known.
+template <typename T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+
+	ArenaAllocator(LinearArena& arena) : arena(&arena) {
+	}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.source()) {
+	}
+
+	T* allocate(size_t count) {
+		return arena->allocateArray<T>(count);
+	}
+
+	void deallocate(T*, size_t) {
+	}
+
+	LinearArena* source() const {
+		return arena;
+	}
+
+private:
+	LinearArena* arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+	return a.source() == b.source();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+	return a.source() != b.source();
+}
+
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T> >;
+
+struct FrameArenaStats {
+	size_t bytes;
+	size_t allocations;
+	// Chunks taken from the heap during the frame; 0 in the steady state.
+	size_t heapAllocations;
+};
+
+// Per-frame scratch memory, double-buffered: data allocated during frame N
+// stays valid through frame N + 1, for consumers running a frame behind.
+// Every thread gets its own sub-arena, found through a thread-local slot, so
+// workers allocate without locking. endFrame() must be called while no
+// thread is allocating.
+//
+// Every FrameArena has maxThreads slots of its own, taken by threads on
+// their first allocation and kept for the arena's lifetime, so at most
+// maxThreads distinct threads can use one arena; keep workers persistent
+// rather than spawning a thread per task. A thread remembers its slots in
+// the last few arenas it used and takes a new one when it comes back to an
+// arena it has forgotten.
+class FrameArena {
+public:
+	static const int maxThreads = 32;
+
+	FrameArena(size_t bytesPerThread);
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	// The calling thread's arena for this frame; NULL once the slots are used
+	// up, in which case the caller has to allocate elsewhere.
+	LinearArena* threadArena();
+
+	// Flips to the other buffer and resets it. Returns the finished frame's counters.
+	FrameArenaStats endFrame();
+
+	FrameArenaStats lastFrame() const;
+
+private:
+	size_t initialSize;
+	// Distinguishes this FrameArena from others in threads' cached slots.
+	unsigned int generation;
+	std::atomic<int> nextThreadSlot;
+	int current;
+	size_t heapAtFrameStart;
+	FrameArenaStats finished;
+	std::unique_ptr<LinearArena> arenas[2][maxThreads];
+};
+
+// Builds and sorts per-worker draw lists of sort keys each frame, once in
+// fresh std::vectors and once in FrameVectors on the frame arena, and prints
+// frame times and the arena's heap allocations once warmed up. Returns 0 on
+// success.
+int runFrameArenaBenchmark(int frames, int workers);
+
+#endif // !CUSTOM_FRAMEARENA_H
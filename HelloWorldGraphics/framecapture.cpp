@@ -0,0 +1,195 @@
+#include "framecapture.hpp"
+#include <GL/glew.h>
+#include <cstring>
+#include <iostream>
+
+FrameCapture::FrameCapture(int width, int height, int ringSize, const WriteFunction& write)
+	: width(width), height(height), frameBytes((size_t)width * height * 4), slots(ringSize), nextSlot(0), frameCounter(0),
+	stallCount(0), write(write), writing(false), stopping(false) {
+	for (size_t i = 0; i < slots.size(); i++) {
+		Slot& slot = slots[i];
+
+		glGenBuffers(1, &slot.pixelBuffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, NULL, GL_STREAM_READ);
+
+		slot.fence = NULL;
+		slot.frameIndex = 0;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// Two images per slot lets the writer fall a full ring behind before the render thread waits.
+	for (size_t i = 0; i < slots.size() * 2; i++) {
+		images.push_back(std::unique_ptr<Image>(new Image()));
+		images.back()->width = width;
+		images.back()->height = height;
+		images.back()->pixels.resize(frameBytes);
+		freeImages.push_back(images.back().get());
+	}
+
+	writer = std::thread(&FrameCapture::writerLoop, this);
+}
+
+FrameCapture::~FrameCapture() {
+	finish();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	wake.notify_all();
+	writer.join();
+
+	for (size_t i = 0; i < slots.size(); i++) {
+		glDeleteBuffers(1, &slots[i].pixelBuffer);
+	}
+}
+
+void FrameCapture::capture(unsigned int framebuffer) {
+	Slot& slot = slots[nextSlot];
+
+	if (slot.fence != NULL) {
+		stallCount++;
+
+		while (!busySlots.empty() && busySlots.front() != nextSlot) {
+			collect(slots[busySlots.front()], true);
+			busySlots.pop_front();
+		}
+
+		collect(slot, true);
+		busySlots.pop_front();
+	}
+
+	int previousReadFramebuffer = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousReadFramebuffer);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadBuffer(framebuffer == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previousReadFramebuffer);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frameIndex = frameCounter++;
+	busySlots.push_back(nextSlot);
+	nextSlot = (nextSlot + 1) % slots.size();
+
+	// Hand over whatever already finished, oldest first so frames reach the writer in order.
+	while (!busySlots.empty() && collect(slots[busySlots.front()], false)) {
+		busySlots.pop_front();
+	}
+}
+
+bool FrameCapture::collect(Slot& slot, bool wait) {
+	GLsync fence = (GLsync)slot.fence;
+	GLenum status = glClientWaitSync(fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, 0);
+
+	while (wait && status == GL_TIMEOUT_EXPIRED) {
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	}
+
+	// The pack may still be writing the buffer, so wait for everything instead.
+	if (wait && status == GL_WAIT_FAILED) {
+		std::cerr << "ERROR::FRAME_CAPTURE::FENCE_WAIT_FAILED" << std::endl;
+		glFinish();
+		status = GL_ALREADY_SIGNALED;
+	}
+
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+		return false;
+	}
+
+	glDeleteSync(fence);
+	slot.fence = NULL;
+
+	Image* image = NULL;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (freeImages.empty()) {
+			stallCount++;
+			wake.wait(lock, [this] { return !freeImages.empty(); });
+		}
+
+		image = freeImages.back();
+		freeImages.pop_back();
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+	void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+
+	if (pixels != NULL) {
+		std::memcpy(image->pixels.data(), pixels, frameBytes);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else {
+		std::cerr << "ERROR::FRAME_CAPTURE::MAP_FAILED" << std::endl;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (pixels != NULL) {
+			PendingWrite pending = { slot.frameIndex, image };
+			queue.push_back(pending);
+		}
+		else {
+			freeImages.push_back(image);
+		}
+	}
+
+	wake.notify_all();
+	return true;
+}
+
+void FrameCapture::writerLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;) {
+		wake.wait(lock, [this] { return stopping || !queue.empty(); });
+
+		if (queue.empty()) {
+			return;
+		}
+
+		PendingWrite pending = queue.front();
+		queue.pop_front();
+		writing = true;
+		lock.unlock();
+
+		flipRows(*pending.image);
+		write(pending.frameIndex, *pending.image);
+
+		lock.lock();
+		writing = false;
+		freeImages.push_back(pending.image);
+		wake.notify_all();
+	}
+}
+
+void FrameCapture::finish() {
+	while (!busySlots.empty()) {
+		collect(slots[busySlots.front()], true);
+		busySlots.pop_front();
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	wake.wait(lock, [this] { return queue.empty() && !writing; });
+}
+
+unsigned long long FrameCapture::capturedFrames() const {
+	return frameCounter;
+}
+
+unsigned long long FrameCapture::stalls() const {
+	return stallCount;
+}
@@ -0,0 +1,77 @@
+#ifndef CUSTOM_FRAMECAPTURE_H
+#define CUSTOM_FRAMECAPTURE_H
+
+#include "image.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Captures frames without stalling the render thread. capture() only queues
+// glReadPixels into the next pixel pack buffer of a ring and fences it; the
+// buffer is mapped once the fence has signalled, normally ringSize frames
+// later, and the pixels are handed to a writer thread. Images are recycled
+// so steady-state capturing does not allocate.
+class FrameCapture {
+public:
+	typedef std::function<void(unsigned long long frameIndex, const Image& image)> WriteFunction;
+
+	FrameCapture(int width, int height, int ringSize, const WriteFunction& write);
+	~FrameCapture();
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	// Reads GL_BACK of the default framebuffer (0) or GL_COLOR_ATTACHMENT0 of framebuffer.
+	void capture(unsigned int framebuffer);
+
+	// Blocks until every captured frame has been written.
+	void finish();
+
+	unsigned long long capturedFrames() const;
+
+	// Times the render thread had to wait for a fence or the writer.
+	unsigned long long stalls() const;
+
+private:
+	struct Slot {
+		unsigned int pixelBuffer;
+		void* fence;
+		unsigned long long frameIndex;
+	};
+
+	struct PendingWrite {
+		unsigned long long frameIndex;
+		Image* image;
+	};
+
+	// Hands the slot's pixels to the writer once its fence has signalled and
+	// returns true. With wait it always does, falling back to glFinish() when
+	// the fence cannot be waited on.
+	bool collect(Slot& slot, bool wait);
+	void writerLoop();
+
+	int width;
+	int height;
+	size_t frameBytes;
+	std::vector<Slot> slots;
+	std::deque<size_t> busySlots;
+	size_t nextSlot;
+	unsigned long long frameCounter;
+	unsigned long long stallCount;
+
+	WriteFunction write;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<PendingWrite> queue;
+	std::vector<Image*> freeImages;
+	std::vector<std::unique_ptr<Image> > images;
+	bool writing;
+	bool stopping;
+};
+
+#endif // !CUSTOM_FRAMECAPTURE_H
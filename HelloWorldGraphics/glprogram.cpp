@@ -0,0 +1,98 @@
+#include "glprogram.hpp"
+#include <iostream>
+
+unsigned int compileShader(GLenum type, const char* source) {
+	unsigned int shader = glCreateShader(type);
+
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	int success;
+
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+
+	if (!success) {
+		char info[512];
+		glGetShaderInfoLog(shader, 512, NULL, info);
+		std::cerr << "SHADER COMPILATION ERROR: " << info;
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+static unsigned int linkProgram(const unsigned int* shaders, int count, const char* const* varyings = NULL, int varyingCount = 0) {
+	unsigned int program = glCreateProgram();
+
+	for (int i = 0; i < count; i++) {
+		glAttachShader(program, shaders[i]);
+	}
+
+	if (varyingCount > 0) {
+		glTransformFeedbackVaryings(program, varyingCount, varyings, GL_INTERLEAVED_ATTRIBS);
+	}
+
+	glLinkProgram(program);
+
+	for (int i = 0; i < count; i++) {
+		glDeleteShader(shaders[i]);
+	}
+
+	int success;
+
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+	if (!success) {
+		char info[512];
+		glGetProgramInfoLog(program, 512, NULL, info);
+		std::cerr << "ERROR LINKING SHADER PROGRAM: " << info;
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+unsigned int createProgram(const char* vertexSource, const char* fragmentSource) {
+	unsigned int shaders[2];
+
+	shaders[0] = compileShader(GL_VERTEX_SHADER, vertexSource);
+	shaders[1] = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+
+	if (shaders[0] == 0 || shaders[1] == 0) {
+		glDeleteShader(shaders[0]);
+		glDeleteShader(shaders[1]);
+		return 0;
+	}
+
+	return linkProgram(shaders, 2);
+}
+
+unsigned int createComputeProgram(const char* computeSource) {
+	unsigned int shader = compileShader(GL_COMPUTE_SHADER, computeSource);
+
+	if (shader == 0) {
+		return 0;
+	}
+
+	return linkProgram(&shader, 1);
+}
+
+unsigned int createTransformFeedbackProgram(const char* vertexSource, const char* const* varyings, int varyingCount) {
+	unsigned int shader = compileShader(GL_VERTEX_SHADER, vertexSource);
+
+	if (shader == 0) {
+		return 0;
+	}
+
+	return linkProgram(&shader, 1, varyings, varyingCount);
+}
+
+unsigned int createDepthOnlyProgram(const char* vertexSource) {
+	static const char* emptyFragmentShaderSource = "#version 330 core\n"
+		"void main() {\n"
+		"}\0";
+
+	return createProgram(vertexSource, emptyFragmentShaderSource);
+}
@@ -0,0 +1,21 @@
+#ifndef CUSTOM_GLPROGRAM_H
+#define CUSTOM_GLPROGRAM_H
+
+#include <GL/glew.h>
+
+// Helpers for the internal programs used by the renderer modules. They report
+// errors on std::cerr and return 0 on failure.
+unsigned int compileShader(GLenum type, const char* source);
+
+unsigned int createProgram(const char* vertexSource, const char* fragmentSource);
+
+unsigned int createComputeProgram(const char* computeSource);
+
+// Vertex-only program capturing varyings interleaved, for transform feedback
+// with GL_RASTERIZER_DISCARD.
+unsigned int createTransformFeedbackProgram(const char* vertexSource, const char* const* varyings, int varyingCount);
+
+// Pairs a vertex shader with an empty fragment shader, for depth-only passes.
+unsigned int createDepthOnlyProgram(const char* vertexSource);
+
+#endif // !CUSTOM_GLPROGRAM_H
@@ -0,0 +1,103 @@
+#include "goldenrunner.hpp"
+#include <GL/glew.h>
+#include <iostream>
+
+static Image renderScene(const GoldenScene& scene, unsigned int framebuffer, int width, int height) {
+	Image image;
+	image.width = width;
+	image.height = height;
+	image.pixels.resize((size_t)width * height * 4);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+
+	scene.render();
+
+	// Regression runs favour simplicity over throughput, so this reads back synchronously.
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+	flipRows(image);
+
+	return image;
+}
+
+int runGoldenScenes(const std::vector<GoldenScene>& scenes, const std::string& directory, bool record,
+	int width, int height, const ImageCompareOptions& options) {
+	unsigned int framebuffer, color, depth;
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	glGenRenderbuffers(1, &color);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+	int failures = 0;
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "ERROR::GOLDEN::FRAMEBUFFER_INCOMPLETE" << std::endl;
+		failures = (int)scenes.size();
+	}
+
+	for (size_t i = 0; i < scenes.size() && failures == 0; i++) {
+		const GoldenScene& scene = scenes[i];
+		std::string goldenPath = directory + "/" + scene.name + ".ppm";
+		Image actual = renderScene(scene, framebuffer, width, height);
+
+		if (record) {
+			if (writePpm(goldenPath, actual)) {
+				std::cout << "[ RECORDED ] " << scene.name << std::endl;
+			}
+			else {
+				std::cerr << "ERROR::GOLDEN::WRITE_FAILED: " << goldenPath << std::endl;
+				failures++;
+			}
+
+			continue;
+		}
+
+		Image expected;
+
+		// A missing golden is a failure, not a skip, so a run against the wrong
+		// directory cannot pass. The render is kept for review and recording.
+		if (!readPpm(goldenPath, expected)) {
+			std::cerr << "ERROR::GOLDEN::MISSING: " << goldenPath << " (run with --record-golden to create it)" << std::endl;
+			std::cout << "[ MISSING ] " << scene.name << std::endl;
+			failures++;
+			writePpm(directory + "/" + scene.name + "_actual.ppm", actual);
+			continue;
+		}
+
+		Image diff;
+		ImageCompareResult result = compareImages(expected, actual, options, &diff);
+
+		std::cout << (result.passed ? "[ PASS ] " : "[ FAIL ] ") << scene.name
+			<< " ssim=" << result.ssim
+			<< " bad_pixels=" << result.badPixels
+			<< " max_difference=" << result.maxChannelDifference << std::endl;
+
+		if (!result.passed) {
+			failures++;
+			writePpm(directory + "/" + scene.name + "_actual.ppm", actual);
+
+			if (!diff.pixels.empty()) {
+				writePpm(directory + "/" + scene.name + "_diff.ppm", diff);
+			}
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &color);
+	glDeleteRenderbuffers(1, &depth);
+
+	return failures;
+}
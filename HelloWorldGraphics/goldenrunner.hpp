@@ -0,0 +1,24 @@
+#ifndef CUSTOM_GOLDENRUNNER_H
+#define CUSTOM_GOLDENRUNNER_H
+
+#include "imagecompare.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+// A named scene for the golden-image regression run. render draws one frame
+// into the bound framebuffer and is responsible for its own clear.
+struct GoldenScene {
+	std::string name;
+	std::function<void()> render;
+};
+
+// Renders every scene offscreen at width x height and compares it with
+// <directory>/<name>.ppm. Failures leave <name>_actual.ppm and <name>_diff.ppm
+// next to the golden; a missing golden fails and leaves <name>_actual.ppm.
+// With record set the goldens are (re)written instead. Returns the number of
+// failed scenes, including goldens that could not be read or written.
+int runGoldenScenes(const std::vector<GoldenScene>& scenes, const std::string& directory, bool record,
+	int width, int height, const ImageCompareOptions& options);
+
+#endif // !CUSTOM_GOLDENRUNNER_H
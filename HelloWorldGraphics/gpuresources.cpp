@@ -0,0 +1,279 @@
+#include "gpuresources.hpp"
+#include "glprogram.hpp"
+#include <iostream>
+
+static const uint32_t freeSlot = 0xFFFFFFFFu;
+static const uint32_t generationMask = 0xFFFu;
+
+GpuResourcePool::GpuResourcePool() : slots(), freeSlots(), dense(), denseSlots() {
+}
+
+uint32_t GpuResourcePool::insert(unsigned int name) {
+	uint32_t index;
+
+	if (!freeSlots.empty()) {
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else if (slots.size() < maxSlots) {
+		index = (uint32_t)slots.size();
+		Slot slot = { freeSlot, 1 };
+		slots.push_back(slot);
+	}
+	else {
+		std::cerr << "ERROR::GPURESOURCES::POOL_FULL" << std::endl;
+		return 0;
+	}
+
+	slots[index].dense = (uint32_t)dense.size();
+	dense.push_back(name);
+	denseSlots.push_back(index);
+
+	return (slots[index].generation << indexBits) | index;
+}
+
+uint32_t GpuResourcePool::find(uint32_t handle) const {
+	uint32_t index = handle & (maxSlots - 1);
+	uint32_t generation = handle >> indexBits;
+
+	if (handle == 0 || index >= slots.size() || slots[index].dense == freeSlot || slots[index].generation != generation) {
+		return maxSlots;
+	}
+
+	return index;
+}
+
+unsigned int GpuResourcePool::get(uint32_t handle) const {
+	uint32_t index = find(handle);
+
+	return index == maxSlots ? 0 : dense[slots[index].dense];
+}
+
+unsigned int GpuResourcePool::remove(uint32_t handle) {
+	uint32_t index = find(handle);
+
+	if (index == maxSlots) {
+		return 0;
+	}
+
+	uint32_t position = slots[index].dense;
+	unsigned int name = dense[position];
+
+	dense[position] = dense.back();
+	denseSlots[position] = denseSlots.back();
+	slots[denseSlots[position]].dense = position;
+	dense.pop_back();
+	denseSlots.pop_back();
+
+	// Generation 0 is skipped so that no handle is ever 0.
+	uint32_t generation = (slots[index].generation + 1) & generationMask;
+
+	slots[index].dense = freeSlot;
+	slots[index].generation = generation == 0 ? 1 : generation;
+	freeSlots.push_back(index);
+
+	return name;
+}
+
+size_t GpuResourcePool::size() const {
+	return dense.size();
+}
+
+const unsigned int* GpuResourcePool::names() const {
+	return dense.empty() ? NULL : &dense[0];
+}
+
+void deleteGpuNames(GpuResourceType type, const unsigned int* names, size_t count) {
+	if (count == 0) {
+		return;
+	}
+
+	switch (type) {
+	case GpuResourceType::Buffer:
+		glDeleteBuffers((GLsizei)count, names);
+		break;
+	case GpuResourceType::Texture:
+		glDeleteTextures((GLsizei)count, names);
+		break;
+	case GpuResourceType::VertexArray:
+		glDeleteVertexArrays((GLsizei)count, names);
+		break;
+	case GpuResourceType::Program:
+		for (size_t i = 0; i < count; i++) {
+			glDeleteProgram(names[i]);
+		}
+		break;
+	}
+}
+
+// Groups resources by type so each type costs one delete call.
+static void deletePending(const std::vector<unsigned int>* byType) {
+	for (int i = 0; i < gpuResourceTypeCount; i++) {
+		if (!byType[i].empty()) {
+			deleteGpuNames((GpuResourceType)i, &byType[i][0], byType[i].size());
+		}
+	}
+}
+
+GpuResourceManager::GpuResourceManager() : pools(), queued(), retired() {
+}
+
+GpuResourceManager::~GpuResourceManager() {
+	std::vector<unsigned int> byType[gpuResourceTypeCount];
+
+	for (size_t i = 0; i < retired.size(); i++) {
+		glDeleteSync((GLsync)retired[i].fence);
+
+		for (size_t j = 0; j < retired[i].resources.size(); j++) {
+			byType[(int)retired[i].resources[j].type].push_back(retired[i].resources[j].name);
+		}
+	}
+
+	for (size_t i = 0; i < queued.size(); i++) {
+		byType[(int)queued[i].type].push_back(queued[i].name);
+	}
+
+	deletePending(byType);
+
+	for (int i = 0; i < gpuResourceTypeCount; i++) {
+		deleteGpuNames((GpuResourceType)i, pools[i].names(), pools[i].size());
+	}
+}
+
+uint32_t GpuResourceManager::adopt(GpuResourceType type, unsigned int name) {
+	if (name == 0) {
+		return 0;
+	}
+
+	uint32_t handle = pools[(int)type].insert(name);
+
+	if (handle == 0) {
+		deleteGpuNames(type, &name, 1);
+	}
+
+	return handle;
+}
+
+BufferHandle GpuResourceManager::createBuffer(GLenum target, size_t size, const void* data, GLenum usage) {
+	unsigned int name;
+
+	glGenBuffers(1, &name);
+	glBindBuffer(target, name);
+	glBufferData(target, size, data, usage);
+
+	return adoptBuffer(name);
+}
+
+TextureHandle GpuResourceManager::createTexture2D(int width, int height, GLenum internalFormat, GLenum format, GLenum type) {
+	unsigned int name;
+
+	glGenTextures(1, &name);
+	glBindTexture(GL_TEXTURE_2D, name);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	return adoptTexture(name);
+}
+
+VertexArrayHandle GpuResourceManager::createVertexArray() {
+	unsigned int name;
+
+	glGenVertexArrays(1, &name);
+	glBindVertexArray(name);
+
+	return adoptVertexArray(name);
+}
+
+ProgramHandle GpuResourceManager::createProgram(const char* vertexSource, const char* fragmentSource) {
+	return adoptProgram(::createProgram(vertexSource, fragmentSource));
+}
+
+BufferHandle GpuResourceManager::adoptBuffer(unsigned int name) {
+	BufferHandle handle = { adopt(GpuResourceType::Buffer, name) };
+	return handle;
+}
+
+TextureHandle GpuResourceManager::adoptTexture(unsigned int name) {
+	TextureHandle handle = { adopt(GpuResourceType::Texture, name) };
+	return handle;
+}
+
+VertexArrayHandle GpuResourceManager::adoptVertexArray(unsigned int name) {
+	VertexArrayHandle handle = { adopt(GpuResourceType::VertexArray, name) };
+	return handle;
+}
+
+ProgramHandle GpuResourceManager::adoptProgram(unsigned int name) {
+	ProgramHandle handle = { adopt(GpuResourceType::Program, name) };
+	return handle;
+}
+
+void GpuResourceManager::queue(GpuResourceType type, unsigned int name) {
+	if (name != 0) {
+		Pending pending = { type, name };
+		queued.push_back(pending);
+	}
+}
+
+void GpuResourceManager::endFrame() {
+	if (!queued.empty()) {
+		Retired batch;
+		batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		batch.resources.swap(queued);
+		retired.push_back(batch);
+	}
+
+	collect();
+}
+
+void GpuResourceManager::collect() {
+	size_t done = 0;
+	std::vector<unsigned int> byType[gpuResourceTypeCount];
+
+	// Fences signal in submission order, so the first unsignalled one ends the scan.
+	for (; done < retired.size(); done++) {
+		GLsync fence = (GLsync)retired[done].fence;
+
+		GLenum status = glClientWaitSync(fence, 0, 0);
+
+		if (status == GL_WAIT_FAILED) {
+			// The batch stays fenced and is tried again next frame.
+			std::cerr << "ERROR::GPURESOURCES::FENCE_WAIT_FAILED" << std::endl;
+			break;
+		}
+
+		if (status == GL_TIMEOUT_EXPIRED) {
+			break;
+		}
+
+		glDeleteSync(fence);
+
+		for (size_t i = 0; i < retired[done].resources.size(); i++) {
+			byType[(int)retired[done].resources[i].type].push_back(retired[done].resources[i].name);
+		}
+	}
+
+	deletePending(byType);
+	retired.erase(retired.begin(), retired.begin() + done);
+}
+
+size_t GpuResourceManager::liveCount(GpuResourceType type) const {
+	return pools[(int)type].size();
+}
+
+const unsigned int* GpuResourceManager::liveNames(GpuResourceType type) const {
+	return pools[(int)type].names();
+}
+
+size_t GpuResourceManager::pendingCount() const {
+	size_t count = queued.size();
+
+	for (size_t i = 0; i < retired.size(); i++) {
+		count += retired[i].resources.size();
+	}
+
+	return count;
+}
@@ -0,0 +1,153 @@
+#ifndef CUSTOM_GPURESOURCES_H
+#define CUSTOM_GPURESOURCES_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class GpuResourceType {
+	Buffer,
+	Texture,
+	VertexArray,
+	Program
+};
+
+static const int gpuResourceTypeCount = 4;
+
+// 32-bit handle: the low 20 bits are a slot index, the high 12 bits the slot
+// generation. A destroyed handle stays stale until the slot generation wraps
+// around. The value 0 is never handed out and means no resource.
+template <GpuResourceType Type>
+struct GpuHandle {
+	uint32_t value;
+
+	bool isNull() const {
+		return value == 0;
+	}
+};
+
+typedef GpuHandle<GpuResourceType::Buffer> BufferHandle;
+typedef GpuHandle<GpuResourceType::Texture> TextureHandle;
+typedef GpuHandle<GpuResourceType::VertexArray> VertexArrayHandle;
+typedef GpuHandle<GpuResourceType::Program> ProgramHandle;
+
+// GL names of one resource type packed densely, with a slot table mapping
+// handles into the dense array. Removal swaps the last name into the hole.
+class GpuResourcePool {
+public:
+	static const uint32_t indexBits = 20;
+	static const uint32_t maxSlots = 1u << indexBits;
+
+	GpuResourcePool();
+
+	// Returns 0 when all slots are in use.
+	uint32_t insert(unsigned int name);
+
+	// Returns 0 for stale or null handles.
+	unsigned int get(uint32_t handle) const;
+
+	// Returns the removed name, or 0 for stale or null handles.
+	unsigned int remove(uint32_t handle);
+
+	size_t size() const;
+	const unsigned int* names() const;
+
+private:
+	struct Slot {
+		uint32_t dense;
+		uint32_t generation;
+	};
+
+	// Slot index of handle when it is live, maxSlots otherwise.
+	uint32_t find(uint32_t handle) const;
+
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
+	std::vector<unsigned int> dense;
+	std::vector<uint32_t> denseSlots;
+};
+
+// Owns buffers, textures, vertex arrays and programs behind generational
+// handles. destroy() invalidates the handle at once but only queues the GL
+// name; endFrame() fences everything queued during the frame, and the names
+// are deleted once that fence has signalled, so nothing the GPU may still
+// read goes away under it. Whatever is alive when the manager is destroyed
+// is deleted with it.
+class GpuResourceManager {
+public:
+	GpuResourceManager();
+	~GpuResourceManager();
+
+	GpuResourceManager(const GpuResourceManager&) = delete;
+	GpuResourceManager& operator=(const GpuResourceManager&) = delete;
+
+	// Leaves the new buffer bound to target.
+	BufferHandle createBuffer(GLenum target, size_t size, const void* data, GLenum usage);
+
+	// Uninitialized single-level texture; format and type are those glTexImage2D
+	// expects for internalFormat. Linear filtering, clamped to edge. Leaves the
+	// texture bound to GL_TEXTURE_2D.
+	TextureHandle createTexture2D(int width, int height, GLenum internalFormat, GLenum format, GLenum type);
+
+	// Leaves the new vertex array bound.
+	VertexArrayHandle createVertexArray();
+
+	ProgramHandle createProgram(const char* vertexSource, const char* fragmentSource);
+
+	// Takes ownership of names created elsewhere. Name 0 gives a null handle.
+	BufferHandle adoptBuffer(unsigned int name);
+	TextureHandle adoptTexture(unsigned int name);
+	VertexArrayHandle adoptVertexArray(unsigned int name);
+	ProgramHandle adoptProgram(unsigned int name);
+
+	// GL name behind handle, 0 if it is stale.
+	template <GpuResourceType Type>
+	unsigned int get(GpuHandle<Type> handle) const {
+		return pools[(int)Type].get(handle.value);
+	}
+
+	template <GpuResourceType Type>
+	bool isAlive(GpuHandle<Type> handle) const {
+		return get(handle) != 0;
+	}
+
+	template <GpuResourceType Type>
+	void destroy(GpuHandle<Type> handle) {
+		queue(Type, pools[(int)Type].remove(handle.value));
+	}
+
+	// Fences this frame's destructions and deletes those the GPU is done with.
+	void endFrame();
+
+	// Live names of one type, densely packed.
+	size_t liveCount(GpuResourceType type) const;
+	const unsigned int* liveNames(GpuResourceType type) const;
+
+	// Names destroyed but not yet deleted.
+	size_t pendingCount() const;
+
+private:
+	struct Pending {
+		GpuResourceType type;
+		unsigned int name;
+	};
+
+	struct Retired {
+		void* fence;
+		std::vector<Pending> resources;
+	};
+
+	uint32_t adopt(GpuResourceType type, unsigned int name);
+	void queue(GpuResourceType type, unsigned int name);
+	void collect();
+
+	GpuResourcePool pools[gpuResourceTypeCount];
+	std::vector<Pending> queued;
+	std::vector<Retired> retired;
+};
+
+// Deletes names of one type right away, batched into one GL call.
+void deleteGpuNames(GpuResourceType type, const unsigned int* names, size_t count);
+
+#endif // !CUSTOM_GPURESOURCES_H
@@ -0,0 +1,93 @@
+#include "gputimer.hpp"
+#include <GL/glew.h>
+
+GpuTimer::GpuTimer(int latency)
+	: startQueries(latency), endQueries(latency), writeIndex(0), readIndex(0), inFlight(0), measuring(false), skipped(false),
+	lastValue(0.0), totalValue(0.0), samples(0) {
+	glGenQueries(latency, startQueries.data());
+	glGenQueries(latency, endQueries.data());
+}
+
+GpuTimer::~GpuTimer() {
+	glDeleteQueries((GLsizei)startQueries.size(), startQueries.data());
+	glDeleteQueries((GLsizei)endQueries.size(), endQueries.data());
+}
+
+void GpuTimer::begin() {
+	if (inFlight == (int)startQueries.size()) {
+		poll();
+	}
+
+	skipped = inFlight == (int)startQueries.size();
+
+	if (skipped) {
+		return;
+	}
+
+	glQueryCounter(startQueries[writeIndex], GL_TIMESTAMP);
+	measuring = true;
+}
+
+void GpuTimer::end() {
+	if (!measuring) {
+		return;
+	}
+
+	glQueryCounter(endQueries[writeIndex], GL_TIMESTAMP);
+	measuring = false;
+	writeIndex = (writeIndex + 1) % (int)startQueries.size();
+	inFlight++;
+}
+
+bool GpuTimer::poll() {
+	bool collected = false;
+
+	while (inFlight > 0) {
+		GLint available = 0;
+		glGetQueryObjectiv(endQueries[readIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (!available) {
+			break;
+		}
+
+		GLuint64 start = 0;
+		GLuint64 stop = 0;
+
+		glGetQueryObjectui64v(startQueries[readIndex], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(endQueries[readIndex], GL_QUERY_RESULT, &stop);
+
+		lastValue = (double)(stop - start) / 1000000.0;
+		totalValue += lastValue;
+		samples++;
+		collected = true;
+
+		readIndex = (readIndex + 1) % (int)startQueries.size();
+		inFlight--;
+	}
+
+	return collected;
+}
+
+void GpuTimer::wait() {
+	while (inFlight > 0) {
+		glFinish();
+		poll();
+	}
+}
+
+double GpuTimer::lastMilliseconds() const {
+	return lastValue;
+}
+
+double GpuTimer::averageMilliseconds() const {
+	return samples > 0 ? totalValue / samples : 0.0;
+}
+
+unsigned int GpuTimer::sampleCount() const {
+	return samples;
+}
+
+void GpuTimer::resetAverage() {
+	totalValue = 0.0;
+	samples = 0;
+}
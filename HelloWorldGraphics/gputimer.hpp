@@ -0,0 +1,45 @@
+#ifndef CUSTOM_GPUTIMER_H
+#define CUSTOM_GPUTIMER_H
+
+#include <vector>
+
+// Measures GPU time between begin() and end() with timestamp queries. Up to
+// latency measurements can be in flight; results are collected by poll()
+// without waiting, and a begin() with every slot busy is skipped rather
+// than stalling. Timestamps make timers safe to nest.
+class GpuTimer {
+public:
+	GpuTimer(int latency);
+	~GpuTimer();
+
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+
+	void begin();
+	void end();
+
+	// Returns true when at least one new measurement arrived.
+	bool poll();
+
+	// Waits for every measurement in flight. Only for benchmarks and shutdown.
+	void wait();
+
+	double lastMilliseconds() const;
+	double averageMilliseconds() const;
+	unsigned int sampleCount() const;
+	void resetAverage();
+
+private:
+	std::vector<unsigned int> startQueries;
+	std::vector<unsigned int> endQueries;
+	int writeIndex;
+	int readIndex;
+	int inFlight;
+	bool measuring;
+	bool skipped;
+	double lastValue;
+	double totalValue;
+	unsigned int samples;
+};
+
+#endif // !CUSTOM_GPUTIMER_H
@@ -0,0 +1,88 @@
+#include "image.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+bool writePpm(const std::string& path, const Image& image) {
+	std::ofstream file(path.c_str(), std::ios::binary);
+
+	if (!file) {
+		std::cerr << "ERROR::IMAGE::FILE_NOT_SUCCESSFULLY_WRITTEN: " << path << std::endl;
+		return false;
+	}
+
+	file << "P6\n" << image.width << " " << image.height << "\n255\n";
+
+	std::vector<unsigned char> row((size_t)image.width * 3);
+
+	for (int y = 0; y < image.height; y++) {
+		const unsigned char* source = &image.pixels[(size_t)y * image.width * 4];
+
+		for (int x = 0; x < image.width; x++) {
+			row[x * 3] = source[x * 4];
+			row[x * 3 + 1] = source[x * 4 + 1];
+			row[x * 3 + 2] = source[x * 4 + 2];
+		}
+
+		file.write((const char*)row.data(), row.size());
+	}
+
+	return (bool)file;
+}
+
+static bool readPpmToken(std::istream& in, int& value) {
+	in >> std::ws;
+
+	// Header comments run to the end of the line.
+	while (in.peek() == '#') {
+		std::string comment;
+		std::getline(in, comment);
+		in >> std::ws;
+	}
+
+	return (bool)(in >> value);
+}
+
+bool readPpm(const std::string& path, Image& image) {
+	std::ifstream file(path.c_str(), std::ios::binary);
+	std::string magic;
+	int maxValue = 0;
+
+	file >> magic;
+
+	if (!file || magic != "P6" || !readPpmToken(file, image.width) || !readPpmToken(file, image.height) ||
+		!readPpmToken(file, maxValue) || maxValue != 255) {
+		std::cerr << "ERROR::IMAGE::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+		return false;
+	}
+
+	file.get();
+
+	std::vector<unsigned char> rgb((size_t)image.width * image.height * 3);
+	file.read((char*)rgb.data(), rgb.size());
+
+	if (!file) {
+		std::cerr << "ERROR::IMAGE::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+		return false;
+	}
+
+	image.pixels.resize((size_t)image.width * image.height * 4);
+
+	for (size_t i = 0; i < (size_t)image.width * image.height; i++) {
+		image.pixels[i * 4] = rgb[i * 3];
+		image.pixels[i * 4 + 1] = rgb[i * 3 + 1];
+		image.pixels[i * 4 + 2] = rgb[i * 3 + 2];
+		image.pixels[i * 4 + 3] = 255;
+	}
+
+	return true;
+}
+
+void flipRows(Image& image) {
+	size_t stride = (size_t)image.width * 4;
+
+	for (int top = 0, bottom = image.height - 1; top < bottom; top++, bottom--) {
+		std::swap_ranges(image.pixels.begin() + top * stride, image.pixels.begin() + (top + 1) * stride,
+			image.pixels.begin() + bottom * stride);
+	}
+}
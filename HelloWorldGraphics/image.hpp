@@ -0,0 +1,23 @@
+#ifndef CUSTOM_IMAGE_H
+#define CUSTOM_IMAGE_H
+
+#include <string>
+#include <vector>
+
+// Tightly packed RGBA8 pixels, first row at the top.
+struct Image {
+	int width;
+	int height;
+	std::vector<unsigned char> pixels;
+};
+
+// Binary PPM (P6) keeps captures and reference images dependency free.
+// Alpha is dropped on write and read back as 255.
+bool writePpm(const std::string& path, const Image& image);
+
+bool readPpm(const std::string& path, Image& image);
+
+// glReadPixels returns the bottom row first; this puts the top row first.
+void flipRows(Image& image);
+
+#endif // !CUSTOM_IMAGE_H
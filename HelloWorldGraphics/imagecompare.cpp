@@ -0,0 +1,125 @@
+#include "imagecompare.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+ImageCompareOptions defaultImageCompareOptions() {
+	ImageCompareOptions options;
+	options.channelTolerance = 8;
+	options.maxBadPixelRatio = 0.001;
+	options.minSsim = 0.98;
+	return options;
+}
+
+static std::vector<float> luminance(const Image& image) {
+	std::vector<float> result((size_t)image.width * image.height);
+
+	for (size_t i = 0; i < result.size(); i++) {
+		const unsigned char* p = &image.pixels[i * 4];
+		result[i] = 0.2126f * p[0] + 0.7152f * p[1] + 0.0722f * p[2];
+	}
+
+	return result;
+}
+
+// Mean SSIM over 8x8 windows stepping by 4 pixels, with the usual constants for 8-bit data.
+static double structuralSimilarity(const Image& expected, const Image& actual) {
+	const int window = 8;
+	const int step = 4;
+	const double c1 = (0.01 * 255) * (0.01 * 255);
+	const double c2 = (0.03 * 255) * (0.03 * 255);
+
+	std::vector<float> a = luminance(expected);
+	std::vector<float> b = luminance(actual);
+	int width = expected.width;
+	int height = expected.height;
+
+	if (width < window || height < window) {
+		return a == b ? 1.0 : 0.0;
+	}
+
+	double total = 0.0;
+	int windows = 0;
+
+	for (int y = 0; y + window <= height; y += step) {
+		for (int x = 0; x + window <= width; x += step) {
+			double sumA = 0.0, sumB = 0.0, sumAA = 0.0, sumBB = 0.0, sumAB = 0.0;
+
+			for (int wy = 0; wy < window; wy++) {
+				for (int wx = 0; wx < window; wx++) {
+					size_t index = (size_t)(y + wy) * width + x + wx;
+					double va = a[index];
+					double vb = b[index];
+
+					sumA += va;
+					sumB += vb;
+					sumAA += va * va;
+					sumBB += vb * vb;
+					sumAB += va * vb;
+				}
+			}
+
+			double n = window * window;
+			double meanA = sumA / n;
+			double meanB = sumB / n;
+			double varianceA = sumAA / n - meanA * meanA;
+			double varianceB = sumBB / n - meanB * meanB;
+			double covariance = sumAB / n - meanA * meanB;
+
+			total += ((2.0 * meanA * meanB + c1) * (2.0 * covariance + c2)) /
+				((meanA * meanA + meanB * meanB + c1) * (varianceA + varianceB + c2));
+			windows++;
+		}
+	}
+
+	return total / windows;
+}
+
+ImageCompareResult compareImages(const Image& expected, const Image& actual, const ImageCompareOptions& options, Image* diff) {
+	ImageCompareResult result = { false, 0, 1.0, 0.0, 255 };
+
+	if (expected.width != actual.width || expected.height != actual.height) {
+		return result;
+	}
+
+	size_t pixelCount = (size_t)expected.width * expected.height;
+
+	if (diff != NULL) {
+		diff->width = expected.width;
+		diff->height = expected.height;
+		diff->pixels.assign(pixelCount * 4, 255);
+	}
+
+	result.maxChannelDifference = 0;
+
+	for (size_t i = 0; i < pixelCount; i++) {
+		int difference = 0;
+
+		for (int c = 0; c < 3; c++) {
+			difference = std::max(difference, std::abs((int)expected.pixels[i * 4 + c] - (int)actual.pixels[i * 4 + c]));
+		}
+
+		bool bad = difference > options.channelTolerance;
+
+		if (bad) {
+			result.badPixels++;
+		}
+
+		result.maxChannelDifference = std::max(result.maxChannelDifference, difference);
+
+		if (diff != NULL) {
+			unsigned char* out = &diff->pixels[i * 4];
+			unsigned char amplified = (unsigned char)std::min(255, difference * 8);
+
+			out[0] = bad ? 255 : amplified;
+			out[1] = bad ? 0 : amplified;
+			out[2] = bad ? 0 : amplified;
+		}
+	}
+
+	result.badPixelRatio = pixelCount > 0 ? (double)result.badPixels / pixelCount : 0.0;
+	result.ssim = structuralSimilarity(expected, actual);
+	result.passed = result.badPixelRatio <= options.maxBadPixelRatio && result.ssim >= options.minSsim;
+
+	return result;
+}
@@ -0,0 +1,30 @@
+#ifndef CUSTOM_IMAGECOMPARE_H
+#define CUSTOM_IMAGECOMPARE_H
+
+#include "image.hpp"
+#include <cstddef>
+
+struct ImageCompareOptions {
+	// Largest per-channel difference a pixel may have and still count as equal.
+	int channelTolerance;
+	// Fraction of pixels allowed to exceed channelTolerance.
+	double maxBadPixelRatio;
+	// Mean structural similarity of the luminance, 1.0 for identical images.
+	double minSsim;
+};
+
+struct ImageCompareResult {
+	bool passed;
+	size_t badPixels;
+	double badPixelRatio;
+	double ssim;
+	int maxChannelDifference;
+};
+
+ImageCompareOptions defaultImageCompareOptions();
+
+// Compares actual against expected. When diff is given it receives an image
+// of the amplified differences with pixels over the tolerance marked in red.
+ImageCompareResult compareImages(const Image& expected, const Image& actual, const ImageCompareOptions& options, Image* diff);
+
+#endif // !CUSTOM_IMAGECOMPARE_H
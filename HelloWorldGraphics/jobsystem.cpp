@@ -0,0 +1,94 @@
+#include "jobsystem.hpp"
+
+JobSystem::JobSystem(int workerCount)
+	: workers(), mutex(), started(), finished(), generation(0), busyWorkers(0), quit(false),
+	function(NULL), body(NULL), itemCount(0), grainSize(1), next(0) {
+	for (int i = 0; i < workerCount; i++) {
+		workers.push_back(std::thread(&JobSystem::workerLoop, this, i + 1));
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+
+	started.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+int JobSystem::laneCount() const {
+	return (int)workers.size() + 1;
+}
+
+void JobSystem::run(size_t count, size_t grain, RangeFunction rangeFunction, const void* rangeBody) {
+	if (count == 0) {
+		return;
+	}
+
+	grain = grain == 0 ? 1 : grain;
+
+	// Not worth waking anyone for a single range.
+	if (workers.empty() || count <= grain) {
+		rangeFunction(rangeBody, 0, count, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		function = rangeFunction;
+		body = rangeBody;
+		itemCount = count;
+		grainSize = grain;
+		next.store(0);
+		busyWorkers = (int)workers.size();
+		generation++;
+	}
+
+	started.notify_all();
+	workOn(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this]() { return busyWorkers == 0; });
+}
+
+void JobSystem::workOn(int lane) {
+	for (;;) {
+		size_t begin = next.fetch_add(grainSize);
+
+		if (begin >= itemCount) {
+			return;
+		}
+
+		function(body, begin, begin + grainSize < itemCount ? begin + grainSize : itemCount, lane);
+	}
+}
+
+void JobSystem::workerLoop(int lane) {
+	unsigned long long seen = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			started.wait(lock, [this, seen]() { return quit || generation != seen; });
+
+			if (quit) {
+				return;
+			}
+
+			seen = generation;
+		}
+
+		workOn(lane);
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (--busyWorkers == 0) {
+			finished.notify_one();
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef CUSTOM_JOBSYSTEM_H
+#define CUSTOM_JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads running data-parallel loops. parallelFor()
+// splits [0, count) into ranges of grain items that workers and the calling
+// thread claim from a shared atomic counter, and returns once all ranges are
+// done. Loop bodies are passed by pointer, so dispatching never allocates.
+//
+// One loop runs at a time and bodies must not call parallelFor() again.
+class JobSystem {
+public:
+	// workerCount extra threads; 0 runs everything on the caller.
+	JobSystem(int workerCount);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Threads taking part in a loop, the caller included.
+	int laneCount() const;
+
+	// body(begin, end, lane) with lane in [0, laneCount()); the caller is lane 0.
+	template <typename Body>
+	void parallelFor(size_t count, size_t grain, const Body& body) {
+		run(count, grain, &invokeBody<Body>, &body);
+	}
+
+private:
+	typedef void (*RangeFunction)(const void* body, size_t begin, size_t end, int lane);
+
+	template <typename Body>
+	static void invokeBody(const void* body, size_t begin, size_t end, int lane) {
+		(*(const Body*)body)(begin, end, lane);
+	}
+
+	void run(size_t count, size_t grain, RangeFunction function, const void* body);
+	void workOn(int lane);
+	void workerLoop(int lane);
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable started;
+	std::condition_variable finished;
+	unsigned long long generation;
+	int busyWorkers;
+	bool quit;
+
+	RangeFunction function;
+	const void* body;
+	size_t itemCount;
+	size_t grainSize;
+	std::atomic<size_t> next;
+};
+
+#endif // !CUSTOM_JOBSYSTEM_H
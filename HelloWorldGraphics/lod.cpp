@@ -0,0 +1,974 @@
+#include "lod.hpp"
+#include "glprogram.hpp"
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <queue>
+
+struct Quadric {
+	double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+};
+
+static Quadric planeQuadric(double a, double b, double c, double d) {
+	Quadric q = { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+	return q;
+}
+
+static Quadric addQuadrics(const Quadric& p, const Quadric& q) {
+	Quadric r = {
+		p.xx + q.xx, p.xy + q.xy, p.xz + q.xz, p.xw + q.xw, p.yy + q.yy,
+		p.yz + q.yz, p.yw + q.yw, p.zz + q.zz, p.zw + q.zw, p.ww + q.ww
+	};
+	return r;
+}
+
+static Quadric scaleQuadric(const Quadric& q, double s) {
+	Quadric r = { q.xx * s, q.xy * s, q.xz * s, q.xw * s, q.yy * s, q.yz * s, q.yw * s, q.zz * s, q.zw * s, q.ww * s };
+	return r;
+}
+
+static double evaluateQuadric(const Quadric& q, const Vec3& v) {
+	double x = v.x, y = v.y, z = v.z;
+
+	return q.xx * x * x + 2.0 * q.xy * x * y + 2.0 * q.xz * x * z + 2.0 * q.xw * x
+		+ q.yy * y * y + 2.0 * q.yz * y * z + 2.0 * q.yw * y
+		+ q.zz * z * z + 2.0 * q.zw * z + q.ww;
+}
+
+// Minimizes the quadric by solving its 3x3 system; near-singular systems
+// (flat or linear neighbourhoods) fall back to the best of the endpoints and midpoint.
+static Vec3 optimalPosition(const Quadric& q, const Vec3& a, const Vec3& b) {
+	double det = q.xx * (q.yy * q.zz - q.yz * q.yz) - q.xy * (q.xy * q.zz - q.yz * q.xz) + q.xz * (q.xy * q.yz - q.yy * q.xz);
+
+	if (std::fabs(det) > 1e-10) {
+		double bx = -q.xw, by = -q.yw, bz = -q.zw;
+		double x = (bx * (q.yy * q.zz - q.yz * q.yz) - q.xy * (by * q.zz - q.yz * bz) + q.xz * (by * q.yz - q.yy * bz)) / det;
+		double y = (q.xx * (by * q.zz - q.yz * bz) - bx * (q.xy * q.zz - q.yz * q.xz) + q.xz * (q.xy * bz - by * q.xz)) / det;
+		double z = (q.xx * (q.yy * bz - by * q.yz) - q.xy * (q.xy * bz - by * q.xz) + bx * (q.xy * q.yz - q.yy * q.xz)) / det;
+
+		return vec3((float)x, (float)y, (float)z);
+	}
+
+	Vec3 midpoint = scale(add(a, b), 0.5f);
+	double errorA = evaluateQuadric(q, a);
+	double errorB = evaluateQuadric(q, b);
+	double errorMid = evaluateQuadric(q, midpoint);
+
+	if (errorA <= errorB && errorA <= errorMid) {
+		return a;
+	}
+
+	return errorB <= errorMid ? b : midpoint;
+}
+
+struct CollapseCandidate {
+	double cost;
+	unsigned int a;
+	unsigned int b;
+	unsigned int versionA;
+	unsigned int versionB;
+	Vec3 position;
+
+	bool operator<(const CollapseCandidate& other) const {
+		return cost > other.cost;
+	}
+};
+
+static Vec3 triangleNormal(const Vec3& a, const Vec3& b, const Vec3& c) {
+	return cross(sub(b, a), sub(c, a));
+}
+
+MeshData simplifyMesh(const MeshData& mesh, size_t targetTriangleCount, float* error) {
+	size_t vertexCount = mesh.positions.size();
+	size_t triangleCount = mesh.indices.size() / 3;
+
+	std::vector<Vec3> positions = mesh.positions;
+	std::vector<unsigned int> indices = mesh.indices;
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+	std::vector<unsigned int> versions(vertexCount, 0);
+	std::vector<bool> removedVertex(vertexCount, false);
+	std::vector<bool> removedTriangle(triangleCount, false);
+	std::vector<std::vector<unsigned int> > vertexTriangles(vertexCount);
+
+	// Every edge once, as (smaller << 32 | larger), next to the number of triangles using it.
+	std::vector<uint64_t> edgeKeys;
+	edgeKeys.reserve(triangleCount * 3);
+
+	for (size_t t = 0; t < triangleCount; t++) {
+		const Vec3& p0 = positions[indices[t * 3]];
+		const Vec3& p1 = positions[indices[t * 3 + 1]];
+		const Vec3& p2 = positions[indices[t * 3 + 2]];
+		Vec3 n = normalize(triangleNormal(p0, p1, p2));
+		Quadric q = planeQuadric(n.x, n.y, n.z, -dot(n, p0));
+
+		for (int corner = 0; corner < 3; corner++) {
+			unsigned int v = indices[t * 3 + corner];
+			unsigned int next = indices[t * 3 + (corner + 1) % 3];
+
+			quadrics[v] = addQuadrics(quadrics[v], q);
+			vertexTriangles[v].push_back((unsigned int)t);
+			edgeKeys.push_back((uint64_t)std::min(v, next) << 32 | std::max(v, next));
+		}
+	}
+
+	std::sort(edgeKeys.begin(), edgeKeys.end());
+
+	// Face planes alone let an open border slide along itself or fold in, so
+	// every border edge adds a plane through it perpendicular to its triangle.
+	const double boundaryWeight = 10.0;
+	std::vector<bool> boundaryVertex(vertexCount, false);
+
+	for (size_t t = 0; t < triangleCount; t++) {
+		for (int corner = 0; corner < 3; corner++) {
+			unsigned int a = indices[t * 3 + corner];
+			unsigned int b = indices[t * 3 + (corner + 1) % 3];
+			uint64_t key = (uint64_t)std::min(a, b) << 32 | std::max(a, b);
+
+			if (std::upper_bound(edgeKeys.begin(), edgeKeys.end(), key) - std::lower_bound(edgeKeys.begin(), edgeKeys.end(), key) != 1) {
+				continue;
+			}
+
+			Vec3 edge = sub(positions[b], positions[a]);
+			Vec3 n = triangleNormal(positions[indices[t * 3]], positions[indices[t * 3 + 1]], positions[indices[t * 3 + 2]]);
+			Vec3 m = normalize(cross(edge, n));
+			Quadric q = scaleQuadric(planeQuadric(m.x, m.y, m.z, -dot(m, positions[a])), boundaryWeight);
+
+			quadrics[a] = addQuadrics(quadrics[a], q);
+			quadrics[b] = addQuadrics(quadrics[b], q);
+			boundaryVertex[a] = true;
+			boundaryVertex[b] = true;
+		}
+	}
+
+	std::priority_queue<CollapseCandidate> heap;
+
+	auto pushEdge = [&](unsigned int a, unsigned int b) {
+		Quadric q = addQuadrics(quadrics[a], quadrics[b]);
+		CollapseCandidate candidate;
+
+		candidate.position = optimalPosition(q, positions[a], positions[b]);
+		candidate.cost = std::max(0.0, evaluateQuadric(q, candidate.position));
+		candidate.a = a;
+		candidate.b = b;
+		candidate.versionA = versions[a];
+		candidate.versionB = versions[b];
+		heap.push(candidate);
+	};
+
+	for (size_t i = 0; i < edgeKeys.size(); i++) {
+		if (i == 0 || edgeKeys[i] != edgeKeys[i - 1]) {
+			pushEdge((unsigned int)(edgeKeys[i] >> 32), (unsigned int)(edgeKeys[i] & 0xFFFFFFFFu));
+		}
+	}
+
+	// Live neighbours of a vertex, sorted, gathered for the link condition.
+	auto gatherNeighbours = [&](unsigned int v, std::vector<unsigned int>& neighbours) {
+		neighbours.clear();
+
+		for (size_t i = 0; i < vertexTriangles[v].size(); i++) {
+			unsigned int t = vertexTriangles[v][i];
+
+			if (removedTriangle[t]) {
+				continue;
+			}
+
+			for (int corner = 0; corner < 3; corner++) {
+				if (indices[t * 3 + corner] != v) {
+					neighbours.push_back(indices[t * 3 + corner]);
+				}
+			}
+		}
+
+		std::sort(neighbours.begin(), neighbours.end());
+		neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+	};
+
+	std::vector<unsigned int> neighboursA;
+	std::vector<unsigned int> neighboursB;
+	std::vector<unsigned int> commonNeighbours;
+
+	size_t liveTriangles = triangleCount;
+	double maxCost = 0.0;
+
+	while (liveTriangles > targetTriangleCount && !heap.empty()) {
+		CollapseCandidate candidate = heap.top();
+		heap.pop();
+
+		unsigned int a = candidate.a;
+		unsigned int b = candidate.b;
+
+		if (removedVertex[a] || removedVertex[b] || versions[a] != candidate.versionA || versions[b] != candidate.versionB) {
+			continue;
+		}
+
+		// Link condition: a and b may only share the neighbours opposite the
+		// triangles on edge ab, or the collapse pinches the surface into a
+		// non-manifold edge or vertex.
+		size_t edgeTriangles = 0;
+
+		for (size_t i = 0; i < vertexTriangles[a].size(); i++) {
+			unsigned int t = vertexTriangles[a][i];
+			unsigned int* tri = &indices[t * 3];
+
+			if (!removedTriangle[t] && (tri[0] == b || tri[1] == b || tri[2] == b)) {
+				edgeTriangles++;
+			}
+		}
+
+		gatherNeighbours(a, neighboursA);
+		gatherNeighbours(b, neighboursB);
+		commonNeighbours.clear();
+		std::set_intersection(neighboursA.begin(), neighboursA.end(), neighboursB.begin(), neighboursB.end(), std::back_inserter(commonNeighbours));
+
+		if (edgeTriangles == 0 || edgeTriangles > 2 || commonNeighbours.size() != edgeTriangles) {
+			continue;
+		}
+
+		// An interior edge between two border vertices would join the borders at one vertex.
+		if (edgeTriangles == 2 && boundaryVertex[a] && boundaryVertex[b]) {
+			continue;
+		}
+
+		// Reject collapses that would flip or turn a surviving triangle far
+		// from its normal, or squash it to nothing.
+		const float minNormalCosine = 0.25f;
+		bool flips = false;
+
+		for (int side = 0; side < 2 && !flips; side++) {
+			unsigned int moved = side == 0 ? a : b;
+
+			for (size_t i = 0; i < vertexTriangles[moved].size() && !flips; i++) {
+				unsigned int t = vertexTriangles[moved][i];
+
+				if (removedTriangle[t]) {
+					continue;
+				}
+
+				unsigned int* tri = &indices[t * 3];
+				bool hasA = tri[0] == a || tri[1] == a || tri[2] == a;
+				bool hasB = tri[0] == b || tri[1] == b || tri[2] == b;
+
+				if (hasA && hasB) {
+					continue;
+				}
+
+				Vec3 corners[3];
+
+				for (int corner = 0; corner < 3; corner++) {
+					corners[corner] = tri[corner] == moved ? candidate.position : positions[tri[corner]];
+				}
+
+				Vec3 before = triangleNormal(positions[tri[0]], positions[tri[1]], positions[tri[2]]);
+				Vec3 after = triangleNormal(corners[0], corners[1], corners[2]);
+
+				float beforeLength = length(before);
+				float afterLength = length(after);
+
+				flips = afterLength <= 1e-6f * beforeLength || dot(before, after) < minNormalCosine * beforeLength * afterLength;
+			}
+		}
+
+		if (flips) {
+			continue;
+		}
+
+		positions[a] = candidate.position;
+		quadrics[a] = addQuadrics(quadrics[a], quadrics[b]);
+		boundaryVertex[a] = boundaryVertex[a] || boundaryVertex[b];
+		removedVertex[b] = true;
+		versions[a]++;
+		maxCost = std::max(maxCost, candidate.cost);
+
+		for (size_t i = 0; i < vertexTriangles[b].size(); i++) {
+			unsigned int t = vertexTriangles[b][i];
+
+			if (removedTriangle[t]) {
+				continue;
+			}
+
+			unsigned int* tri = &indices[t * 3];
+
+			for (int corner = 0; corner < 3; corner++) {
+				if (tri[corner] == b) {
+					tri[corner] = a;
+				}
+			}
+
+			if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) {
+				removedTriangle[t] = true;
+				liveTriangles--;
+			}
+			else {
+				vertexTriangles[a].push_back(t);
+			}
+		}
+
+		vertexTriangles[b].clear();
+
+		for (size_t i = 0; i < vertexTriangles[a].size(); i++) {
+			unsigned int t = vertexTriangles[a][i];
+
+			if (removedTriangle[t]) {
+				continue;
+			}
+
+			for (int corner = 0; corner < 3; corner++) {
+				unsigned int other = indices[t * 3 + corner];
+
+				if (other != a) {
+					pushEdge(a, other);
+				}
+			}
+		}
+	}
+
+	MeshData result;
+	std::vector<unsigned int> remap(vertexCount, 0xFFFFFFFFu);
+
+	for (size_t t = 0; t < triangleCount; t++) {
+		if (removedTriangle[t]) {
+			continue;
+		}
+
+		for (int corner = 0; corner < 3; corner++) {
+			unsigned int v = indices[t * 3 + corner];
+
+			if (remap[v] == 0xFFFFFFFFu) {
+				remap[v] = (unsigned int)result.positions.size();
+				result.positions.push_back(positions[v]);
+			}
+
+			result.indices.push_back(remap[v]);
+		}
+	}
+
+	if (error != NULL) {
+		*error = (float)std::sqrt(maxCost);
+	}
+
+	return result;
+}
+
+std::vector<MeshLod> buildLodChain(const MeshData& mesh, int levelCount, float ratio) {
+	std::vector<MeshLod> chain;
+
+	MeshLod original;
+	original.mesh = mesh;
+	original.geometricError = 0.0f;
+	chain.push_back(original);
+
+	for (int level = 1; level < levelCount; level++) {
+		const MeshLod& previous = chain.back();
+		size_t target = (size_t)(previous.mesh.indices.size() / 3 * ratio);
+
+		if (target < 1) {
+			break;
+		}
+
+		MeshLod next;
+		float error = 0.0f;
+
+		// Simplifying from the original keeps errors from compounding across levels.
+		next.mesh = simplifyMesh(mesh, target, &error);
+		next.geometricError = std::max(error, previous.geometricError);
+
+		if (next.mesh.indices.size() >= previous.mesh.indices.size()) {
+			break;
+		}
+
+		chain.push_back(next);
+	}
+
+	return chain;
+}
+
+static const uint32_t lodFileMagic = 0x31444F4C; // "LOD1"
+
+bool saveLodChain(const char* path, const std::vector<MeshLod>& chain) {
+	std::ofstream file(path, std::ios::binary);
+
+	if (!file) {
+		std::cerr << "ERROR::LOD::FILE_NOT_SUCCESSFULLY_WRITTEN: " << path << std::endl;
+		return false;
+	}
+
+	uint32_t levelCount = (uint32_t)chain.size();
+
+	file.write((const char*)&lodFileMagic, sizeof(lodFileMagic));
+	file.write((const char*)&levelCount, sizeof(levelCount));
+
+	for (size_t i = 0; i < chain.size(); i++) {
+		const MeshLod& lod = chain[i];
+		uint32_t vertexCount = (uint32_t)lod.mesh.positions.size();
+		uint32_t indexCount = (uint32_t)lod.mesh.indices.size();
+
+		file.write((const char*)&lod.geometricError, sizeof(float));
+		file.write((const char*)&vertexCount, sizeof(vertexCount));
+		file.write((const char*)&indexCount, sizeof(indexCount));
+		file.write((const char*)lod.mesh.positions.data(), vertexCount * sizeof(Vec3));
+		file.write((const char*)lod.mesh.indices.data(), indexCount * sizeof(unsigned int));
+	}
+
+	return (bool)file;
+}
+
+bool loadLodChain(const char* path, std::vector<MeshLod>& chain) {
+	std::ifstream file(path, std::ios::binary);
+	uint32_t magic = 0;
+	uint32_t levelCount = 0;
+
+	file.read((char*)&magic, sizeof(magic));
+	file.read((char*)&levelCount, sizeof(levelCount));
+
+	if (!file || magic != lodFileMagic) {
+		std::cerr << "ERROR::LOD::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+		return false;
+	}
+
+	chain.clear();
+	chain.resize(levelCount);
+
+	for (uint32_t i = 0; i < levelCount && file; i++) {
+		MeshLod& lod = chain[i];
+		uint32_t vertexCount = 0;
+		uint32_t indexCount = 0;
+
+		file.read((char*)&lod.geometricError, sizeof(float));
+		file.read((char*)&vertexCount, sizeof(vertexCount));
+		file.read((char*)&indexCount, sizeof(indexCount));
+
+		if (!file) {
+			break;
+		}
+
+		lod.mesh.positions.resize(vertexCount);
+		lod.mesh.indices.resize(indexCount);
+		file.read((char*)lod.mesh.positions.data(), vertexCount * sizeof(Vec3));
+		file.read((char*)lod.mesh.indices.data(), indexCount * sizeof(unsigned int));
+	}
+
+	if (!file) {
+		std::cerr << "ERROR::LOD::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+		chain.clear();
+		return false;
+	}
+
+	return true;
+}
+
+LodSelector::LodSelector(float fovY, int screenHeight, float maxPixelError, float hysteresis)
+	: projectionScale(0.0f), fovY(fovY), maxPixelError(maxPixelError), hysteresis(hysteresis) {
+	setScreenHeight(screenHeight);
+}
+
+void LodSelector::setScreenHeight(int screenHeight) {
+	projectionScale = screenHeight / (2.0f * std::tan(fovY * 0.5f));
+}
+
+void LodSelector::resize(size_t objectCount) {
+	levels.resize(objectCount, 0);
+}
+
+float LodSelector::projectedError(float geometricError, float distance) const {
+	return geometricError * projectionScale / std::max(distance, 1e-4f);
+}
+
+int LodSelector::select(size_t object, float distance, const float* errors, int levelCount) {
+	int current = std::min(levels[object], levelCount - 1);
+	int level = current;
+
+	// Refine right away when the current level is visibly wrong.
+	while (level > 0 && projectedError(errors[level], distance) > maxPixelError) {
+		level--;
+	}
+
+	// Coarsen only when the next level is below the threshold by the hysteresis margin.
+	if (level == current) {
+		float coarsenThreshold = maxPixelError * (1.0f - hysteresis);
+
+		while (level + 1 < levelCount && projectedError(errors[level + 1], distance) <= coarsenThreshold) {
+			level++;
+		}
+	}
+
+	levels[object] = level;
+	return level;
+}
+
+int LodSelector::currentLevel(size_t object) const {
+	return levels[object];
+}
+
+static const char* lodBenchVertexShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec3 position;\n"
+	"layout (location = 1) in vec4 instance;\n"
+	"uniform mat4 viewProjection;\n"
+	"out vec3 worldPosition;\n"
+	"void main() {\n"
+	"worldPosition = instance.xyz + position * instance.w;\n"
+	"gl_Position = viewProjection * vec4(worldPosition, 1.0);\n"
+	"}\0";
+
+static const char* lodBenchFragmentShaderSource = "#version 330 core\n"
+	"in vec3 worldPosition;\n"
+	"uniform vec3 levelColor;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"vec3 normal = normalize(cross(dFdx(worldPosition), dFdy(worldPosition)));\n"
+	"float light = 0.3 + 0.7 * max(dot(normal, normalize(vec3(0.4, 0.8, 0.3))), 0.0);\n"
+	"FragColor = vec4(levelColor * light, 1.0);\n"
+	"}\0";
+
+// Closed sphere of radius about 1 with ridges, vertices shared between
+// triangles so that edges can collapse. Triangles face outwards.
+static MeshData buildLodBenchMesh(int rings, int segments) {
+	MeshData mesh;
+
+	auto surface = [](float theta, float phi) {
+		float radius = 1.0f + 0.08f * std::sin(5.0f * phi) * std::sin(4.0f * theta) + 0.03f * std::sin(23.0f * phi + 7.0f * theta);
+		return vec3(radius * std::sin(theta) * std::cos(phi), radius * std::cos(theta), radius * std::sin(theta) * std::sin(phi));
+	};
+
+	mesh.positions.push_back(vec3(0.0f, 1.0f, 0.0f));
+
+	for (int r = 1; r < rings; r++) {
+		for (int s = 0; s < segments; s++) {
+			mesh.positions.push_back(surface(3.1415927f * r / rings, 6.2831853f * s / segments));
+		}
+	}
+
+	mesh.positions.push_back(vec3(0.0f, -1.0f, 0.0f));
+
+	unsigned int southPole = (unsigned int)mesh.positions.size() - 1;
+
+	auto ringVertex = [&](int r, int s) {
+		if (r == 0) {
+			return 0u;
+		}
+
+		if (r == rings) {
+			return southPole;
+		}
+
+		return (unsigned int)(1 + (r - 1) * segments + s % segments);
+	};
+
+	auto addTriangle = [&](unsigned int a, unsigned int b, unsigned int c) {
+		if (a == b || b == c || a == c) {
+			return;
+		}
+
+		const Vec3& pa = mesh.positions[a];
+		const Vec3& pb = mesh.positions[b];
+		const Vec3& pc = mesh.positions[c];
+
+		// The mesh is star-shaped around the origin, which decides the winding.
+		if (dot(triangleNormal(pa, pb, pc), add(add(pa, pb), pc)) < 0.0f) {
+			std::swap(b, c);
+		}
+
+		unsigned int triangle[3] = { a, b, c };
+		mesh.indices.insert(mesh.indices.end(), triangle, triangle + 3);
+	};
+
+	for (int r = 0; r < rings; r++) {
+		for (int s = 0; s < segments; s++) {
+			addTriangle(ringVertex(r, s), ringVertex(r + 1, s), ringVertex(r + 1, s + 1));
+			addTriangle(ringVertex(r, s), ringVertex(r + 1, s + 1), ringVertex(r, s + 1));
+		}
+	}
+
+	return mesh;
+}
+
+static bool sameLodChain(const std::vector<MeshLod>& a, const std::vector<MeshLod>& b) {
+	if (a.size() != b.size()) {
+		return false;
+	}
+
+	for (size_t i = 0; i < a.size(); i++) {
+		const MeshData& meshA = a[i].mesh;
+		const MeshData& meshB = b[i].mesh;
+
+		if (a[i].geometricError != b[i].geometricError || meshA.indices != meshB.indices || meshA.positions.size() != meshB.positions.size()) {
+			return false;
+		}
+
+		for (size_t v = 0; v < meshA.positions.size(); v++) {
+			if (meshA.positions[v].x != meshB.positions[v].x || meshA.positions[v].y != meshB.positions[v].y || meshA.positions[v].z != meshB.positions[v].z) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+int runLodBenchmark(int width, int height, int objectCount, int frames) {
+	static const char* pathNames[2] = { "full detail", "LOD" };
+	static const float levelColors[6][3] = {
+		{ 0.9f, 0.35f, 0.3f }, { 0.9f, 0.7f, 0.3f }, { 0.5f, 0.85f, 0.35f },
+		{ 0.3f, 0.8f, 0.8f }, { 0.35f, 0.5f, 0.9f }, { 0.7f, 0.4f, 0.9f }
+	};
+	const int warmupFrames = 10;
+	const int maxLevels = 6;
+	const float fovY = 1.0f;
+	const float maxPixelError = 1.0f;
+	const float hysteresis = 0.25f;
+	const float spacing = 3.0f;
+	const int oscillations = 100;
+	const char* path = "lod_bench.lod";
+
+	// Offline part: build the chain, then store and reload it as a game would.
+	MeshData source = buildLodBenchMesh(64, 128);
+
+	std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+	std::vector<MeshLod> built = buildLodChain(source, maxLevels, 0.35f);
+	double buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+	std::vector<MeshLod> chain;
+	int result = 0;
+
+	if (!saveLodChain(path, built) || !loadLodChain(path, chain)) {
+		result = -1;
+	}
+	else if (!sameLodChain(built, chain)) {
+		std::cerr << "ERROR::LOD::RELOADED_CHAIN_DIFFERS: " << path << std::endl;
+		result = 1;
+	}
+
+	std::remove(path);
+
+	std::cout << "LOD BENCHMARK " << width << "x" << height << ", " << objectCount << " objects, " << source.indices.size() / 3
+		<< " triangle source mesh, " << built.size() << " levels built in " << buildMilliseconds << " ms, " << frames << " frames" << std::endl;
+
+	int levelCount = (int)chain.size();
+	std::vector<float> errors(levelCount);
+
+	for (int level = 0; level < levelCount; level++) {
+		errors[level] = chain[level].geometricError;
+
+		std::cout << "level " << level << ": " << chain[level].mesh.indices.size() / 3 << " triangles, " << chain[level].mesh.positions.size()
+			<< " vertices, geometric error " << errors[level] << std::endl;
+
+		// Coarser levels must be smaller and no more accurate, or selection by error means nothing.
+		bool ordered = level == 0 ? errors[0] == 0.0f
+			: chain[level].mesh.indices.size() < chain[level - 1].mesh.indices.size() && errors[level] >= errors[level - 1];
+
+		if (result == 0 && !ordered) {
+			std::cerr << "ERROR::LOD::CHAIN_NOT_ORDERED: level " << level << std::endl;
+			result = 1;
+		}
+	}
+
+	if (result == 0 && levelCount < 2) {
+		std::cerr << "ERROR::LOD::CHAIN_NOT_SIMPLIFIED" << std::endl;
+		result = 1;
+	}
+
+	if (result != 0) {
+		return result;
+	}
+
+	// Every level in one vertex and index buffer.
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<int> baseVertex(levelCount);
+	std::vector<unsigned int> firstIndex(levelCount);
+
+	for (int level = 0; level < levelCount; level++) {
+		const MeshData& mesh = chain[level].mesh;
+
+		baseVertex[level] = (int)(vertices.size() / 3);
+		firstIndex[level] = (unsigned int)indices.size();
+
+		for (size_t v = 0; v < mesh.positions.size(); v++) {
+			vertices.push_back(mesh.positions[v].x);
+			vertices.push_back(mesh.positions[v].y);
+			vertices.push_back(mesh.positions[v].z);
+		}
+
+		indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+	}
+
+	// A square field of objects that the camera flies over lengthwise.
+	int columns = (int)std::ceil(std::sqrt((float)objectCount));
+	float fieldLength = ((objectCount + columns - 1) / columns) * spacing;
+	std::vector<Vec3> centers(objectCount);
+
+	for (int i = 0; i < objectCount; i++) {
+		centers[i] = vec3((i % columns - (columns - 1) * 0.5f) * spacing, 1.0f, (i / columns) * spacing);
+	}
+
+	unsigned int program = createProgram(lodBenchVertexShaderSource, lodBenchFragmentShaderSource);
+
+	if (program == 0) {
+		return -1;
+	}
+
+	unsigned int vao;
+	unsigned int buffers[3];
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(3, buffers);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+	// Instances grouped by level, re-pointed per draw since GL 3.3 has no baseInstance.
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[2]);
+	glBufferData(GL_ARRAY_BUFFER, objectCount * sizeof(Vec4), NULL, GL_STREAM_DRAW);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vec4), (void*)0);
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	LodSelector selector(fovY, height, maxPixelError, hysteresis);
+	selector.resize(objectCount);
+
+	Mat4 projection = perspective(fovY, (float)width / height, 0.1f, fieldLength + 20.0f);
+	Mat4 viewProjection = identity();
+	Vec3 eye = vec3(0.0f, 0.0f, 0.0f);
+	int mode = 0;
+
+	std::vector<int> selected(objectCount, 0);
+	std::vector<Vec4> sorted(objectCount);
+	std::vector<int> levelFirst(levelCount + 1);
+	std::vector<int> levelNext(levelCount);
+	unsigned long long violations = 0;
+	unsigned long long changes = 0;
+
+	// Flies lengthwise over the field, low and looking ahead, so every
+	// object crosses the whole range of distances.
+	auto placeCamera = [&](float t) {
+		eye = vec3(0.0f, 4.0f, -10.0f + t * (fieldLength + 10.0f));
+		viewProjection = multiply(projection, lookAt(eye, add(eye, vec3(0.0f, -0.25f, 1.0f)), vec3(0.0f, 1.0f, 0.0f)));
+	};
+
+	// Picks the levels, checking every pick: the chosen level must be within
+	// the error threshold and the next coarser one must not be below the
+	// coarsening threshold, or the selector kept too much or too little detail.
+	auto selectLevels = [&]() {
+		for (int i = 0; i < objectCount; i++) {
+			float distance = std::max(length(sub(centers[i], eye)) - 1.1f, 0.1f);
+			int previous = selector.currentLevel(i);
+			int level = selector.select(i, distance, errors.data(), levelCount);
+
+			bool fineEnough = selector.projectedError(errors[level], distance) <= maxPixelError;
+			bool coarseEnough = level + 1 == levelCount || selector.projectedError(errors[level + 1], distance) > maxPixelError * (1.0f - hysteresis);
+
+			violations += fineEnough && coarseEnough ? 0 : 1;
+			changes += level != previous ? 1 : 0;
+			selected[i] = level;
+		}
+	};
+
+	auto groupByLevel = [&]() {
+		std::fill(levelFirst.begin(), levelFirst.end(), 0);
+
+		for (int i = 0; i < objectCount; i++) {
+			levelFirst[selected[i] + 1]++;
+		}
+
+		for (int level = 0; level < levelCount; level++) {
+			levelFirst[level + 1] += levelFirst[level];
+		}
+
+		std::copy(levelFirst.begin(), levelFirst.end() - 1, levelNext.begin());
+
+		for (int i = 0; i < objectCount; i++) {
+			sorted[levelNext[selected[i]]++] = vec4(centers[i].x, centers[i].y, centers[i].z, 1.0f);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[2]);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, objectCount * sizeof(Vec4), sorted.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	};
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	RenderTextureDesc depthDesc = { width, height, GL_DEPTH_COMPONENT24 };
+	RenderGraph graph;
+	RenderGraph::Resource output = graph.importTexture("output", outputTexture, outputDesc);
+
+	graph.addPass("objects",
+		[&](RenderGraph::Builder& builder) {
+			RenderGraph::Resource depth = builder.create("lod.depth", depthDesc);
+
+			builder.write(output, LoadOp::Clear);
+			builder.write(depth, LoadOp::Clear);
+			builder.setClearColor(0.08f, 0.09f, 0.12f, 1.0f);
+		},
+		[&](const RenderGraph&) {
+			glEnable(GL_DEPTH_TEST);
+			glDepthMask(GL_TRUE);
+			glUseProgram(program);
+			glUniformMatrix4fv(glGetUniformLocation(program, "viewProjection"), 1, GL_FALSE, viewProjection.m);
+			glBindVertexArray(vao);
+			glBindBuffer(GL_ARRAY_BUFFER, buffers[2]);
+
+			for (int level = 0; level < levelCount; level++) {
+				int count = levelFirst[level + 1] - levelFirst[level];
+
+				if (count == 0) {
+					continue;
+				}
+
+				const float* color = levelColors[std::min(level, maxLevels - 1)];
+				glUniform3f(glGetUniformLocation(program, "levelColor"), color[0], color[1], color[2]);
+				glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vec4), (void*)(levelFirst[level] * sizeof(Vec4)));
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)chain[level].mesh.indices.size(), GL_UNSIGNED_INT,
+					(void*)(firstIndex[level] * sizeof(unsigned int)), count, baseVertex[level]);
+			}
+
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vec4), (void*)0);
+			glBindVertexArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glDisable(GL_DEPTH_TEST);
+		});
+
+	if (!graph.compile()) {
+		result = -1;
+	}
+
+	for (mode = 0; mode < 2 && result == 0; mode++) {
+		GpuTimer timer(4);
+		double selectMilliseconds = 0.0;
+		unsigned long long triangles = 0;
+		std::vector<unsigned long long> perLevel(levelCount, 0);
+
+		std::fill(selected.begin(), selected.end(), 0);
+		groupByLevel();
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				timer.wait();
+				timer.resetAverage();
+				selectMilliseconds = 0.0;
+				changes = 0;
+				triangles = 0;
+				std::fill(perLevel.begin(), perLevel.end(), 0);
+			}
+
+			placeCamera(std::max(frame - warmupFrames, 0) / (float)frames);
+
+			if (mode == 1) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				selectLevels();
+				groupByLevel();
+				selectMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+
+			timer.begin();
+			graph.execute();
+			timer.end();
+			timer.poll();
+
+			for (int level = 0; level < levelCount; level++) {
+				unsigned long long count = (unsigned long long)(levelFirst[level + 1] - levelFirst[level]);
+				perLevel[level] += count;
+				triangles += count * (chain[level].mesh.indices.size() / 3);
+			}
+		}
+
+		timer.wait();
+
+		std::cout << pathNames[mode] << ": " << selectMilliseconds / frames << " ms CPU selecting, " << timer.averageMilliseconds()
+			<< " ms GPU, " << (double)triangles / frames << " triangles per frame, objects per level";
+
+		for (int level = 0; level < levelCount; level++) {
+			std::cout << (level == 0 ? " " : " / ") << (double)perLevel[level] / frames;
+		}
+
+		std::cout << std::endl;
+
+		if (mode == 1) {
+			std::cout << "LOD selection: " << (double)changes / frames << " level changes per frame, " << violations << " of "
+				<< (unsigned long long)objectCount * (warmupFrames + frames) << " picks outside the error thresholds" << std::endl;
+
+			if (violations != 0) {
+				std::cerr << "ERROR::LOD::SELECTION_OUTSIDE_THRESHOLDS: " << violations << " picks" << std::endl;
+				result = 1;
+			}
+		}
+	}
+
+	// Hysteresis: an object swaying from just past the distance where a level
+	// becomes allowed to just past the one where it is chosen must coarsen once
+	// and keep that level on the way back, while a selector without hysteresis
+	// swaying as far around its single switch distance changes on every swing.
+	if (result == 0) {
+		LodSelector steady(fovY, height, maxPixelError, hysteresis);
+		LodSelector eager(fovY, height, maxPixelError, 0.0f);
+		int boundaries = 0;
+		int steadyChanges = 0;
+		int eagerChanges = 0;
+
+		for (int level = 1; level < levelCount; level++) {
+			// Level is allowed beyond refineDistance and chosen beyond coarsenDistance.
+			float refineDistance = steady.projectedError(errors[level], 1.0f) / maxPixelError;
+			float coarsenDistance = refineDistance / (1.0f - hysteresis);
+			float nearest = refineDistance * 1.02f;
+			float farthest = coarsenDistance * 1.05f;
+
+			// Skips levels whose band overlaps the neighbouring ones, where switching more than once is right.
+			bool isolated = errors[level] > errors[level - 1]
+				&& (level + 1 == levelCount || steady.projectedError(errors[level + 1], farthest) > maxPixelError * (1.0f - hysteresis));
+
+			if (!isolated) {
+				continue;
+			}
+
+			steady.resize(0);
+			steady.resize(1);
+			eager.resize(0);
+			eager.resize(1);
+			boundaries++;
+
+			for (int swing = 0; swing < oscillations * 8; swing++) {
+				float phase = 0.5f - 0.5f * std::cos(swing * 0.7853982f);
+				int steadyPrevious = steady.currentLevel(0);
+				int eagerPrevious = eager.currentLevel(0);
+
+				steadyChanges += steady.select(0, nearest + (farthest - nearest) * phase, errors.data(), levelCount) != steadyPrevious ? 1 : 0;
+				eagerChanges += eager.select(0, refineDistance * (0.95f + 0.1f * phase), errors.data(), levelCount) != eagerPrevious ? 1 : 0;
+			}
+		}
+
+		std::cout << "LOD hysteresis: " << boundaries << " level boundaries swayed across " << oscillations << " times, " << steadyChanges
+			<< " level changes with hysteresis " << hysteresis << ", " << eagerChanges << " without" << std::endl;
+
+		// From level 0 an object may settle once below the level and coarsen once into it; any other switch is popping.
+		if (boundaries == 0 || steadyChanges > 2 * boundaries) {
+			std::cerr << "ERROR::LOD::HYSTERESIS_POPPING: " << steadyChanges << " level changes over " << boundaries << " boundaries" << std::endl;
+			result = 1;
+		}
+	}
+
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(3, buffers);
+	glDeleteTextures(1, &outputTexture);
+	glDeleteProgram(program);
+
+	return result;
+}
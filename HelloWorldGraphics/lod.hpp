@@ -0,0 +1,71 @@
+#ifndef CUSTOM_LOD_H
+#define CUSTOM_LOD_H
+
+#include "vecmath.hpp"
+#include <vector>
+#include <cstddef>
+
+struct MeshData {
+	std::vector<Vec3> positions;
+	std::vector<unsigned int> indices;
+};
+
+struct MeshLod {
+	MeshData mesh;
+	// World-space distance the simplified surface may deviate from the original.
+	float geometricError;
+};
+
+// Edge-collapse simplification driven by quadric error metrics (Garland and
+// Heckbert), with penalty planes holding open borders in place. Stops at
+// targetTriangleCount or when no collapse is left that keeps triangle
+// orientation and the surface manifold. Writes the largest error accepted to
+// error.
+MeshData simplifyMesh(const MeshData& mesh, size_t targetTriangleCount, float* error);
+
+// Level 0 is the original mesh; each following level keeps ratio of the
+// triangles of the previous one. Meant to run offline, see saveLodChain().
+std::vector<MeshLod> buildLodChain(const MeshData& mesh, int levelCount, float ratio);
+
+bool saveLodChain(const char* path, const std::vector<MeshLod>& chain);
+
+bool loadLodChain(const char* path, std::vector<MeshLod>& chain);
+
+// Picks a level per object from the projected screen-space error of each
+// level. An object only moves to a coarser level once that level's error is
+// clearly below the threshold, which keeps it from popping back and forth.
+class LodSelector {
+public:
+	LodSelector(float fovY, int screenHeight, float maxPixelError, float hysteresis);
+
+	void setScreenHeight(int screenHeight);
+
+	void resize(size_t objectCount);
+
+	// errors holds the geometric error of each level, finest first.
+	int select(size_t object, float distance, const float* errors, int levelCount);
+
+	float projectedError(float geometricError, float distance) const;
+
+	int currentLevel(size_t object) const;
+
+private:
+	float projectionScale;
+	float fovY;
+	float maxPixelError;
+	float hysteresis;
+	std::vector<int> levels;
+};
+
+// Builds a LOD chain from a ridged sphere, stores it to lod_bench.lod in the
+// working directory and loads it back, then flies a camera over a field of
+// objectCount of them at width x height for frames frames, once drawing every
+// object at full detail and once at the level LodSelector picks. Prints the
+// chain, CPU and GPU time, triangles and objects per level per frame, then
+// sways an object across every level boundary with and without hysteresis.
+// Needs a current context. Returns 0 on success, 1 when the reloaded chain
+// differs, the levels do not get coarser, a pick is outside the error
+// thresholds or the level pops back and forth despite hysteresis.
+int runLodBenchmark(int width, int height, int objectCount, int frames);
+
+#endif // !CUSTOM_LOD_H
@@ -1,174 +1,372 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rendergraph.hpp"
+#include "framecapture.hpp"
+#include "goldenrunner.hpp"
+#include "deferred.hpp"
+#include "clustered.hpp"
+#include "shadows.hpp"
+#include "postprocess.hpp"
+#include "dynamicresolution.hpp"
+#include "gpuresources.hpp"
+#include "bufferallocator.hpp"
+#include "framearena.hpp"
+#include "allocationtracker.hpp"
+#include "scenesystems.hpp"
+#include "particles.hpp"
+#include "spritebatch.hpp"
+#include "textrenderer.hpp"
+#include "debugdraw.hpp"
+#include "skinning.hpp"
+#include "animation.hpp"
+#include "terrain.hpp"
+#include "culling.hpp"
+#include "occlusion.hpp"
+#include "lod.hpp"
+#include "shader.hpp"
+#include "shaderreloader.hpp"
+
+// Points the vertex array at the triangle's current place in the shared buffers.
+void bindTriangleAttributes(unsigned int vertexArray, const BufferSlice& vertices) {
+	glBindVertexArray(vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, vertices.buffer);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (void*)vertices.offset);
+	glEnableVertexAttribArray(0);
 
-const char* vertexShaderSource = "#version 330 core\n"
-	"layout (location = 0) in vec3 aPos;\n"
-	"layout (location = 1) in vec3 aColor;\n"
-	"out vec3 ourColor;\n"
-	"void main() {\n"
-	"gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);\n"
-	"ourColor = aColor;\n"
-	"}\0";
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (void*)(vertices.offset + 3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
 
-const char* fragmentShaderSource = "#version 330 core\n"
-	"in vec3 ourColor;\n"
-	"out vec4 FragColor;\n"
-	"void main() {\n"
-	"FragColor = vec4(ourColor.r, ourColor.g, ourColor.b, 1.0f);\n"
-	"}\0";
+	glBindVertexArray(0);
+}
 
-bool checkCompilationShaderSuccess(unsigned int shaderId) {
-	int success;
+// The vertices live in a sub-allocation of buffers; the vertex array is owned by resources.
+VertexArrayHandle defineTriangles(GpuResourceManager& resources, BufferAllocator& buffers, float* vertices, size_t size, BufferRange& range) {
+	VertexArrayHandle vertexArray = resources.createVertexArray();
 
-	glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+	range = buffers.allocate(size, sizeof(float), vertices);
+	bindTriangleAttributes(resources.get(vertexArray), buffers.slice(range));
+
+	return vertexArray;
+}
 
-	if (!success) {
-		char info[512];
-		glGetShaderInfoLog(shaderId, 512, NULL, info);
-		std::cerr << "SHADER COMPILATION ERROR: " << info;
-		return false;
+GLFWwindow* configureAsCurrentAndCreateWindow(bool visible) {
+	if (!glfwInit()) {
+		std::cerr << "ERROR WHILE INITIATING GLFW";
+		return NULL;
 	}
 
-	return true;
-}
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
-unsigned int bindVertexArray() {
-	unsigned int VAO;
+	GLFWwindow* window = glfwCreateWindow(800, 800, "Hello World OpenGL", NULL, NULL);
+	
+	if (window == NULL) {
+		std::cerr << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
 
-	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
+		return NULL;
+	}
 
-	return VAO;
+	glfwMakeContextCurrent(window);
+
+	int framebufferWidth;
+	int framebufferHeight;
+
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+	glViewport(0, 0, framebufferWidth, framebufferHeight);
+
+	GLenum err = glewInit();
+
+	if (err != GLEW_OK) {
+		std::cerr << "Error while init glew: " << glewGetErrorString(err);
+		glfwTerminate();
+
+		return NULL;
+	}
+
+	return window;
 }
 
-unsigned int defineTriangles(float* vertices, size_t size) {
-	unsigned int firstVAO = bindVertexArray();
+int main(int argc, char** argv) {	
+	const char* capturePrefix = NULL;
+	const char* goldenDirectory = NULL;
+	bool recordGolden = false;
+	int deferredBenchLights = 0;
+	int clusteredBenchLights = 0;
+	bool shadowBench = false;
+	bool postBench = false;
+	bool dynamicResolutionBench = false;
+	bool bufferBench = false;
+	bool arenaBench = false;
+	int ecsBenchEntities = 0;
+	int particleBenchCount = 0;
+	int spriteBenchCount = 0;
+	bool textBench = false;
+	int debugDrawBenchCount = 0;
+	int skinningBenchCount = 0;
+	int animationBenchCount = 0;
+	int terrainBenchLevels = 0;
+	int cullingBenchCount = 0;
+	int occlusionBenchCount = 0;
+	int lodBenchCount = 0;
+	int allocationCheckFrames = 0;
+	double targetMilliseconds = 16.0;
+
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			capturePrefix = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+			goldenDirectory = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--record-golden") == 0 && i + 1 < argc) {
+			goldenDirectory = argv[++i];
+			recordGolden = true;
+		}
+		else if (std::strcmp(argv[i], "--bench-deferred") == 0 && i + 1 < argc) {
+			deferredBenchLights = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bench-clustered") == 0 && i + 1 < argc) {
+			clusteredBenchLights = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bench-shadows") == 0) {
+			shadowBench = true;
+		}
+		else if (std::strcmp(argv[i], "--bench-post") == 0) {
+			postBench = true;
+		}
+		else if (std::strcmp(argv[i], "--bench-dynres") == 0) {
+			dynamicResolutionBench = true;
+		}
+		else if (std::strcmp(argv[i], "--bench-buffers") == 0) {
+			bufferBench = true;
+		}
+		else if (std::strcmp(argv[i], "--bench-arena") == 0) {
+			arenaBench = true;
+		}
+		else if (std::strcmp(argv[i], "--bench-ecs") == 0 && i + 1 < argc) {
+			ecsBenchEntities = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bench-particles") == 0 && i + 1 < argc) {
+			particleBenchCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bench-sprites") == 0 && i + 1 < argc) {
+			spriteBenchCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bench-text") == 0) {
+			textBench = true;
+		}
+		else if (std::strcmp(argv[i], "--bench-debugdraw") == 0 && i + 1 < argc) {
+			debugDrawBenchCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bench-skinning") == 0 && i + 1 < argc) {
+			skinningBenchCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bench-animation") == 0 && i + 1 < argc) {
+			animationBenchCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bench-terrain") == 0 && i + 1 < argc) {
+			terrainBenchLevels = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bench-culling") == 0 && i + 1 < argc) {
+			cullingBenchCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bench-occlusion") == 0 && i + 1 < argc) {
+			occlusionBenchCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bench-lod") == 0 && i + 1 < argc) {
+			lodBenchCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--check-allocations") == 0 && i + 1 < argc) {
+			allocationCheckFrames = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--target-ms") == 0 && i + 1 < argc) {
+			targetMilliseconds = std::atof(argv[++i]);
+		}
+	}
 
-	unsigned int firstVBO;
+	// With --check-allocations the loop runs hidden for a fixed number of
+	// frames and fails if the render thread allocates once warmed up.
+	if (allocationCheckFrames > 0 && !allocationTrackingEnabled()) {
+		std::cerr << "ERROR::MAIN::ALLOCATION_TRACKING_DISABLED: build with TRACK_ALLOCATIONS (the Benchmark configuration)" << std::endl;
+		return -1;
+	}
 
-	glGenBuffers(1, &firstVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, firstVBO);
-	glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
+	bool headless = goldenDirectory != NULL || deferredBenchLights > 0 || clusteredBenchLights > 0 || shadowBench || postBench || dynamicResolutionBench || bufferBench || arenaBench || ecsBenchEntities > 0 || particleBenchCount > 0 || spriteBenchCount > 0 || textBench || debugDrawBenchCount > 0 || skinningBenchCount > 0 || animationBenchCount > 0 || terrainBenchLevels > 0 || cullingBenchCount > 0 || occlusionBenchCount > 0 || lodBenchCount > 0 || allocationCheckFrames > 0;
+	GLFWwindow* window = configureAsCurrentAndCreateWindow(!headless);
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (void*)0);
-	glEnableVertexAttribArray(0);
+	if (window == NULL) {
+		return -1;
+	}
 
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
+	if (deferredBenchLights > 0) {
+		int result = runDeferredBenchmark(1280, 720, deferredBenchLights, 200);
 
+		glfwTerminate();
 
-	return firstVBO;
-}
+		return result;
+	}
 
-unsigned int createFragmentShader() {
-	unsigned int fragmentShader;
-	fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	if (clusteredBenchLights > 0) {
+		int result = runClusteredBenchmark(1280, 720, clusteredBenchLights, 200);
 
-	glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-	glCompileShader(fragmentShader);
+		glfwTerminate();
 
-	if (!checkCompilationShaderSuccess(fragmentShader)) {
-		return 0;
+		return result;
 	}
 
-	return fragmentShader;
-}
+	if (shadowBench) {
+		int result = runShadowBenchmark(1280, 720, 200);
 
-unsigned int createVertexShader() {
-	unsigned int vertexShader;
-	vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	
-	glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-	glCompileShader(vertexShader);
+		glfwTerminate();
 
-	if (!checkCompilationShaderSuccess(vertexShader)) {
-		return 0;
+		return result;
 	}
 
-	return vertexShader;
-}
+	if (postBench) {
+		int result = runPostProcessBenchmark(1280, 720, 200);
 
-unsigned int createShaderProgram(unsigned int vertexShader, unsigned int fragmentShader) {
-	unsigned int shaderProgram;
-	shaderProgram = glCreateProgram();
+		glfwTerminate();
 
-	glAttachShader(shaderProgram, vertexShader);
-	glAttachShader(shaderProgram, fragmentShader);
-	glLinkProgram(shaderProgram);
+		return result;
+	}
 
-	int success;
+	if (dynamicResolutionBench) {
+		int result = runDynamicResolutionBenchmark(1280, 720, 600, targetMilliseconds);
 
-	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+		glfwTerminate();
 
-	if (!success) {
-		char info[512];
-		glGetProgramInfoLog(shaderProgram, 512, NULL, info);
-		std::cerr << "ERROR LINKING SHADER PROGRAM: " << info;
-		return 0;
+		return result;
 	}
 
-	return shaderProgram;
-}
+	if (bufferBench) {
+		int result = runBufferAllocatorBenchmark(1000);
 
-GLFWwindow* configureAsCurrentAndCreateWindow() {
-	if (!glfwInit()) {
-		std::cerr << "ERROR WHILE INITIATING GLFW";
-		return NULL;
+		glfwTerminate();
+
+		return result;
 	}
 
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if (arenaBench) {
+		int result = runFrameArenaBenchmark(500, 4);
 
-	GLFWwindow* window = glfwCreateWindow(800, 800, "Hello World OpenGL", NULL, NULL);
-	
-	if (window == NULL) {
-		std::cerr << "Failed to create GLFW window" << std::endl;
 		glfwTerminate();
 
-		return NULL;
+		return result;
 	}
 
-	glfwMakeContextCurrent(window);
+	if (ecsBenchEntities > 0) {
+		int result = runEcsBenchmark(1280, 720, ecsBenchEntities, 200);
 
-	glViewport(0, 0, 800, 800);
+		glfwTerminate();
 
-	GLenum err = glewInit();
+		return result;
+	}
 
-	if (err != GLEW_OK) {
-		std::cerr << "Error while init glew: " << glewGetErrorString(err);
-		return NULL;
+	if (particleBenchCount > 0) {
+		int result = runParticleBenchmark(1280, 720, particleBenchCount, 200);
+
+		glfwTerminate();
+
+		return result;
 	}
 
-	return window;
-}
+	if (spriteBenchCount > 0) {
+		int result = runSpriteBenchmark(1280, 720, spriteBenchCount, 200);
 
-int main() {	
-	GLFWwindow* window = configureAsCurrentAndCreateWindow();
+		glfwTerminate();
 
-	if (window == NULL) {
-		return -1;
+		return result;
 	}
-	// DETERMING AND BINDING SHADER PROGRAM..
-	unsigned int vertexShader = createVertexShader();
 
-	if (vertexShader == 0) {
-		return -1;
+	if (textBench) {
+		int result = runTextBenchmark(1280, 720, 200);
+
+		glfwTerminate();
+
+		return result;
+	}
+
+	if (debugDrawBenchCount > 0) {
+		int result = runDebugDrawBenchmark(1280, 720, debugDrawBenchCount, 200);
+
+		glfwTerminate();
+
+		return result;
+	}
+
+	if (skinningBenchCount > 0) {
+		int result = runSkinningBenchmark(1280, 720, skinningBenchCount, 200);
+
+		glfwTerminate();
+
+		return result;
 	}
 
-	unsigned int fragmentShader = createFragmentShader();
+	if (animationBenchCount > 0) {
+		int result = runAnimationBenchmark(animationBenchCount, 200);
+
+		glfwTerminate();
+
+		return result;
+	}
+
+	if (terrainBenchLevels > 0) {
+		int result = runTerrainBenchmark(1280, 720, terrainBenchLevels, 200);
+
+		glfwTerminate();
+
+		return result;
+	}
+
+	if (cullingBenchCount > 0) {
+		int result = runCullingBenchmark(1280, 720, cullingBenchCount, 300);
+
+		glfwTerminate();
+
+		return result;
+	}
+
+	if (occlusionBenchCount > 0) {
+		int result = runOcclusionBenchmark(1280, 720, occlusionBenchCount, 300);
+
+		glfwTerminate();
+
+		return result;
+	}
+
+	if (lodBenchCount > 0) {
+		int result = runLodBenchmark(1280, 720, lodBenchCount, 300);
+
+		glfwTerminate();
 
-	if (fragmentShader == 0) {
+		return result;
+	}
+	// DETERMING AND BINDING SHADER PROGRAM..
+	// Paths are relative to the working directory, the project directory under Visual Studio.
+	std::unique_ptr<Shader> triangleShader(new Shader("shaders/triangle.vs", "shaders/triangle.fs"));
+
+	if (triangleShader->ID == 0) {
+		triangleShader.reset();
+		glfwTerminate();
 		return -1;
 	}
 
-	unsigned int shaderProgram = createShaderProgram(vertexShader, fragmentShader);
-	
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
+	// Everything below is released through the manager before the context goes away.
+	std::unique_ptr<GpuResourceManager> resources(new GpuResourceManager());
+	std::unique_ptr<BufferAllocator> buffers(new BufferAllocator(1 << 20));
 
-	glUseProgram(shaderProgram);
+	triangleShader->use();
 	// DETERMING AND BINDING SHADER PROGRAM..
 
 	float vertices[] = {
@@ -177,23 +375,182 @@ int main() {
 		-0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f
 	};
 
-	unsigned int VAO = defineTriangles(vertices, sizeof(float) * 18);
-
-	glBindVertexArray(VAO);
+	BufferRange triangleRange;
+	VertexArrayHandle VAO = defineTriangles(*resources, *buffers, vertices, sizeof(float) * 18, triangleRange);
+	unsigned int triangleLayout = buffers->layoutVersion();
 
 	int renderLoops = 0;
 
-	while (!glfwWindowShouldClose(window)) {
-		glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
-
+	auto drawTriangle = [&]() {
+		triangleShader->use();
+		glBindVertexArray(resources->get(VAO));
 		glDrawArrays(GL_TRIANGLES, 0, 3);
+	};
+
+	if (goldenDirectory != NULL) {
+		std::vector<GoldenScene> scenes;
+
+		GoldenScene triangleScene;
+		triangleScene.name = "triangle";
+		triangleScene.render = [&]() {
+			glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			drawTriangle();
+		};
+		scenes.push_back(triangleScene);
+
+		int failures = runGoldenScenes(scenes, goldenDirectory, recordGolden, 800, 800, defaultImageCompareOptions());
+
+		if (failures != 0) {
+			std::cerr << "ERROR::MAIN::GOLDEN_FAILED: " << failures << " of " << scenes.size() << " scenes in " << goldenDirectory
+				<< std::endl;
+		}
+
+		buffers.reset();
+		resources.reset();
+		triangleShader.reset();
+		glfwTerminate();
+
+		return failures == 0 ? 0 : 1;
+	}
+
+	// The triangle renders at a scale picked from GPU frame time into a
+	// framebuffer-sized target, which is upscaled to the window.
+	std::unique_ptr<DynamicResolution> resolution(new DynamicResolution(targetMilliseconds, 0.5f, 1.0f));
+
+	if (!resolution->isValid()) {
+		resolution.reset();
+		buffers.reset();
+		resources.reset();
+		triangleShader.reset();
+		glfwTerminate();
+
+		return -1;
+	}
+
+	int frameWidth;
+	int frameHeight;
+
+	glfwGetFramebufferSize(window, &frameWidth, &frameHeight);
+
+	std::unique_ptr<FrameCapture> capture;
+
+	if (capturePrefix != NULL) {
+		std::string prefix = capturePrefix;
+
+		// Captures keep the initial size.
+		glfwSetWindowAttrib(window, GLFW_RESIZABLE, GLFW_FALSE);
+
+		capture.reset(new FrameCapture(frameWidth, frameHeight, 3, [prefix](unsigned long long frameIndex, const Image& image) {
+			char suffix[32];
+			std::snprintf(suffix, sizeof(suffix), "_%06llu.ppm", frameIndex);
+			writePpm(prefix + suffix, image);
+		}));
+	}
+
+	TextureHandle sceneTexture = { 0 };
+	AllocationMonitor allocationMonitor(10);
+
+	// Saving either shader file swaps the recompiled program in at the next frame.
+	std::unique_ptr<ShaderReloader> shaderReloader(new ShaderReloader(window, !headless));
+	shaderReloader->watch(triangleShader.get());
+
+	std::unique_ptr<RenderGraph> frameGraph;
+	int graphWidth = 0;
+	int graphHeight = 0;
+	int result = 0;
+
+	while (!glfwWindowShouldClose(window) && (allocationCheckFrames == 0 || allocationMonitor.frameCount() < allocationCheckFrames)) {
+		allocationMonitor.beginFrame();
+		glfwGetFramebufferSize(window, &frameWidth, &frameHeight);
+
+		if (frameWidth == 0 || frameHeight == 0) {
+			// Minimized.
+			glfwWaitEvents();
+			continue;
+		}
+
+		if (frameWidth != graphWidth || frameHeight != graphHeight) {
+			graphWidth = frameWidth;
+			graphHeight = frameHeight;
+
+			// Frames in flight may still sample the old target; the manager
+			// deletes it once they have finished.
+			resources->destroy(sceneTexture);
+			sceneTexture = resources->createTexture2D(graphWidth, graphHeight, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+
+			frameGraph.reset(new RenderGraph());
+
+			RenderTextureDesc sceneDesc = { graphWidth, graphHeight, GL_RGBA8 };
+			RenderGraph::Resource scene = frameGraph->importTexture("scene", resources->get(sceneTexture), sceneDesc);
+			RenderGraph::Resource backbuffer = frameGraph->importBackbuffer(graphWidth, graphHeight);
+
+			frameGraph->addPass("triangle",
+				[&](RenderGraph::Builder& builder) {
+					builder.write(scene, LoadOp::Clear);
+					builder.setClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+				},
+				[&resolution, &drawTriangle, &graphWidth, &graphHeight](const RenderGraph&) {
+					resolution->setSceneViewport(graphWidth, graphHeight);
+					drawTriangle();
+				});
+
+			resolution->addUpscalePass(*frameGraph, scene, backbuffer);
+
+			if (!frameGraph->compile()) {
+				result = -1;
+				break;
+			}
+		}
+
+		shaderReloader->applyPendingReloads();
+		resolution->update();
+		resolution->beginFrame();
+		frameGraph->execute();
+		resolution->endFrame();
+		resources->endFrame();
+
+		// Compacts between frames; a move means the triangle's attributes need rebinding.
+		buffers->defragment(256 * 1024);
+
+		if (buffers->layoutVersion() != triangleLayout) {
+			triangleLayout = buffers->layoutVersion();
+			bindTriangleAttributes(resources->get(VAO), buffers->slice(triangleRange));
+		}
+
+		if (capture) {
+			capture->capture(0);
+		}
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+
+		allocationMonitor.endFrame();
+
+		if (allocationCheckFrames > 0 && allocationMonitor.isWarmedUp() && allocationMonitor.lastFrame().allocations > 0) {
+			std::cout << "frame " << allocationMonitor.frameCount() - 1 << ": " << allocationMonitor.lastFrame().allocations
+				<< " allocations, " << allocationMonitor.lastFrame().bytes << " bytes" << std::endl;
+		}
 	}
 
+	if (result == 0 && allocationCheckFrames > 0) {
+		std::cout << "ALLOCATION CHECK " << allocationMonitor.frameCount() << " frames: " << allocationMonitor.steadyStateAllocations()
+			<< " allocations in " << allocationMonitor.steadyStateFramesAllocating() << " steady-state frames" << std::endl;
+
+		result = allocationMonitor.steadyStateFramesAllocating() == 0 ? 0 : 1;
+	}
+
+	frameGraph.reset();
+	resolution.reset();
+	buffers.reset();
+	resources.reset();
+
+	capture.reset();
+
+	shaderReloader.reset();
+	triangleShader.reset();
+
 	glfwTerminate();
 
-	return 0;
+	return result;
 };
\ No newline at end of file
@@ -0,0 +1,965 @@
+#include "occlusion.hpp"
+#include "glprogram.hpp"
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define OCCLUSION_USE_SSE
+#endif
+
+static const char* fullscreenVertexShaderSource = "#version 330 core\n"
+	"void main() {\n"
+	"vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+	"gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\0";
+
+static const char* copyDepthFragmentShaderSource = "#version 330 core\n"
+	"uniform sampler2D source;\n"
+	"out float depth;\n"
+	"void main() {\n"
+	"depth = texelFetch(source, ivec2(gl_FragCoord.xy), 0).r;\n"
+	"}\0";
+
+static const char* reduceDepthFragmentShaderSource = "#version 330 core\n"
+	"uniform sampler2D source;\n"
+	"uniform int sourceLevel;\n"
+	"uniform ivec2 sourceSize;\n"
+	"out float depth;\n"
+	"float fetch(ivec2 coord) {\n"
+	"return texelFetch(source, min(coord, sourceSize - 1), sourceLevel).r;\n"
+	"}\n"
+	"void main() {\n"
+	"ivec2 coord = ivec2(gl_FragCoord.xy) * 2;\n"
+	"float farthest = max(max(fetch(coord), fetch(coord + ivec2(1, 0))), max(fetch(coord + ivec2(0, 1)), fetch(coord + ivec2(1, 1))));\n"
+	"bool oddX = (sourceSize.x & 1) != 0;\n"
+	"bool oddY = (sourceSize.y & 1) != 0;\n"
+	"if (oddX) farthest = max(farthest, max(fetch(coord + ivec2(2, 0)), fetch(coord + ivec2(2, 1))));\n"
+	"if (oddY) farthest = max(farthest, max(fetch(coord + ivec2(0, 2)), fetch(coord + ivec2(1, 2))));\n"
+	"if (oddX && oddY) farthest = max(farthest, fetch(coord + ivec2(2, 2)));\n"
+	"depth = farthest;\n"
+	"}\0";
+
+DepthPyramid::DepthPyramid()
+	: pyramid(0), framebuffer(0), emptyVao(0), copyProgram(0), reduceProgram(0), pyramidWidth(0), pyramidHeight(0), levelCount(0) {
+	copyProgram = createProgram(fullscreenVertexShaderSource, copyDepthFragmentShaderSource);
+	reduceProgram = createProgram(fullscreenVertexShaderSource, reduceDepthFragmentShaderSource);
+
+	glGenFramebuffers(1, &framebuffer);
+	glGenVertexArrays(1, &emptyVao);
+}
+
+DepthPyramid::~DepthPyramid() {
+	glDeleteTextures(1, &pyramid);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteVertexArrays(1, &emptyVao);
+	glDeleteProgram(copyProgram);
+	glDeleteProgram(reduceProgram);
+}
+
+bool DepthPyramid::resize(int width, int height) {
+	if (copyProgram == 0 || reduceProgram == 0) {
+		return false;
+	}
+
+	if (width == pyramidWidth && height == pyramidHeight && pyramid != 0) {
+		return true;
+	}
+
+	pyramidWidth = width;
+	pyramidHeight = height;
+	levelCount = 1;
+
+	while ((width >> levelCount) > 0 || (height >> levelCount) > 0) {
+		levelCount++;
+	}
+
+	glDeleteTextures(1, &pyramid);
+	glGenTextures(1, &pyramid);
+	glBindTexture(GL_TEXTURE_2D, pyramid);
+
+	for (int level = 0; level < levelCount; level++) {
+		int levelWidth = std::max(1, width >> level);
+		int levelHeight = std::max(1, height >> level);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, levelWidth, levelHeight, 0, GL_RED, GL_FLOAT, NULL);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+	return true;
+}
+
+void DepthPyramid::build(unsigned int depthTexture) {
+	if (pyramid == 0) {
+		return;
+	}
+
+	int viewport[4];
+	int previousFramebuffer;
+
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glBindVertexArray(emptyVao);
+	glDisable(GL_DEPTH_TEST);
+	glActiveTexture(GL_TEXTURE0);
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, 0);
+	glViewport(0, 0, pyramidWidth, pyramidHeight);
+	glUseProgram(copyProgram);
+	glUniform1i(glGetUniformLocation(copyProgram, "source"), 0);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glUseProgram(reduceProgram);
+	glUniform1i(glGetUniformLocation(reduceProgram, "source"), 0);
+	glBindTexture(GL_TEXTURE_2D, pyramid);
+
+	for (int level = 1; level < levelCount; level++) {
+		int sourceWidth = std::max(1, pyramidWidth >> (level - 1));
+		int sourceHeight = std::max(1, pyramidHeight >> (level - 1));
+
+		// Only the source level is sampleable, so reading and writing the same texture is defined.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, level);
+		glViewport(0, 0, std::max(1, pyramidWidth >> level), std::max(1, pyramidHeight >> level));
+		glUniform1i(glGetUniformLocation(reduceProgram, "sourceLevel"), level - 1);
+		glUniform2i(glGetUniformLocation(reduceProgram, "sourceSize"), sourceWidth, sourceHeight);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+unsigned int DepthPyramid::texture() const {
+	return pyramid;
+}
+
+int DepthPyramid::width() const {
+	return pyramidWidth;
+}
+
+int DepthPyramid::height() const {
+	return pyramidHeight;
+}
+
+int DepthPyramid::levels() const {
+	return levelCount;
+}
+
+SoftwareOcclusionBuffer::SoftwareOcclusionBuffer(int width, int height)
+	: bufferWidth((width + 3) & ~3), bufferHeight(height), viewProjection(identity()) {
+	depth.assign((size_t)bufferWidth * bufferHeight, 1.0f);
+}
+
+void SoftwareOcclusionBuffer::clear(const Mat4& newViewProjection) {
+	viewProjection = newViewProjection;
+	std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+void SoftwareOcclusionBuffer::addOccluder(const Vec3& boxMin, const Vec3& boxMax) {
+	float x[8];
+	float y[8];
+	float farthest = 0.0f;
+
+	for (int i = 0; i < 8; i++) {
+		Vec4 clip = transform(viewProjection, vec4((i & 4) ? boxMax.x : boxMin.x, (i & 2) ? boxMax.y : boxMin.y, (i & 1) ? boxMax.z : boxMin.z, 1.0f));
+
+		// Dropping an occluder is always safe, so boxes crossing the near plane are skipped instead of clipped.
+		if (clip.w <= 1e-5f || clip.z < -clip.w) {
+			return;
+		}
+
+		x[i] = (clip.x / clip.w * 0.5f + 0.5f) * bufferWidth;
+		y[i] = (clip.y / clip.w * 0.5f + 0.5f) * bufferHeight;
+		farthest = std::max(farthest, clip.z / clip.w * 0.5f + 0.5f);
+	}
+
+	// The box covers exactly the convex hull of its projected corners, so it is
+	// drawn as that one polygon rather than as faces whose shared edges would
+	// each lose the pixels they cross.
+	int order[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+	std::sort(order, order + 8, [&](int a, int b) {
+		return x[a] < x[b] || (x[a] == x[b] && y[a] < y[b]);
+	});
+
+	auto turn = [&](int o, int a, int b) {
+		return (x[a] - x[o]) * (y[b] - y[o]) - (y[a] - y[o]) * (x[b] - x[o]);
+	};
+
+	// Andrew's monotone chain, counter-clockwise.
+	int hull[16];
+	int hullCount = 0;
+
+	for (int i = 0; i < 8; i++) {
+		while (hullCount >= 2 && turn(hull[hullCount - 2], hull[hullCount - 1], order[i]) <= 0.0f) {
+			hullCount--;
+		}
+
+		hull[hullCount++] = order[i];
+	}
+
+	for (int i = 6, lower = hullCount + 1; i >= 0; i--) {
+		while (hullCount >= lower && turn(hull[hullCount - 2], hull[hullCount - 1], order[i]) <= 0.0f) {
+			hullCount--;
+		}
+
+		hull[hullCount++] = order[i];
+	}
+
+	// The last point repeats the first.
+	hullCount--;
+
+	if (hullCount < 3) {
+		return;
+	}
+
+	float hullX[8];
+	float hullY[8];
+
+	for (int i = 0; i < hullCount; i++) {
+		hullX[i] = x[hull[i]];
+		hullY[i] = y[hull[i]];
+	}
+
+	rasterizeConvex(hullX, hullY, hullCount, farthest);
+}
+
+void SoftwareOcclusionBuffer::addOccluderTriangles(const Vec3* vertices, size_t vertexCount) {
+	for (size_t i = 0; i + 2 < vertexCount; i += 3) {
+		float x[3];
+		float y[3];
+		float farthest = 0.0f;
+		bool behind = false;
+
+		for (int v = 0; v < 3; v++) {
+			Vec4 clip = transform(viewProjection, vec4(vertices[i + v].x, vertices[i + v].y, vertices[i + v].z, 1.0f));
+
+			// Dropping an occluder is always safe, so triangles crossing the near plane are skipped instead of clipped.
+			if (clip.w <= 1e-5f || clip.z < -clip.w) {
+				behind = true;
+				break;
+			}
+
+			x[v] = (clip.x / clip.w * 0.5f + 0.5f) * bufferWidth;
+			y[v] = (clip.y / clip.w * 0.5f + 0.5f) * bufferHeight;
+			farthest = std::max(farthest, clip.z / clip.w * 0.5f + 0.5f);
+		}
+
+		if (behind) {
+			continue;
+		}
+
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+
+		if (area == 0.0f) {
+			continue;
+		}
+
+		// Occluders are double sided: flip clockwise triangles instead of rejecting them.
+		if (area < 0.0f) {
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+		}
+
+		rasterizeConvex(x, y, 3, farthest);
+	}
+}
+
+void SoftwareOcclusionBuffer::rasterizeConvex(const float* pointsX, const float* pointsY, int count, float farthest) {
+	float boundsMinX = pointsX[0], boundsMaxX = pointsX[0];
+	float boundsMinY = pointsY[0], boundsMaxY = pointsY[0];
+
+	float edgeA[8];
+	float edgeB[8];
+	float edgeC[8];
+
+	for (int e = 0; e < count; e++) {
+		int next = e + 1 < count ? e + 1 : 0;
+
+		boundsMinX = std::min(boundsMinX, pointsX[e]);
+		boundsMaxX = std::max(boundsMaxX, pointsX[e]);
+		boundsMinY = std::min(boundsMinY, pointsY[e]);
+		boundsMaxY = std::max(boundsMaxY, pointsY[e]);
+
+		// Edge e is A * x + B * y + C and is non-negative inside the polygon.
+		// Tested at pixel centers, C is lowered by the most the edge function
+		// drops within half a pixel, so only pixels fully inside are written:
+		// a partly covered pixel may still show what is behind the occluder.
+		edgeA[e] = pointsY[e] - pointsY[next];
+		edgeB[e] = pointsX[next] - pointsX[e];
+		edgeC[e] = pointsX[e] * pointsY[next] - pointsX[next] * pointsY[e] - 0.5f * (std::fabs(edgeA[e]) + std::fabs(edgeB[e]));
+	}
+
+	// Clamped before converting, as corners close to the camera plane project far outside.
+	int minX = (int)std::floor(std::min(std::max(boundsMinX, 0.0f), (float)bufferWidth));
+	int maxX = (int)std::ceil(std::min(std::max(boundsMaxX, -1.0f), (float)(bufferWidth - 1)));
+	int minY = (int)std::floor(std::min(std::max(boundsMinY, 0.0f), (float)bufferHeight));
+	int maxY = (int)std::ceil(std::min(std::max(boundsMaxY, -1.0f), (float)(bufferHeight - 1)));
+
+	if (minX > maxX || minY > maxY) {
+		return;
+	}
+
+	minX &= ~3;
+
+#ifdef OCCLUSION_USE_SSE
+	__m128 laneOffset = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	__m128 zero = _mm_setzero_ps();
+	__m128 polygonDepth = _mm_set1_ps(farthest);
+
+	for (int y = minY; y <= maxY; y++) {
+		float* row = &depth[(size_t)y * bufferWidth];
+		__m128 centerY = _mm_set1_ps(y + 0.5f);
+
+		for (int x = minX; x <= maxX; x += 4) {
+			__m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), laneOffset);
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+
+			for (int e = 0; e < count; e++) {
+				__m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[e]), centerX),
+					_mm_mul_ps(_mm_set1_ps(edgeB[e]), centerY)), _mm_set1_ps(edgeC[e]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(value, zero));
+			}
+
+			if (_mm_movemask_ps(inside) == 0) {
+				continue;
+			}
+
+			__m128 current = _mm_loadu_ps(row + x);
+			__m128 nearer = _mm_min_ps(current, polygonDepth);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+		}
+	}
+#else
+	for (int y = minY; y <= maxY; y++) {
+		float* row = &depth[(size_t)y * bufferWidth];
+		float centerY = y + 0.5f;
+
+		for (int x = minX; x <= maxX; x++) {
+			float centerX = x + 0.5f;
+			bool inside = true;
+
+			for (int e = 0; e < count; e++) {
+				inside = inside && edgeA[e] * centerX + edgeB[e] * centerY + edgeC[e] >= 0.0f;
+			}
+
+			if (inside) {
+				row[x] = std::min(row[x], farthest);
+			}
+		}
+	}
+#endif
+}
+
+bool SoftwareOcclusionBuffer::isVisible(const BoundingSphere& sphere) const {
+	float minX = 1.0f, minY = 1.0f, minZ = 1.0f;
+	float maxX = -1.0f, maxY = -1.0f;
+
+	for (int i = 0; i < 8; i++) {
+		Vec4 corner = vec4(
+			sphere.center.x + ((i & 1) ? sphere.radius : -sphere.radius),
+			sphere.center.y + ((i & 2) ? sphere.radius : -sphere.radius),
+			sphere.center.z + ((i & 4) ? sphere.radius : -sphere.radius),
+			1.0f);
+		Vec4 clip = transform(viewProjection, corner);
+
+		if (clip.w <= 1e-5f) {
+			return true;
+		}
+
+		minX = std::min(minX, clip.x / clip.w);
+		minY = std::min(minY, clip.y / clip.w);
+		minZ = std::min(minZ, clip.z / clip.w);
+		maxX = std::max(maxX, clip.x / clip.w);
+		maxY = std::max(maxY, clip.y / clip.w);
+	}
+
+	float nearest = minZ * 0.5f + 0.5f;
+
+	// Clamped to NDC first, as corners close to the camera plane project far outside.
+	minX = std::min(std::max(minX, -1.0f), 1.0f);
+	maxX = std::min(std::max(maxX, -1.0f), 1.0f);
+	minY = std::min(std::max(minY, -1.0f), 1.0f);
+	maxY = std::min(std::max(maxY, -1.0f), 1.0f);
+
+	int startX = std::max(0, (int)std::floor((minX * 0.5f + 0.5f) * bufferWidth));
+	int endX = std::min(bufferWidth - 1, (int)std::ceil((maxX * 0.5f + 0.5f) * bufferWidth));
+	int startY = std::max(0, (int)std::floor((minY * 0.5f + 0.5f) * bufferHeight));
+	int endY = std::min(bufferHeight - 1, (int)std::ceil((maxY * 0.5f + 0.5f) * bufferHeight));
+
+	if (startX > endX || startY > endY) {
+		return true;
+	}
+
+	for (int y = startY; y <= endY; y++) {
+		const float* row = &depth[(size_t)y * bufferWidth];
+		int x = startX;
+
+#ifdef OCCLUSION_USE_SSE
+		__m128 objectDepth = _mm_set1_ps(nearest);
+
+		for (; x + 3 <= endX; x += 4) {
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), objectDepth)) != 0) {
+				return true;
+			}
+		}
+#endif
+
+		for (; x <= endX; x++) {
+			if (row[x] >= nearest) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+int SoftwareOcclusionBuffer::width() const {
+	return bufferWidth;
+}
+
+int SoftwareOcclusionBuffer::height() const {
+	return bufferHeight;
+}
+
+const float* SoftwareOcclusionBuffer::data() const {
+	return depth.data();
+}
+
+static const char* occlusionBenchVertexShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec3 position;\n"
+	"layout (location = 1) in vec3 normal;\n"
+	"layout (location = 2) in uint boxId;\n"
+	"uniform samplerBuffer boxes;\n"
+	"uniform mat4 viewProjection;\n"
+	"uniform uint firstBuilding;\n"
+	"out vec3 worldNormal;\n"
+	"out vec3 color;\n"
+	"void main() {\n"
+	"vec3 center = texelFetch(boxes, int(boxId) * 2).xyz;\n"
+	"vec3 halfExtent = texelFetch(boxes, int(boxId) * 2 + 1).xyz;\n"
+	"gl_Position = viewProjection * vec4(center + position * halfExtent, 1.0);\n"
+	"worldNormal = normal;\n"
+	"color = boxId >= firstBuilding ? vec3(0.55, 0.57, 0.6) : 0.55 + 0.45 * sin(float(boxId) * vec3(0.37, 0.71, 1.13));\n"
+	"}\0";
+
+static const char* occlusionBenchFragmentShaderSource = "#version 330 core\n"
+	"in vec3 worldNormal;\n"
+	"in vec3 color;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"float light = 0.3 + 0.7 * max(dot(normalize(worldNormal), normalize(vec3(0.4, 0.8, 0.3))), 0.0);\n"
+	"FragColor = vec4(color * light, 1.0);\n"
+	"}\0";
+
+// Cube from -1 to 1, position and normal per vertex, two triangles per face.
+static void buildOcclusionBenchCube(std::vector<float>& vertices, std::vector<unsigned int>& indices) {
+	for (int axis = 0; axis < 3; axis++) {
+		for (int side = -1; side <= 1; side += 2) {
+			int u = (axis + 1) % 3;
+			int v = (axis + 2) % 3;
+			unsigned int base = (unsigned int)(vertices.size() / 6);
+
+			for (int corner = 0; corner < 4; corner++) {
+				float vertex[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+				vertex[axis] = (float)side;
+				vertex[u] = (corner == 1 || corner == 2) ? 1.0f : -1.0f;
+				vertex[v] = corner >= 2 ? 1.0f : -1.0f;
+				vertex[3 + axis] = (float)side;
+				vertices.insert(vertices.end(), vertex, vertex + 6);
+			}
+
+			unsigned int face[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+			indices.insert(indices.end(), face, face + 6);
+		}
+	}
+}
+
+// Entry distance along the ray, 0 when it starts inside, or a negative value on a miss.
+static float rayBoxEntry(const Vec3& origin, const Vec3& direction, const Vec3& boxMin, const Vec3& boxMax) {
+	float entry = 0.0f;
+	float exit = 1e30f;
+	const float* o = &origin.x;
+	const float* d = &direction.x;
+	const float* lower = &boxMin.x;
+	const float* upper = &boxMax.x;
+
+	for (int axis = 0; axis < 3; axis++) {
+		if (std::fabs(d[axis]) < 1e-12f) {
+			if (o[axis] < lower[axis] || o[axis] > upper[axis]) {
+				return -1.0f;
+			}
+
+			continue;
+		}
+
+		float t0 = (lower[axis] - o[axis]) / d[axis];
+		float t1 = (upper[axis] - o[axis]) / d[axis];
+		entry = std::max(entry, std::min(t0, t1));
+		exit = std::min(exit, std::max(t0, t1));
+	}
+
+	return entry <= exit ? entry : -1.0f;
+}
+
+// Screen rectangle of the box around a sphere or of a box, in NDC. False when
+// part of it is behind the camera and the whole screen has to be assumed.
+static bool projectBoxBounds(const Mat4& viewProjection, const Vec3& boxMin, const Vec3& boxMax, Vec4& bounds) {
+	bounds = vec4(1.0f, 1.0f, -1.0f, -1.0f);
+
+	for (int i = 0; i < 8; i++) {
+		Vec4 clip = transform(viewProjection, vec4((i & 1) ? boxMax.x : boxMin.x, (i & 2) ? boxMax.y : boxMin.y, (i & 4) ? boxMax.z : boxMin.z, 1.0f));
+
+		if (clip.w <= 1e-5f) {
+			bounds = vec4(-1.0f, -1.0f, 1.0f, 1.0f);
+			return false;
+		}
+
+		bounds.x = std::min(bounds.x, clip.x / clip.w);
+		bounds.y = std::min(bounds.y, clip.y / clip.w);
+		bounds.z = std::max(bounds.z, clip.x / clip.w);
+		bounds.w = std::max(bounds.w, clip.y / clip.w);
+	}
+
+	return true;
+}
+
+// Brute force: casts a ray through every pixel center of a width x height
+// view that the sphere might cover and reports whether one reaches the sphere
+// before any occluder box. The sphere shrinks and the boxes grow by tolerance,
+// so pixels that rasterization could decide either way do not count.
+static bool sphereSeenPastBoxes(const Mat4& viewProjection, const Mat4& inverseViewProjection, int width, int height,
+	const BoundingSphere& sphere, const std::vector<Vec3>& boxMin, const std::vector<Vec3>& boxMax, float tolerance) {
+	Vec3 extent = vec3(sphere.radius, sphere.radius, sphere.radius);
+	Vec4 bounds;
+	projectBoxBounds(viewProjection, sub(sphere.center, extent), add(sphere.center, extent), bounds);
+
+	// Pixel centers inside the rectangle.
+	int startX = std::max(0, (int)std::ceil((std::max(bounds.x, -1.0f) * 0.5f + 0.5f) * width - 0.5f));
+	int endX = std::min(width - 1, (int)std::floor((std::min(bounds.z, 1.0f) * 0.5f + 0.5f) * width - 0.5f));
+	int startY = std::max(0, (int)std::ceil((std::max(bounds.y, -1.0f) * 0.5f + 0.5f) * height - 0.5f));
+	int endY = std::min(height - 1, (int)std::floor((std::min(bounds.w, 1.0f) * 0.5f + 0.5f) * height - 0.5f));
+
+	Vec3 margin = vec3(tolerance, tolerance, tolerance);
+	std::vector<Vec3> nearMin;
+	std::vector<Vec3> nearMax;
+
+	for (size_t b = 0; b < boxMin.size(); b++) {
+		Vec4 boxBounds;
+		projectBoxBounds(viewProjection, boxMin[b], boxMax[b], boxBounds);
+
+		if (boxBounds.x <= bounds.z && boxBounds.z >= bounds.x && boxBounds.y <= bounds.w && boxBounds.w >= bounds.y) {
+			nearMin.push_back(sub(boxMin[b], margin));
+			nearMax.push_back(add(boxMax[b], margin));
+		}
+	}
+
+	float radius = std::max(sphere.radius - tolerance, sphere.radius * 0.5f);
+
+	for (int y = startY; y <= endY; y++) {
+		for (int x = startX; x <= endX; x++) {
+			float ndcX = (x + 0.5f) / width * 2.0f - 1.0f;
+			float ndcY = (y + 0.5f) / height * 2.0f - 1.0f;
+			Vec4 nearPoint = transform(inverseViewProjection, vec4(ndcX, ndcY, -1.0f, 1.0f));
+			Vec4 farPoint = transform(inverseViewProjection, vec4(ndcX, ndcY, 1.0f, 1.0f));
+			Vec3 origin = scale(vec3(nearPoint.x, nearPoint.y, nearPoint.z), 1.0f / nearPoint.w);
+			Vec3 direction = sub(scale(vec3(farPoint.x, farPoint.y, farPoint.z), 1.0f / farPoint.w), origin);
+
+			// Between the near (0) and far (1) planes.
+			Vec3 offset = sub(origin, sphere.center);
+			float a = dot(direction, direction);
+			float b = dot(direction, offset);
+			float c = dot(offset, offset) - radius * radius;
+			float discriminant = b * b - a * c;
+
+			if (discriminant < 0.0f) {
+				continue;
+			}
+
+			float root = std::sqrt(discriminant);
+			float sphereEntry = std::max((-b - root) / a, 0.0f);
+
+			if ((-b + root) / a < 0.0f || sphereEntry > 1.0f) {
+				continue;
+			}
+
+			bool blocked = false;
+
+			for (size_t i = 0; i < nearMin.size() && !blocked; i++) {
+				float boxEntry = rayBoxEntry(origin, direction, nearMin[i], nearMax[i]);
+				blocked = boxEntry >= 0.0f && boxEntry <= sphereEntry;
+			}
+
+			if (!blocked) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+int runOcclusionBenchmark(int width, int height, int instanceCount, int frames) {
+	static const char* pathNames[3] = { "frustum only", "software occlusion", "Hi-Z occlusion" };
+	const int warmupFrames = 10;
+	const int checkViews = 8;
+	const int blocksPerSide = 6;
+	const float blockPitch = 12.0f;
+	const float blockSize = 8.0f;
+	const float streetHalfWidth = (blockPitch - blockSize) * 0.5f;
+
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	buildOcclusionBenchCube(vertices, indices);
+
+	// A city block grid whose streets are scattered with small cubes, a
+	// quarter of them floating up to rooftop height. Instances come first in
+	// the box data, then the buildings.
+	unsigned int seed = 2024;
+
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) / 16777216.0f;
+	};
+
+	int buildingCount = blocksPerSide * blocksPerSide;
+	float worldSize = blocksPerSide * blockPitch;
+	std::vector<Vec3> buildingMin(buildingCount);
+	std::vector<Vec3> buildingMax(buildingCount);
+	std::vector<Vec4> boxData;
+	std::vector<CullInstance> instances(instanceCount);
+
+	auto inBlock = [&](float coordinate, float halfExtent) {
+		float local = coordinate - blockPitch * std::floor(coordinate / blockPitch);
+		return coordinate >= 0.0f && coordinate < worldSize
+			&& local >= streetHalfWidth - halfExtent && local <= streetHalfWidth + blockSize + halfExtent;
+	};
+
+	for (int i = 0; i < instanceCount; i++) {
+		float halfExtent = 0.25f + 0.35f * random();
+		Vec3 center;
+
+		do {
+			center.x = -streetHalfWidth + random() * (worldSize + 2.0f * streetHalfWidth);
+			center.z = -streetHalfWidth + random() * (worldSize + 2.0f * streetHalfWidth);
+		} while (inBlock(center.x, halfExtent) && inBlock(center.z, halfExtent));
+
+		center.y = halfExtent + (random() < 0.25f ? random() * 16.0f : 0.0f);
+
+		instances[i].bounds.center = center;
+		instances[i].bounds.radius = halfExtent * 1.7320508f;
+		instances[i].indexCount = (unsigned int)indices.size();
+		instances[i].firstIndex = 0;
+		instances[i].baseVertex = 0;
+		instances[i].padding = 0;
+		boxData.push_back(vec4(center.x, center.y, center.z, 0.0f));
+		boxData.push_back(vec4(halfExtent, halfExtent, halfExtent, 0.0f));
+	}
+
+	std::vector<unsigned int> buildingIds(buildingCount);
+
+	for (int i = 0; i < buildingCount; i++) {
+		float x = (i % blocksPerSide) * blockPitch + streetHalfWidth;
+		float z = (i / blocksPerSide) * blockPitch + streetHalfWidth;
+		float buildingHeight = 6.0f + 14.0f * random();
+
+		buildingMin[i] = vec3(x, 0.0f, z);
+		buildingMax[i] = vec3(x + blockSize, buildingHeight, z + blockSize);
+		buildingIds[i] = (unsigned int)(instanceCount + i);
+		boxData.push_back(vec4(x + blockSize * 0.5f, buildingHeight * 0.5f, z + blockSize * 0.5f, 0.0f));
+		boxData.push_back(vec4(blockSize * 0.5f, buildingHeight * 0.5f, blockSize * 0.5f, 0.0f));
+	}
+
+	unsigned int program = createProgram(occlusionBenchVertexShaderSource, occlusionBenchFragmentShaderSource);
+	int result = program != 0 ? 0 : -1;
+
+	unsigned int buffers[4];
+	unsigned int boxTexture;
+	glGenBuffers(4, buffers);
+	glGenTextures(1, &boxTexture);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[2]);
+	glBufferData(GL_TEXTURE_BUFFER, boxData.size() * sizeof(Vec4), boxData.data(), GL_STATIC_DRAW);
+	glBindTexture(GL_TEXTURE_BUFFER, boxTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffers[2]);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	// One vertex array per culler, since each attaches its own instance id
+	// buffer, and one drawing every building from a fixed id buffer.
+	std::unique_ptr<InstanceCuller> cullers[3] = {
+		std::unique_ptr<InstanceCuller>(new InstanceCuller(false)),
+		std::unique_ptr<InstanceCuller>(new InstanceCuller(false)),
+		std::unique_ptr<InstanceCuller>(new InstanceCuller(true))
+	};
+	unsigned int vaos[4];
+	glGenVertexArrays(4, vaos);
+
+	for (int v = 0; v < 4; v++) {
+		glBindVertexArray(vaos[v]);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+
+		if (v == 0) {
+			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+		}
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+
+		if (v == 0) {
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+		}
+
+		if (v < 3) {
+			cullers[v]->setInstances(instances);
+			cullers[v]->attachInstanceIds(vaos[v], 2);
+			continue;
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[3]);
+		glBufferData(GL_ARRAY_BUFFER, buildingIds.size() * sizeof(unsigned int), buildingIds.data(), GL_STATIC_DRAW);
+		glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, 0, (void*)0);
+		glVertexAttribDivisor(2, 1);
+		glEnableVertexAttribArray(2);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	SoftwareOcclusionBuffer softwareBuffer(width / 4, height / 4);
+	DepthPyramid pyramid;
+	cullers[1]->setOcclusionBuffer(&softwareBuffer);
+
+	int pathCount = cullers[2]->isGpuDriven() && pyramid.resize(width, height) ? 3 : 2;
+	int path = 0;
+
+	if (pathCount == 3) {
+		cullers[2]->setOcclusionPyramid(pyramid.texture(), pyramid.width(), pyramid.height());
+	}
+
+	Mat4 projection = perspective(1.0f, (float)width / height, 0.25f, 2.0f * worldSize);
+	Mat4 viewProjection = identity();
+
+	// Walks up and down the middle street at eye height while turning, so the
+	// view alternates between looking along the street and into buildings.
+	auto placeCamera = [&](float t) {
+		Vec3 eye = vec3(worldSize * 0.5f, 1.7f, worldSize * (0.5f + 0.4f * std::sin(t * 0.5f)));
+		Vec3 forward = vec3(std::sin(t), -0.05f, std::cos(t));
+		viewProjection = multiply(projection, lookAt(eye, add(eye, forward), vec3(0.0f, 1.0f, 0.0f)));
+	};
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	RenderTextureDesc depthDesc = { width, height, GL_DEPTH_COMPONENT24 };
+	RenderGraph graph;
+	RenderGraph::Resource output = graph.importTexture("output", outputTexture, outputDesc);
+	RenderGraph::Resource depth = 0;
+	double cullMilliseconds = 0.0;
+
+	auto beginBoxes = [&]() {
+		glEnable(GL_DEPTH_TEST);
+		glDepthMask(GL_TRUE);
+		glUseProgram(program);
+		glUniformMatrix4fv(glGetUniformLocation(program, "viewProjection"), 1, GL_FALSE, viewProjection.m);
+		glUniform1ui(glGetUniformLocation(program, "firstBuilding"), (unsigned int)instanceCount);
+		glUniform1i(glGetUniformLocation(program, "boxes"), 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_BUFFER, boxTexture);
+	};
+
+	auto endBoxes = [&]() {
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glDisable(GL_DEPTH_TEST);
+	};
+
+	graph.addPass("buildings",
+		[&](RenderGraph::Builder& builder) {
+			depth = builder.create("occlusion.depth", depthDesc);
+
+			builder.write(output, LoadOp::Clear);
+			builder.write(depth, LoadOp::Clear);
+			builder.setClearColor(0.08f, 0.09f, 0.12f, 1.0f);
+		},
+		[&](const RenderGraph&) {
+			beginBoxes();
+			glBindVertexArray(vaos[3]);
+			glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, (void*)0, buildingCount);
+			endBoxes();
+		});
+
+	// Occluders are the buildings of this frame, drawn first, rather than last frame's depth.
+	graph.addPass("cull",
+		[&](RenderGraph::Builder& builder) {
+			builder.read(depth);
+			builder.sideEffect();
+		},
+		[&](const RenderGraph& executing) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			if (path == 1) {
+				softwareBuffer.clear(viewProjection);
+
+				for (int i = 0; i < buildingCount; i++) {
+					softwareBuffer.addOccluder(buildingMin[i], buildingMax[i]);
+				}
+			}
+			else if (path == 2) {
+				pyramid.build(executing.texture(depth));
+			}
+
+			cullers[path]->cull(viewProjection);
+			cullMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		});
+
+	graph.addPass("instances",
+		[&](RenderGraph::Builder& builder) {
+			builder.write(output, LoadOp::Load);
+			builder.write(depth, LoadOp::Load);
+		},
+		[&](const RenderGraph&) {
+			beginBoxes();
+			cullers[path]->draw();
+			endBoxes();
+		});
+
+	if (result == 0 && !graph.compile()) {
+		result = -1;
+	}
+
+	if (result == 0) {
+		std::cout << "OCCLUSION BENCHMARK " << width << "x" << height << ", " << instanceCount << " instances among " << buildingCount
+			<< " buildings, software occlusion at " << softwareBuffer.width() << "x" << softwareBuffer.height() << ", "
+			<< (pathCount == 3 ? "Hi-Z by compute" : "no Hi-Z (no GL 4.3)") << ", " << frames << " frames" << std::endl;
+	}
+
+	for (path = 0; path < pathCount && result == 0; path++) {
+		GpuTimer timer(4);
+		unsigned long long drawn = 0;
+		unsigned long long occlusionCulled = 0;
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				timer.wait();
+				timer.resetAverage();
+				cullMilliseconds = 0.0;
+				drawn = 0;
+				occlusionCulled = 0;
+			}
+
+			placeCamera(frame * 0.02f);
+
+			timer.begin();
+			graph.execute();
+			timer.end();
+			timer.poll();
+
+			drawn += cullers[path]->stats().drawn;
+			occlusionCulled += cullers[path]->stats().occlusionCulled;
+		}
+
+		timer.wait();
+
+		std::cout << pathNames[path] << ": " << cullMilliseconds / frames << " ms CPU in occluders and cull(), " << timer.averageMilliseconds()
+			<< " ms GPU per frame, " << (double)drawn / frames << " of " << instanceCount << " instances drawn and "
+			<< (double)occlusionCulled / frames << " occlusion culled per frame" << (path == 2 ? " (counters lag a frame or two)" : "") << std::endl;
+	}
+
+	// Every path against ray casting each pixel: an instance that is culled
+	// while in the frustum must be hidden everywhere on screen.
+	std::vector<unsigned int> visible;
+	std::vector<char> seen(instanceCount);
+	std::vector<char> kept(instanceCount);
+	unsigned int hiddenCulled[3] = { 0, 0, 0 };
+	unsigned int visibleCulled[3] = { 0, 0, 0 };
+	unsigned int hiddenTotal = 0;
+
+	for (int view = 0; view < checkViews && result == 0; view++) {
+		placeCamera(view * 12.566371f / checkViews);
+
+		Frustum frustum = extractFrustum(viewProjection);
+		Mat4 inverseViewProjection = inverse(viewProjection);
+
+		for (int i = 0; i < instanceCount; i++) {
+			const BoundingSphere& sphere = instances[i].bounds;
+			bool inFrustum = sphereInFrustum(frustum, sphere);
+
+			seen[i] = inFrustum && sphereSeenPastBoxes(viewProjection, inverseViewProjection, width, height, sphere, buildingMin, buildingMax, 0.01f);
+			hiddenTotal += inFrustum && !seen[i] ? 1 : 0;
+		}
+
+		for (path = 0; path < pathCount; path++) {
+			graph.execute();
+			cullers[path]->readVisibleInstances(visible);
+
+			std::fill(kept.begin(), kept.end(), 0);
+
+			for (size_t i = 0; i < visible.size(); i++) {
+				kept[visible[i]] = 1;
+			}
+
+			for (int i = 0; i < instanceCount; i++) {
+				if (kept[i] || !sphereInFrustum(frustum, instances[i].bounds)) {
+					continue;
+				}
+
+				if (seen[i]) {
+					visibleCulled[path]++;
+				}
+				else {
+					hiddenCulled[path]++;
+				}
+			}
+		}
+	}
+
+	for (path = 0; path < pathCount && result != -1; path++) {
+		std::cout << pathNames[path] << " vs ray casting: culled " << hiddenCulled[path] << " of " << hiddenTotal << " hidden instances in "
+			<< checkViews << " views, " << visibleCulled[path] << " visible instances culled" << std::endl;
+
+		if (visibleCulled[path] != 0) {
+			std::cerr << "ERROR::OCCLUSION::VISIBLE_CULLED: " << pathNames[path] << " path" << std::endl;
+			result = 1;
+		}
+	}
+
+	cullers[0].reset();
+	cullers[1].reset();
+	cullers[2].reset();
+
+	glDeleteVertexArrays(4, vaos);
+	glDeleteBuffers(4, buffers);
+	glDeleteTextures(1, &boxTexture);
+	glDeleteTextures(1, &outputTexture);
+	glDeleteProgram(program);
+
+	return result;
+}
@@ -0,0 +1,797 @@
+#include "particles.hpp"
+#include "glprogram.hpp"
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define PARTICLES_USE_SSE
+#endif
+
+static_assert(sizeof(GpuParticle) == 32, "GpuParticle must match two RGBA32F texels and the std430 Particle struct");
+
+// Emission and integration shared by the transform feedback and compute
+// paths. CpuParticleSimulation repeats it operation for operation.
+#define PARTICLE_UPDATE_GLSL \
+	"uniform vec4 emitterOrigin;\n" \
+	"uniform vec4 emitterMotion;\n" \
+	"uniform vec2 emitterLifetime;\n" \
+	"uniform uvec4 stepEmission;\n" \
+	"uniform float deltaTime;\n" \
+	"uint hashUint(uint v) {\n" \
+	"uint state = v * 747796405u + 2891336453u;\n" \
+	"uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;\n" \
+	"return (word >> 22u) ^ word;\n" \
+	"}\n" \
+	"float unitFloat(uint h) {\n" \
+	"return float(h >> 8u) * (1.0 / 16777216.0);\n" \
+	"}\n" \
+	"void updateParticle(uint index, inout vec4 positionAge, inout vec4 velocityLifetime) {\n" \
+	"if (((index - stepEmission.x) & (stepEmission.w - 1u)) < stepEmission.y) {\n" \
+	"uint h0 = hashUint(index ^ hashUint(stepEmission.z));\n" \
+	"uint h1 = hashUint(h0);\n" \
+	"uint h2 = hashUint(h1);\n" \
+	"uint h3 = hashUint(h2);\n" \
+	"float speed = emitterMotion.x * (0.75 + 0.25 * unitFloat(h2));\n" \
+	"positionAge = vec4(emitterOrigin.xyz, 0.0);\n" \
+	"velocityLifetime.x = (unitFloat(h0) * 2.0 - 1.0) * emitterOrigin.w * speed;\n" \
+	"velocityLifetime.y = speed;\n" \
+	"velocityLifetime.z = (unitFloat(h1) * 2.0 - 1.0) * emitterOrigin.w * speed;\n" \
+	"velocityLifetime.w = emitterLifetime.x + (emitterLifetime.y - emitterLifetime.x) * unitFloat(h3);\n" \
+	"}\n" \
+	"if (positionAge.w >= velocityLifetime.w) return;\n" \
+	"velocityLifetime.y = velocityLifetime.y - emitterMotion.y * deltaTime;\n" \
+	"positionAge.xyz = positionAge.xyz + velocityLifetime.xyz * deltaTime;\n" \
+	"if (positionAge.y < 0.0) {\n" \
+	"positionAge.y = 0.0;\n" \
+	"velocityLifetime.y = -velocityLifetime.y * emitterMotion.z;\n" \
+	"}\n" \
+	"positionAge.w = positionAge.w + deltaTime;\n" \
+	"}\n"
+
+// Back to front; equal depths fall back to the index so the order is total.
+#define PARTICLE_KEY_ORDER_GLSL \
+	"bool keyFirst(vec2 a, vec2 b) {\n" \
+	"return a.x > b.x || (a.x == b.x && a.y < b.y);\n" \
+	"}\n"
+
+static const char* simulateFeedbackShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec4 aPositionAge;\n"
+	"layout (location = 1) in vec4 aVelocityLifetime;\n"
+	"out vec4 outPositionAge;\n"
+	"out vec4 outVelocityLifetime;\n"
+	PARTICLE_UPDATE_GLSL
+	"void main() {\n"
+	"vec4 positionAge = aPositionAge;\n"
+	"vec4 velocityLifetime = aVelocityLifetime;\n"
+	"updateParticle(uint(gl_VertexID), positionAge, velocityLifetime);\n"
+	"outPositionAge = positionAge;\n"
+	"outVelocityLifetime = velocityLifetime;\n"
+	"}\0";
+
+static const char* keyFeedbackShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec4 aPositionAge;\n"
+	"layout (location = 1) in vec4 aVelocityLifetime;\n"
+	"uniform vec4 depthRow;\n"
+	"out vec2 outKey;\n"
+	"void main() {\n"
+	"float depth = aPositionAge.w < aVelocityLifetime.w ? dot(depthRow, vec4(aPositionAge.xyz, 1.0)) : -1e30;\n"
+	"outKey = vec2(depth, float(gl_VertexID));\n"
+	"}\0";
+
+// One bitonic compare-exchange step; every vertex writes one sorted slot.
+static const char* sortStepFeedbackShaderSource = "#version 330 core\n"
+	"uniform samplerBuffer keys;\n"
+	"uniform int stepSize;\n"
+	"uniform int blockSize;\n"
+	"out vec2 outKey;\n"
+	PARTICLE_KEY_ORDER_GLSL
+	"void main() {\n"
+	"int index = gl_VertexID;\n"
+	"int partner = index ^ stepSize;\n"
+	"vec2 a = texelFetch(keys, index).xy;\n"
+	"vec2 b = texelFetch(keys, partner).xy;\n"
+	"bool wantFirst = (index < partner) == ((index & blockSize) == 0);\n"
+	"outKey = keyFirst(a, b) == wantFirst ? a : b;\n"
+	"}\0";
+
+static const char* simulateComputeShaderSource = "#version 430 core\n"
+	"layout (local_size_x = 256) in;\n"
+	"struct Particle { vec4 positionAge; vec4 velocityLifetime; };\n"
+	"layout (std430, binding = 0) buffer Particles { Particle particles[]; };\n"
+	PARTICLE_UPDATE_GLSL
+	"void main() {\n"
+	"uint index = gl_GlobalInvocationID.x;\n"
+	"Particle particle = particles[index];\n"
+	"updateParticle(index, particle.positionAge, particle.velocityLifetime);\n"
+	"particles[index] = particle;\n"
+	"}\0";
+
+static const char* keyComputeShaderSource = "#version 430 core\n"
+	"layout (local_size_x = 256) in;\n"
+	"struct Particle { vec4 positionAge; vec4 velocityLifetime; };\n"
+	"layout (std430, binding = 0) readonly buffer Particles { Particle particles[]; };\n"
+	"layout (std430, binding = 1) writeonly buffer Keys { vec2 keys[]; };\n"
+	"uniform vec4 depthRow;\n"
+	"void main() {\n"
+	"uint index = gl_GlobalInvocationID.x;\n"
+	"Particle particle = particles[index];\n"
+	"float depth = particle.positionAge.w < particle.velocityLifetime.w ? dot(depthRow, vec4(particle.positionAge.xyz, 1.0)) : -1e30;\n"
+	"keys[index] = vec2(depth, float(index));\n"
+	"}\0";
+
+// Steps whose pairs are further apart than a workgroup's 512 keys.
+static const char* sortStepComputeShaderSource = "#version 430 core\n"
+	"layout (local_size_x = 256) in;\n"
+	"layout (std430, binding = 1) buffer Keys { vec2 keys[]; };\n"
+	"uniform uint stepSize;\n"
+	"uniform uint blockSize;\n"
+	PARTICLE_KEY_ORDER_GLSL
+	"void main() {\n"
+	"uint pair = gl_GlobalInvocationID.x;\n"
+	"uint low = ((pair & ~(stepSize - 1u)) << 1u) | (pair & (stepSize - 1u));\n"
+	"uint high = low | stepSize;\n"
+	"vec2 a = keys[low];\n"
+	"vec2 b = keys[high];\n"
+	"if (keyFirst(b, a) == ((low & blockSize) == 0u)) {\n"
+	"keys[low] = b;\n"
+	"keys[high] = a;\n"
+	"}\n"
+	"}\0";
+
+// Runs the remaining steps of blockSize in shared memory, or with blockSize
+// 0 the whole sort of each 512 key block.
+static const char* sortLocalComputeShaderSource = "#version 430 core\n"
+	"layout (local_size_x = 256) in;\n"
+	"layout (std430, binding = 1) buffer Keys { vec2 keys[]; };\n"
+	"uniform uint blockSize;\n"
+	"shared vec2 localKeys[512];\n"
+	PARTICLE_KEY_ORDER_GLSL
+	"void main() {\n"
+	"uint base = gl_WorkGroupID.x * 512u;\n"
+	"uint thread = gl_LocalInvocationIndex;\n"
+	"localKeys[thread] = keys[base + thread];\n"
+	"localKeys[thread + 256u] = keys[base + thread + 256u];\n"
+	"barrier();\n"
+	"uint firstBlock = blockSize == 0u ? 2u : blockSize;\n"
+	"uint lastBlock = blockSize == 0u ? 512u : blockSize;\n"
+	"for (uint block = firstBlock; block <= lastBlock; block <<= 1u) {\n"
+	"for (uint step = min(block >> 1u, 256u); step > 0u; step >>= 1u) {\n"
+	"uint low = ((thread & ~(step - 1u)) << 1u) | (thread & (step - 1u));\n"
+	"uint high = low | step;\n"
+	"vec2 a = localKeys[low];\n"
+	"vec2 b = localKeys[high];\n"
+	"if (keyFirst(b, a) == (((base + low) & block) == 0u)) {\n"
+	"localKeys[low] = b;\n"
+	"localKeys[high] = a;\n"
+	"}\n"
+	"barrier();\n"
+	"}\n"
+	"}\n"
+	"keys[base + thread] = localKeys[thread];\n"
+	"keys[base + thread + 256u] = localKeys[thread + 256u];\n"
+	"}\0";
+
+static const char* particleVertexShaderSource = "#version 330 core\n"
+	"uniform samplerBuffer particles;\n"
+	"uniform samplerBuffer order;\n"
+	"uniform int useOrder;\n"
+	"uniform mat4 viewProjection;\n"
+	"uniform vec3 cameraRight;\n"
+	"uniform vec3 cameraUp;\n"
+	"uniform float particleSize;\n"
+	"out vec2 corner;\n"
+	"out vec4 tint;\n"
+	"void main() {\n"
+	"int index = useOrder != 0 ? int(texelFetch(order, gl_InstanceID).y) : gl_InstanceID;\n"
+	"vec4 positionAge = texelFetch(particles, index * 2);\n"
+	"vec4 velocityLifetime = texelFetch(particles, index * 2 + 1);\n"
+	"corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;\n"
+	"if (positionAge.w >= velocityLifetime.w) {\n"
+	"tint = vec4(0.0);\n"
+	"gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+	"return;\n"
+	"}\n"
+	"float life = positionAge.w / velocityLifetime.w;\n"
+	"tint = vec4(mix(vec3(1.0, 0.8, 0.4), vec3(0.3, 0.4, 1.0), life), 1.0 - life);\n"
+	"vec3 world = positionAge.xyz + (cameraRight * corner.x + cameraUp * corner.y) * particleSize;\n"
+	"gl_Position = viewProjection * vec4(world, 1.0);\n"
+	"}\0";
+
+static const char* particleFragmentShaderSource = "#version 330 core\n"
+	"in vec2 corner;\n"
+	"in vec4 tint;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"float falloff = max(1.0 - dot(corner, corner), 0.0);\n"
+	"FragColor = vec4(tint.rgb, tint.a * falloff);\n"
+	"}\0";
+
+static uint32_t hashParticle(uint32_t value) {
+	uint32_t state = value * 747796405u + 2891336453u;
+	uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+static float unitFloat(uint32_t hash) {
+	return (float)(hash >> 8) * (1.0f / 16777216.0f);
+}
+
+unsigned int particleCapacity(unsigned int requested) {
+	// Sort keys store the index as a float, exact up to 2^24.
+	unsigned int capacity = 1024;
+
+	while (capacity < requested && capacity < (1u << 24)) {
+		capacity <<= 1;
+	}
+
+	return capacity;
+}
+
+ParticleSpawner::ParticleSpawner(unsigned int capacity) : poolSize(particleCapacity(capacity)), cursor(0), frame(0), carry(0.0f) {
+}
+
+ParticleStep ParticleSpawner::advance(const ParticleEmitter& emitter, float deltaTime) {
+	carry += emitter.rate * deltaTime;
+
+	unsigned int count = (unsigned int)carry;
+	carry -= (float)count;
+
+	ParticleStep step = { deltaTime, cursor, std::min(count, poolSize), frame++ };
+	cursor = (cursor + step.emitCount) & (poolSize - 1);
+
+	return step;
+}
+
+CpuParticleSimulation::CpuParticleSimulation(unsigned int capacity)
+	: positionX(particleCapacity(capacity), 0.0f), positionY(positionX.size(), 0.0f), positionZ(positionX.size(), 0.0f),
+	velocityX(positionX.size(), 0.0f), velocityY(positionX.size(), 0.0f), velocityZ(positionX.size(), 0.0f),
+	ages(positionX.size(), 0.0f), lifetimes(positionX.size(), 0.0f) {
+}
+
+unsigned int CpuParticleSimulation::capacity() const {
+	return (unsigned int)positionX.size();
+}
+
+void CpuParticleSimulation::simulate(const ParticleEmitter& emitter, const ParticleStep& step, JobSystem& jobs) {
+	unsigned int mask = capacity() - 1;
+
+	for (unsigned int e = 0; e < step.emitCount; e++) {
+		uint32_t index = (step.emitStart + e) & mask;
+		uint32_t h0 = hashParticle(index ^ hashParticle(step.seed));
+		uint32_t h1 = hashParticle(h0);
+		uint32_t h2 = hashParticle(h1);
+		uint32_t h3 = hashParticle(h2);
+		float speed = emitter.speed * (0.75f + 0.25f * unitFloat(h2));
+
+		positionX[index] = emitter.origin.x;
+		positionY[index] = emitter.origin.y;
+		positionZ[index] = emitter.origin.z;
+		ages[index] = 0.0f;
+		velocityX[index] = (unitFloat(h0) * 2.0f - 1.0f) * emitter.spread * speed;
+		velocityY[index] = speed;
+		velocityZ[index] = (unitFloat(h1) * 2.0f - 1.0f) * emitter.spread * speed;
+		lifetimes[index] = emitter.minLifetime + (emitter.maxLifetime - emitter.minLifetime) * unitFloat(h3);
+	}
+
+	// The capacity and the grain are multiples of four, so every range is whole SSE groups.
+	jobs.parallelFor(capacity(), 16384, [this, &emitter, &step](size_t begin, size_t end, int) {
+		integrate(emitter, step.deltaTime, begin, end);
+	});
+}
+
+void CpuParticleSimulation::integrate(const ParticleEmitter& emitter, float deltaTime, size_t begin, size_t end) {
+	float fall = emitter.gravity * deltaTime;
+
+#ifdef PARTICLES_USE_SSE
+	__m128 dt = _mm_set1_ps(deltaTime);
+	__m128 fallStep = _mm_set1_ps(fall);
+	__m128 bounce = _mm_set1_ps(emitter.restitution);
+	__m128 zero = _mm_setzero_ps();
+	__m128 sign = _mm_set1_ps(-0.0f);
+
+	for (size_t i = begin; i < end; i += 4) {
+		__m128 age = _mm_loadu_ps(&ages[i]);
+		__m128 alive = _mm_cmplt_ps(age, _mm_loadu_ps(&lifetimes[i]));
+
+		if (_mm_movemask_ps(alive) == 0) {
+			continue;
+		}
+
+		__m128 vx = _mm_loadu_ps(&velocityX[i]);
+		__m128 vy = _mm_loadu_ps(&velocityY[i]);
+		__m128 vz = _mm_loadu_ps(&velocityZ[i]);
+		__m128 px = _mm_loadu_ps(&positionX[i]);
+		__m128 py = _mm_loadu_ps(&positionY[i]);
+		__m128 pz = _mm_loadu_ps(&positionZ[i]);
+
+		__m128 nvy = _mm_sub_ps(vy, fallStep);
+		__m128 npx = _mm_add_ps(px, _mm_mul_ps(vx, dt));
+		__m128 npy = _mm_add_ps(py, _mm_mul_ps(nvy, dt));
+		__m128 npz = _mm_add_ps(pz, _mm_mul_ps(vz, dt));
+
+		__m128 below = _mm_cmplt_ps(npy, zero);
+		__m128 bounced = _mm_mul_ps(_mm_xor_ps(nvy, sign), bounce);
+		nvy = _mm_or_ps(_mm_and_ps(below, bounced), _mm_andnot_ps(below, nvy));
+		npy = _mm_andnot_ps(below, npy);
+
+		_mm_storeu_ps(&velocityY[i], _mm_or_ps(_mm_and_ps(alive, nvy), _mm_andnot_ps(alive, vy)));
+		_mm_storeu_ps(&positionX[i], _mm_or_ps(_mm_and_ps(alive, npx), _mm_andnot_ps(alive, px)));
+		_mm_storeu_ps(&positionY[i], _mm_or_ps(_mm_and_ps(alive, npy), _mm_andnot_ps(alive, py)));
+		_mm_storeu_ps(&positionZ[i], _mm_or_ps(_mm_and_ps(alive, npz), _mm_andnot_ps(alive, pz)));
+		_mm_storeu_ps(&ages[i], _mm_add_ps(age, _mm_and_ps(alive, dt)));
+	}
+#else
+	for (size_t i = begin; i < end; i++) {
+		if (ages[i] >= lifetimes[i]) {
+			continue;
+		}
+
+		velocityY[i] = velocityY[i] - fall;
+		positionX[i] = positionX[i] + velocityX[i] * deltaTime;
+		positionY[i] = positionY[i] + velocityY[i] * deltaTime;
+		positionZ[i] = positionZ[i] + velocityZ[i] * deltaTime;
+
+		if (positionY[i] < 0.0f) {
+			positionY[i] = 0.0f;
+			velocityY[i] = -velocityY[i] * emitter.restitution;
+		}
+
+		ages[i] = ages[i] + deltaTime;
+	}
+#endif
+}
+
+GpuParticle CpuParticleSimulation::particle(unsigned int index) const {
+	GpuParticle result;
+	result.positionAge = vec4(positionX[index], positionY[index], positionZ[index], ages[index]);
+	result.velocityLifetime = vec4(velocityX[index], velocityY[index], velocityZ[index], lifetimes[index]);
+	return result;
+}
+
+unsigned int CpuParticleSimulation::aliveCount() const {
+	unsigned int count = 0;
+
+	for (size_t i = 0; i < ages.size(); i++) {
+		count += ages[i] < lifetimes[i] ? 1 : 0;
+	}
+
+	return count;
+}
+
+ParticleSystem::ParticleSystem(unsigned int capacity, bool allowCompute)
+	: poolSize(particleCapacity(capacity)), compute(false), sorted(false), current(0), currentKeys(0),
+	particleBuffers(), particleTextures(), particleArrays(), keyBuffers(), keyTextures(), emptyArray(0),
+	simulateProgram(0), keyProgram(0), sortStepProgram(0), sortLocalProgram(0), drawProgram(0) {
+	GLint maxTexels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+
+	if ((GLint64)poolSize * 2 > maxTexels) {
+		std::cerr << "ERROR::PARTICLES::CAPACITY_EXCEEDS_TEXTURE_BUFFER_SIZE" << std::endl;
+		return;
+	}
+
+	if (allowCompute && GLEW_VERSION_4_3) {
+		simulateProgram = createComputeProgram(simulateComputeShaderSource);
+		keyProgram = createComputeProgram(keyComputeShaderSource);
+		sortStepProgram = createComputeProgram(sortStepComputeShaderSource);
+		sortLocalProgram = createComputeProgram(sortLocalComputeShaderSource);
+		compute = simulateProgram != 0 && keyProgram != 0 && sortStepProgram != 0 && sortLocalProgram != 0;
+
+		if (!compute) {
+			glDeleteProgram(simulateProgram);
+			glDeleteProgram(keyProgram);
+			glDeleteProgram(sortStepProgram);
+			glDeleteProgram(sortLocalProgram);
+			simulateProgram = keyProgram = sortStepProgram = sortLocalProgram = 0;
+		}
+	}
+
+	if (!compute) {
+		static const char* particleVaryings[2] = { "outPositionAge", "outVelocityLifetime" };
+		static const char* keyVaryings[1] = { "outKey" };
+
+		simulateProgram = createTransformFeedbackProgram(simulateFeedbackShaderSource, particleVaryings, 2);
+		keyProgram = createTransformFeedbackProgram(keyFeedbackShaderSource, keyVaryings, 1);
+		sortStepProgram = createTransformFeedbackProgram(sortStepFeedbackShaderSource, keyVaryings, 1);
+
+		glUseProgram(sortStepProgram);
+		glUniform1i(glGetUniformLocation(sortStepProgram, "keys"), 0);
+	}
+
+	drawProgram = createProgram(particleVertexShaderSource, particleFragmentShaderSource);
+
+	glUseProgram(drawProgram);
+	glUniform1i(glGetUniformLocation(drawProgram, "particles"), 0);
+	glUniform1i(glGetUniformLocation(drawProgram, "order"), 1);
+
+	// Everything starts dead: age 0, lifetime 0. The compute path updates in place and needs one buffer of each.
+	int bufferCount = compute ? 1 : 2;
+	std::vector<GpuParticle> initial(poolSize, GpuParticle());
+
+	glGenBuffers(bufferCount, particleBuffers);
+	glGenBuffers(bufferCount, keyBuffers);
+	glGenTextures(bufferCount, particleTextures);
+	glGenTextures(bufferCount, keyTextures);
+	glGenVertexArrays(1, &emptyArray);
+
+	for (int i = 0; i < bufferCount; i++) {
+		glBindBuffer(GL_ARRAY_BUFFER, particleBuffers[i]);
+		glBufferData(GL_ARRAY_BUFFER, poolSize * sizeof(GpuParticle), i == 0 ? initial.data() : NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_ARRAY_BUFFER, keyBuffers[i]);
+		glBufferData(GL_ARRAY_BUFFER, poolSize * 2 * sizeof(float), NULL, GL_DYNAMIC_COPY);
+
+		glBindTexture(GL_TEXTURE_BUFFER, particleTextures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, particleBuffers[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, keyTextures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, keyBuffers[i]);
+	}
+
+	if (!compute) {
+		glGenVertexArrays(2, particleArrays);
+
+		for (int i = 0; i < 2; i++) {
+			glBindVertexArray(particleArrays[i]);
+			glBindBuffer(GL_ARRAY_BUFFER, particleBuffers[i]);
+			glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void*)0);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void*)sizeof(Vec4));
+			glEnableVertexAttribArray(1);
+		}
+
+		glBindVertexArray(0);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+ParticleSystem::~ParticleSystem() {
+	glDeleteTextures(2, particleTextures);
+	glDeleteTextures(2, keyTextures);
+	glDeleteBuffers(2, particleBuffers);
+	glDeleteBuffers(2, keyBuffers);
+	glDeleteVertexArrays(2, particleArrays);
+	glDeleteVertexArrays(1, &emptyArray);
+	glDeleteProgram(simulateProgram);
+	glDeleteProgram(keyProgram);
+	glDeleteProgram(sortStepProgram);
+	glDeleteProgram(sortLocalProgram);
+	glDeleteProgram(drawProgram);
+}
+
+bool ParticleSystem::isValid() const {
+	return simulateProgram != 0 && keyProgram != 0 && sortStepProgram != 0 && drawProgram != 0;
+}
+
+bool ParticleSystem::isCompute() const {
+	return compute;
+}
+
+unsigned int ParticleSystem::capacity() const {
+	return poolSize;
+}
+
+void ParticleSystem::simulate(const ParticleEmitter& emitter, const ParticleStep& step) {
+	glUseProgram(simulateProgram);
+	glUniform4f(glGetUniformLocation(simulateProgram, "emitterOrigin"), emitter.origin.x, emitter.origin.y, emitter.origin.z, emitter.spread);
+	glUniform4f(glGetUniformLocation(simulateProgram, "emitterMotion"), emitter.speed, emitter.gravity, emitter.restitution, 0.0f);
+	glUniform2f(glGetUniformLocation(simulateProgram, "emitterLifetime"), emitter.minLifetime, emitter.maxLifetime);
+	glUniform4ui(glGetUniformLocation(simulateProgram, "stepEmission"), step.emitStart, step.emitCount, step.seed, poolSize);
+	glUniform1f(glGetUniformLocation(simulateProgram, "deltaTime"), step.deltaTime);
+
+	if (compute) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers[0]);
+		glDispatchCompute(poolSize / 256, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+	}
+	else {
+		transformFeedbackPass(particleArrays[current], particleBuffers[1 - current]);
+		current = 1 - current;
+	}
+
+	sorted = false;
+}
+
+void ParticleSystem::sort(const Mat4& view) {
+	if (compute) {
+		sortWithCompute(view);
+	}
+	else {
+		sortWithTransformFeedback(view);
+	}
+
+	sorted = true;
+}
+
+void ParticleSystem::transformFeedbackPass(unsigned int vertexArray, unsigned int target) const {
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(vertexArray);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, target);
+
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, (GLsizei)poolSize);
+	glEndTransformFeedback();
+
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glBindVertexArray(0);
+	glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void ParticleSystem::sortWithTransformFeedback(const Mat4& view) {
+	glUseProgram(keyProgram);
+	glUniform4f(glGetUniformLocation(keyProgram, "depthRow"), -view.m[2], -view.m[6], -view.m[10], -view.m[14]);
+
+	transformFeedbackPass(particleArrays[current], keyBuffers[0]);
+	currentKeys = 0;
+
+	// A pass per bitonic step, ping-ponging between the key buffers.
+	glUseProgram(sortStepProgram);
+	glActiveTexture(GL_TEXTURE0);
+
+	int stepLocation = glGetUniformLocation(sortStepProgram, "stepSize");
+	int blockLocation = glGetUniformLocation(sortStepProgram, "blockSize");
+
+	for (unsigned int block = 2; block <= poolSize; block <<= 1) {
+		for (unsigned int step = block >> 1; step > 0; step >>= 1) {
+			glUniform1i(stepLocation, (int)step);
+			glUniform1i(blockLocation, (int)block);
+			glBindTexture(GL_TEXTURE_BUFFER, keyTextures[currentKeys]);
+
+			transformFeedbackPass(emptyArray, keyBuffers[1 - currentKeys]);
+			currentKeys = 1 - currentKeys;
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void ParticleSystem::sortWithCompute(const Mat4& view) {
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers[0]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, keyBuffers[0]);
+
+	glUseProgram(keyProgram);
+	glUniform4f(glGetUniformLocation(keyProgram, "depthRow"), -view.m[2], -view.m[6], -view.m[10], -view.m[14]);
+	glDispatchCompute(poolSize / 256, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Blocks up to 512 keys sort entirely in shared memory. Larger blocks
+	// need global passes until the pairs fit in a workgroup again.
+	int localBlockLocation = glGetUniformLocation(sortLocalProgram, "blockSize");
+	int stepLocation = glGetUniformLocation(sortStepProgram, "stepSize");
+	int blockLocation = glGetUniformLocation(sortStepProgram, "blockSize");
+
+	glUseProgram(sortLocalProgram);
+	glUniform1ui(localBlockLocation, 0);
+	glDispatchCompute(poolSize / 512, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	for (unsigned int block = 1024; block <= poolSize; block <<= 1) {
+		glUseProgram(sortStepProgram);
+		glUniform1ui(blockLocation, block);
+
+		for (unsigned int step = block >> 1; step >= 512; step >>= 1) {
+			glUniform1ui(stepLocation, step);
+			glDispatchCompute(poolSize / 512, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+
+		glUseProgram(sortLocalProgram);
+		glUniform1ui(localBlockLocation, block);
+		glDispatchCompute(poolSize / 512, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	currentKeys = 0;
+}
+
+void ParticleSystem::draw(const Mat4& view, const Mat4& projection, float size) const {
+	Mat4 viewProjection = multiply(projection, view);
+
+	glUseProgram(drawProgram);
+	glUniformMatrix4fv(glGetUniformLocation(drawProgram, "viewProjection"), 1, GL_FALSE, viewProjection.m);
+	glUniform3f(glGetUniformLocation(drawProgram, "cameraRight"), view.m[0], view.m[4], view.m[8]);
+	glUniform3f(glGetUniformLocation(drawProgram, "cameraUp"), view.m[1], view.m[5], view.m[9]);
+	glUniform1f(glGetUniformLocation(drawProgram, "particleSize"), size);
+	glUniform1i(glGetUniformLocation(drawProgram, "useOrder"), sorted ? 1 : 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, particleTextures[current]);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_BUFFER, keyTextures[currentKeys]);
+	glActiveTexture(GL_TEXTURE0);
+
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, sorted ? GL_ONE_MINUS_SRC_ALPHA : GL_ONE);
+
+	glBindVertexArray(emptyArray);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)poolSize);
+	glBindVertexArray(0);
+
+	glDisable(GL_BLEND);
+}
+
+void ParticleSystem::readBack(std::vector<GpuParticle>& particles) const {
+	particles.resize(poolSize);
+
+	glBindBuffer(GL_ARRAY_BUFFER, particleBuffers[current]);
+	glGetBufferSubData(GL_ARRAY_BUFFER, 0, poolSize * sizeof(GpuParticle), particles.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Replays the first frames on both sides and counts particles whose state
+// differs by more than rounding; FMA contraction on the GPU can flip a
+// bounce that lands within an ulp of the ground.
+static unsigned int compareWithReference(const ParticleEmitter& emitter, bool compute, unsigned int capacity, int frames, float& maxError) {
+	ParticleSystem system(capacity, compute);
+	CpuParticleSimulation reference(capacity);
+	ParticleSpawner spawner(capacity);
+	JobSystem jobs(0);
+
+	for (int frame = 0; frame < frames; frame++) {
+		ParticleStep step = spawner.advance(emitter, 1.0f / 60.0f);
+		system.simulate(emitter, step);
+		reference.simulate(emitter, step, jobs);
+	}
+
+	std::vector<GpuParticle> particles;
+	system.readBack(particles);
+
+	unsigned int mismatches = 0;
+	maxError = 0.0f;
+
+	for (unsigned int i = 0; i < capacity; i++) {
+		GpuParticle expected = reference.particle(i);
+		const Vec4& a = particles[i].positionAge;
+		const Vec4& b = expected.positionAge;
+		float error = std::max(std::max(std::fabs(a.x - b.x), std::fabs(a.y - b.y)), std::max(std::fabs(a.z - b.z), std::fabs(a.w - b.w)));
+		bool aliveMatches = (a.w < particles[i].velocityLifetime.w) == (b.w < expected.velocityLifetime.w);
+
+		maxError = std::max(maxError, error);
+
+		if (error > 1e-3f || !aliveMatches) {
+			mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+int runParticleBenchmark(int width, int height, int particleCount, int frames) {
+	unsigned int capacity = particleCapacity((unsigned int)std::max(particleCount, 1));
+	ParticleEmitter emitter = { vec3(0.0f, 0.0f, 0.0f), 0.35f, 9.0f, 2.0f, 4.0f, 9.81f, 0.5f, 0.0f };
+	const float deltaTime = 1.0f / 60.0f;
+	const int warmupFrames = 10;
+	int result = 0;
+
+	// Emit a pool's worth per average lifetime, so the pool stays nearly full.
+	emitter.rate = capacity / ((emitter.minLifetime + emitter.maxLifetime) * 0.5f);
+
+	float aspect = (float)width / height;
+	Mat4 view = lookAt(vec3(0.0f, 5.0f, 16.0f), vec3(0.0f, 3.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+	Mat4 projection = perspective(1.0f, aspect, 0.1f, 100.0f);
+
+	std::cout << "PARTICLE BENCHMARK " << width << "x" << height << ", " << capacity << " particles, " << frames << " frames" << std::endl;
+
+	for (int parallel = 0; parallel < 2; parallel++) {
+		JobSystem jobs(parallel != 0 ? std::max((int)std::thread::hardware_concurrency() - 1, 1) : 0);
+		CpuParticleSimulation simulation(capacity);
+		ParticleSpawner spawner(capacity);
+		double milliseconds = 0.0;
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			ParticleStep step = spawner.advance(emitter, deltaTime);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			simulation.simulate(emitter, step, jobs);
+
+			if (frame >= warmupFrames) {
+				milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+		}
+
+		std::cout << "cpu reference, " << jobs.laneCount() << (jobs.laneCount() == 1 ? " lane: " : " lanes: ") << milliseconds / frames
+			<< " ms, " << simulation.aliveCount() << " alive" << std::endl;
+	}
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+
+	for (int compute = 0; compute < 2; compute++) {
+		const char* name = compute != 0 ? "compute" : "transform feedback";
+		ParticleSystem system(capacity, compute != 0);
+
+		if (!system.isValid()) {
+			result = -1;
+			break;
+		}
+
+		if (compute != 0 && !system.isCompute()) {
+			std::cout << name << ": unavailable" << std::endl;
+			break;
+		}
+
+		RenderGraph graph;
+		RenderGraph::Resource output = graph.importTexture("output", outputTexture, outputDesc);
+
+		graph.addPass("particles",
+			[&](RenderGraph::Builder& builder) {
+				builder.write(output, LoadOp::Clear);
+				builder.setClearColor(0.02f, 0.02f, 0.03f, 1.0f);
+			},
+			[&system, &view, &projection](const RenderGraph&) {
+				system.draw(view, projection, 0.03f);
+			});
+
+		if (!graph.compile()) {
+			result = -1;
+			break;
+		}
+
+		ParticleSpawner spawner(capacity);
+		GpuTimer simulateTimer(4);
+		GpuTimer sortTimer(4);
+		GpuTimer drawTimer(4);
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				simulateTimer.wait();
+				sortTimer.wait();
+				drawTimer.wait();
+				simulateTimer.resetAverage();
+				sortTimer.resetAverage();
+				drawTimer.resetAverage();
+			}
+
+			simulateTimer.begin();
+			system.simulate(emitter, spawner.advance(emitter, deltaTime));
+			simulateTimer.end();
+
+			sortTimer.begin();
+			system.sort(view);
+			sortTimer.end();
+
+			drawTimer.begin();
+			graph.execute();
+			drawTimer.end();
+
+			simulateTimer.poll();
+			sortTimer.poll();
+			drawTimer.poll();
+		}
+
+		simulateTimer.wait();
+		sortTimer.wait();
+		drawTimer.wait();
+
+		float maxError = 0.0f;
+		unsigned int mismatches = compareWithReference(emitter, compute != 0, capacity, 120, maxError);
+
+		std::cout << name << ": simulate " << simulateTimer.averageMilliseconds() << " ms, sort " << sortTimer.averageMilliseconds()
+			<< " ms, draw " << drawTimer.averageMilliseconds() << " ms GPU; against the cpu reference after 120 frames "
+			<< mismatches << " particles differ, max error " << maxError << std::endl;
+
+		// Allow a few flipped bounces, nothing systematic.
+		if (mismatches > capacity / 1000 && result == 0) {
+			result = 1;
+		}
+	}
+
+	glDeleteTextures(1, &outputTexture);
+
+	return result;
+}
@@ -0,0 +1,144 @@
+#ifndef CUSTOM_PARTICLES_H
+#define CUSTOM_PARTICLES_H
+
+#include "jobsystem.hpp"
+#include "vecmath.hpp"
+#include <vector>
+
+// A fountain: particles leave origin upwards inside a cone of the given
+// spread, fall under gravity and bounce off the y = 0 plane.
+struct ParticleEmitter {
+	Vec3 origin;
+	float spread;
+	float speed;
+	float minLifetime;
+	float maxLifetime;
+	float gravity;
+	float restitution;
+	// Particles per second.
+	float rate;
+};
+
+// One simulation step. Slots emitStart .. emitStart + emitCount, wrapping at
+// the capacity, are respawned with random values derived from their index
+// and seed, so every simulator produces the same particles.
+struct ParticleStep {
+	float deltaTime;
+	unsigned int emitStart;
+	unsigned int emitCount;
+	unsigned int seed;
+};
+
+// Hands out emission ranges round-robin over a pool, oldest slot first.
+class ParticleSpawner {
+public:
+	ParticleSpawner(unsigned int capacity);
+
+	ParticleStep advance(const ParticleEmitter& emitter, float deltaTime);
+
+private:
+	unsigned int poolSize;
+	unsigned int cursor;
+	unsigned int frame;
+	float carry;
+};
+
+// Pools are rounded up to a power of two for the wrap-around and the bitonic sort.
+unsigned int particleCapacity(unsigned int requested);
+
+// Layout of a particle in GPU buffers. A particle is alive while age < lifetime.
+struct GpuParticle {
+	Vec4 positionAge;
+	Vec4 velocityLifetime;
+};
+
+// CPU reference simulation in SoA layout, four particles per SSE step.
+// Only integration is vectorized; emission touches a few slots per frame.
+class CpuParticleSimulation {
+public:
+	CpuParticleSimulation(unsigned int capacity);
+
+	unsigned int capacity() const;
+
+	void simulate(const ParticleEmitter& emitter, const ParticleStep& step, JobSystem& jobs);
+
+	GpuParticle particle(unsigned int index) const;
+	unsigned int aliveCount() const;
+
+private:
+	void integrate(const ParticleEmitter& emitter, float deltaTime, size_t begin, size_t end);
+
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> positionZ;
+	std::vector<float> velocityX;
+	std::vector<float> velocityY;
+	std::vector<float> velocityZ;
+	std::vector<float> ages;
+	std::vector<float> lifetimes;
+};
+
+// Particles simulated, sorted and drawn entirely on the GPU. Simulation and
+// sorting use transform feedback on GL 3.3 and compute shaders when GL 4.3
+// is available. Sorting is a bitonic sort of (view depth, index) keys, back
+// to front, and is only needed for alpha blending. Particles are drawn as
+// instanced camera-facing quads fetched from buffer textures.
+class ParticleSystem {
+public:
+	ParticleSystem(unsigned int capacity, bool allowCompute);
+	~ParticleSystem();
+
+	ParticleSystem(const ParticleSystem&) = delete;
+	ParticleSystem& operator=(const ParticleSystem&) = delete;
+
+	bool isValid() const;
+	bool isCompute() const;
+	unsigned int capacity() const;
+
+	void simulate(const ParticleEmitter& emitter, const ParticleStep& step);
+
+	// Orders the particles back to front for the next draw().
+	void sort(const Mat4& view);
+
+	// Alpha-blended when sorted since the last simulate(), additive otherwise.
+	// Leaves depth writes and blending disabled.
+	void draw(const Mat4& view, const Mat4& projection, float size) const;
+
+	// Stalls; for tests and benchmarks.
+	void readBack(std::vector<GpuParticle>& particles) const;
+
+private:
+	void sortWithTransformFeedback(const Mat4& view);
+	void sortWithCompute(const Mat4& view);
+	// Runs every particle slot through the bound program once, capturing into target.
+	void transformFeedbackPass(unsigned int vertexArray, unsigned int target) const;
+
+	unsigned int poolSize;
+	bool compute;
+	bool sorted;
+	// Buffers holding the current particles and sort keys; the other one of each pair is scratch.
+	int current;
+	int currentKeys;
+
+	unsigned int particleBuffers[2];
+	unsigned int particleTextures[2];
+	unsigned int particleArrays[2];
+	unsigned int keyBuffers[2];
+	unsigned int keyTextures[2];
+	unsigned int emptyArray;
+
+	unsigned int simulateProgram;
+	unsigned int keyProgram;
+	unsigned int sortStepProgram;
+	unsigned int sortLocalProgram;
+	unsigned int drawProgram;
+};
+
+// Runs a fountain of particleCount particles on the CPU reference (one lane,
+// then every core) and on each available GPU path, sorted and drawn at
+// width x height. Prints times per stage, then replays the first frames on
+// the GPU and the CPU and compares the particles. Needs a current context.
+// Returns 0 on success, 1 when the GPU and CPU results disagree.
+int runParticleBenchmark(int width, int height, int particleCount, int frames);
+
+#endif // !CUSTOM_PARTICLES_H
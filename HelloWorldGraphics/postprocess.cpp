@@ -0,0 +1,617 @@
+#include "postprocess.hpp"
+#include "clustered.hpp"
+#include "glprogram.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <iostream>
+
+static const char* fullscreenVertexShaderSource = "#version 330 core\n"
+	"void main() {\n"
+	"vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+	"gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\0";
+
+static const char* downsampleFragmentShaderSource = "#version 330 core\n"
+	"uniform sampler2D source;\n"
+	"uniform float threshold;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"vec2 texel = 1.0 / vec2(textureSize(source, 0));\n"
+	"vec2 uv = gl_FragCoord.xy * 2.0 * texel;\n"
+	"vec3 color = 0.25 * (texture(source, uv + texel * vec2(-1.0, -1.0)).rgb + texture(source, uv + texel * vec2(1.0, -1.0)).rgb +\n"
+	"texture(source, uv + texel * vec2(-1.0, 1.0)).rgb + texture(source, uv + texel * vec2(1.0, 1.0)).rgb);\n"
+	"if (threshold >= 0.0) {\n"
+	"float brightness = max(color.r, max(color.g, color.b));\n"
+	"color = min(color * max(brightness - threshold, 0.0) / max(brightness, 0.0001), vec3(64.0));\n"
+	"}\n"
+	"FragColor = vec4(color, 1.0);\n"
+	"}\0";
+
+static const char* upsampleFragmentShaderSource = "#version 330 core\n"
+	"uniform sampler2D base;\n"
+	"uniform sampler2D smaller;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"vec2 uv = gl_FragCoord.xy / vec2(textureSize(base, 0));\n"
+	"vec2 texel = 1.0 / vec2(textureSize(smaller, 0));\n"
+	"vec3 blur = vec3(0.0);\n"
+	"for (int y = -1; y <= 1; y++) {\n"
+	"for (int x = -1; x <= 1; x++) {\n"
+	"blur += texture(smaller, uv + vec2(x, y) * texel).rgb * float((2 - abs(x)) * (2 - abs(y)));\n"
+	"}\n"
+	"}\n"
+	"FragColor = vec4(texelFetch(base, ivec2(gl_FragCoord.xy), 0).rgb + blur / 16.0, 1.0);\n"
+	"}\0";
+
+static const char* gradingSource =
+	"uniform float bloomIntensity;\n"
+	"uniform float exposure;\n"
+	"uniform vec3 lift;\n"
+	"uniform vec3 gamma;\n"
+	"uniform vec3 gain;\n"
+	"uniform float saturation;\n"
+	"vec3 composite(vec3 hdr, vec3 bloom) {\n"
+	"return hdr + bloom * bloomIntensity;\n"
+	"}\n"
+	"vec3 tonemap(vec3 x) {\n"
+	"x *= exposure;\n"
+	"return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);\n"
+	"}\n"
+	"vec3 grade(vec3 c) {\n"
+	"c = clamp(c * gain + lift * (1.0 - c), 0.0, 1.0);\n"
+	"c = pow(c, 1.0 / gamma);\n"
+	"c = mix(vec3(dot(c, vec3(0.2126, 0.7152, 0.0722))), c, saturation);\n"
+	"return pow(clamp(c, 0.0, 1.0), vec3(1.0 / 2.2));\n"
+	"}\n"
+	"vec4 withLuma(vec3 c) {\n"
+	"return vec4(c, dot(c, vec3(0.299, 0.587, 0.114)));\n"
+	"}\n";
+
+// Expects sampleAt(pixel) returning the graded color with luma in alpha, pixel centers at +0.5.
+static const char* fxaaSource =
+	"vec4 sampleAt(vec2 pixel);\n"
+	"vec3 fxaa(vec2 pixel) {\n"
+	"float lumaNW = sampleAt(pixel + vec2(-1.0, -1.0)).a;\n"
+	"float lumaNE = sampleAt(pixel + vec2(1.0, -1.0)).a;\n"
+	"float lumaSW = sampleAt(pixel + vec2(-1.0, 1.0)).a;\n"
+	"float lumaSE = sampleAt(pixel + vec2(1.0, 1.0)).a;\n"
+	"float lumaM = sampleAt(pixel).a;\n"
+	"float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));\n"
+	"float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));\n"
+	"vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));\n"
+	"float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.03125, 1.0 / 128.0);\n"
+	"direction = clamp(direction / (min(abs(direction.x), abs(direction.y)) + reduce), vec2(-8.0), vec2(8.0));\n"
+	"vec3 a = 0.5 * (sampleAt(pixel + direction * (1.0 / 3.0 - 0.5)).rgb + sampleAt(pixel + direction * (2.0 / 3.0 - 0.5)).rgb);\n"
+	"vec3 b = a * 0.5 + 0.25 * (sampleAt(pixel - direction * 0.5).rgb + sampleAt(pixel + direction * 0.5).rgb);\n"
+	"float lumaB = dot(b, vec3(0.299, 0.587, 0.114));\n"
+	"return (lumaB < lumaMin || lumaB > lumaMax) ? a : b;\n"
+	"}\n";
+
+static const char* bloomCompositeBody =
+	"uniform sampler2D hdrColor;\n"
+	"uniform sampler2D bloomColor;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"vec2 uv = gl_FragCoord.xy / vec2(textureSize(hdrColor, 0));\n"
+	"FragColor = vec4(composite(texelFetch(hdrColor, ivec2(gl_FragCoord.xy), 0).rgb, texture(bloomColor, uv).rgb), 1.0);\n"
+	"}\n";
+
+static const char* tonemapBody =
+	"uniform sampler2D source;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"FragColor = vec4(tonemap(texelFetch(source, ivec2(gl_FragCoord.xy), 0).rgb), 1.0);\n"
+	"}\n";
+
+static const char* gradeBody =
+	"uniform sampler2D source;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"FragColor = withLuma(grade(texelFetch(source, ivec2(gl_FragCoord.xy), 0).rgb));\n"
+	"}\n";
+
+static const char* compositeBody =
+	"uniform sampler2D hdrColor;\n"
+	"uniform sampler2D bloomColor;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"vec2 uv = gl_FragCoord.xy / vec2(textureSize(hdrColor, 0));\n"
+	"vec3 color = composite(texelFetch(hdrColor, ivec2(gl_FragCoord.xy), 0).rgb, texture(bloomColor, uv).rgb);\n"
+	"FragColor = withLuma(grade(tonemap(color)));\n"
+	"}\n";
+
+static const char* fxaaBody =
+	"uniform sampler2D source;\n"
+	"out vec4 FragColor;\n"
+	"vec4 sampleAt(vec2 pixel) {\n"
+	"return texture(source, pixel / vec2(textureSize(source, 0)));\n"
+	"}\n"
+	"void main() {\n"
+	"FragColor = vec4(fxaa(gl_FragCoord.xy), 1.0);\n"
+	"}\n";
+
+// 16x16 tiles with a 5 pixel apron: FXAA reaches 4 pixels along the edge plus one for bilinear filtering.
+static const char* computeBody =
+	"layout (local_size_x = 16, local_size_y = 16) in;\n"
+	"layout (rgba8, binding = 0) writeonly uniform image2D outputImage;\n"
+	"uniform sampler2D hdrColor;\n"
+	"uniform sampler2D bloomColor;\n"
+	"uniform int fxaaEnabled;\n"
+	"shared vec4 tile[26 * 26];\n"
+	"vec2 tileOrigin;\n"
+	"vec4 fetchTile(ivec2 p) {\n"
+	"p = clamp(p, ivec2(0), ivec2(25));\n"
+	"return tile[p.y * 26 + p.x];\n"
+	"}\n"
+	"vec4 sampleAt(vec2 pixel) {\n"
+	"vec2 p = pixel - tileOrigin - 0.5;\n"
+	"ivec2 i = ivec2(floor(p));\n"
+	"vec2 f = p - floor(p);\n"
+	"return mix(mix(fetchTile(i), fetchTile(i + ivec2(1, 0)), f.x), mix(fetchTile(i + ivec2(0, 1)), fetchTile(i + ivec2(1, 1)), f.x), f.y);\n"
+	"}\n"
+	"void main() {\n"
+	"ivec2 size = textureSize(hdrColor, 0);\n"
+	"ivec2 origin = ivec2(gl_WorkGroupID.xy) * 16 - 5;\n"
+	"tileOrigin = vec2(origin);\n"
+	"for (uint i = gl_LocalInvocationIndex; i < 676u; i += 256u) {\n"
+	"ivec2 pixel = clamp(origin + ivec2(int(i % 26u), int(i / 26u)), ivec2(0), size - 1);\n"
+	"vec2 uv = (vec2(pixel) + 0.5) / vec2(size);\n"
+	"tile[i] = withLuma(grade(tonemap(composite(texelFetch(hdrColor, pixel, 0).rgb, textureLod(bloomColor, uv, 0.0).rgb))));\n"
+	"}\n"
+	"barrier();\n"
+	"ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);\n"
+	"if (any(greaterThanEqual(pixel, size))) return;\n"
+	"vec2 center = vec2(pixel) + 0.5;\n"
+	"vec3 color = fxaaEnabled != 0 ? fxaa(center) : sampleAt(center).rgb;\n"
+	"imageStore(outputImage, pixel, vec4(color, 1.0));\n"
+	"}\n";
+
+static unsigned int createPostProgram(const char* body, bool withFxaa) {
+	std::string source = std::string("#version 330 core\n") + gradingSource + (withFxaa ? fxaaSource : "") + body;
+	return createProgram(fullscreenVertexShaderSource, source.c_str());
+}
+
+PostProcessSettings defaultPostProcessSettings() {
+	PostProcessSettings settings;
+	settings.bloomThreshold = 1.0f;
+	settings.bloomIntensity = 0.2f;
+	settings.exposure = 1.0f;
+	settings.lift = vec3(0.0f, 0.0f, 0.0f);
+	settings.gamma = vec3(1.0f, 1.0f, 1.0f);
+	settings.gain = vec3(1.0f, 1.0f, 1.0f);
+	settings.saturation = 1.0f;
+	settings.fxaa = true;
+	return settings;
+}
+
+PostProcessStack::Stage::Stage(const char* stageName, const char* stageEffects, size_t stageBytes)
+	: name(stageName), effects(stageEffects), bytes(stageBytes), timer(4) {
+}
+
+PostProcessStack::PostProcessStack()
+	: current(defaultPostProcessSettings()), downsampleProgram(0), upsampleProgram(0), bloomCompositeProgram(0), tonemapProgram(0),
+	gradeProgram(0), compositeProgram(0), fxaaProgram(0), computeProgram(0), emptyVao(0) {
+	downsampleProgram = createProgram(fullscreenVertexShaderSource, downsampleFragmentShaderSource);
+	upsampleProgram = createProgram(fullscreenVertexShaderSource, upsampleFragmentShaderSource);
+	bloomCompositeProgram = createPostProgram(bloomCompositeBody, false);
+	tonemapProgram = createPostProgram(tonemapBody, false);
+	gradeProgram = createPostProgram(gradeBody, false);
+	compositeProgram = createPostProgram(compositeBody, false);
+	fxaaProgram = createPostProgram(fxaaBody, true);
+
+	if (GLEW_VERSION_4_3) {
+		std::string source = std::string("#version 430 core\n") + gradingSource + fxaaSource + computeBody;
+		computeProgram = createComputeProgram(source.c_str());
+	}
+
+	glGenVertexArrays(1, &emptyVao);
+}
+
+PostProcessStack::~PostProcessStack() {
+	glDeleteProgram(downsampleProgram);
+	glDeleteProgram(upsampleProgram);
+	glDeleteProgram(bloomCompositeProgram);
+	glDeleteProgram(tonemapProgram);
+	glDeleteProgram(gradeProgram);
+	glDeleteProgram(compositeProgram);
+	glDeleteProgram(fxaaProgram);
+	glDeleteProgram(computeProgram);
+	glDeleteVertexArrays(1, &emptyVao);
+}
+
+bool PostProcessStack::isValid() const {
+	return downsampleProgram != 0 && upsampleProgram != 0 && bloomCompositeProgram != 0 && tonemapProgram != 0 &&
+		gradeProgram != 0 && compositeProgram != 0 && fxaaProgram != 0;
+}
+
+bool PostProcessStack::supportsCompute() const {
+	return computeProgram != 0;
+}
+
+void PostProcessStack::setSettings(const PostProcessSettings& settings) {
+	current = settings;
+}
+
+const PostProcessSettings& PostProcessStack::settings() const {
+	return current;
+}
+
+PostProcessStack::Stage* PostProcessStack::addStage(const char* name, const char* effects, size_t bytes) {
+	stages.push_back(std::unique_ptr<Stage>(new Stage(name, effects, bytes)));
+	return stages.back().get();
+}
+
+void PostProcessStack::setGradingUniforms(unsigned int program) const {
+	glUniform1f(glGetUniformLocation(program, "bloomIntensity"), current.bloomIntensity / bloomLevels);
+	glUniform1f(glGetUniformLocation(program, "exposure"), current.exposure);
+	glUniform3f(glGetUniformLocation(program, "lift"), current.lift.x, current.lift.y, current.lift.z);
+	glUniform3f(glGetUniformLocation(program, "gamma"), current.gamma.x, current.gamma.y, current.gamma.z);
+	glUniform3f(glGetUniformLocation(program, "gain"), current.gain.x, current.gain.y, current.gain.z);
+	glUniform1f(glGetUniformLocation(program, "saturation"), current.saturation);
+}
+
+void PostProcessStack::drawFullscreen(unsigned int program) const {
+	glUseProgram(program);
+	glBindVertexArray(emptyVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+static size_t textureBytes(const RenderTextureDesc& desc) {
+	return (size_t)desc.width * desc.height * bytesPerPixel(desc.internalFormat);
+}
+
+static void bindTexture(unsigned int unit, unsigned int texture) {
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void PostProcessStack::addBloomPasses(RenderGraph& graph, RenderGraph::Resource hdr, RenderGraph::Resource& bloom) {
+	RenderTextureDesc levels[bloomLevels];
+
+	for (int i = 0; i < bloomLevels; i++) {
+		const RenderTextureDesc& source = i == 0 ? graph.desc(hdr) : levels[i - 1];
+		RenderTextureDesc level = { std::max(source.width / 2, 1), std::max(source.height / 2, 1), GL_R11F_G11F_B10F };
+		levels[i] = level;
+	}
+
+	// Downsampling reads the larger level and writes the next; upsampling reads a level and the smaller result and writes a new one.
+	size_t bytes = 0;
+
+	for (int i = 0; i < bloomLevels; i++) {
+		bytes += textureBytes(i == 0 ? graph.desc(hdr) : levels[i - 1]) + textureBytes(levels[i]);
+
+		if (i < bloomLevels - 1) {
+			bytes += 2 * textureBytes(levels[i]) + textureBytes(levels[i + 1]);
+		}
+	}
+
+	Stage* stage = addStage("bloom", "bloom", bytes);
+	RenderGraph::Resource down[bloomLevels];
+
+	for (int i = 0; i < bloomLevels; i++) {
+		RenderGraph::Resource source = i == 0 ? hdr : down[i - 1];
+		std::string name = "bloom.down" + std::to_string(i);
+
+		graph.addPass(name.c_str(),
+			[&](RenderGraph::Builder& builder) {
+				down[i] = builder.create(name.c_str(), levels[i]);
+				builder.read(source);
+				builder.write(down[i], LoadOp::DontCare);
+			},
+			[this, stage, source, i](const RenderGraph& frame) {
+				if (i == 0) {
+					stage->timer.poll();
+					stage->timer.begin();
+				}
+
+				bindTexture(0, frame.texture(source));
+				glUseProgram(downsampleProgram);
+				glUniform1i(glGetUniformLocation(downsampleProgram, "source"), 0);
+				glUniform1f(glGetUniformLocation(downsampleProgram, "threshold"), i == 0 ? current.bloomThreshold : -1.0f);
+				drawFullscreen(downsampleProgram);
+			});
+	}
+
+	RenderGraph::Resource smaller = down[bloomLevels - 1];
+
+	for (int i = bloomLevels - 2; i >= 0; i--) {
+		RenderGraph::Resource base = down[i];
+		RenderGraph::Resource up = 0;
+		std::string name = "bloom.up" + std::to_string(i);
+
+		graph.addPass(name.c_str(),
+			[&](RenderGraph::Builder& builder) {
+				up = builder.create(name.c_str(), levels[i]);
+				builder.read(base);
+				builder.read(smaller);
+				builder.write(up, LoadOp::DontCare);
+			},
+			[this, stage, base, smaller, i](const RenderGraph& frame) {
+				bindTexture(0, frame.texture(base));
+				bindTexture(1, frame.texture(smaller));
+				glActiveTexture(GL_TEXTURE0);
+				glUseProgram(upsampleProgram);
+				glUniform1i(glGetUniformLocation(upsampleProgram, "base"), 0);
+				glUniform1i(glGetUniformLocation(upsampleProgram, "smaller"), 1);
+				drawFullscreen(upsampleProgram);
+
+				if (i == 0) {
+					stage->timer.end();
+				}
+			});
+
+		smaller = up;
+	}
+
+	bloom = smaller;
+}
+
+void PostProcessStack::addPasses(RenderGraph& graph, RenderGraph::Resource hdr, RenderGraph::Resource output, PostFusion fusion) {
+	stages.clear();
+
+	if (fusion == PostFusion::Compute && (computeProgram == 0 || graph.texture(output) == 0)) {
+		fusion = PostFusion::Fragment;
+	}
+
+	RenderGraph::Resource bloom = 0;
+	addBloomPasses(graph, hdr, bloom);
+
+	const RenderTextureDesc& target = graph.desc(output);
+	RenderTextureDesc hdrDesc = { target.width, target.height, GL_R11F_G11F_B10F };
+	RenderTextureDesc ldrDesc = { target.width, target.height, GL_RGBA8 };
+	size_t hdrBytes = textureBytes(hdrDesc);
+	size_t ldrBytes = textureBytes(ldrDesc);
+	size_t bloomBytes = textureBytes(graph.desc(bloom));
+	bool fxaa = current.fxaa;
+
+	if (fusion == PostFusion::Compute) {
+		Stage* stage = addStage("post", "composite+tonemap+grade+fxaa", hdrBytes + bloomBytes + ldrBytes);
+
+		graph.addPass("post.compute",
+			[&](RenderGraph::Builder& builder) {
+				builder.read(hdr);
+				builder.read(bloom);
+				builder.write(output, LoadOp::DontCare);
+			},
+			[this, stage, hdr, bloom, output, fxaa, target](const RenderGraph& frame) {
+				stage->timer.poll();
+				stage->timer.begin();
+
+				bindTexture(0, frame.texture(hdr));
+				bindTexture(1, frame.texture(bloom));
+				glActiveTexture(GL_TEXTURE0);
+				glBindImageTexture(0, frame.texture(output), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+				glUseProgram(computeProgram);
+				glUniform1i(glGetUniformLocation(computeProgram, "hdrColor"), 0);
+				glUniform1i(glGetUniformLocation(computeProgram, "bloomColor"), 1);
+				glUniform1i(glGetUniformLocation(computeProgram, "fxaaEnabled"), fxaa ? 1 : 0);
+				setGradingUniforms(computeProgram);
+
+				glDispatchCompute((target.width + 15) / 16, (target.height + 15) / 16, 1);
+				glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+				stage->timer.end();
+			});
+
+		return;
+	}
+
+	// Each step writes the output directly when it is the last one.
+	RenderGraph::Resource graded = 0;
+
+	if (fusion == PostFusion::Separate) {
+		RenderGraph::Resource combined = 0;
+		RenderGraph::Resource mapped = 0;
+		Stage* compositeStage = addStage("bloom composite", "bloom", hdrBytes + bloomBytes + hdrBytes);
+		Stage* tonemapStage = addStage("tonemap", "tonemap", hdrBytes + ldrBytes);
+		Stage* gradeStage = addStage("grade", "grade", 2 * ldrBytes);
+
+		graph.addPass("post.bloomComposite",
+			[&](RenderGraph::Builder& builder) {
+				combined = builder.create("post.combined", hdrDesc);
+				builder.read(hdr);
+				builder.read(bloom);
+				builder.write(combined, LoadOp::DontCare);
+			},
+			[this, compositeStage, hdr, bloom](const RenderGraph& frame) {
+				compositeStage->timer.poll();
+				compositeStage->timer.begin();
+				bindTexture(0, frame.texture(hdr));
+				bindTexture(1, frame.texture(bloom));
+				glActiveTexture(GL_TEXTURE0);
+				glUseProgram(bloomCompositeProgram);
+				glUniform1i(glGetUniformLocation(bloomCompositeProgram, "hdrColor"), 0);
+				glUniform1i(glGetUniformLocation(bloomCompositeProgram, "bloomColor"), 1);
+				setGradingUniforms(bloomCompositeProgram);
+				drawFullscreen(bloomCompositeProgram);
+				compositeStage->timer.end();
+			});
+
+		graph.addPass("post.tonemap",
+			[&](RenderGraph::Builder& builder) {
+				mapped = builder.create("post.tonemapped", ldrDesc);
+				builder.read(combined);
+				builder.write(mapped, LoadOp::DontCare);
+			},
+			[this, tonemapStage, combined](const RenderGraph& frame) {
+				tonemapStage->timer.poll();
+				tonemapStage->timer.begin();
+				bindTexture(0, frame.texture(combined));
+				glUseProgram(tonemapProgram);
+				glUniform1i(glGetUniformLocation(tonemapProgram, "source"), 0);
+				setGradingUniforms(tonemapProgram);
+				drawFullscreen(tonemapProgram);
+				tonemapStage->timer.end();
+			});
+
+		graph.addPass("post.grade",
+			[&](RenderGraph::Builder& builder) {
+				graded = fxaa ? builder.create("post.graded", ldrDesc) : output;
+				builder.read(mapped);
+				builder.write(graded, LoadOp::DontCare);
+			},
+			[this, gradeStage, mapped](const RenderGraph& frame) {
+				gradeStage->timer.poll();
+				gradeStage->timer.begin();
+				bindTexture(0, frame.texture(mapped));
+				glUseProgram(gradeProgram);
+				glUniform1i(glGetUniformLocation(gradeProgram, "source"), 0);
+				setGradingUniforms(gradeProgram);
+				drawFullscreen(gradeProgram);
+				gradeStage->timer.end();
+			});
+	}
+	else {
+		Stage* stage = addStage("composite", "bloom+tonemap+grade", hdrBytes + bloomBytes + ldrBytes);
+
+		graph.addPass("post.composite",
+			[&](RenderGraph::Builder& builder) {
+				graded = fxaa ? builder.create("post.graded", ldrDesc) : output;
+				builder.read(hdr);
+				builder.read(bloom);
+				builder.write(graded, LoadOp::DontCare);
+			},
+			[this, stage, hdr, bloom](const RenderGraph& frame) {
+				stage->timer.poll();
+				stage->timer.begin();
+				bindTexture(0, frame.texture(hdr));
+				bindTexture(1, frame.texture(bloom));
+				glActiveTexture(GL_TEXTURE0);
+				glUseProgram(compositeProgram);
+				glUniform1i(glGetUniformLocation(compositeProgram, "hdrColor"), 0);
+				glUniform1i(glGetUniformLocation(compositeProgram, "bloomColor"), 1);
+				setGradingUniforms(compositeProgram);
+				drawFullscreen(compositeProgram);
+				stage->timer.end();
+			});
+	}
+
+	if (!fxaa) {
+		return;
+	}
+
+	Stage* fxaaStage = addStage("fxaa", "fxaa", 2 * ldrBytes);
+
+	graph.addPass("post.fxaa",
+		[&](RenderGraph::Builder& builder) {
+			builder.read(graded);
+			builder.write(output, LoadOp::DontCare);
+		},
+		[this, fxaaStage, graded](const RenderGraph& frame) {
+			fxaaStage->timer.poll();
+			fxaaStage->timer.begin();
+			bindTexture(0, frame.texture(graded));
+			glUseProgram(fxaaProgram);
+			glUniform1i(glGetUniformLocation(fxaaProgram, "source"), 0);
+			drawFullscreen(fxaaProgram);
+			fxaaStage->timer.end();
+		});
+}
+
+std::vector<PostStageTiming> PostProcessStack::timings() const {
+	std::vector<PostStageTiming> result;
+
+	for (size_t i = 0; i < stages.size(); i++) {
+		PostStageTiming timing = { stages[i]->name, stages[i]->effects, stages[i]->timer.averageMilliseconds(), stages[i]->bytes };
+		result.push_back(timing);
+	}
+
+	return result;
+}
+
+void PostProcessStack::resetTimings() {
+	for (size_t i = 0; i < stages.size(); i++) {
+		stages[i]->timer.wait();
+		stages[i]->timer.resetAverage();
+	}
+}
+
+int runPostProcessBenchmark(int width, int height, int frames) {
+	PostProcessStack post;
+	ClusteredRenderer renderer(true);
+
+	if (!post.isValid() || !renderer.isValid()) {
+		return -1;
+	}
+
+	BenchScene scene(64, 2.0f);
+	// Bright enough for the bloom threshold.
+	std::vector<ClusterLight> lights = toClusterLights(scene.makeLights(512, 6.0f), 4.0f);
+
+	float aspect = (float)width / height;
+	Mat4 view = scene.cameraView();
+	Mat4 projection = scene.cameraProjection(aspect);
+	renderer.resize(width, height, projection, scene.nearPlane(), scene.farPlane());
+
+	UniformRing ring(4096, 3);
+	std::function<void()> drawScene = [&scene]() { scene.draw(); };
+
+	unsigned int textures[2];
+	glGenTextures(2, textures);
+	glBindTexture(GL_TEXTURE_2D, textures[0]);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, textures[1]);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc hdrDesc = { width, height, GL_R11F_G11F_B10F };
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+
+	static const PostFusion modes[3] = { PostFusion::Separate, PostFusion::Fragment, PostFusion::Compute };
+	static const char* modeNames[3] = { "separate passes", "fused fragment", "fused compute" };
+	const int warmupFrames = 10;
+
+	std::cout << "POST-PROCESS BENCHMARK " << width << "x" << height << ", " << frames << " frames" << std::endl;
+
+	for (int m = 0; m < 3; m++) {
+		if (modes[m] == PostFusion::Compute && !post.supportsCompute()) {
+			std::cout << modeNames[m] << ": unavailable" << std::endl;
+			continue;
+		}
+
+		RenderGraph graph;
+		RenderGraph::Resource hdr = graph.importTexture("hdr", textures[0], hdrDesc);
+		RenderGraph::Resource output = graph.importTexture("output", textures[1], outputDesc);
+
+		renderer.addPass(graph, hdr, drawScene);
+		post.addPasses(graph, hdr, output, modes[m]);
+
+		if (!graph.compile()) {
+			continue;
+		}
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				post.resetTimings();
+			}
+
+			ring.beginFrame();
+			renderer.setFrame(ring, view, projection, lights);
+			graph.execute();
+			ring.endFrame();
+		}
+
+		std::vector<PostStageTiming> timings = post.timings();
+		double totalMilliseconds = 0.0;
+		size_t totalBytes = 0;
+
+		std::cout << modeNames[m] << ":" << std::endl;
+
+		for (size_t i = 0; i < timings.size(); i++) {
+			std::cout << "  " << timings[i].name << " (" << timings[i].effects << "): " << timings[i].milliseconds << " ms, "
+				<< timings[i].bytes / (1024.0 * 1024.0) << " MB" << std::endl;
+			totalMilliseconds += timings[i].milliseconds;
+			totalBytes += timings[i].bytes;
+		}
+
+		std::cout << "  total: " << totalMilliseconds << " ms, " << totalBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+	}
+
+	glDeleteTextures(2, textures);
+
+	return 0;
+}
@@ -0,0 +1,105 @@
+#ifndef CUSTOM_POSTPROCESS_H
+#define CUSTOM_POSTPROCESS_H
+
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+#include "vecmath.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct PostProcessSettings {
+	float bloomThreshold;
+	float bloomIntensity;
+	float exposure;
+	// Lift/gamma/gain color grading, applied after tonemapping.
+	Vec3 lift;
+	Vec3 gamma;
+	Vec3 gain;
+	float saturation;
+	bool fxaa;
+};
+
+PostProcessSettings defaultPostProcessSettings();
+
+enum class PostFusion {
+	// One full-screen pass per effect, for comparison.
+	Separate,
+	// Bloom composite, tonemap and grading in one pass, then FXAA.
+	Fragment,
+	// Everything after the bloom chain in a single tiled compute dispatch.
+	// Needs GL 4.3 and an output that is not the backbuffer; falls back to Fragment otherwise.
+	Compute
+};
+
+struct PostStageTiming {
+	std::string name;
+	// Effects the stage covers, e.g. "tonemap+grade".
+	std::string effects;
+	double milliseconds;
+	// Every texel of the stage's inputs and outputs touched once.
+	size_t bytes;
+};
+
+// Bloom, tonemapping, color grading and FXAA as RenderGraph passes. Bloom is a
+// thresholded half-resolution pyramid blurred on the way down and back up;
+// the other effects are per-pixel except FXAA, so they fuse into the pass
+// that feeds it. The compute variant goes one step further: each 16x16 tile
+// composites, tonemaps and grades its pixels plus an apron into shared
+// memory and runs FXAA from there, so the graded image never reaches memory.
+class PostProcessStack {
+public:
+	static const int bloomLevels = 5;
+
+	PostProcessStack();
+	~PostProcessStack();
+
+	PostProcessStack(const PostProcessStack&) = delete;
+	PostProcessStack& operator=(const PostProcessStack&) = delete;
+
+	bool isValid() const;
+	bool supportsCompute() const;
+
+	void setSettings(const PostProcessSettings& settings);
+	const PostProcessSettings& settings() const;
+
+	// Adds the passes reading hdr and writing output. Calling it again replaces the stages reported by timings().
+	void addPasses(RenderGraph& graph, RenderGraph::Resource hdr, RenderGraph::Resource output, PostFusion fusion);
+
+	std::vector<PostStageTiming> timings() const;
+	void resetTimings();
+
+private:
+	struct Stage {
+		std::string name;
+		std::string effects;
+		size_t bytes;
+		GpuTimer timer;
+
+		Stage(const char* name, const char* effects, size_t bytes);
+	};
+
+	Stage* addStage(const char* name, const char* effects, size_t bytes);
+	void setGradingUniforms(unsigned int program) const;
+	void addBloomPasses(RenderGraph& graph, RenderGraph::Resource hdr, RenderGraph::Resource& bloom);
+	void drawFullscreen(unsigned int program) const;
+
+	PostProcessSettings current;
+	unsigned int downsampleProgram;
+	unsigned int upsampleProgram;
+	unsigned int bloomCompositeProgram;
+	unsigned int tonemapProgram;
+	unsigned int gradeProgram;
+	unsigned int compositeProgram;
+	unsigned int fxaaProgram;
+	unsigned int computeProgram;
+	unsigned int emptyVao;
+	std::vector<std::unique_ptr<Stage>> stages;
+};
+
+// Renders BenchScene with bright clustered lights into an HDR target and
+// post-processes it with every fusion mode, printing GPU time and estimated
+// traffic per stage. Needs a current context. Returns 0 on success.
+int runPostProcessBenchmark(int width, int height, int frames);
+
+#endif // !CUSTOM_POSTPROCESS_H
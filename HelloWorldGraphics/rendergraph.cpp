@@ -0,0 +1,520 @@
+#include "rendergraph.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <iostream>
+#include <set>
+
+static bool isDepthFormat(unsigned int internalFormat) {
+	switch (internalFormat) {
+	case GL_DEPTH_COMPONENT16:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32:
+	case GL_DEPTH_COMPONENT32F:
+	case GL_DEPTH24_STENCIL8:
+	case GL_DEPTH32F_STENCIL8:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool hasStencil(unsigned int internalFormat) {
+	return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+}
+
+size_t bytesPerPixel(unsigned int internalFormat) {
+	switch (internalFormat) {
+	case GL_R8:
+		return 1;
+	case GL_RG8:
+	case GL_R16F:
+	case GL_DEPTH_COMPONENT16:
+		return 2;
+	case GL_RGBA16F:
+	case GL_RG32F:
+	case GL_DEPTH32F_STENCIL8:
+		return 8;
+	case GL_RGBA32F:
+		return 16;
+	default:
+		// RGBA8, RGB10_A2, R11F_G11F_B10F, RG16F, RG16_SNORM, R32F and the 24/32 bit depth formats.
+		return 4;
+	}
+}
+
+static unsigned int createRenderTexture(const RenderTextureDesc& desc) {
+	unsigned int texture;
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	if (hasStencil(desc.internalFormat)) {
+		glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+	}
+	else if (isDepthFormat(desc.internalFormat)) {
+		glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	}
+	else {
+		glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	return texture;
+}
+
+static bool sameDesc(const RenderTextureDesc& a, const RenderTextureDesc& b) {
+	return a.width == b.width && a.height == b.height && a.internalFormat == b.internalFormat;
+}
+
+RenderGraph::Builder::Builder(RenderGraph& graph, size_t pass) : graph(graph), pass(pass) {
+}
+
+RenderGraph::Resource RenderGraph::Builder::create(const char* name, const RenderTextureDesc& desc) {
+	ResourceNode node = { name, desc, false, false, 0, -1, -1 };
+	graph.resources.push_back(node);
+	return (Resource)(graph.resources.size() - 1);
+}
+
+void RenderGraph::Builder::read(Resource resource) {
+	graph.passes[pass].reads.push_back(resource);
+}
+
+void RenderGraph::Builder::write(Resource resource, LoadOp loadOp) {
+	Attachment attachment = { resource, loadOp };
+	graph.passes[pass].writes.push_back(attachment);
+}
+
+void RenderGraph::Builder::setClearColor(float r, float g, float b, float a) {
+	float* color = graph.passes[pass].clearColor;
+	color[0] = r;
+	color[1] = g;
+	color[2] = b;
+	color[3] = a;
+}
+
+void RenderGraph::Builder::sideEffect() {
+	graph.passes[pass].sideEffect = true;
+}
+
+RenderGraph::RenderGraph() : culledPasses(0), requestedBytes(0) {
+}
+
+RenderGraph::~RenderGraph() {
+	for (size_t i = 0; i < pool.size(); i++) {
+		glDeleteTextures(1, &pool[i].texture);
+	}
+
+	for (std::map<std::vector<unsigned int>, unsigned int>::iterator it = framebuffers.begin(); it != framebuffers.end(); ++it) {
+		glDeleteFramebuffers(1, &it->second);
+	}
+}
+
+RenderGraph::Resource RenderGraph::importTexture(const char* name, unsigned int texture, const RenderTextureDesc& desc) {
+	ResourceNode node = { name, desc, true, false, texture, -1, -1 };
+	resources.push_back(node);
+	return (Resource)(resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::importBackbuffer(int width, int height) {
+	RenderTextureDesc desc = { width, height, GL_RGBA8 };
+	ResourceNode node = { "backbuffer", desc, true, true, 0, -1, -1 };
+	resources.push_back(node);
+	return (Resource)(resources.size() - 1);
+}
+
+void RenderGraph::addPass(const char* name, const SetupFunction& setup, const ExecuteFunction& execute) {
+	PassNode node;
+	node.name = name;
+	node.clearColor[0] = node.clearColor[1] = node.clearColor[2] = 0.0f;
+	node.clearColor[3] = 1.0f;
+	node.sideEffect = false;
+	node.culled = false;
+	node.execute = execute;
+	passes.push_back(node);
+
+	Builder builder(*this, passes.size() - 1);
+	setup(builder);
+}
+
+bool RenderGraph::compile() {
+	size_t passCount = passes.size();
+	// Ordering edges, and the subset a pass needs the results of for culling.
+	std::vector<std::set<size_t> > dependencies(passCount);
+	std::vector<std::set<size_t> > inputs(passCount);
+
+	// Every write starts a new version of its resource. Walking the passes in
+	// declaration order, a reader depends on the writer of the version it
+	// sees, and a writer comes after the previous writer and after everything
+	// that read the previous version.
+	std::vector<int> lastWriter(resources.size(), -1);
+	std::vector<std::vector<size_t> > readersSinceWrite(resources.size());
+
+	for (size_t p = 0; p < passCount; p++) {
+		const PassNode& pass = passes[p];
+
+		for (size_t r = 0; r < pass.reads.size(); r++) {
+			Resource resource = pass.reads[r];
+			int writer = lastWriter[resource];
+
+			if (writer >= 0 && (size_t)writer != p) {
+				dependencies[p].insert(writer);
+				inputs[p].insert(writer);
+			}
+
+			readersSinceWrite[resource].push_back(p);
+		}
+
+		for (size_t a = 0; a < pass.writes.size(); a++) {
+			Resource resource = pass.writes[a].resource;
+			int writer = lastWriter[resource];
+
+			if (writer >= 0 && (size_t)writer != p) {
+				dependencies[p].insert(writer);
+
+				if (pass.writes[a].loadOp == LoadOp::Load) {
+					inputs[p].insert(writer);
+				}
+			}
+
+			for (size_t i = 0; i < readersSinceWrite[resource].size(); i++) {
+				if (readersSinceWrite[resource][i] != p) {
+					dependencies[p].insert(readersSinceWrite[resource][i]);
+				}
+			}
+
+			lastWriter[resource] = (int)p;
+			readersSinceWrite[resource].clear();
+		}
+	}
+
+	// Cull: start from passes with visible results and walk back through what they need.
+	std::vector<size_t> worklist;
+
+	for (size_t p = 0; p < passCount; p++) {
+		PassNode& pass = passes[p];
+		pass.culled = true;
+
+		bool visible = pass.sideEffect;
+
+		for (size_t a = 0; a < pass.writes.size(); a++) {
+			visible = visible || resources[pass.writes[a].resource].imported;
+		}
+
+		if (visible) {
+			pass.culled = false;
+			worklist.push_back(p);
+		}
+	}
+
+	while (!worklist.empty()) {
+		size_t p = worklist.back();
+		worklist.pop_back();
+
+		for (std::set<size_t>::iterator it = inputs[p].begin(); it != inputs[p].end(); ++it) {
+			if (passes[*it].culled) {
+				passes[*it].culled = false;
+				worklist.push_back(*it);
+			}
+		}
+	}
+
+	// Topological order over the surviving passes, ties broken by declaration order.
+	std::vector<size_t> pendingDependencies(passCount, 0);
+	std::set<size_t> ready;
+	size_t livePasses = 0;
+
+	culledPasses = 0;
+
+	for (size_t p = 0; p < passCount; p++) {
+		if (passes[p].culled) {
+			culledPasses++;
+			continue;
+		}
+
+		livePasses++;
+
+		for (std::set<size_t>::iterator it = dependencies[p].begin(); it != dependencies[p].end(); ++it) {
+			if (!passes[*it].culled) {
+				pendingDependencies[p]++;
+			}
+		}
+
+		if (pendingDependencies[p] == 0) {
+			ready.insert(p);
+		}
+	}
+
+	order.clear();
+
+	while (!ready.empty()) {
+		size_t p = *ready.begin();
+		ready.erase(ready.begin());
+		order.push_back(p);
+
+		for (size_t q = 0; q < passCount; q++) {
+			if (!passes[q].culled && dependencies[q].count(p) != 0 && --pendingDependencies[q] == 0) {
+				ready.insert(q);
+			}
+		}
+	}
+
+	if (order.size() != livePasses) {
+		std::cerr << "ERROR::RENDER_GRAPH::DEPENDENCY_CYCLE" << std::endl;
+		order.clear();
+		return false;
+	}
+
+	for (size_t r = 0; r < resources.size(); r++) {
+		resources[r].firstUse = -1;
+		resources[r].lastUse = -1;
+	}
+
+	for (size_t i = 0; i < order.size(); i++) {
+		const PassNode& pass = passes[order[i]];
+		std::vector<Resource> used = pass.reads;
+
+		for (size_t a = 0; a < pass.writes.size(); a++) {
+			used.push_back(pass.writes[a].resource);
+		}
+
+		for (size_t u = 0; u < used.size(); u++) {
+			ResourceNode& resource = resources[used[u]];
+
+			if (resource.firstUse < 0) {
+				resource.firstUse = (int)i;
+			}
+
+			resource.lastUse = (int)i;
+		}
+	}
+
+	assignTransientTextures();
+
+	return true;
+}
+
+void RenderGraph::assignTransientTextures() {
+	std::vector<Resource> transients;
+
+	for (size_t r = 0; r < resources.size(); r++) {
+		if (!resources[r].imported && resources[r].firstUse >= 0) {
+			transients.push_back((Resource)r);
+		}
+	}
+
+	std::sort(transients.begin(), transients.end(), [this](Resource a, Resource b) {
+		return resources[a].firstUse < resources[b].firstUse;
+	});
+
+	std::vector<bool> used(pool.size(), false);
+
+	for (size_t i = 0; i < pool.size(); i++) {
+		pool[i].availableAfter = -1;
+	}
+
+	requestedBytes = 0;
+
+	for (size_t t = 0; t < transients.size(); t++) {
+		ResourceNode& resource = resources[transients[t]];
+		size_t chosen = pool.size();
+
+		requestedBytes += (size_t)resource.desc.width * resource.desc.height * bytesPerPixel(resource.desc.internalFormat);
+
+		// A pooled texture can be shared once the previous user's last pass has run.
+		for (size_t i = 0; i < pool.size(); i++) {
+			if (sameDesc(pool[i].desc, resource.desc) && pool[i].availableAfter < resource.firstUse) {
+				chosen = i;
+				break;
+			}
+		}
+
+		if (chosen == pool.size()) {
+			PooledTexture pooled = { resource.desc, createRenderTexture(resource.desc), -1 };
+			pool.push_back(pooled);
+			used.push_back(false);
+		}
+
+		pool[chosen].availableAfter = resource.lastUse;
+		used[chosen] = true;
+		resource.texture = pool[chosen].texture;
+	}
+
+	// Textures nobody needs this frame (after a resize, say) are released along with their framebuffers.
+	for (size_t i = pool.size(); i-- > 0;) {
+		if (used[i]) {
+			continue;
+		}
+
+		unsigned int texture = pool[i].texture;
+
+		for (std::map<std::vector<unsigned int>, unsigned int>::iterator it = framebuffers.begin(); it != framebuffers.end();) {
+			if (std::find(it->first.begin(), it->first.end(), texture) != it->first.end()) {
+				glDeleteFramebuffers(1, &it->second);
+				it = framebuffers.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+
+		glDeleteTextures(1, &texture);
+		pool.erase(pool.begin() + i);
+	}
+}
+
+unsigned int RenderGraph::framebufferFor(const PassNode& pass) {
+	framebufferKey.clear();
+
+	for (size_t a = 0; a < pass.writes.size(); a++) {
+		const ResourceNode& resource = resources[pass.writes[a].resource];
+
+		if (resource.backbuffer) {
+			return 0;
+		}
+
+		framebufferKey.push_back(resource.texture);
+	}
+
+	std::map<std::vector<unsigned int>, unsigned int>::iterator found = framebuffers.find(framebufferKey);
+
+	if (found != framebuffers.end()) {
+		return found->second;
+	}
+
+	unsigned int framebuffer;
+	std::vector<GLenum> drawBuffers;
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	for (size_t a = 0; a < pass.writes.size(); a++) {
+		const ResourceNode& resource = resources[pass.writes[a].resource];
+
+		if (hasStencil(resource.desc.internalFormat)) {
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, resource.texture, 0);
+		}
+		else if (isDepthFormat(resource.desc.internalFormat)) {
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, resource.texture, 0);
+		}
+		else {
+			GLenum attachment = GL_COLOR_ATTACHMENT0 + (GLenum)drawBuffers.size();
+			glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, resource.texture, 0);
+			drawBuffers.push_back(attachment);
+		}
+	}
+
+	if (drawBuffers.empty()) {
+		glDrawBuffer(GL_NONE);
+	}
+	else {
+		glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+	}
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "ERROR::RENDER_GRAPH::FRAMEBUFFER_INCOMPLETE: " << pass.name << std::endl;
+	}
+
+	framebuffers[framebufferKey] = framebuffer;
+	return framebuffer;
+}
+
+void RenderGraph::beginPass(const PassNode& pass) {
+	if (pass.writes.empty()) {
+		return;
+	}
+
+	unsigned int framebuffer = framebufferFor(pass);
+	const RenderTextureDesc& target = resources[pass.writes[0].resource].desc;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, target.width, target.height);
+
+	std::vector<unsigned int>& invalidated = invalidatedAttachments;
+	int colorIndex = 0;
+
+	invalidated.clear();
+
+	for (size_t a = 0; a < pass.writes.size(); a++) {
+		const Attachment& attachment = pass.writes[a];
+		const ResourceNode& resource = resources[attachment.resource];
+		bool depth = isDepthFormat(resource.desc.internalFormat);
+
+		if (attachment.loadOp == LoadOp::Clear) {
+			if (resource.backbuffer) {
+				glClearColor(pass.clearColor[0], pass.clearColor[1], pass.clearColor[2], pass.clearColor[3]);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+			}
+			else if (depth) {
+				glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+			}
+			else {
+				glClearBufferfv(GL_COLOR, colorIndex, pass.clearColor);
+			}
+		}
+		else if (attachment.loadOp == LoadOp::DontCare) {
+			if (resource.backbuffer) {
+				invalidated.push_back(GL_COLOR);
+			}
+			else if (depth) {
+				invalidated.push_back(hasStencil(resource.desc.internalFormat) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT);
+			}
+			else {
+				invalidated.push_back(GL_COLOR_ATTACHMENT0 + colorIndex);
+			}
+		}
+
+		if (!depth) {
+			colorIndex++;
+		}
+	}
+
+	// Lets tiled and compressing GPUs skip loading contents the pass overwrites anyway.
+	if (!invalidated.empty() && (GLEW_VERSION_4_3 || GLEW_ARB_invalidate_subdata)) {
+		glInvalidateFramebuffer(GL_FRAMEBUFFER, (GLsizei)invalidated.size(), invalidated.data());
+	}
+}
+
+void RenderGraph::execute() {
+	for (size_t i = 0; i < order.size(); i++) {
+		const PassNode& pass = passes[order[i]];
+
+		beginPass(pass);
+		pass.execute(*this);
+	}
+}
+
+void RenderGraph::reset() {
+	resources.clear();
+	passes.clear();
+	order.clear();
+}
+
+unsigned int RenderGraph::texture(Resource resource) const {
+	return resources[resource].texture;
+}
+
+const RenderTextureDesc& RenderGraph::desc(Resource resource) const {
+	return resources[resource].desc;
+}
+
+size_t RenderGraph::culledPassCount() const {
+	return culledPasses;
+}
+
+size_t RenderGraph::transientBytesRequested() const {
+	return requestedBytes;
+}
+
+size_t RenderGraph::transientBytesAllocated() const {
+	size_t total = 0;
+
+	for (size_t i = 0; i < pool.size(); i++) {
+		total += (size_t)pool[i].desc.width * pool[i].desc.height * bytesPerPixel(pool[i].desc.internalFormat);
+	}
+
+	return total;
+}
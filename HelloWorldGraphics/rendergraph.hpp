@@ -0,0 +1,130 @@
+#ifndef CUSTOM_RENDERGRAPH_H
+#define CUSTOM_RENDERGRAPH_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+struct RenderTextureDesc {
+	int width;
+	int height;
+	unsigned int internalFormat;
+};
+
+// Size of one texel of a sized internal format, for memory statistics.
+size_t bytesPerPixel(unsigned int internalFormat);
+
+enum class LoadOp {
+	Load,
+	Clear,
+	DontCare
+};
+
+// Declarative frame description. Passes declare the textures they read and
+// write, and every write makes a new version of its texture that readers
+// declared after it see. compile() drops passes whose results nobody
+// consumes, orders the rest by their dependencies (a reader after the writer
+// of its version, a writer after the readers of the version it replaces)
+// and lets transient textures whose lifetimes do not overlap share one GL
+// texture. Clears only happen where a pass asks for LoadOp::Clear, and
+// LoadOp::DontCare invalidates instead of loading.
+class RenderGraph {
+public:
+	typedef unsigned int Resource;
+
+	class Builder {
+	public:
+		Resource create(const char* name, const RenderTextureDesc& desc);
+		void read(Resource resource);
+		void write(Resource resource, LoadOp loadOp);
+		void setClearColor(float r, float g, float b, float a);
+		// Keeps the pass alive even if nothing reads what it writes.
+		void sideEffect();
+
+	private:
+		friend class RenderGraph;
+		Builder(RenderGraph& graph, size_t pass);
+
+		RenderGraph& graph;
+		size_t pass;
+	};
+
+	typedef std::function<void(Builder&)> SetupFunction;
+	typedef std::function<void(const RenderGraph&)> ExecuteFunction;
+
+	RenderGraph();
+	~RenderGraph();
+
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+
+	Resource importTexture(const char* name, unsigned int texture, const RenderTextureDesc& desc);
+	Resource importBackbuffer(int width, int height);
+
+	void addPass(const char* name, const SetupFunction& setup, const ExecuteFunction& execute);
+
+	bool compile();
+
+	void execute();
+
+	// Forgets passes and resources but keeps the texture pool for the next frame.
+	void reset();
+
+	unsigned int texture(Resource resource) const;
+	const RenderTextureDesc& desc(Resource resource) const;
+
+	size_t culledPassCount() const;
+	size_t transientBytesRequested() const;
+	size_t transientBytesAllocated() const;
+
+private:
+	struct ResourceNode {
+		std::string name;
+		RenderTextureDesc desc;
+		bool imported;
+		bool backbuffer;
+		unsigned int texture;
+		int firstUse;
+		int lastUse;
+	};
+
+	struct Attachment {
+		Resource resource;
+		LoadOp loadOp;
+	};
+
+	struct PassNode {
+		std::string name;
+		std::vector<Resource> reads;
+		std::vector<Attachment> writes;
+		float clearColor[4];
+		bool sideEffect;
+		bool culled;
+		ExecuteFunction execute;
+	};
+
+	struct PooledTexture {
+		RenderTextureDesc desc;
+		unsigned int texture;
+		int availableAfter;
+	};
+
+	void assignTransientTextures();
+	unsigned int framebufferFor(const PassNode& pass);
+	void beginPass(const PassNode& pass);
+
+	std::vector<ResourceNode> resources;
+	std::vector<PassNode> passes;
+	std::vector<size_t> order;
+	std::vector<PooledTexture> pool;
+	std::map<std::vector<unsigned int>, unsigned int> framebuffers;
+	// Scratch for execute(), kept so that steady-state frames do not allocate.
+	std::vector<unsigned int> framebufferKey;
+	std::vector<unsigned int> invalidatedAttachments;
+	size_t culledPasses;
+	size_t requestedBytes;
+};
+
+#endif // !CUSTOM_RENDERGRAPH_H
@@ -0,0 +1,246 @@
+#include "scenesystems.hpp"
+#include "benchscene.hpp"
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+#include "uniformring.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+void animateEntities(World& world, JobSystem& jobs, float time) {
+	world.parallelEachChunk<Transform, Motion>(jobs, [time](int, size_t count, const Entity*, Transform* transforms, Motion* motions) {
+		for (size_t i = 0; i < count; i++) {
+			transforms[i].position.y = motions[i].baseHeight + 0.3f * std::sin(time * motions[i].speed + motions[i].phase);
+		}
+	});
+}
+
+void updateBounds(World& world, JobSystem& jobs) {
+	world.parallelEachChunk<Transform, Bounds>(jobs, [](int, size_t count, const Entity*, Transform* transforms, Bounds* bounds) {
+		for (size_t i = 0; i < count; i++) {
+			bounds[i].sphere.center = transforms[i].position;
+			bounds[i].sphere.radius = 0.7f * transforms[i].scale;
+		}
+	});
+}
+
+VisibleGather::VisibleGather(FrameArena& arena) : arena(arena), fallback(), instances(NULL), instanceCount(0) {
+}
+
+unsigned int VisibleGather::gather(World& world, JobSystem& jobs, const Frustum& frustum) {
+	size_t capacity = world.entityCount() * 6;
+	LinearArena* frameMemory = arena.threadArena();
+
+	if (frameMemory != NULL) {
+		instances = frameMemory->allocateArray<float>(capacity);
+	} else {
+		fallback.resize(capacity);
+		instances = fallback.empty() ? NULL : &fallback[0];
+	}
+
+	float* output = instances;
+	std::atomic<size_t> cursor(0);
+
+	world.parallelEachChunk<Bounds, Renderable>(jobs, [&frustum, output, &cursor](int, size_t count, const Entity*, Bounds* bounds, Renderable* renderables) {
+		// Visible rows are collected in batches so lanes touch the cursor rarely.
+		const int batchSize = 64;
+		size_t batch[batchSize];
+		int batched = 0;
+
+		for (size_t i = 0; i < count; i++) {
+			if (sphereInFrustum(frustum, bounds[i].sphere)) {
+				batch[batched++] = i;
+			}
+
+			if (batched == batchSize || (i + 1 == count && batched > 0)) {
+				float* instance = output + cursor.fetch_add(batched, std::memory_order_relaxed) * 6;
+
+				for (int b = 0; b < batched; b++, instance += 6) {
+					const Vec3& center = bounds[batch[b]].sphere.center;
+					const Vec3& color = renderables[batch[b]].color;
+
+					instance[0] = center.x;
+					instance[1] = center.y;
+					instance[2] = center.z;
+					instance[3] = color.x;
+					instance[4] = color.y;
+					instance[5] = color.z;
+				}
+
+				batched = 0;
+			}
+		}
+	});
+
+	instanceCount = (unsigned int)cursor.load();
+
+	return instanceCount;
+}
+
+const float* VisibleGather::instanceData() const {
+	return instanceCount == 0 ? NULL : instances;
+}
+
+void gatherLights(World& world, std::vector<ClusterLight>& lights) {
+	lights.clear();
+
+	world.each<Transform, LightSource>([&lights](Transform& transform, LightSource& source) {
+		ClusterLight light;
+		light.positionRadius = vec4(transform.position.x, transform.position.y, transform.position.z, source.radius);
+		light.color = vec4(source.color.x, source.color.y, source.color.z, -1.0f);
+		light.directionCone = vec4(0.0f, -1.0f, 0.0f, -1.0f);
+		lights.push_back(light);
+	});
+}
+
+static float nextUnit(unsigned int& seed) {
+	seed = seed * 1664525u + 1013904223u;
+	return ((seed >> 8) & 0xFFFF) / 65535.0f;
+}
+
+int runEcsBenchmark(int width, int height, int entityCount, int frames) {
+	const float spacing = 1.0f;
+	int gridSize = (int)std::ceil(std::sqrt((double)entityCount));
+
+	// Supplies the cube mesh and camera; its instances are replaced every frame.
+	BenchScene scene(gridSize, spacing);
+	ClusteredRenderer renderer(true);
+
+	if (!renderer.isValid()) {
+		return -1;
+	}
+
+	World world;
+	float halfExtent = scene.extent();
+	unsigned int seed = 13579;
+
+	for (int i = 0; i < entityCount; i++) {
+		Transform transform = { vec3((i % gridSize) * spacing - halfExtent, 0.4f, (i / gridSize) * spacing - halfExtent), 1.0f };
+		Motion motion = { 0.4f, nextUnit(seed) * 6.2832f, 1.0f + nextUnit(seed) };
+		Renderable renderable = { vec3(0.4f + 0.6f * nextUnit(seed), 0.4f + 0.6f * nextUnit(seed), 0.4f + 0.6f * nextUnit(seed)) };
+		Bounds bounds = { { transform.position, 0.7f } };
+
+		world.create(transform, motion, renderable, bounds);
+	}
+
+	int lightCount = std::min(std::max(entityCount / 1024, 1), 1024);
+
+	for (int i = 0; i < lightCount; i++) {
+		Transform transform = { vec3((nextUnit(seed) * 2.0f - 1.0f) * halfExtent, 1.5f, (nextUnit(seed) * 2.0f - 1.0f) * halfExtent), 1.0f };
+		Motion motion = { 1.5f, nextUnit(seed) * 6.2832f, 0.5f };
+		LightSource source = { vec3(nextUnit(seed), nextUnit(seed), nextUnit(seed)), 6.0f };
+
+		world.create(transform, motion, source);
+	}
+
+	float aspect = (float)width / height;
+	Mat4 view = scene.cameraView();
+	Mat4 projection = scene.cameraProjection(aspect);
+	Frustum frustum = extractFrustum(multiply(projection, view));
+	UniformRing ring(4096, 3);
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	std::function<void()> drawScene = [&scene]() { scene.draw(); };
+
+	renderer.resize(width, height, projection, scene.nearPlane(), scene.farPlane());
+
+	RenderGraph graph;
+	renderer.addPass(graph, graph.importTexture("output", outputTexture, outputDesc), drawScene);
+
+	if (!graph.compile()) {
+		glDeleteTextures(1, &outputTexture);
+		return -1;
+	}
+
+	JobSystem serial(0);
+	JobSystem parallel(std::max((int)std::thread::hardware_concurrency() - 1, 1));
+	std::vector<ClusterLight> lights;
+	const int warmupFrames = 10;
+	bool failed = false;
+
+	std::cout << "ECS BENCHMARK " << width << "x" << height << ", " << world.entityCount() << " entities in "
+		<< world.archetypeCount() << " archetypes, " << world.chunkCount() << " chunks, " << frames << " frames" << std::endl;
+
+	for (int pass = 0; pass < 2; pass++) {
+		JobSystem& jobs = pass == 0 ? serial : parallel;
+		// Holds the visible list; every entity fits in each buffer's first chunk.
+		FrameArena frameArena(world.entityCount() * 6 * sizeof(float) + 256);
+		VisibleGather visible(frameArena);
+		GpuTimer timer(4);
+		double milliseconds[4] = { 0.0, 0.0, 0.0, 0.0 };
+		unsigned int visibleCount = 0;
+		size_t arenaHeapAllocations = 0;
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				timer.wait();
+				timer.resetAverage();
+				std::fill(milliseconds, milliseconds + 4, 0.0);
+			}
+
+			std::chrono::steady_clock::time_point stamps[5];
+
+			stamps[0] = std::chrono::steady_clock::now();
+			animateEntities(world, jobs, frame / 60.0f);
+			stamps[1] = std::chrono::steady_clock::now();
+			updateBounds(world, jobs);
+			stamps[2] = std::chrono::steady_clock::now();
+			visibleCount = visible.gather(world, jobs, frustum);
+			stamps[3] = std::chrono::steady_clock::now();
+			gatherLights(world, lights);
+			stamps[4] = std::chrono::steady_clock::now();
+
+			for (int s = 0; s < 4; s++) {
+				milliseconds[s] += std::chrono::duration<double, std::milli>(stamps[s + 1] - stamps[s]).count();
+			}
+
+			ring.beginFrame();
+			timer.begin();
+
+			scene.updateInstances(visible.instanceData(), visibleCount);
+			renderer.setFrame(ring, view, projection, lights);
+			graph.execute();
+
+			timer.end();
+			ring.endFrame();
+			timer.poll();
+
+			FrameArenaStats arenaFrame = frameArena.endFrame();
+
+			if (frame >= warmupFrames) {
+				arenaHeapAllocations += arenaFrame.heapAllocations;
+			}
+		}
+
+		timer.wait();
+
+		std::cout << jobs.laneCount() << (jobs.laneCount() == 1 ? " lane: " : " lanes: ") << "animate " << milliseconds[0] / frames
+			<< " ms, bounds " << milliseconds[1] / frames << " ms, cull and gather " << milliseconds[2] / frames << " ms, lights "
+			<< milliseconds[3] / frames << " ms CPU, " << visibleCount << " visible, " << timer.averageMilliseconds() << " ms GPU, "
+			<< arenaHeapAllocations << " frame arena heap chunks after warm-up" << std::endl;
+
+		if (arenaHeapAllocations != 0) {
+			failed = true;
+		}
+	}
+
+	glDeleteTextures(1, &outputTexture);
+
+	if (failed) {
+		std::cerr << "ERROR::ECS::FRAME_ARENA_ALLOCATED_AFTER_WARMUP" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
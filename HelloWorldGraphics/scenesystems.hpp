@@ -0,0 +1,81 @@
+#ifndef CUSTOM_SCENESYSTEMS_H
+#define CUSTOM_SCENESYSTEMS_H
+
+#include "clustered.hpp"
+#include "culling.hpp"
+#include "ecs.hpp"
+#include "framearena.hpp"
+#include "vecmath.hpp"
+#include <vector>
+
+// Components of renderable scenes. Entities drawn as BenchScene cubes carry
+// Transform, Renderable and Bounds; lights carry Transform and LightSource.
+
+struct Transform {
+	Vec3 position;
+	float scale;
+};
+
+// Bobs an entity up and down around baseHeight.
+struct Motion {
+	float baseHeight;
+	float phase;
+	float speed;
+};
+
+struct Renderable {
+	Vec3 color;
+};
+
+// World-space bounds, derived from Transform by updateBounds().
+struct Bounds {
+	BoundingSphere sphere;
+};
+
+struct LightSource {
+	Vec3 color;
+	float radius;
+};
+
+void animateEntities(World& world, JobSystem& jobs, float time);
+
+// Cube bounds: the sphere around a 0.8 cube scaled by Transform::scale.
+void updateBounds(World& world, JobSystem& jobs);
+
+// Frustum-culls renderables straight into one array in the instance layout
+// of BenchScene::updateInstances(). The array comes from the calling
+// thread's arena in the given FrameArena, sized for every entity, and lanes
+// claim ranges of it through an atomic cursor, so instance order varies from
+// frame to frame. The data stays valid until the arena's second endFrame()
+// after gather().
+class VisibleGather {
+public:
+	VisibleGather(FrameArena& arena);
+
+	VisibleGather(const VisibleGather&) = delete;
+	VisibleGather& operator=(const VisibleGather&) = delete;
+
+	// Returns the number of visible instances.
+	unsigned int gather(World& world, JobSystem& jobs, const Frustum& frustum);
+
+	const float* instanceData() const;
+
+private:
+	FrameArena& arena;
+	// Used when the calling thread got no slot in the arena.
+	std::vector<float> fallback;
+	float* instances;
+	unsigned int instanceCount;
+};
+
+void gatherLights(World& world, std::vector<ClusterLight>& lights);
+
+// Fills a World with entityCount bobbing cubes and a light per 1024 of
+// them, runs the systems above on one lane and then on every core, and draws
+// the result with the clustered renderer. Prints CPU time per system, GPU
+// time and the heap chunks the frame arena behind the visible list took
+// after warm-up. Needs a current context. Returns 0 on success, 1 when the
+// arena still allocated after warm-up.
+int runEcsBenchmark(int width, int height, int entityCount, int frames);
+
+#endif // !CUSTOM_SCENESYSTEMS_H
@@ -1,12 +1,27 @@
 #include "shader.hpp"
+#include "glprogram.hpp"
+#include <GL/glew.h>
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath) {
+Shader::Shader(const char* vertexPath, const char* fragmentPath)
+	: ID(0), vertexPath(vertexPath), fragmentPath(fragmentPath) {
 	std::string vertexCode;
 	std::string fragmentCode;
 
+	if (readSources(this->vertexPath, this->fragmentPath, vertexCode, fragmentCode)) {
+		ID = buildProgram(vertexCode, fragmentCode);
+	}
+}
+
+Shader::~Shader() {
+	glDeleteProgram(ID);
+}
+
+bool Shader::readSources(const std::string& vertexPath, const std::string& fragmentPath,
+	std::string& vertexCode, std::string& fragmentCode) {
 	std::ifstream vShaderFile;
 	std::ifstream fShaderFile;
 
@@ -16,9 +31,61 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
 	try {
 		vShaderFile.open(vertexPath);
 		fShaderFile.open(fragmentPath);
-		
+
+		std::stringstream vShaderStream;
+		std::stringstream fShaderStream;
+
+		vShaderStream << vShaderFile.rdbuf();
+		fShaderStream << fShaderFile.rdbuf();
+
+		vertexCode = vShaderStream.str();
+		fragmentCode = fShaderStream.str();
 	}
 	catch (std::ifstream::failure e) {
 		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+unsigned int Shader::buildProgram(const std::string& vertexCode, const std::string& fragmentCode) {
+	return createProgram(vertexCode.c_str(), fragmentCode.c_str());
+}
+
+void Shader::use() {
+	glUseProgram(ID);
+}
+
+bool Shader::reload() {
+	std::string vertexCode;
+	std::string fragmentCode;
+
+	if (!readSources(vertexPath, fragmentPath, vertexCode, fragmentCode)) {
+		return false;
+	}
+
+	unsigned int program = buildProgram(vertexCode, fragmentCode);
+
+	if (program == 0) {
+		return false;
+	}
+
+	swapProgram(program);
+	return true;
+}
+
+void Shader::swapProgram(unsigned int program) {
+	unsigned int previous = ID;
+	int current = 0;
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+
+	ID = program;
+
+	if ((unsigned int)current == previous && previous != 0) {
+		glUseProgram(ID);
 	}
-}
\ No newline at end of file
+
+	glDeleteProgram(previous);
+}
@@ -1,14 +1,33 @@
 #ifndef CUSTOM_SHADER_H
 #define CUSTOM_SHADER_H
 
+#include <string>
+
 class Shader {
 public:
 	unsigned int ID;
+	std::string vertexPath;
+	std::string fragmentPath;
 
 	Shader(const char* vertexPath, const char* fragmentPath);
+	~Shader();
+
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
 
 	void use();
 
+	// Re-reads and relinks both files. The current program is kept when that fails.
+	bool reload();
+
+	// Replaces ID with an already linked program and deletes the previous one.
+	void swapProgram(unsigned int program);
+
+	static bool readSources(const std::string& vertexPath, const std::string& fragmentPath,
+		std::string& vertexCode, std::string& fragmentCode);
+
+	// Builds a program on whichever context is current, 0 on failure.
+	static unsigned int buildProgram(const std::string& vertexCode, const std::string& fragmentCode);
 };
 
 #endif // !CUSTOM_SHADER_H
@@ -0,0 +1,247 @@
+#include "shaderreloader.hpp"
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Both stay 0 while the file is missing.
+static void fileStamp(const std::string& path, long long& modified, long long& size) {
+	struct stat info;
+
+	if (stat(path.c_str(), &info) != 0) {
+		modified = 0;
+		size = 0;
+		return;
+	}
+
+	modified = (long long)info.st_mtime;
+	size = (long long)info.st_size;
+}
+
+FileWatcher::FileWatcher() : inotifyFd(-1) {
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (inotifyFd < 0) {
+		std::cerr << "ERROR WHILE INITIATING INOTIFY, FALLING BACK TO POLLING" << std::endl;
+	}
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+	if (inotifyFd >= 0) {
+		close(inotifyFd);
+	}
+#endif
+}
+
+void FileWatcher::add(const std::string& path) {
+	for (size_t i = 0; i < files.size(); i++) {
+		if (files[i].path == path) {
+			return;
+		}
+	}
+
+	size_t slash = path.find_last_of("/\\");
+
+	WatchedFile file;
+	file.path = path;
+	file.name = slash == std::string::npos ? path : path.substr(slash + 1);
+	file.watch = -1;
+	fileStamp(path, file.modified, file.size);
+
+#ifdef __linux__
+	if (inotifyFd >= 0) {
+		std::string directory = slash == std::string::npos ? std::string(".") : path.substr(0, slash + 1);
+
+		// Adding the same directory twice returns the existing watch descriptor.
+		file.watch = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	}
+#endif
+
+	files.push_back(file);
+}
+
+void FileWatcher::poll(std::vector<std::string>& changed) {
+	size_t firstChanged = changed.size();
+
+#ifdef __linux__
+	if (inotifyFd >= 0) {
+		alignas(struct inotify_event) char buffer[4096];
+
+		for (;;) {
+			ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+
+			if (length <= 0) {
+				break;
+			}
+
+			for (char* cursor = buffer; cursor < buffer + length;) {
+				struct inotify_event* event = (struct inotify_event*)cursor;
+
+				if (event->len > 0) {
+					for (size_t i = 0; i < files.size(); i++) {
+						if (files[i].watch == event->wd && files[i].name == event->name &&
+							std::find(changed.begin() + firstChanged, changed.end(), files[i].path) == changed.end()) {
+							changed.push_back(files[i].path);
+						}
+					}
+				}
+
+				cursor += sizeof(struct inotify_event) + event->len;
+			}
+		}
+	}
+#endif
+
+	for (size_t i = 0; i < files.size(); i++) {
+		if (files[i].watch >= 0) {
+			continue;
+		}
+
+		long long modified = 0;
+		long long size = 0;
+
+		fileStamp(files[i].path, modified, size);
+
+		if (modified != files[i].modified || size != files[i].size) {
+			files[i].modified = modified;
+			files[i].size = size;
+			changed.push_back(files[i].path);
+		}
+	}
+}
+
+ShaderReloader::ShaderReloader(GLFWwindow* mainWindow, bool windowsVisible) : workerContext(NULL), running(false) {
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	workerContext = glfwCreateWindow(1, 1, "Shader Reloader", NULL, mainWindow);
+	glfwWindowHint(GLFW_VISIBLE, windowsVisible ? GLFW_TRUE : GLFW_FALSE);
+
+	if (workerContext == NULL) {
+		std::cerr << "Failed to create shared context, shader reloads will compile on the render thread" << std::endl;
+		return;
+	}
+
+	running = true;
+	worker = std::thread(&ShaderReloader::run, this);
+}
+
+ShaderReloader::~ShaderReloader() {
+	running = false;
+
+	if (worker.joinable()) {
+		worker.join();
+	}
+
+	for (size_t i = 0; i < pending.size(); i++) {
+		glDeleteSync((GLsync)pending[i].fence);
+		glDeleteProgram(pending[i].program);
+	}
+
+	if (workerContext != NULL) {
+		glfwDestroyWindow(workerContext);
+	}
+}
+
+void ShaderReloader::watch(Shader* shader) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	shaders.push_back(shader);
+	watcher.add(shader->vertexPath);
+	watcher.add(shader->fragmentPath);
+}
+
+void ShaderReloader::collectChangedShaders(std::vector<Shader*>& changedShaders) {
+	std::vector<std::string> changed;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	watcher.poll(changed);
+
+	for (size_t i = 0; i < shaders.size(); i++) {
+		Shader* shader = shaders[i];
+
+		if (std::find(changed.begin(), changed.end(), shader->vertexPath) != changed.end() ||
+			std::find(changed.begin(), changed.end(), shader->fragmentPath) != changed.end()) {
+			changedShaders.push_back(shader);
+		}
+	}
+}
+
+void ShaderReloader::run() {
+	glfwMakeContextCurrent(workerContext);
+
+	std::vector<Shader*> changedShaders;
+
+	while (running) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		changedShaders.clear();
+		collectChangedShaders(changedShaders);
+
+		for (size_t i = 0; i < changedShaders.size(); i++) {
+			Shader* shader = changedShaders[i];
+			std::string vertexCode;
+			std::string fragmentCode;
+
+			if (!Shader::readSources(shader->vertexPath, shader->fragmentPath, vertexCode, fragmentCode)) {
+				continue;
+			}
+
+			unsigned int program = Shader::buildProgram(vertexCode, fragmentCode);
+
+			if (program == 0) {
+				std::cerr << "SHADER RELOAD FAILED, KEEPING PREVIOUS PROGRAM: " << shader->vertexPath << " " << shader->fragmentPath << std::endl;
+				continue;
+			}
+
+			// The fence tells the render thread when the program is usable from its own context.
+			PendingProgram result = { shader, program, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) };
+			glFlush();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			pending.push_back(result);
+		}
+	}
+
+	glfwMakeContextCurrent(NULL);
+}
+
+void ShaderReloader::applyPendingReloads() {
+	if (workerContext == NULL) {
+		std::vector<Shader*> changedShaders;
+		collectChangedShaders(changedShaders);
+
+		for (size_t i = 0; i < changedShaders.size(); i++) {
+			changedShaders[i]->reload();
+		}
+
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t applied = 0;
+
+	// Programs are applied in submission order so an older compile never replaces a newer one.
+	for (; applied < pending.size(); applied++) {
+		GLsync fence = (GLsync)pending[applied].fence;
+		GLenum status = glClientWaitSync(fence, 0, 0);
+
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			break;
+		}
+
+		glDeleteSync(fence);
+		pending[applied].shader->swapProgram(pending[applied].program);
+	}
+
+	pending.erase(pending.begin(), pending.begin() + applied);
+}
@@ -0,0 +1,81 @@
+#ifndef CUSTOM_SHADERRELOADER_H
+#define CUSTOM_SHADERRELOADER_H
+
+#include "shader.hpp"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+// Reports files that changed on disk. Uses inotify on Linux, watching the
+// parent directories so editors that save through a rename are caught, and
+// polls modification time and size everywhere else. The polled times have
+// one-second resolution on some filesystems, so a second save within the
+// same second that keeps the size is missed until the file changes again.
+class FileWatcher {
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	void add(const std::string& path);
+
+	// Appends the watched paths that changed since the previous call.
+	void poll(std::vector<std::string>& changed);
+
+private:
+	struct WatchedFile {
+		std::string path;
+		std::string name;
+		int watch;
+		long long modified;
+		long long size;
+	};
+
+	int inotifyFd;
+	std::vector<WatchedFile> files;
+};
+
+// Recompiles watched shaders when their sources change. Compilation runs on a
+// worker thread with a hidden context shared with the main window; finished
+// programs are swapped into their Shader by applyPendingReloads(), which the
+// render loop calls once per frame. A failed compile keeps the old program.
+class ShaderReloader {
+public:
+	// GLFW cannot report window hints, so windowsVisible is the GLFW_VISIBLE
+	// hint in effect, restored after the hidden worker context is created.
+	ShaderReloader(GLFWwindow* mainWindow, bool windowsVisible);
+	~ShaderReloader();
+
+	ShaderReloader(const ShaderReloader&) = delete;
+	ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+	void watch(Shader* shader);
+
+	void applyPendingReloads();
+
+private:
+	struct PendingProgram {
+		Shader* shader;
+		unsigned int program;
+		void* fence;
+	};
+
+	void run();
+	void collectChangedShaders(std::vector<Shader*>& changedShaders);
+
+	GLFWwindow* workerContext;
+	std::thread worker;
+	std::atomic<bool> running;
+	std::mutex mutex;
+	FileWatcher watcher;
+	std::vector<Shader*> shaders;
+	std::vector<PendingProgram> pending;
+};
+
+#endif // !CUSTOM_SHADERRELOADER_H
@@ -0,0 +1,6 @@
+#version 330 core
+in vec3 ourColor;
+out vec4 FragColor;
+void main() {
+	FragColor = vec4(ourColor.r, ourColor.g, ourColor.b, 1.0f);
+}
@@ -0,0 +1,531 @@
+#include "shadows.hpp"
+#include "benchscene.hpp"
+#include "glprogram.hpp"
+#include "rendergraph.hpp"
+#include <GL/glew.h>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+static const char* depthVertexShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec3 aPos;\n"
+	"layout (location = 2) in vec3 aOffset;\n"
+	"uniform mat4 lightViewProjection;\n"
+	"uniform mat4 casterModel;\n"
+	"void main() {\n"
+	"gl_Position = lightViewProjection * casterModel * vec4(aPos + aOffset, 1.0);\n"
+	"}\0";
+
+static const char* shadowSamplingSource =
+	"uniform sampler2DArrayShadow shadowMap;\n"
+	"uniform mat4 shadowMatrices[4];\n"
+	"uniform vec4 cascadeSplits;\n"
+	"uniform int shadowCascadeCount;\n"
+	"float shadowFactor(vec3 worldPosition, float viewDepth) {\n"
+	"int cascade = 0;\n"
+	"for (int i = 0; i < shadowCascadeCount - 1; i++) {\n"
+	"if (viewDepth > cascadeSplits[i]) cascade = i + 1;\n"
+	"}\n"
+	"vec3 uvw = (shadowMatrices[cascade] * vec4(worldPosition, 1.0)).xyz * 0.5 + 0.5;\n"
+	"uvw.z = min(uvw.z, 1.0);\n"
+	"vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);\n"
+	"float lit = 0.0;\n"
+	"for (int y = 0; y < 2; y++) {\n"
+	"for (int x = 0; x < 2; x++) {\n"
+	"lit += texture(shadowMap, vec4(uvw.xy + (vec2(x, y) - 0.5) * texel, float(cascade), uvw.z));\n"
+	"}\n"
+	"}\n"
+	"return lit * 0.25;\n"
+	"}\n";
+
+static bool createLayerFramebuffers(unsigned int texture, int layers, unsigned int* framebuffers) {
+	glGenFramebuffers(layers, framebuffers);
+
+	for (int i = 0; i < layers; i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "ERROR::SHADOWS::FRAMEBUFFER INCOMPLETE" << std::endl;
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return false;
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return true;
+}
+
+static unsigned int createDepthArray(int size, int layers) {
+	unsigned int texture;
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, size, size, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	return texture;
+}
+
+CascadedShadowMap::CascadedShadowMap(int resolution, int cascadeCount)
+	: size(resolution), cascades(cascadeCount < 1 ? 1 : (cascadeCount > maxCascades ? maxCascades : cascadeCount)), lambda(0.75f),
+	direction(vec3(0.0f, 0.0f, 0.0f)), lightView(identity()), depthTexture(0), staticTexture(0), depthProgram(0),
+	lightViewProjectionLocation(-1), casterModelLocation(-1), dynamicLastFrame(false), rendered(0) {
+	for (int i = 0; i < maxCascades; i++) {
+		cascade[i].lightViewProjection = identity();
+		cascade[i].center = vec3(0.0f, 0.0f, 0.0f);
+		cascade[i].extent = 0.0f;
+		cascade[i].split = 0.0f;
+		cascade[i].placed = false;
+		cascade[i].staticValid = false;
+		framebuffers[i] = 0;
+		staticFramebuffers[i] = 0;
+	}
+
+	for (int i = 0; i < cascades; i++) {
+		timers[i].reset(new GpuTimer(4));
+	}
+
+	depthTexture = createDepthArray(size, cascades);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	if (!createLayerFramebuffers(depthTexture, cascades, framebuffers)) {
+		return;
+	}
+
+	depthProgram = createDepthOnlyProgram(depthVertexShaderSource);
+
+	if (depthProgram != 0) {
+		lightViewProjectionLocation = glGetUniformLocation(depthProgram, "lightViewProjection");
+		casterModelLocation = glGetUniformLocation(depthProgram, "casterModel");
+	}
+}
+
+CascadedShadowMap::~CascadedShadowMap() {
+	glDeleteFramebuffers(cascades, framebuffers);
+	glDeleteFramebuffers(cascades, staticFramebuffers);
+	glDeleteTextures(1, &depthTexture);
+	glDeleteTextures(1, &staticTexture);
+	glDeleteProgram(depthProgram);
+}
+
+bool CascadedShadowMap::isValid() const {
+	return depthProgram != 0;
+}
+
+void CascadedShadowMap::setSplitLambda(float value) {
+	lambda = value;
+}
+
+void CascadedShadowMap::update(const ShadowCamera& camera, const Vec3& lightDirection) {
+	Vec3 newDirection = normalize(lightDirection);
+
+	if (newDirection.x != direction.x || newDirection.y != direction.y || newDirection.z != direction.z) {
+		direction = newDirection;
+		Vec3 up = std::fabs(direction.y) > 0.99f ? vec3(0.0f, 0.0f, 1.0f) : vec3(0.0f, 1.0f, 0.0f);
+		lightView = lookAt(vec3(0.0f, 0.0f, 0.0f), direction, up);
+
+		for (int i = 0; i < cascades; i++) {
+			cascade[i].placed = false;
+		}
+	}
+
+	Mat4 inverseView = inverse(camera.view);
+	float tanY = std::tan(camera.fovY * 0.5f);
+	float tanX = tanY * camera.aspect;
+	float previous = camera.nearPlane;
+
+	for (int i = 0; i < cascades; i++) {
+		float t = (float)(i + 1) / cascades;
+		float logarithmic = camera.nearPlane * std::pow(camera.farPlane / camera.nearPlane, t);
+		float uniform = camera.nearPlane + (camera.farPlane - camera.nearPlane) * t;
+		float split = lambda * logarithmic + (1.0f - lambda) * uniform;
+
+		Vec3 corners[8];
+		Vec3 center = vec3(0.0f, 0.0f, 0.0f);
+
+		for (int c = 0; c < 8; c++) {
+			float depth = c < 4 ? previous : split;
+			Vec4 corner = transform(inverseView, vec4((c & 1 ? 1.0f : -1.0f) * depth * tanX, (c & 2 ? 1.0f : -1.0f) * depth * tanY, -depth, 1.0f));
+			corners[c] = vec3(corner.x, corner.y, corner.z);
+			center = add(center, scale(corners[c], 0.125f));
+		}
+
+		float radius = 0.0f;
+
+		for (int c = 0; c < 8; c++) {
+			radius = std::fmax(radius, length(sub(corners[c], center)));
+		}
+
+		// Rounded so float noise never changes the cascade size.
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		float guard = radius * 0.25f;
+		float extent = radius + guard;
+		Vec4 lightCenter = transform(lightView, vec4(center.x, center.y, center.z, 1.0f));
+		Cascade& current = cascade[i];
+
+		if (!current.placed || current.extent != extent || std::fabs(lightCenter.x - current.center.x) > guard ||
+			std::fabs(lightCenter.y - current.center.y) > guard || std::fabs(lightCenter.z - current.center.z) > guard) {
+			float texel = 2.0f * extent / size;
+
+			current.center = vec3(std::floor(lightCenter.x / texel) * texel, std::floor(lightCenter.y / texel) * texel, lightCenter.z);
+			current.extent = extent;
+			current.lightViewProjection = multiply(orthographic(current.center.x - extent, current.center.x + extent,
+				current.center.y - extent, current.center.y + extent, -current.center.z - extent, -current.center.z + extent), lightView);
+			current.placed = true;
+			current.staticValid = false;
+		}
+
+		current.split = split;
+		previous = split;
+	}
+}
+
+void CascadedShadowMap::createStaticCache() {
+	staticTexture = createDepthArray(size, cascades);
+
+	if (!createLayerFramebuffers(staticTexture, cascades, staticFramebuffers)) {
+		glDeleteFramebuffers(cascades, staticFramebuffers);
+		glDeleteTextures(1, &staticTexture);
+		staticTexture = 0;
+	}
+}
+
+void CascadedShadowMap::render(const std::function<void()>& drawStatic, const std::function<void()>& drawDynamic) {
+	rendered = 0;
+
+	if (depthProgram == 0) {
+		return;
+	}
+
+	bool dynamic = (bool)drawDynamic;
+
+	if (dynamic && staticTexture == 0) {
+		createStaticCache();
+	}
+
+	if (dynamic && staticTexture == 0) {
+		dynamic = false;
+	}
+
+	// The live layers hold last frame's dynamic casters, or lack them, so switching modes rebuilds everything.
+	if (dynamic != dynamicLastFrame) {
+		invalidateStatic();
+		dynamicLastFrame = dynamic;
+	}
+
+	glUseProgram(depthProgram);
+	glViewport(0, 0, size, size);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_CLAMP);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+
+	for (int i = 0; i < cascades; i++) {
+		timers[i]->poll();
+
+		if (cascade[i].staticValid && !dynamic) {
+			continue;
+		}
+
+		timers[i]->begin();
+		glUniformMatrix4fv(lightViewProjectionLocation, 1, GL_FALSE, cascade[i].lightViewProjection.m);
+
+		if (!cascade[i].staticValid) {
+			glBindFramebuffer(GL_FRAMEBUFFER, dynamic ? staticFramebuffers[i] : framebuffers[i]);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			setCasterModel(identity());
+			drawStatic();
+			cascade[i].staticValid = true;
+		}
+
+		if (dynamic) {
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffers[i]);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[i]);
+			glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+			setCasterModel(identity());
+			drawDynamic();
+		}
+
+		timers[i]->end();
+		rendered++;
+	}
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glDisable(GL_DEPTH_CLAMP);
+	glDisable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void CascadedShadowMap::setCasterModel(const Mat4& model) {
+	glUniformMatrix4fv(casterModelLocation, 1, GL_FALSE, model.m);
+}
+
+void CascadedShadowMap::invalidateStatic() {
+	for (int i = 0; i < cascades; i++) {
+		cascade[i].staticValid = false;
+	}
+}
+
+void CascadedShadowMap::bindForSampling(unsigned int program, unsigned int unit) const {
+	float matrices[maxCascades * 16];
+	float splits[maxCascades] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for (int i = 0; i < cascades; i++) {
+		for (int k = 0; k < 16; k++) {
+			matrices[i * 16 + k] = cascade[i].lightViewProjection.m[k];
+		}
+
+		splits[i] = cascade[i].split;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniform1i(glGetUniformLocation(program, "shadowMap"), (int)unit);
+	glUniformMatrix4fv(glGetUniformLocation(program, "shadowMatrices"), cascades, GL_FALSE, matrices);
+	glUniform4fv(glGetUniformLocation(program, "cascadeSplits"), 1, splits);
+	glUniform1i(glGetUniformLocation(program, "shadowCascadeCount"), cascades);
+}
+
+const char* CascadedShadowMap::samplingSource() {
+	return shadowSamplingSource;
+}
+
+int CascadedShadowMap::cascadeCount() const {
+	return cascades;
+}
+
+float CascadedShadowMap::cascadeSplit(int index) const {
+	return cascade[index].split;
+}
+
+const Mat4& CascadedShadowMap::cascadeMatrix(int index) const {
+	return cascade[index].lightViewProjection;
+}
+
+double CascadedShadowMap::cascadeMilliseconds(int index) const {
+	return timers[index]->averageMilliseconds();
+}
+
+int CascadedShadowMap::renderedLastFrame() const {
+	return rendered;
+}
+
+void CascadedShadowMap::resetTimings() {
+	for (int i = 0; i < cascades; i++) {
+		timers[i]->wait();
+		timers[i]->resetAverage();
+	}
+}
+
+static const char* litVertexShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec3 aPos;\n"
+	"layout (location = 1) in vec3 aNormal;\n"
+	"layout (location = 2) in vec3 aOffset;\n"
+	"layout (location = 3) in vec3 aColor;\n"
+	"uniform mat4 viewProjection;\n"
+	"uniform mat4 view;\n"
+	"uniform mat4 model;\n"
+	"out vec3 worldPosition;\n"
+	"out vec3 worldNormal;\n"
+	"out vec3 baseColor;\n"
+	"out float viewDepth;\n"
+	"void main() {\n"
+	"worldPosition = (model * vec4(aPos + aOffset, 1.0)).xyz;\n"
+	"worldNormal = aNormal;\n"
+	"baseColor = aColor;\n"
+	"viewDepth = -(view * vec4(worldPosition, 1.0)).z;\n"
+	"gl_Position = viewProjection * vec4(worldPosition, 1.0);\n"
+	"}\0";
+
+static const char* litFragmentShaderSource =
+	"in vec3 worldPosition;\n"
+	"in vec3 worldNormal;\n"
+	"in vec3 baseColor;\n"
+	"in float viewDepth;\n"
+	"uniform vec3 lightDirection;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"float lit = max(dot(normalize(worldNormal), -lightDirection), 0.0) * shadowFactor(worldPosition, viewDepth);\n"
+	"FragColor = vec4(baseColor * (0.15 + 0.85 * lit), 1.0);\n"
+	"}\n";
+
+int runShadowBenchmark(int width, int height, int frames) {
+	CascadedShadowMap shadowMap(2048, 4);
+
+	if (!shadowMap.isValid()) {
+		return -1;
+	}
+
+	std::string fragmentSource = std::string("#version 330 core\n") + CascadedShadowMap::samplingSource() + litFragmentShaderSource;
+	unsigned int program = createProgram(litVertexShaderSource, fragmentSource.c_str());
+
+	if (program == 0) {
+		return -1;
+	}
+
+	BenchScene scene(64, 2.0f);
+	BenchScene ground(1, 0.0f);
+	BenchScene mover(2, 2.0f);
+
+	// The single ground cube spans [-0.4, 0.4] x [0, 0.8] x [-0.4, 0.4]; flatten it under the grid.
+	Mat4 groundModel = identity();
+	groundModel.m[0] = groundModel.m[10] = (scene.extent() + 4.0f) / 0.4f;
+	groundModel.m[5] = 0.125f;
+	groundModel.m[13] = -0.1f;
+
+	Mat4 moverModel = identity();
+	Vec3 lightDirection = normalize(vec3(-0.4f, -1.0f, -0.3f));
+	float aspect = (float)width / height;
+	Mat4 projection = scene.cameraProjection(aspect);
+	bool moveCamera = false;
+	bool withMover = false;
+	Mat4 view = scene.cameraView();
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	RenderTextureDesc depthDesc = { width, height, GL_DEPTH24_STENCIL8 };
+
+	RenderGraph graph;
+	RenderGraph::Resource output = graph.importTexture("output", outputTexture, outputDesc);
+
+	graph.addPass("shadows",
+		[&](RenderGraph::Builder& builder) {
+			builder.sideEffect();
+		},
+		[&](const RenderGraph&) {
+			std::function<void()> drawDynamic;
+
+			if (withMover) {
+				drawDynamic = [&]() {
+					shadowMap.setCasterModel(moverModel);
+					mover.draw();
+				};
+			}
+
+			shadowMap.render([&]() {
+				scene.draw();
+				shadowMap.setCasterModel(groundModel);
+				ground.draw();
+			}, drawDynamic);
+		});
+
+	graph.addPass("lit",
+		[&](RenderGraph::Builder& builder) {
+			RenderGraph::Resource depth = builder.create("lit.depth", depthDesc);
+
+			builder.write(output, LoadOp::Clear);
+			builder.write(depth, LoadOp::Clear);
+			builder.setClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+		},
+		[&](const RenderGraph&) {
+			Mat4 viewProjection = multiply(projection, view);
+			Mat4 model = identity();
+
+			glUseProgram(program);
+			glUniformMatrix4fv(glGetUniformLocation(program, "viewProjection"), 1, GL_FALSE, viewProjection.m);
+			glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, view.m);
+			glUniform3f(glGetUniformLocation(program, "lightDirection"), lightDirection.x, lightDirection.y, lightDirection.z);
+			shadowMap.bindForSampling(program, 0);
+
+			glEnable(GL_DEPTH_TEST);
+			glDepthMask(GL_TRUE);
+
+			int modelLocation = glGetUniformLocation(program, "model");
+			glUniformMatrix4fv(modelLocation, 1, GL_FALSE, model.m);
+			scene.draw();
+			glUniformMatrix4fv(modelLocation, 1, GL_FALSE, groundModel.m);
+			ground.draw();
+
+			if (withMover) {
+				glUniformMatrix4fv(modelLocation, 1, GL_FALSE, moverModel.m);
+				mover.draw();
+			}
+
+			glDisable(GL_DEPTH_TEST);
+		});
+
+	if (!graph.compile()) {
+		glDeleteTextures(1, &outputTexture);
+		glDeleteProgram(program);
+		return -1;
+	}
+
+	static const char* phaseNames[3] = { "still camera", "moving camera", "moving camera + dynamic caster" };
+	GpuTimer frameTimer(4);
+	int frame = 0;
+
+	std::cout << "SHADOW BENCHMARK " << width << "x" << height << ", " << shadowMap.cascadeCount() << " cascades, "
+		<< frames << " frames per phase" << std::endl;
+
+	for (int phase = 0; phase < 3; phase++) {
+		moveCamera = phase >= 1;
+		withMover = phase == 2;
+
+		int renderedCascades = 0;
+
+		for (int i = 0; i < frames; i++, frame++) {
+			if (moveCamera) {
+				float angle = frame * 0.002f;
+				float distance = scene.extent() * 1.6f;
+				view = lookAt(vec3(std::sin(angle) * distance, scene.extent() * 0.8f, std::cos(angle) * distance),
+					vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+			}
+
+			if (withMover) {
+				float angle = frame * 0.02f;
+				moverModel = translation(vec3(std::sin(angle) * 10.0f, 4.0f, std::cos(angle) * 10.0f));
+			}
+
+			ShadowCamera camera = { view, 1.0f, aspect, scene.nearPlane(), scene.farPlane() };
+			shadowMap.update(camera, lightDirection);
+
+			frameTimer.begin();
+			graph.execute();
+			frameTimer.end();
+			frameTimer.poll();
+
+			renderedCascades += shadowMap.renderedLastFrame();
+
+			// Skip the first frame of each phase, which rebuilds every cascade.
+			if (i == 0) {
+				frameTimer.wait();
+				frameTimer.resetAverage();
+				shadowMap.resetTimings();
+				renderedCascades = 0;
+			}
+		}
+
+		frameTimer.wait();
+
+		std::cout << phaseNames[phase] << ": " << (double)renderedCascades / (frames - 1) << " cascades rendered per frame, "
+			<< frameTimer.averageMilliseconds() << " ms per frame" << std::endl;
+
+		for (int c = 0; c < shadowMap.cascadeCount(); c++) {
+			std::cout << "  cascade " << c << " (to " << shadowMap.cascadeSplit(c) << "): " << shadowMap.cascadeMilliseconds(c)
+				<< " ms when rendered" << std::endl;
+		}
+	}
+
+	glDeleteTextures(1, &outputTexture);
+	glDeleteProgram(program);
+
+	return 0;
+}
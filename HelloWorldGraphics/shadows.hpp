@@ -0,0 +1,108 @@
+#ifndef CUSTOM_SHADOWS_H
+#define CUSTOM_SHADOWS_H
+
+#include "gputimer.hpp"
+#include "vecmath.hpp"
+#include <functional>
+#include <memory>
+
+struct ShadowCamera {
+	Mat4 view;
+	float fovY;
+	float aspect;
+	float nearPlane;
+	float farPlane;
+};
+
+// Cascaded shadow map for one directional light, stored as a depth texture
+// array with one layer per cascade.
+//
+// Each cascade covers a bounding sphere of its slice of the camera frustum,
+// so its size does not change when the camera turns, padded by a guard band.
+// A cascade is only re-placed when the camera leaves the guard band, and the
+// new placement is snapped to whole texels so shadow edges do not swim. As
+// long as a cascade stays put its static casters are not re-rendered: with no
+// dynamic casters the cascade is skipped entirely, otherwise its cached static
+// depth is copied back and only the dynamic casters are drawn on top.
+//
+// Casters are drawn with a depth-only program for the BenchScene attribute
+// layout and depth clamping, so casters in front of a cascade still land in it.
+class CascadedShadowMap {
+public:
+	static const int maxCascades = 4;
+
+	CascadedShadowMap(int resolution, int cascadeCount);
+	~CascadedShadowMap();
+
+	CascadedShadowMap(const CascadedShadowMap&) = delete;
+	CascadedShadowMap& operator=(const CascadedShadowMap&) = delete;
+
+	bool isValid() const;
+
+	// Blend between logarithmic (1) and uniform (0) split distances.
+	void setSplitLambda(float lambda);
+
+	void update(const ShadowCamera& camera, const Vec3& lightDirection);
+
+	// drawDynamic may be empty. Both callbacks start with an identity caster model.
+	void render(const std::function<void()>& drawStatic, const std::function<void()>& drawDynamic);
+
+	// For draw callbacks: transform applied to the following casters.
+	void setCasterModel(const Mat4& model);
+
+	// Forces every cascade to re-render its static casters.
+	void invalidateStatic();
+
+	// Binds the shadow map to unit and sets the uniforms declared by
+	// samplingSource() on program, which must be current.
+	void bindForSampling(unsigned int program, unsigned int unit) const;
+
+	// GLSL declaring float shadowFactor(vec3 worldPosition, float viewDepth).
+	static const char* samplingSource();
+
+	int cascadeCount() const;
+	float cascadeSplit(int cascade) const;
+	const Mat4& cascadeMatrix(int cascade) const;
+	// Average GPU time of a cascade over the frames it was rendered in.
+	double cascadeMilliseconds(int cascade) const;
+	int renderedLastFrame() const;
+	void resetTimings();
+
+private:
+	struct Cascade {
+		Mat4 lightViewProjection;
+		// Snapped center in light view space.
+		Vec3 center;
+		float extent;
+		float split;
+		bool placed;
+		bool staticValid;
+	};
+
+	void createStaticCache();
+
+	int size;
+	int cascades;
+	float lambda;
+	Vec3 direction;
+	Mat4 lightView;
+	Cascade cascade[maxCascades];
+	std::unique_ptr<GpuTimer> timers[maxCascades];
+	unsigned int depthTexture;
+	unsigned int framebuffers[maxCascades];
+	unsigned int staticTexture;
+	unsigned int staticFramebuffers[maxCascades];
+	unsigned int depthProgram;
+	int lightViewProjectionLocation;
+	int casterModelLocation;
+	bool dynamicLastFrame;
+	int rendered;
+};
+
+// Renders BenchScene over a ground plane with a shadowing directional light
+// in three phases: still camera, moving camera, and moving camera with a
+// dynamic caster. Prints cascades rendered per frame and GPU time per
+// cascade. Needs a current context. Returns 0 on success.
+int runShadowBenchmark(int width, int height, int frames);
+
+#endif // !CUSTOM_SHADOWS_H
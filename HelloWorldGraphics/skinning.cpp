@@ -0,0 +1,713 @@
+#include "skinning.hpp"
+#include "glprogram.hpp"
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+
+// Linear palettes hold three rows of each joint's matrix, dual quaternion
+// palettes the real and dual part; the block fits either at maxJoints.
+static const char* linearSkinningSource =
+	"layout (std140) uniform SkinPalette {\n"
+	"vec4 skinPalette[384];\n"
+	"};\n"
+	"void skinVertex(uvec4 joints, vec4 weights, inout vec3 position, inout vec3 normal) {\n"
+	"vec4 row0 = vec4(0.0);\n"
+	"vec4 row1 = vec4(0.0);\n"
+	"vec4 row2 = vec4(0.0);\n"
+	"for (int i = 0; i < 4; i++) {\n"
+	"int base = int(joints[i]) * 3;\n"
+	"row0 += skinPalette[base] * weights[i];\n"
+	"row1 += skinPalette[base + 1] * weights[i];\n"
+	"row2 += skinPalette[base + 2] * weights[i];\n"
+	"}\n"
+	"vec4 p = vec4(position, 1.0);\n"
+	"position = vec3(dot(row0, p), dot(row1, p), dot(row2, p));\n"
+	"normal = normalize(vec3(dot(row0.xyz, normal), dot(row1.xyz, normal), dot(row2.xyz, normal)));\n"
+	"}\n";
+
+static const char* dualQuaternionSkinningSource =
+	"layout (std140) uniform SkinPalette {\n"
+	"vec4 skinPalette[384];\n"
+	"};\n"
+	"void skinVertex(uvec4 joints, vec4 weights, inout vec3 position, inout vec3 normal) {\n"
+	"vec4 pivot = skinPalette[int(joints[0]) * 2];\n"
+	"vec4 real = vec4(0.0);\n"
+	"vec4 dual = vec4(0.0);\n"
+	"for (int i = 0; i < 4; i++) {\n"
+	"vec4 jointReal = skinPalette[int(joints[i]) * 2];\n"
+	// Keeps every joint in the pivot's hemisphere, so blends take the short way round.
+	"float weight = dot(jointReal, pivot) < 0.0 ? -weights[i] : weights[i];\n"
+	"real += jointReal * weight;\n"
+	"dual += skinPalette[int(joints[i]) * 2 + 1] * weight;\n"
+	"}\n"
+	"float len = length(real);\n"
+	"real /= len;\n"
+	"dual /= len;\n"
+	"vec3 translation = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));\n"
+	"position += 2.0 * cross(real.xyz, cross(real.xyz, position) + real.w * position) + translation;\n"
+	"normal += 2.0 * cross(real.xyz, cross(real.xyz, normal) + real.w * normal);\n"
+	"}\n";
+
+static const char* preskinFeedbackShaderSource =
+	"layout (location = 0) in vec3 aPos;\n"
+	"layout (location = 1) in vec3 aNormal;\n"
+	"layout (location = 2) in uvec4 aJoints;\n"
+	"layout (location = 3) in vec4 aWeights;\n"
+	"out vec4 skinnedPosition;\n"
+	"out vec4 skinnedNormal;\n"
+	"void main() {\n"
+	"vec3 position = aPos;\n"
+	"vec3 normal = aNormal;\n"
+	"skinVertex(aJoints, aWeights, position, normal);\n"
+	"skinnedPosition = vec4(position, 1.0);\n"
+	"skinnedNormal = vec4(normal, 0.0);\n"
+	"}\0";
+
+static const char* preskinComputeShaderSource =
+	"layout (local_size_x = 64) in;\n"
+	"layout (std430, binding = 0) readonly buffer SourceVertices {\n"
+	"uint source[];\n"
+	"};\n"
+	"layout (std430, binding = 1) writeonly buffer SkinnedVertices {\n"
+	"vec4 skinned[];\n"
+	"};\n"
+	"uniform uint vertexCount;\n"
+	"void main() {\n"
+	"uint i = gl_GlobalInvocationID.x;\n"
+	"if (i >= vertexCount) {\n"
+	"return;\n"
+	"}\n"
+	"uint base = i * 8u;\n"
+	"vec3 position = uintBitsToFloat(uvec3(source[base], source[base + 1u], source[base + 2u]));\n"
+	"vec3 normal = uintBitsToFloat(uvec3(source[base + 3u], source[base + 4u], source[base + 5u]));\n"
+	"uint packedJoints = source[base + 6u];\n"
+	"uvec4 joints = uvec4(packedJoints & 0xFFu, (packedJoints >> 8) & 0xFFu, (packedJoints >> 16) & 0xFFu, packedJoints >> 24);\n"
+	"skinVertex(joints, unpackUnorm4x8(source[base + 7u]), position, normal);\n"
+	"skinned[i * 2u] = vec4(position, 1.0);\n"
+	"skinned[i * 2u + 1u] = vec4(normal, 0.0);\n"
+	"}\0";
+
+static const char* preskinVaryings[2] = { "skinnedPosition", "skinnedNormal" };
+
+// Bytes per vertex written by pre-skinning.
+static const size_t skinnedVertexSize = 2 * sizeof(Vec4);
+
+static void dualQuaternion(const Mat4& skin, Vec4& real, Vec4& dual) {
+	real = quaternionFromMatrix(skin);
+
+	const Vec4& q = real;
+	float tx = skin.m[12];
+	float ty = skin.m[13];
+	float tz = skin.m[14];
+
+	dual = vec4(
+		0.5f * (tx * q.w + ty * q.z - tz * q.y),
+		0.5f * (-tx * q.z + ty * q.w + tz * q.x),
+		0.5f * (tx * q.y - ty * q.x + tz * q.w),
+		-0.5f * (tx * q.x + ty * q.y + tz * q.z)
+	);
+}
+
+SkinnedMesh::SkinnedMesh(const std::vector<SkinVertex>& vertexData, const std::vector<unsigned int>& indexData)
+	: vertices((unsigned int)vertexData.size()), indices((unsigned int)indexData.size()), vao(0), sourceBuffer(0), elementBuffer(0) {
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &sourceBuffer);
+	glGenBuffers(1, &elementBuffer);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, sourceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(SkinVertex), vertexData.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(unsigned int), indexData.data(), GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribIPointer(2, 4, GL_UNSIGNED_BYTE, sizeof(SkinVertex), (void*)(6 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SkinVertex), (void*)(6 * sizeof(float) + sizeof(uint32_t)));
+	glEnableVertexAttribArray(3);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+SkinnedMesh::~SkinnedMesh() {
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &sourceBuffer);
+	glDeleteBuffers(1, &elementBuffer);
+}
+
+void SkinnedMesh::draw() const {
+	glBindVertexArray(vao);
+	glDrawElements(GL_TRIANGLES, (GLsizei)indices, GL_UNSIGNED_INT, 0);
+	glBindVertexArray(0);
+}
+
+unsigned int SkinnedMesh::vertexCount() const {
+	return vertices;
+}
+
+unsigned int SkinnedMesh::indexCount() const {
+	return indices;
+}
+
+unsigned int SkinnedMesh::vertexBuffer() const {
+	return sourceBuffer;
+}
+
+unsigned int SkinnedMesh::indexBuffer() const {
+	return elementBuffer;
+}
+
+unsigned int SkinnedMesh::vertexArray() const {
+	return vao;
+}
+
+SkinnedVertexCache::SkinnedVertexCache(const SkinnedMesh& mesh)
+	: indices(mesh.indexCount()), vao(0), skinnedBuffer(0) {
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &skinnedBuffer);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, skinnedBuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount() * skinnedVertexSize, NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer());
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (GLsizei)skinnedVertexSize, (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, (GLsizei)skinnedVertexSize, (void*)sizeof(Vec4));
+	glEnableVertexAttribArray(1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+SkinnedVertexCache::~SkinnedVertexCache() {
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &skinnedBuffer);
+}
+
+void SkinnedVertexCache::draw() const {
+	glBindVertexArray(vao);
+	glDrawElements(GL_TRIANGLES, (GLsizei)indices, GL_UNSIGNED_INT, 0);
+	glBindVertexArray(0);
+}
+
+unsigned int SkinnedVertexCache::buffer() const {
+	return skinnedBuffer;
+}
+
+GpuSkinning::GpuSkinning(bool allowCompute)
+	: compute(allowCompute && GLEW_VERSION_4_3), preskinPrograms(), vertexCountLocations() {
+	for (int method = 0; method < 2; method++) {
+		const char* skinning = skinningSource((SkinningMethod)method);
+
+		if (compute) {
+			std::string source = std::string("#version 430 core\n") + skinning + preskinComputeShaderSource;
+			preskinPrograms[method] = createComputeProgram(source.c_str());
+		}
+		else {
+			std::string source = std::string("#version 330 core\n") + skinning + preskinFeedbackShaderSource;
+			preskinPrograms[method] = createTransformFeedbackProgram(source.c_str(), preskinVaryings, 2);
+		}
+
+		if (preskinPrograms[method] != 0) {
+			bindPaletteBlock(preskinPrograms[method]);
+			vertexCountLocations[method] = glGetUniformLocation(preskinPrograms[method], "vertexCount");
+		}
+	}
+}
+
+GpuSkinning::~GpuSkinning() {
+	glDeleteProgram(preskinPrograms[0]);
+	glDeleteProgram(preskinPrograms[1]);
+}
+
+bool GpuSkinning::isValid() const {
+	return preskinPrograms[0] != 0 && preskinPrograms[1] != 0;
+}
+
+bool GpuSkinning::isCompute() const {
+	return compute;
+}
+
+UniformAllocation GpuSkinning::writePalette(UniformRing& ring, const Mat4* skinMatrices, int jointCount, SkinningMethod method) {
+	if (jointCount > maxJoints) {
+		std::cerr << "ERROR::SKINNING::TOO_MANY_JOINTS: " << jointCount << std::endl;
+		UniformAllocation none = { NULL, 0, 0 };
+		return none;
+	}
+
+	// Always the full block; binding a smaller range than a block declares is undefined.
+	UniformAllocation allocation = ring.allocate(maxJoints * 3 * sizeof(Vec4));
+
+	if (allocation.data == NULL) {
+		return allocation;
+	}
+
+	Vec4* palette = (Vec4*)allocation.data;
+
+	for (int joint = 0; joint < jointCount; joint++) {
+		const float* m = skinMatrices[joint].m;
+
+		if (method == SkinningMethod::Linear) {
+			for (int row = 0; row < 3; row++) {
+				palette[joint * 3 + row] = vec4(m[row], m[4 + row], m[8 + row], m[12 + row]);
+			}
+		}
+		else {
+			dualQuaternion(skinMatrices[joint], palette[joint * 2], palette[joint * 2 + 1]);
+		}
+	}
+
+	return allocation;
+}
+
+const char* GpuSkinning::skinningSource(SkinningMethod method) {
+	return method == SkinningMethod::Linear ? linearSkinningSource : dualQuaternionSkinningSource;
+}
+
+void GpuSkinning::bindPaletteBlock(unsigned int program) {
+	unsigned int blockIndex = glGetUniformBlockIndex(program, "SkinPalette");
+
+	if (blockIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, blockIndex, paletteBinding);
+	}
+}
+
+void GpuSkinning::preskin(const SkinnedMesh& mesh, const SkinnedVertexCache& cache, SkinningMethod method) const {
+	int index = (int)method;
+
+	glUseProgram(preskinPrograms[index]);
+
+	if (compute) {
+		glUniform1ui(vertexCountLocations[index], mesh.vertexCount());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mesh.vertexBuffer());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, cache.buffer());
+		glDispatchCompute((mesh.vertexCount() + 63) / 64, 1, 1);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+		return;
+	}
+
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(mesh.vertexArray());
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, cache.buffer());
+
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, (GLsizei)mesh.vertexCount());
+	glEndTransformFeedback();
+
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glBindVertexArray(0);
+	glDisable(GL_RASTERIZER_DISCARD);
+}
+
+static const char* benchSkinnedVertexShaderBody =
+	"layout (location = 0) in vec3 aPos;\n"
+	"layout (location = 1) in vec3 aNormal;\n"
+	"layout (location = 2) in uvec4 aJoints;\n"
+	"layout (location = 3) in vec4 aWeights;\n"
+	"uniform mat4 viewProjection;\n"
+	"out vec3 normal;\n"
+	"void main() {\n"
+	"vec3 position = aPos;\n"
+	"normal = aNormal;\n"
+	"skinVertex(aJoints, aWeights, position, normal);\n"
+	"gl_Position = viewProjection * vec4(position, 1.0);\n"
+	"}\0";
+
+static const char* benchVertexShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec3 aPos;\n"
+	"layout (location = 1) in vec3 aNormal;\n"
+	"uniform mat4 viewProjection;\n"
+	"out vec3 normal;\n"
+	"void main() {\n"
+	"normal = aNormal;\n"
+	"gl_Position = viewProjection * vec4(aPos, 1.0);\n"
+	"}\0";
+
+static const char* benchFragmentShaderSource = "#version 330 core\n"
+	"in vec3 normal;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"float diffuse = max(dot(normalize(normal), normalize(vec3(0.4, 1.0, 0.3))), 0.0);\n"
+	"FragColor = vec4(vec3(0.9, 0.5, 0.3) * (0.2 + 0.8 * diffuse), 1.0);\n"
+	"}\0";
+
+static const int benchJoints = 32;
+static const int benchRingsPerJoint = 4;
+static const int benchSides = 16;
+static const float benchJointLength = 0.25f;
+
+// A tapering tube along +y, each ring weighted between its two nearest joints.
+static void buildTentacle(std::vector<SkinVertex>& vertices, std::vector<unsigned int>& indices) {
+	int rings = benchJoints * benchRingsPerJoint + 1;
+
+	for (int ring = 0; ring < rings; ring++) {
+		float y = ring * benchJointLength / benchRingsPerJoint;
+		float radius = 0.12f * (1.0f - 0.7f * ring / (rings - 1));
+		float along = y / benchJointLength;
+		int joint = std::min((int)along, benchJoints - 1);
+		float offset = along - joint;
+		int other = joint;
+		float weight = 1.0f;
+
+		if (offset < 0.5f && joint > 0) {
+			other = joint - 1;
+			weight = 0.5f + offset;
+		}
+		else if (offset >= 0.5f && joint < benchJoints - 1) {
+			other = joint + 1;
+			weight = 1.5f - offset;
+		}
+
+		unsigned int first = (unsigned int)(weight * 255.0f + 0.5f);
+
+		for (int side = 0; side < benchSides; side++) {
+			float angle = 6.28318531f * side / benchSides;
+			SkinVertex vertex;
+			vertex.position[0] = std::cos(angle) * radius;
+			vertex.position[1] = y;
+			vertex.position[2] = std::sin(angle) * radius;
+			vertex.normal[0] = std::cos(angle);
+			vertex.normal[1] = 0.0f;
+			vertex.normal[2] = std::sin(angle);
+			vertex.joints = (uint32_t)joint | ((uint32_t)other << 8);
+			vertex.weights = first | ((255u - first) << 8);
+			vertices.push_back(vertex);
+		}
+	}
+
+	for (int ring = 0; ring + 1 < rings; ring++) {
+		for (int side = 0; side < benchSides; side++) {
+			unsigned int a = ring * benchSides + side;
+			unsigned int b = ring * benchSides + (side + 1) % benchSides;
+			unsigned int c = a + benchSides;
+			unsigned int d = b + benchSides;
+			unsigned int quad[6] = { a, c, b, b, c, d };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+// Bends and twists the chain; the root sits at base.
+static void animateTentacle(const Vec3& base, float time, float phase, Mat4* skinMatrices) {
+	Mat4 parent = translation(base);
+
+	for (int joint = 0; joint < benchJoints; joint++) {
+		Vec4 bend = axisAngleQuaternion(vec3(0.0f, 0.0f, 1.0f), 0.2f * std::sin(time * 2.0f + joint * 0.3f + phase));
+		Vec4 twist = axisAngleQuaternion(vec3(0.0f, 1.0f, 0.0f), 0.15f * std::sin(time * 1.3f + phase));
+		Mat4 local = rigidTransform(multiplyQuaternions(bend, twist), vec3(0.0f, joint > 0 ? benchJointLength : 0.0f, 0.0f));
+		Mat4 model = multiply(parent, local);
+
+		skinMatrices[joint] = multiply(model, translation(vec3(0.0f, -joint * benchJointLength, 0.0f)));
+		parent = model;
+	}
+}
+
+// Same math as the shaders, for checking pre-skinned output.
+static void skinOnCpu(const SkinVertex& vertex, const Mat4* skinMatrices, SkinningMethod method, Vec3& position, Vec3& normal) {
+	Vec3 p = vec3(vertex.position[0], vertex.position[1], vertex.position[2]);
+	Vec3 n = vec3(vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+
+	if (method == SkinningMethod::Linear) {
+		float blended[16] = {};
+
+		for (int i = 0; i < 4; i++) {
+			float weight = ((vertex.weights >> (i * 8)) & 0xFF) / 255.0f;
+			const float* m = skinMatrices[(vertex.joints >> (i * 8)) & 0xFF].m;
+
+			for (int k = 0; k < 16; k++) {
+				blended[k] += m[k] * weight;
+			}
+		}
+
+		position = vec3(
+			blended[0] * p.x + blended[4] * p.y + blended[8] * p.z + blended[12],
+			blended[1] * p.x + blended[5] * p.y + blended[9] * p.z + blended[13],
+			blended[2] * p.x + blended[6] * p.y + blended[10] * p.z + blended[14]);
+		normal = normalize(vec3(
+			blended[0] * n.x + blended[4] * n.y + blended[8] * n.z,
+			blended[1] * n.x + blended[5] * n.y + blended[9] * n.z,
+			blended[2] * n.x + blended[6] * n.y + blended[10] * n.z));
+		return;
+	}
+
+	Vec4 pivot;
+	Vec4 unused;
+	Vec4 real = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	Vec4 dual = real;
+
+	dualQuaternion(skinMatrices[vertex.joints & 0xFF], pivot, unused);
+
+	for (int i = 0; i < 4; i++) {
+		Vec4 jointReal;
+		Vec4 jointDual;
+		float weight = ((vertex.weights >> (i * 8)) & 0xFF) / 255.0f;
+
+		dualQuaternion(skinMatrices[(vertex.joints >> (i * 8)) & 0xFF], jointReal, jointDual);
+
+		if (jointReal.x * pivot.x + jointReal.y * pivot.y + jointReal.z * pivot.z + jointReal.w * pivot.w < 0.0f) {
+			weight = -weight;
+		}
+
+		real = vec4(real.x + jointReal.x * weight, real.y + jointReal.y * weight, real.z + jointReal.z * weight, real.w + jointReal.w * weight);
+		dual = vec4(dual.x + jointDual.x * weight, dual.y + jointDual.y * weight, dual.z + jointDual.z * weight, dual.w + jointDual.w * weight);
+	}
+
+	float len = std::sqrt(real.x * real.x + real.y * real.y + real.z * real.z + real.w * real.w);
+	Vec3 r = vec3(real.x / len, real.y / len, real.z / len);
+	Vec3 d = vec3(dual.x / len, dual.y / len, dual.z / len);
+	float rw = real.w / len;
+	float dw = dual.w / len;
+	Vec3 t = scale(add(sub(scale(d, rw), scale(r, dw)), cross(r, d)), 2.0f);
+
+	position = add(add(p, scale(cross(r, add(cross(r, p), scale(p, rw))), 2.0f)), t);
+	normal = add(n, scale(cross(r, add(cross(r, n), scale(n, rw))), 2.0f));
+}
+
+static unsigned int createBenchProgram(SkinningMethod method, bool depthOnly) {
+	std::string source = std::string("#version 330 core\n") + GpuSkinning::skinningSource(method) + benchSkinnedVertexShaderBody;
+	unsigned int program = depthOnly ? createDepthOnlyProgram(source.c_str()) : createProgram(source.c_str(), benchFragmentShaderSource);
+
+	if (program != 0) {
+		GpuSkinning::bindPaletteBlock(program);
+	}
+
+	return program;
+}
+
+int runSkinningBenchmark(int width, int height, int characterCount, int frames) {
+	static const char* methodNames[2] = { "linear blend", "dual quaternion" };
+	const int shadowPasses = 3;
+	const int shadowSize = 1024;
+	const int warmupFrames = 10;
+
+	std::vector<SkinVertex> vertices;
+	std::vector<unsigned int> indices;
+	buildTentacle(vertices, indices);
+
+	SkinnedMesh mesh(vertices, indices);
+	GpuSkinning skinning(true);
+	UniformRing ring(characterCount * GpuSkinning::maxJoints * 3 * sizeof(Vec4) + 65536, 3);
+	std::vector<std::unique_ptr<SkinnedVertexCache> > caches;
+
+	for (int i = 0; i < characterCount; i++) {
+		caches.push_back(std::unique_ptr<SkinnedVertexCache>(new SkinnedVertexCache(mesh)));
+	}
+
+	unsigned int programs[2][2] = {
+		{ createBenchProgram(SkinningMethod::Linear, false), createBenchProgram(SkinningMethod::Linear, true) },
+		{ createBenchProgram(SkinningMethod::DualQuaternion, false), createBenchProgram(SkinningMethod::DualQuaternion, true) }
+	};
+	unsigned int plainPrograms[2] = { createProgram(benchVertexShaderSource, benchFragmentShaderSource), createDepthOnlyProgram(benchVertexShaderSource) };
+
+	int result = skinning.isValid() && programs[0][0] != 0 && programs[0][1] != 0 && programs[1][0] != 0 && programs[1][1] != 0
+		&& plainPrograms[0] != 0 && plainPrograms[1] != 0 ? 0 : -1;
+
+	int side = 1;
+
+	while (side * side < characterCount) {
+		side++;
+	}
+
+	float extent = side * 0.6f;
+	Mat4 viewProjection = multiply(perspective(0.9f, (float)width / height, 0.1f, extent * 8.0f),
+		lookAt(vec3(0.0f, extent * 1.2f + 4.0f, extent * 2.0f + 4.0f), vec3(0.0f, 3.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f)));
+	Mat4 lightView = lookAt(vec3(extent, extent + 10.0f, extent * 0.5f), vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+	Mat4 shadowMatrices[shadowPasses];
+
+	for (int pass = 0; pass < shadowPasses; pass++) {
+		float size = (extent + 6.0f) * (pass + 1) / shadowPasses;
+		shadowMatrices[pass] = multiply(orthographic(-size, size, -size, size, 0.1f, extent * 4.0f + 40.0f), lightView);
+	}
+
+	unsigned int shadowTexture;
+	unsigned int shadowFramebuffer;
+	glGenTextures(1, &shadowTexture);
+	glBindTexture(GL_TEXTURE_2D, shadowTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, shadowSize, shadowSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glGenFramebuffers(1, &shadowFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	std::vector<Mat4> skinMatrices((size_t)characterCount * benchJoints);
+	std::vector<UniformAllocation> palettes(characterCount);
+	SkinningMethod method = SkinningMethod::Linear;
+	bool preskinned = false;
+
+	// Draws every character with the program for the current mode, which must be current.
+	auto drawCharacters = [&]() {
+		for (int i = 0; i < characterCount; i++) {
+			if (preskinned) {
+				caches[i]->draw();
+			}
+			else {
+				ring.bind(GpuSkinning::paletteBinding, palettes[i]);
+				mesh.draw();
+			}
+		}
+	};
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	RenderGraph graph;
+	RenderGraph::Resource output = graph.importTexture("output", outputTexture, outputDesc);
+
+	graph.addPass("characters",
+		[&](RenderGraph::Builder& builder) {
+			builder.write(output, LoadOp::Clear);
+			builder.setClearColor(0.1f, 0.12f, 0.15f, 1.0f);
+		},
+		[&](const RenderGraph&) {
+			unsigned int program = preskinned ? plainPrograms[0] : programs[(int)method][0];
+			glUseProgram(program);
+			glUniformMatrix4fv(glGetUniformLocation(program, "viewProjection"), 1, GL_FALSE, viewProjection.m);
+			drawCharacters();
+		});
+
+	if (result == 0 && !graph.compile()) {
+		result = -1;
+	}
+
+	if (result == 0) {
+		std::cout << "SKINNING BENCHMARK " << width << "x" << height << ", " << characterCount << " characters of " << mesh.vertexCount()
+			<< " vertices and " << benchJoints << " joints, 1 color and " << shadowPasses << " shadow passes, pre-skinning with "
+			<< (skinning.isCompute() ? "compute" : "transform feedback") << ", " << frames << " frames" << std::endl;
+	}
+
+	for (int mode = 0; mode < 4 && result == 0; mode++) {
+		method = mode < 2 ? SkinningMethod::Linear : SkinningMethod::DualQuaternion;
+		preskinned = (mode & 1) != 0;
+
+		GpuTimer timer(4);
+		double cpuMilliseconds = 0.0;
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				timer.wait();
+				timer.resetAverage();
+				cpuMilliseconds = 0.0;
+			}
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			float time = frame / 60.0f;
+
+			ring.beginFrame();
+
+			for (int i = 0; i < characterCount; i++) {
+				Vec3 base = vec3((i % side) * 1.2f - extent, 0.0f, (i / side) * 1.2f - extent);
+				animateTentacle(base, time, i * 0.7f, &skinMatrices[(size_t)i * benchJoints]);
+				palettes[i] = GpuSkinning::writePalette(ring, &skinMatrices[(size_t)i * benchJoints], benchJoints, method);
+			}
+
+			ring.flush();
+
+			timer.begin();
+
+			if (preskinned) {
+				for (int i = 0; i < characterCount; i++) {
+					ring.bind(GpuSkinning::paletteBinding, palettes[i]);
+					skinning.preskin(mesh, *caches[i], method);
+				}
+			}
+
+			unsigned int depthProgram = preskinned ? plainPrograms[1] : programs[(int)method][1];
+
+			glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer);
+			glViewport(0, 0, shadowSize, shadowSize);
+			glEnable(GL_DEPTH_TEST);
+			glUseProgram(depthProgram);
+
+			for (int pass = 0; pass < shadowPasses; pass++) {
+				glClear(GL_DEPTH_BUFFER_BIT);
+				glUniformMatrix4fv(glGetUniformLocation(depthProgram, "viewProjection"), 1, GL_FALSE, shadowMatrices[pass].m);
+				drawCharacters();
+			}
+
+			glDisable(GL_DEPTH_TEST);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+			graph.execute();
+			timer.end();
+
+			ring.endFrame();
+			cpuMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			timer.poll();
+		}
+
+		timer.wait();
+
+		unsigned int skinnedPerFrame = mesh.vertexCount() * characterCount * (preskinned ? 1 : shadowPasses + 1);
+
+		std::cout << methodNames[(int)method] << (preskinned ? ", pre-skinned: " : ", in vertex shader: ") << cpuMilliseconds / frames
+			<< " ms CPU, " << timer.averageMilliseconds() << " ms GPU, " << skinnedPerFrame << " vertices skinned per frame" << std::endl;
+	}
+
+	// Checks the first character's pre-skinned vertices for both methods against the CPU.
+	for (int m = 0; m < 2 && result == 0; m++) {
+		method = (SkinningMethod)m;
+
+		ring.beginFrame();
+		animateTentacle(vec3(0.0f, 0.0f, 0.0f), 1.7f, 0.3f, skinMatrices.data());
+		UniformAllocation palette = GpuSkinning::writePalette(ring, skinMatrices.data(), benchJoints, method);
+		ring.flush();
+		ring.bind(GpuSkinning::paletteBinding, palette);
+		skinning.preskin(mesh, *caches[0], method);
+		ring.endFrame();
+
+		std::vector<Vec4> skinned(mesh.vertexCount() * 2);
+		glBindBuffer(GL_ARRAY_BUFFER, caches[0]->buffer());
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, skinned.size() * sizeof(Vec4), skinned.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		float maxError = 0.0f;
+
+		for (unsigned int i = 0; i < mesh.vertexCount(); i++) {
+			Vec3 position;
+			Vec3 normal;
+			skinOnCpu(vertices[i], skinMatrices.data(), method, position, normal);
+
+			maxError = std::max(maxError, length(sub(position, vec3(skinned[i * 2].x, skinned[i * 2].y, skinned[i * 2].z))));
+			maxError = std::max(maxError, length(sub(normal, vec3(skinned[i * 2 + 1].x, skinned[i * 2 + 1].y, skinned[i * 2 + 1].z))));
+		}
+
+		std::cout << methodNames[m] << " pre-skinning vs CPU: max error " << maxError << std::endl;
+
+		if (maxError > 1e-3f) {
+			std::cerr << "ERROR::SKINNING::MISMATCH: " << methodNames[m] << std::endl;
+			result = 1;
+		}
+	}
+
+	glDeleteFramebuffers(1, &shadowFramebuffer);
+	glDeleteTextures(1, &shadowTexture);
+	glDeleteTextures(1, &outputTexture);
+
+	for (int m = 0; m < 2; m++) {
+		glDeleteProgram(programs[m][0]);
+		glDeleteProgram(programs[m][1]);
+		glDeleteProgram(plainPrograms[m]);
+	}
+
+	return result;
+}
@@ -0,0 +1,128 @@
+#ifndef CUSTOM_SKINNING_H
+#define CUSTOM_SKINNING_H
+
+#include "uniformring.hpp"
+#include "vecmath.hpp"
+#include <cstdint>
+#include <vector>
+
+enum class SkinningMethod {
+	// Blends joint matrices; cheap, but volume collapses at twisting joints.
+	Linear,
+	// Blends rigid joint transforms as dual quaternions; joints must not scale.
+	DualQuaternion
+};
+
+// Bind-pose vertex of a skinned mesh. Same layout in the vertex buffer and,
+// read as eight uints per vertex, in the compute pre-skinning pass.
+struct SkinVertex {
+	float position[3];
+	float normal[3];
+	// Four joint indices, one byte each, first joint in the lowest byte.
+	uint32_t joints;
+	// Four weights as normalized bytes in the same order, summing to 255.
+	uint32_t weights;
+};
+
+// Vertex and index buffers of a mesh in bind pose. draw() binds attributes
+// 0 position, 1 normal, 2 joints (uvec4) and 3 weights (vec4).
+class SkinnedMesh {
+public:
+	SkinnedMesh(const std::vector<SkinVertex>& vertices, const std::vector<unsigned int>& indices);
+	~SkinnedMesh();
+
+	SkinnedMesh(const SkinnedMesh&) = delete;
+	SkinnedMesh& operator=(const SkinnedMesh&) = delete;
+
+	void draw() const;
+
+	unsigned int vertexCount() const;
+	unsigned int indexCount() const;
+	unsigned int vertexBuffer() const;
+	unsigned int indexBuffer() const;
+	unsigned int vertexArray() const;
+
+private:
+	unsigned int vertices;
+	unsigned int indices;
+	unsigned int vao;
+	unsigned int sourceBuffer;
+	unsigned int elementBuffer;
+};
+
+// Skinned vertices of one instance of a mesh, written once per frame by
+// GpuSkinning::preskin() and then drawn by any number of passes with
+// ordinary programs. draw() binds attributes 0 position and 1 normal, like
+// BenchScene, and the mesh's indices.
+class SkinnedVertexCache {
+public:
+	SkinnedVertexCache(const SkinnedMesh& mesh);
+	~SkinnedVertexCache();
+
+	SkinnedVertexCache(const SkinnedVertexCache&) = delete;
+	SkinnedVertexCache& operator=(const SkinnedVertexCache&) = delete;
+
+	void draw() const;
+
+	// vec4 position, vec4 normal per vertex.
+	unsigned int buffer() const;
+
+private:
+	unsigned int indices;
+	unsigned int vao;
+	unsigned int skinnedBuffer;
+};
+
+// Bone palettes and the skinning shaders. A palette is written into a
+// UniformRing per mesh instance and bound at paletteBinding, where both the
+// vertex shader path and pre-skinning read it.
+//
+// Pre-skinning runs a compute shader on GL 4.3 and falls back to transform
+// feedback on 3.3, so a mesh is skinned once per frame however many passes
+// draw it.
+class GpuSkinning {
+public:
+	static const int maxJoints = 128;
+	static const unsigned int paletteBinding = 2;
+
+	GpuSkinning(bool allowCompute);
+	~GpuSkinning();
+
+	GpuSkinning(const GpuSkinning&) = delete;
+	GpuSkinning& operator=(const GpuSkinning&) = delete;
+
+	bool isValid() const;
+	bool isCompute() const;
+
+	// skinMatrices are joint model transforms times inverse bind matrices.
+	// Returns an allocation with data == NULL when the ring is full or there
+	// are more than maxJoints joints.
+	static UniformAllocation writePalette(UniformRing& ring, const Mat4* skinMatrices, int jointCount, SkinningMethod method);
+
+	// GLSL declaring the SkinPalette block and
+	//   void skinVertex(uvec4 joints, vec4 weights, inout vec3 position, inout vec3 normal)
+	// for method; goes after the #version line of a vertex shader.
+	static const char* skinningSource(SkinningMethod method);
+
+	// Points program's SkinPalette block at paletteBinding.
+	static void bindPaletteBlock(unsigned int program);
+
+	// Skins mesh into cache with the palette bound at paletteBinding, which
+	// must have been written for method.
+	void preskin(const SkinnedMesh& mesh, const SkinnedVertexCache& cache, SkinningMethod method) const;
+
+private:
+	bool compute;
+	unsigned int preskinPrograms[2];
+	int vertexCountLocations[2];
+};
+
+// Draws characterCount animated tentacles in one color pass and three
+// depth-only shadow passes at width x height, for each skinning method once
+// skinned in the vertex shader of every pass and once pre-skinned per frame.
+// Prints CPU and GPU time per frame, then checks pre-skinned vertices
+// against a CPU reference. Needs a current context. Returns 0 on success,
+// 1 when the GPU and CPU results disagree.
+int runSkinningBenchmark(int width, int height, int characterCount, int frames);
+
+#endif // !CUSTOM_SKINNING_H
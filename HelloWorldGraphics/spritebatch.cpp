@@ -0,0 +1,509 @@
+#include "spritebatch.hpp"
+#include "glprogram.hpp"
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+static const char* spriteVertexShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec2 aPos;\n"
+	"layout (location = 1) in vec2 aTexCoord;\n"
+	"layout (location = 2) in vec4 aColor;\n"
+	"uniform vec2 pixelScale;\n"
+	"out vec2 texCoord;\n"
+	"out vec4 color;\n"
+	"void main() {\n"
+	"texCoord = aTexCoord;\n"
+	"color = aColor;\n"
+	"gl_Position = vec4(aPos * pixelScale + vec2(-1.0, 1.0), 0.0, 1.0);\n"
+	"}\0";
+
+static const char* spriteFragmentShaderSource = "#version 330 core\n"
+	"uniform sampler2D spriteTexture;\n"
+	"in vec2 texCoord;\n"
+	"in vec4 color;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"FragColor = texture(spriteTexture, texCoord) * color;\n"
+	"}\0";
+
+// Sort keys: layer in the top 16 bits, texture slot and submission index in 24 bits each.
+static const unsigned int maxBatchSprites = 1u << 24;
+
+SpriteBatch::SpriteBatch(unsigned int maxSprites, int framesInFlight)
+	: capacity(std::min(std::max(maxSprites, 1u), maxBatchSprites)), regionCount(framesInFlight), currentRegion(0), sortByTexture(true),
+	persistent(false), mapped(NULL), scaleX(0.0f), scaleY(0.0f), stats(), quads(), keys(), textures(), fences(framesInFlight, (void*)NULL),
+	vertexBuffer(0), indexBuffer(0), vertexArray(0), whiteTexture(0), program(0) {
+	program = createProgram(spriteVertexShaderSource, spriteFragmentShaderSource);
+
+	if (program == 0) {
+		return;
+	}
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "spriteTexture"), 0);
+
+	quads.reserve((size_t)capacity * 4);
+	keys.reserve(capacity);
+
+	// Every quad uses the same six indices relative to its first vertex.
+	std::vector<uint32_t> indices((size_t)capacity * 6);
+
+	for (uint32_t quad = 0; quad < capacity; quad++) {
+		uint32_t* index = &indices[(size_t)quad * 6];
+		index[0] = quad * 4;
+		index[1] = quad * 4 + 1;
+		index[2] = quad * 4 + 2;
+		index[3] = quad * 4 + 2;
+		index[4] = quad * 4 + 1;
+		index[5] = quad * 4 + 3;
+	}
+
+	GLsizeiptr totalSize = (GLsizeiptr)capacity * 4 * sizeof(SpriteVertex) * regionCount;
+
+	glGenVertexArrays(1, &vertexArray);
+	glGenBuffers(1, &vertexBuffer);
+	glGenBuffers(1, &indexBuffer);
+
+	glBindVertexArray(vertexArray);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+
+	if (GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glBufferStorage(GL_ARRAY_BUFFER, totalSize, NULL, flags);
+		mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, totalSize, flags);
+		persistent = mapped != NULL;
+	}
+
+	if (!persistent) {
+		glBufferData(GL_ARRAY_BUFFER, totalSize, NULL, GL_STREAM_DRAW);
+	}
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), (void*)offsetof(SpriteVertex, x));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), (void*)offsetof(SpriteVertex, u));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SpriteVertex), (void*)offsetof(SpriteVertex, color));
+	glEnableVertexAttribArray(2);
+
+	glBindVertexArray(0);
+
+	uint32_t white = 0xFFFFFFFFu;
+
+	glGenTextures(1, &whiteTexture);
+	glBindTexture(GL_TEXTURE_2D, whiteTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &white);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+SpriteBatch::~SpriteBatch() {
+	for (size_t i = 0; i < fences.size(); i++) {
+		if (fences[i] != NULL) {
+			glDeleteSync((GLsync)fences[i]);
+		}
+	}
+
+	if (persistent) {
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+
+	glDeleteVertexArrays(1, &vertexArray);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	glDeleteTextures(1, &whiteTexture);
+	glDeleteProgram(program);
+}
+
+bool SpriteBatch::isValid() const {
+	return program != 0;
+}
+
+void SpriteBatch::setSortByTexture(bool enabled) {
+	sortByTexture = enabled;
+}
+
+void SpriteBatch::begin(int viewportWidth, int viewportHeight) {
+	currentRegion = (currentRegion + 1) % regionCount;
+
+	// Only blocks when the GPU is still reading the region from framesInFlight frames ago.
+	GLsync fence = (GLsync)fences[currentRegion];
+
+	if (fence != NULL) {
+		GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+		while (status == GL_TIMEOUT_EXPIRED) {
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+
+		// The region may still be read, so wait for everything instead.
+		if (status == GL_WAIT_FAILED) {
+			std::cerr << "ERROR::SPRITE_BATCH::FENCE_WAIT_FAILED" << std::endl;
+			glFinish();
+		}
+
+		glDeleteSync(fence);
+		fences[currentRegion] = NULL;
+	}
+
+	scaleX = 2.0f / viewportWidth;
+	scaleY = -2.0f / viewportHeight;
+	quads.clear();
+	keys.clear();
+	textures.clear();
+	stats.sprites = 0;
+	stats.drawCalls = 0;
+	stats.dropped = 0;
+}
+
+unsigned int SpriteBatch::textureSlot(unsigned int texture) {
+	// Frames use a handful of textures, most recently the one just used.
+	for (size_t i = textures.size(); i > 0; i--) {
+		if (textures[i - 1] == texture) {
+			return (unsigned int)(i - 1);
+		}
+	}
+
+	textures.push_back(texture);
+
+	return (unsigned int)(textures.size() - 1);
+}
+
+SpriteBatch::SpriteVertex* SpriteBatch::reserveQuad(unsigned int texture, int layer) {
+	if (keys.size() == capacity) {
+		if (stats.dropped++ == 0) {
+			std::cerr << "ERROR::SPRITE_BATCH::OUT_OF_SPACE" << std::endl;
+		}
+
+		return NULL;
+	}
+
+	uint64_t index = keys.size();
+	uint64_t layerKey = (uint16_t)(std::min(std::max(layer, -32768), 32767) + 32768);
+
+	keys.push_back((layerKey << 48) | ((uint64_t)(textureSlot(texture) & 0xFFFFFF) << 24) | index);
+	quads.resize(quads.size() + 4);
+
+	return &quads[quads.size() - 4];
+}
+
+void SpriteBatch::draw(const SpriteRegion& region, float x, float y, float width, float height, uint32_t color, int layer) {
+	SpriteVertex* quad = reserveQuad(region.texture, layer);
+
+	if (quad == NULL) {
+		return;
+	}
+
+	SpriteVertex corners[4] = {
+		{ x, y, region.u0, region.v0, color },
+		{ x + width, y, region.u1, region.v0, color },
+		{ x, y + height, region.u0, region.v1, color },
+		{ x + width, y + height, region.u1, region.v1, color }
+	};
+
+	std::memcpy(quad, corners, sizeof(corners));
+}
+
+void SpriteBatch::drawRotated(const SpriteRegion& region, float centerX, float centerY, float width, float height, float radians, uint32_t color, int layer) {
+	SpriteVertex* quad = reserveQuad(region.texture, layer);
+
+	if (quad == NULL) {
+		return;
+	}
+
+	float c = std::cos(radians);
+	float s = std::sin(radians);
+	float halfWidth = width * 0.5f;
+	float halfHeight = height * 0.5f;
+	// Half-extent axes of the rotated quad.
+	float ax = c * halfWidth;
+	float ay = s * halfWidth;
+	float bx = -s * halfHeight;
+	float by = c * halfHeight;
+
+	SpriteVertex corners[4] = {
+		{ centerX - ax - bx, centerY - ay - by, region.u0, region.v0, color },
+		{ centerX + ax - bx, centerY + ay - by, region.u1, region.v0, color },
+		{ centerX - ax + bx, centerY - ay + by, region.u0, region.v1, color },
+		{ centerX + ax + bx, centerY + ay + by, region.u1, region.v1, color }
+	};
+
+	std::memcpy(quad, corners, sizeof(corners));
+}
+
+void SpriteBatch::drawRect(float x, float y, float width, float height, uint32_t color, int layer) {
+	SpriteRegion region = { whiteTexture, 0.0f, 0.0f, 1.0f, 1.0f };
+	draw(region, x, y, width, height, color, layer);
+}
+
+SpriteBatch::SpriteVertex* SpriteBatch::mapRegion(size_t quadCount) {
+	size_t regionBase = (size_t)currentRegion * capacity * 4 * sizeof(SpriteVertex);
+
+	if (persistent) {
+		return (SpriteVertex*)(mapped + regionBase);
+	}
+
+	// The fence in begin() already guarantees the GPU is done with this region.
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+
+	return (SpriteVertex*)glMapBufferRange(GL_ARRAY_BUFFER, (GLintptr)regionBase, (GLsizeiptr)(quadCount * 4 * sizeof(SpriteVertex)),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void SpriteBatch::unmapRegion() {
+	if (!persistent) {
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+}
+
+void SpriteBatch::end() {
+	size_t count = keys.size();
+
+	stats.sprites = (unsigned int)count;
+
+	if (count == 0) {
+		return;
+	}
+
+	// Keys are unique, so an unstable sort still keeps submission order within a (layer, texture) run.
+	if (sortByTexture) {
+		std::sort(keys.begin(), keys.end());
+	}
+
+	SpriteVertex* destination = mapRegion(count);
+
+	if (destination == NULL) {
+		std::cerr << "ERROR::SPRITE_BATCH::MAP_FAILED" << std::endl;
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		size_t index = (size_t)(keys[i] & 0xFFFFFF);
+		std::memcpy(&destination[i * 4], &quads[index * 4], 4 * sizeof(SpriteVertex));
+	}
+
+	unmapRegion();
+
+	glUseProgram(program);
+	glUniform2f(glGetUniformLocation(program, "pixelScale"), scaleX, scaleY);
+	glBindVertexArray(vertexArray);
+	glActiveTexture(GL_TEXTURE0);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	GLint baseVertex = (GLint)((size_t)currentRegion * capacity * 4);
+	size_t first = 0;
+
+	// Layer boundaries need no draw of their own; only texture changes split runs.
+	for (size_t i = 1; i <= count; i++) {
+		unsigned int slot = (unsigned int)((keys[first] >> 24) & 0xFFFFFF);
+
+		if (i < count && ((keys[i] >> 24) & 0xFFFFFF) == slot) {
+			continue;
+		}
+
+		glBindTexture(GL_TEXTURE_2D, textures[slot]);
+		glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)((i - first) * 6), GL_UNSIGNED_INT, (void*)(first * 6 * sizeof(uint32_t)), baseVertex);
+		stats.drawCalls++;
+		first = i;
+	}
+
+	glBindVertexArray(0);
+	glDisable(GL_BLEND);
+
+	fences[currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+const SpriteBatchStats& SpriteBatch::lastStats() const {
+	return stats;
+}
+
+// A page of 4x4 soft discs in shades of one hue.
+static unsigned int createAtlasPage(int page) {
+	const int size = 256;
+	const int cell = size / 4;
+	std::vector<unsigned char> pixels((size_t)size * size * 4);
+
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			int entry = (y / cell) * 4 + x / cell;
+			float dx = (x % cell + 0.5f) / cell * 2.0f - 1.0f;
+			float dy = (y % cell + 0.5f) / cell * 2.0f - 1.0f;
+			float alpha = std::max(0.0f, std::min(1.0f, (1.0f - std::sqrt(dx * dx + dy * dy)) * 4.0f));
+			float shade = 0.4f + 0.6f * entry / 15.0f;
+			unsigned char* pixel = &pixels[((size_t)y * size + x) * 4];
+
+			pixel[0] = (unsigned char)(255.0f * shade * (page == 0 || page == 3 ? 1.0f : 0.3f));
+			pixel[1] = (unsigned char)(255.0f * shade * (page == 1 || page == 3 ? 1.0f : 0.3f));
+			pixel[2] = (unsigned char)(255.0f * shade * (page == 2 ? 1.0f : 0.3f));
+			pixel[3] = (unsigned char)(255.0f * alpha);
+		}
+	}
+
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	return texture;
+}
+
+struct BenchSprite {
+	float x, y;
+	float velocityX, velocityY;
+	float size;
+	float angle;
+	int region;
+	int layer;
+	uint32_t color;
+};
+
+int runSpriteBenchmark(int width, int height, int spriteCount, int frames) {
+	const int pageCount = 4;
+	unsigned int pages[pageCount];
+	std::vector<SpriteRegion> regions;
+
+	for (int page = 0; page < pageCount; page++) {
+		pages[page] = createAtlasPage(page);
+
+		for (int entry = 0; entry < 16; entry++) {
+			SpriteRegion region = { pages[page], (entry % 4) * 0.25f, (entry / 4) * 0.25f, (entry % 4 + 1) * 0.25f, (entry / 4 + 1) * 0.25f };
+			regions.push_back(region);
+		}
+	}
+
+	std::vector<BenchSprite> sprites(spriteCount);
+	unsigned int seed = 24680;
+
+	for (size_t i = 0; i < sprites.size(); i++) {
+		float random[6];
+
+		for (int r = 0; r < 6; r++) {
+			seed = seed * 1664525u + 1013904223u;
+			random[r] = ((seed >> 8) & 0xFFFF) / 65535.0f;
+		}
+
+		sprites[i].x = random[0] * width;
+		sprites[i].y = random[1] * height;
+		sprites[i].velocityX = (random[2] - 0.5f) * 4.0f;
+		sprites[i].velocityY = (random[3] - 0.5f) * 4.0f;
+		sprites[i].size = 8.0f + 24.0f * random[4];
+		sprites[i].angle = random[5] * 6.2832f;
+		sprites[i].region = (int)(seed >> 8) % (int)regions.size();
+		sprites[i].layer = (int)(seed >> 20) % 4;
+		sprites[i].color = 0xC0FFFFFFu;
+	}
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	const int warmupFrames = 10;
+	int result = 0;
+
+	std::cout << "SPRITE BENCHMARK " << width << "x" << height << ", " << spriteCount << " sprites from " << pageCount
+		<< " atlas pages in 4 layers, " << frames << " frames" << std::endl;
+
+	for (int sorted = 1; sorted >= 0; sorted--) {
+		SpriteBatch batch((unsigned int)spriteCount, 3);
+
+		if (!batch.isValid()) {
+			result = -1;
+			break;
+		}
+
+		batch.setSortByTexture(sorted != 0);
+
+		RenderGraph graph;
+		RenderGraph::Resource output = graph.importTexture("output", outputTexture, outputDesc);
+
+		graph.addPass("sprites",
+			[&](RenderGraph::Builder& builder) {
+				builder.write(output, LoadOp::Clear);
+				builder.setClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+			},
+			[&batch](const RenderGraph&) {
+				batch.end();
+			});
+
+		if (!graph.compile()) {
+			result = -1;
+			break;
+		}
+
+		GpuTimer timer(4);
+		double cpuMilliseconds = 0.0;
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				timer.wait();
+				timer.resetAverage();
+				cpuMilliseconds = 0.0;
+			}
+
+			for (size_t i = 0; i < sprites.size(); i++) {
+				BenchSprite& sprite = sprites[i];
+				sprite.x += sprite.velocityX;
+				sprite.y += sprite.velocityY;
+				sprite.velocityX = sprite.x < 0.0f || sprite.x > width ? -sprite.velocityX : sprite.velocityX;
+				sprite.velocityY = sprite.y < 0.0f || sprite.y > height ? -sprite.velocityY : sprite.velocityY;
+				sprite.angle += 0.02f;
+			}
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			batch.begin(width, height);
+
+			for (size_t i = 0; i < sprites.size(); i++) {
+				const BenchSprite& sprite = sprites[i];
+
+				// Every fourth sprite spins; a few are plain rectangles.
+				if (i % 4 == 0) {
+					batch.drawRotated(regions[sprite.region], sprite.x, sprite.y, sprite.size, sprite.size, sprite.angle, sprite.color, sprite.layer);
+				}
+				else if (i % 64 == 1) {
+					batch.drawRect(sprite.x, sprite.y, sprite.size, sprite.size * 0.25f, 0x80FFFFFFu, sprite.layer);
+				}
+				else {
+					batch.draw(regions[sprite.region], sprite.x, sprite.y, sprite.size, sprite.size, sprite.color, sprite.layer);
+				}
+			}
+
+			timer.begin();
+			graph.execute();
+			timer.end();
+
+			cpuMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			timer.poll();
+		}
+
+		timer.wait();
+
+		double cpuAverage = cpuMilliseconds / frames;
+		double gpuAverage = timer.averageMilliseconds();
+
+		std::cout << (sorted != 0 ? "sorted by texture: " : "submission order: ") << batch.lastStats().drawCalls << " draws per frame, "
+			<< cpuAverage << " ms CPU (" << (cpuAverage > 0.0 ? spriteCount / cpuAverage : 0.0) << " sprites/ms), " << gpuAverage
+			<< " ms GPU (" << (gpuAverage > 0.0 ? spriteCount / gpuAverage : 0.0) << " sprites/ms)" << std::endl;
+	}
+
+	glDeleteTextures(1, &outputTexture);
+	glDeleteTextures(pageCount, pages);
+
+	return result;
+}
@@ -0,0 +1,95 @@
+#ifndef CUSTOM_SPRITEBATCH_H
+#define CUSTOM_SPRITEBATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A rectangle of a texture, usually one entry of an atlas page.
+struct SpriteRegion {
+	unsigned int texture;
+	float u0, v0, u1, v1;
+};
+
+struct SpriteBatchStats {
+	unsigned int sprites;
+	unsigned int drawCalls;
+	unsigned int dropped;
+};
+
+// Accumulates 2D quads in pixel coordinates (origin top left) between
+// begin() and end(). end() orders them by layer, then texture, then
+// submission, writes them into a streaming vertex buffer and issues one draw
+// per run of equal texture. Overlapping sprites must use layers to keep
+// their order; within a layer only sprites sharing a texture keep theirs.
+//
+// The vertex buffer holds a region per frame in flight like UniformRing, and
+// is persistently mapped when GL_ARB_buffer_storage is available. Sprites
+// beyond maxSprites in a frame are dropped.
+class SpriteBatch {
+public:
+	SpriteBatch(unsigned int maxSprites, int framesInFlight);
+	~SpriteBatch();
+
+	SpriteBatch(const SpriteBatch&) = delete;
+	SpriteBatch& operator=(const SpriteBatch&) = delete;
+
+	bool isValid() const;
+
+	// Draws in submission order, one draw per texture change; for comparison.
+	void setSortByTexture(bool enabled);
+
+	void begin(int viewportWidth, int viewportHeight);
+
+	// color is RGBA8 with red in the lowest byte; it multiplies the texture.
+	void draw(const SpriteRegion& region, float x, float y, float width, float height, uint32_t color, int layer);
+	void drawRotated(const SpriteRegion& region, float centerX, float centerY, float width, float height, float radians, uint32_t color, int layer);
+	void drawRect(float x, float y, float width, float height, uint32_t color, int layer);
+
+	// Blends over the bound framebuffer. Leaves blending and depth testing disabled.
+	void end();
+
+	const SpriteBatchStats& lastStats() const;
+
+private:
+	struct SpriteVertex {
+		float x, y;
+		float u, v;
+		uint32_t color;
+	};
+
+	SpriteVertex* reserveQuad(unsigned int texture, int layer);
+	unsigned int textureSlot(unsigned int texture);
+	SpriteVertex* mapRegion(size_t quadCount);
+	void unmapRegion();
+
+	unsigned int capacity;
+	int regionCount;
+	int currentRegion;
+	bool sortByTexture;
+	bool persistent;
+	char* mapped;
+	float scaleX;
+	float scaleY;
+	SpriteBatchStats stats;
+
+	// Quads in submission order and a (layer, texture slot, index) key per quad.
+	std::vector<SpriteVertex> quads;
+	std::vector<uint64_t> keys;
+	std::vector<unsigned int> textures;
+	std::vector<void*> fences;
+
+	unsigned int vertexBuffer;
+	unsigned int indexBuffer;
+	unsigned int vertexArray;
+	unsigned int whiteTexture;
+	unsigned int program;
+};
+
+// Draws spriteCount moving sprites from four atlas pages over four layers at
+// width x height, once sorted by texture and once in submission order, and
+// prints sprites per millisecond of CPU and GPU time and draws per frame.
+// Needs a current context. Returns 0 on success.
+int runSpriteBenchmark(int width, int height, int spriteCount, int frames);
+
+#endif // !CUSTOM_SPRITEBATCH_H
@@ -0,0 +1,959 @@
+#include "terrain.hpp"
+#include "glprogram.hpp"
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t heightmapFileMagic = 0x31504D48; // "HMP1"
+static const size_t heightmapHeaderSize = 4 * sizeof(uint32_t);
+
+static size_t pyramidTileCount(int levelCount) {
+	size_t count = 0;
+
+	for (int level = 0; level < levelCount; level++) {
+		size_t side = (size_t)1 << (levelCount - 1 - level);
+		count += side * side;
+	}
+
+	return count;
+}
+
+bool writeHeightmapFile(const char* path, int tileSize, int levelCount, const HeightFunction& height) {
+	if (tileSize < 2 || tileSize % 2 != 0 || levelCount < 1 || levelCount > HeightmapFile::maxLevels) {
+		std::cerr << "ERROR::TERRAIN::INVALID_LAYOUT: tile size " << tileSize << ", " << levelCount << " levels" << std::endl;
+		return false;
+	}
+
+	std::ofstream file(path, std::ios::binary);
+
+	if (!file) {
+		std::cerr << "ERROR::TERRAIN::FILE_NOT_SUCCESSFULLY_WRITTEN: " << path << std::endl;
+		return false;
+	}
+
+	uint32_t header[4] = { heightmapFileMagic, (uint32_t)tileSize, (uint32_t)levelCount, 0 };
+	size_t tileCount = pyramidTileCount(levelCount);
+	int samplesPerSide = tileSize + 1;
+	std::vector<uint16_t> samples((size_t)samplesPerSide * samplesPerSide);
+
+	file.write((const char*)header, sizeof(header));
+
+	// Placeholder range table, filled in as the tiles are written.
+	std::vector<char> zeros(4096, 0);
+
+	for (size_t remaining = tileCount * 2 * sizeof(uint16_t); remaining > 0 && file;) {
+		size_t chunk = std::min(remaining, zeros.size());
+		file.write(zeros.data(), chunk);
+		remaining -= chunk;
+	}
+
+	size_t tilesOffset = heightmapHeaderSize + tileCount * 2 * sizeof(uint16_t);
+	size_t index = 0;
+
+	for (int level = 0; level < levelCount && file; level++) {
+		int side = 1 << (levelCount - 1 - level);
+
+		for (int z = 0; z < side && file; z++) {
+			for (int x = 0; x < side && file; x++, index++) {
+				uint16_t range[2] = { 65535, 0 };
+
+				for (int j = 0; j < samplesPerSide; j++) {
+					for (int i = 0; i < samplesPerSide; i++) {
+						uint16_t value = height((x * tileSize + i) << level, (z * tileSize + j) << level);
+						samples[(size_t)j * samplesPerSide + i] = value;
+						range[0] = std::min(range[0], value);
+						range[1] = std::max(range[1], value);
+					}
+				}
+
+				file.seekp((std::streamoff)(tilesOffset + index * samples.size() * sizeof(uint16_t)));
+				file.write((const char*)samples.data(), samples.size() * sizeof(uint16_t));
+				file.seekp((std::streamoff)(heightmapHeaderSize + index * sizeof(range)));
+				file.write((const char*)range, sizeof(range));
+			}
+		}
+	}
+
+	if (!file) {
+		std::cerr << "ERROR::TERRAIN::FILE_NOT_SUCCESSFULLY_WRITTEN: " << path << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+static void unmapFile(void* data, size_t size) {
+#ifdef _WIN32
+	(void)size;
+	UnmapViewOfFile(data);
+#else
+	munmap(data, size);
+#endif
+}
+
+HeightmapFile::HeightmapFile(const char* path)
+	: data(NULL), size(0), tileQuads(0), levels(0), ranges(NULL), tiles(NULL), firstTiles() {
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+
+	if (handle != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER fileSize;
+
+		if (GetFileSizeEx(handle, &fileSize) && fileSize.QuadPart > 0) {
+			HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+			// The view keeps the file open once both handles are closed.
+			if (mapping != NULL) {
+				data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				size = data != NULL ? (size_t)fileSize.QuadPart : 0;
+				CloseHandle(mapping);
+			}
+		}
+
+		CloseHandle(handle);
+	}
+#else
+	int descriptor = open(path, O_RDONLY);
+
+	if (descriptor >= 0) {
+		struct stat info;
+
+		if (fstat(descriptor, &info) == 0 && info.st_size > 0) {
+			void* mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+
+			// The mapping keeps the file open once the descriptor is closed.
+			if (mapped != MAP_FAILED) {
+				data = mapped;
+				size = (size_t)info.st_size;
+				madvise(data, size, MADV_RANDOM);
+			}
+		}
+
+		close(descriptor);
+	}
+#endif
+
+	if (data == NULL) {
+		std::cerr << "ERROR::TERRAIN::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+		return;
+	}
+
+	const uint32_t* header = (const uint32_t*)data;
+	bool valid = size >= heightmapHeaderSize && header[0] == heightmapFileMagic && header[1] >= 2 && header[1] % 2 == 0
+		&& header[2] >= 1 && header[2] <= (uint32_t)maxLevels;
+
+	if (valid) {
+		tileQuads = (int)header[1];
+		levels = (int)header[2];
+
+		size_t tileCount = pyramidTileCount(levels);
+		size_t samplesPerTile = (size_t)(tileQuads + 1) * (tileQuads + 1);
+		valid = size == heightmapHeaderSize + tileCount * 2 * sizeof(uint16_t) + tileCount * samplesPerTile * sizeof(uint16_t);
+	}
+
+	if (!valid) {
+		std::cerr << "ERROR::TERRAIN::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+		unmapFile(data, size);
+		data = NULL;
+		size = 0;
+		tileQuads = 0;
+		levels = 0;
+		return;
+	}
+
+	ranges = (const uint16_t*)((const char*)data + heightmapHeaderSize);
+	tiles = ranges + pyramidTileCount(levels) * 2;
+
+	size_t first = 0;
+
+	for (int level = 0; level < levels; level++) {
+		firstTiles.push_back(first);
+		first += (size_t)tilesPerSide(level) * tilesPerSide(level);
+	}
+}
+
+HeightmapFile::~HeightmapFile() {
+	if (data != NULL) {
+		unmapFile(data, size);
+	}
+}
+
+bool HeightmapFile::isValid() const {
+	return data != NULL;
+}
+
+int HeightmapFile::tileSize() const {
+	return tileQuads;
+}
+
+int HeightmapFile::levelCount() const {
+	return levels;
+}
+
+int HeightmapFile::tilesPerSide(int level) const {
+	return 1 << (levels - 1 - level);
+}
+
+int HeightmapFile::worldQuads() const {
+	return tileQuads << (levels - 1);
+}
+
+size_t HeightmapFile::tileIndex(int level, int x, int z) const {
+	return firstTiles[level] + (size_t)z * tilesPerSide(level) + x;
+}
+
+const uint16_t* HeightmapFile::tile(int level, int x, int z) const {
+	return tiles + tileIndex(level, x, z) * (size_t)(tileQuads + 1) * (tileQuads + 1);
+}
+
+void HeightmapFile::tileRange(int level, int x, int z, uint16_t& minimum, uint16_t& maximum) const {
+	const uint16_t* range = ranges + tileIndex(level, x, z) * 2;
+	minimum = range[0];
+	maximum = range[1];
+}
+
+uint16_t HeightmapFile::sample(int x, int z) const {
+	int world = worldQuads();
+	x = std::min(std::max(x, 0), world);
+	z = std::min(std::max(z, 0), world);
+
+	int tileX = std::min(x / tileQuads, tilesPerSide(0) - 1);
+	int tileZ = std::min(z / tileQuads, tilesPerSide(0) - 1);
+
+	return tile(0, tileX, tileZ)[(size_t)(z - tileZ * tileQuads) * (tileQuads + 1) + (x - tileX * tileQuads)];
+}
+
+size_t HeightmapFile::fileBytes() const {
+	return size;
+}
+
+// 4 bits of level and 13 bits per coordinate cover maxLevels.
+static uint32_t tileKey(int level, int x, int z) {
+	return ((uint32_t)level << 26) | ((uint32_t)x << 13) | (uint32_t)z;
+}
+
+static const uint32_t emptyTileKey = 0xFFFFFFFFu;
+
+// GL 3.3 only guarantees 256 texture array layers.
+static int supportedSlotCount(int slotCount) {
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+	if (maxLayers > 0 && slotCount > maxLayers) {
+		std::cerr << "ERROR::TERRAIN::TOO_MANY_CACHE_SLOTS: " << slotCount << " requested, using the " << maxLayers
+			<< " texture array layers supported" << std::endl;
+		return maxLayers;
+	}
+
+	return slotCount;
+}
+
+TerrainTileCache::TerrainTileCache(const HeightmapFile& file, int slotCount, int stagingCount, int uploadsPerFrame)
+	: file(file), samplesPerSide(file.tileSize() + 1), uploadsPerFrame(uploadsPerFrame), tileTexture(0), frame(1), uploads(0),
+	resident(0), slots(supportedSlotCount(slotCount)), tiles(), stagingBuffers(stagingCount), freeBuffers(), uploadQueue(), loader(), mutex(), wake(),
+	requests(), loaded(), stopping(false) {
+	size_t samplesPerTile = (size_t)samplesPerSide * samplesPerSide;
+
+	for (size_t i = 0; i < slots.size(); i++) {
+		slots[i].key = emptyTileKey;
+		slots[i].lastUsed = 0;
+	}
+
+	for (int i = stagingCount - 1; i >= 0; i--) {
+		stagingBuffers[i].resize(samplesPerTile);
+		freeBuffers.push_back(i);
+	}
+
+	tiles.reserve(slots.size() + stagingBuffers.size());
+	uploadQueue.reserve(stagingBuffers.size());
+	loaded.reserve(stagingBuffers.size());
+
+	glGenTextures(1, &tileTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, tileTexture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R16, samplesPerSide, samplesPerSide, (GLsizei)slots.size(), 0, GL_RED, GL_UNSIGNED_SHORT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// Rows of tileSize + 1 samples are only 2-byte aligned.
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, samplesPerSide, samplesPerSide, 1, GL_RED, GL_UNSIGNED_SHORT,
+		file.tile(file.levelCount() - 1, 0, 0));
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	slots[0].key = tileKey(file.levelCount() - 1, 0, 0);
+	tiles[slots[0].key] = 0;
+	resident = 1;
+
+	loader = std::thread(&TerrainTileCache::loaderLoop, this);
+}
+
+TerrainTileCache::~TerrainTileCache() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	wake.notify_all();
+	loader.join();
+
+	glDeleteTextures(1, &tileTexture);
+}
+
+int TerrainTileCache::acquire(int level, int x, int z) {
+	uint32_t key = tileKey(level, x, z);
+	std::unordered_map<uint32_t, int>::iterator found = tiles.find(key);
+
+	if (found != tiles.end()) {
+		if (found->second >= 0) {
+			slots[found->second].lastUsed = frame;
+		}
+
+		return found->second;
+	}
+
+	// Every request in flight owns a staging buffer; the rest are asked for again next frame.
+	if (freeBuffers.empty()) {
+		return -1;
+	}
+
+	Staged request = { key, freeBuffers.back() };
+	freeBuffers.pop_back();
+	tiles[key] = -1;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requests.push_back(request);
+	}
+
+	wake.notify_one();
+
+	return -1;
+}
+
+void TerrainTileCache::endFrame() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		uploadQueue.insert(uploadQueue.end(), loaded.begin(), loaded.end());
+		loaded.clear();
+	}
+
+	size_t kept = 0;
+	int uploaded = 0;
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, tileTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+
+	for (size_t i = 0; i < uploadQueue.size(); i++) {
+		Staged staged = uploadQueue[i];
+		int slot = -1;
+
+		// Least recently used layer not drawn from this frame; slot 0 holds the root.
+		if (uploaded < uploadsPerFrame) {
+			for (size_t s = 1; s < slots.size(); s++) {
+				if (slots[s].lastUsed < frame && (slot < 0 || slots[s].lastUsed < slots[slot].lastUsed)) {
+					slot = (int)s;
+				}
+			}
+		}
+
+		if (slot < 0) {
+			uploadQueue[kept++] = staged;
+			continue;
+		}
+
+		if (slots[slot].key != emptyTileKey) {
+			tiles.erase(slots[slot].key);
+			resident--;
+		}
+
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, slot, samplesPerSide, samplesPerSide, 1, GL_RED, GL_UNSIGNED_SHORT,
+			stagingBuffers[staged.buffer].data());
+
+		slots[slot].key = staged.key;
+		slots[slot].lastUsed = frame;
+		tiles[staged.key] = slot;
+		freeBuffers.push_back(staged.buffer);
+		resident++;
+		uploaded++;
+		uploads++;
+	}
+
+	uploadQueue.resize(kept);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	frame++;
+}
+
+void TerrainTileCache::loaderLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+	size_t tileBytes = (size_t)samplesPerSide * samplesPerSide * sizeof(uint16_t);
+
+	for (;;) {
+		wake.wait(lock, [this] { return stopping || !requests.empty(); });
+
+		if (stopping) {
+			return;
+		}
+
+		Staged request = requests.front();
+		requests.pop_front();
+		lock.unlock();
+
+		int level = (int)(request.key >> 26);
+		int x = (int)((request.key >> 13) & 0x1FFF);
+		int z = (int)(request.key & 0x1FFF);
+		std::memcpy(stagingBuffers[request.buffer].data(), file.tile(level, x, z), tileBytes);
+
+		lock.lock();
+		loaded.push_back(request);
+	}
+}
+
+unsigned int TerrainTileCache::texture() const {
+	return tileTexture;
+}
+
+int TerrainTileCache::residentCount() const {
+	return resident;
+}
+
+int TerrainTileCache::pendingCount() const {
+	return (int)(stagingBuffers.size() - freeBuffers.size());
+}
+
+unsigned long long TerrainTileCache::uploadCount() const {
+	return uploads;
+}
+
+int TerrainTileCache::slotCount() const {
+	return (int)slots.size();
+}
+
+size_t TerrainTileCache::residentBytes() const {
+	return (slots.size() + stagingBuffers.size()) * samplesPerSide * samplesPerSide * sizeof(uint16_t);
+}
+
+static const char* terrainVertexShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec2 gridPosition;\n"
+	"layout (location = 1) in vec4 node;\n"
+	"layout (location = 2) in vec2 morphRange;\n"
+	"uniform mat4 viewProjection;\n"
+	"uniform vec3 cameraPosition;\n"
+	"uniform float gridSize;\n"
+	"uniform float heightScale;\n"
+	"uniform sampler2DArray heightTiles;\n"
+	"out vec3 worldPosition;\n"
+	"float sampleHeight(vec2 grid) {\n"
+	"return textureLod(heightTiles, vec3((grid + 0.5) / (gridSize + 1.0), node.w), 0.0).r * heightScale;\n"
+	"}\n"
+	"void main() {\n"
+	"float spacing = node.z / gridSize;\n"
+	"vec3 position = vec3(node.x + gridPosition.x * spacing, sampleHeight(gridPosition), node.y + gridPosition.y * spacing);\n"
+	// Odd vertices slide onto their even neighbours, reaching the coarser grid at the end of the range.
+	"float morph = clamp((distance(position, cameraPosition) - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);\n"
+	"vec2 grid = gridPosition - fract(gridPosition * 0.5) * 2.0 * morph;\n"
+	"worldPosition = vec3(node.x + grid.x * spacing, sampleHeight(grid), node.y + grid.y * spacing);\n"
+	"gl_Position = viewProjection * vec4(worldPosition, 1.0);\n"
+	"}\0";
+
+static const char* terrainFragmentShaderSource = "#version 330 core\n"
+	"in vec3 worldPosition;\n"
+	"uniform vec3 lightDirection;\n"
+	"uniform float heightScale;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"vec3 normal = normalize(cross(dFdx(worldPosition), dFdy(worldPosition)));\n"
+	"normal *= sign(normal.y);\n"
+	"float diffuse = max(dot(normal, -lightDirection), 0.0);\n"
+	"vec3 albedo = mix(vec3(0.25, 0.4, 0.2), vec3(0.55, 0.5, 0.45), smoothstep(0.3, 0.7, worldPosition.y / heightScale));\n"
+	"FragColor = vec4(albedo * (0.25 + 0.75 * diffuse), 1.0);\n"
+	"}\0";
+
+// Share of a level's range, from the inside, drawn before vertices start morphing.
+static const float morphStartRatio = 0.66f;
+
+// Range of the finest level in node sizes; every coarser level doubles it.
+static const float finestRangeInNodes = 2.0f;
+
+TerrainRenderer::TerrainRenderer(const HeightmapFile& file, float sampleSpacing, float heightScale, int cacheSlots)
+	: file(file), tileCache(file, cacheSlots, 32, 8), spacing(sampleSpacing), heights(heightScale), gridSize(file.tileSize()),
+	quadrantIndexCount((unsigned int)(file.tileSize() / 2) * (file.tileSize() / 2) * 6), program(0), vao(0), vertexBuffer(0),
+	indexBuffer(0), instanceBuffer(0), instanceCapacity((size_t)tileCache.slotCount() * 4), viewProjectionLocation(-1), cameraLocation(-1),
+	lightLocation(-1), ranges(file.levelCount()), camera(vec3(0.0f, 0.0f, 0.0f)), frustum(), instances(), quadrantFirst(),
+	lastStats() {
+	program = createProgram(terrainVertexShaderSource, terrainFragmentShaderSource);
+
+	if (program != 0) {
+		glUseProgram(program);
+		glUniform1f(glGetUniformLocation(program, "gridSize"), (float)gridSize);
+		glUniform1f(glGetUniformLocation(program, "heightScale"), heights);
+		glUniform1i(glGetUniformLocation(program, "heightTiles"), 0);
+		glUseProgram(0);
+
+		viewProjectionLocation = glGetUniformLocation(program, "viewProjection");
+		cameraLocation = glGetUniformLocation(program, "cameraPosition");
+		lightLocation = glGetUniformLocation(program, "lightDirection");
+	}
+
+	for (size_t level = 0; level < ranges.size(); level++) {
+		ranges[level] = level == 0 ? gridSize * spacing * finestRangeInNodes : ranges[level - 1] * 2.0f;
+	}
+
+	// One grid for every node; indices go quadrant by quadrant so parts of a node can be drawn alone.
+	std::vector<float> positions;
+	std::vector<unsigned int> indices;
+	int half = gridSize / 2;
+
+	for (int z = 0; z <= gridSize; z++) {
+		for (int x = 0; x <= gridSize; x++) {
+			positions.push_back((float)x);
+			positions.push_back((float)z);
+		}
+	}
+
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		int startX = (quadrant & 1) * half;
+		int startZ = (quadrant >> 1) * half;
+
+		for (int z = startZ; z < startZ + half; z++) {
+			for (int x = startX; x < startX + half; x++) {
+				unsigned int corner = (unsigned int)(z * (gridSize + 1) + x);
+				unsigned int below = corner + gridSize + 1;
+
+				indices.push_back(corner);
+				indices.push_back(below);
+				indices.push_back(corner + 1);
+				indices.push_back(corner + 1);
+				indices.push_back(below);
+				indices.push_back(below + 1);
+			}
+		}
+	}
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+	// Attribute offsets are set per quadrant in draw().
+	glGenBuffers(1, &instanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(NodeInstance), NULL, GL_STREAM_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(2, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		quadrantInstances[quadrant].reserve(tileCache.slotCount());
+		quadrantFirst[quadrant] = 0;
+	}
+
+	instances.reserve(instanceCapacity);
+
+	lastStats.nodesSelected = 0;
+	lastStats.quadrantsDrawn = 0;
+	lastStats.finestLevel = file.levelCount();
+	lastStats.tilesResident = tileCache.residentCount();
+	lastStats.tilesPending = 0;
+	lastStats.tilesUploaded = 0;
+}
+
+TerrainRenderer::~TerrainRenderer() {
+	glDeleteProgram(program);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	glDeleteBuffers(1, &instanceBuffer);
+	glDeleteVertexArrays(1, &vao);
+}
+
+bool TerrainRenderer::isValid() const {
+	return program != 0;
+}
+
+static bool boxInFrustum(const Frustum& frustum, const Vec3& minimum, const Vec3& maximum) {
+	for (int i = 0; i < 6; i++) {
+		const Vec4& plane = frustum.planes[i];
+		Vec3 corner = vec3(plane.x >= 0.0f ? maximum.x : minimum.x, plane.y >= 0.0f ? maximum.y : minimum.y,
+			plane.z >= 0.0f ? maximum.z : minimum.z);
+
+		if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0.0f) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool boxInSphere(const Vec3& minimum, const Vec3& maximum, const Vec3& center, float radius) {
+	Vec3 closest = vec3(std::min(std::max(center.x, minimum.x), maximum.x), std::min(std::max(center.y, minimum.y), maximum.y),
+		std::min(std::max(center.z, minimum.z), maximum.z));
+	Vec3 offset = sub(closest, center);
+
+	return dot(offset, offset) <= radius * radius;
+}
+
+// Returns false when the node is out of its level's range, or its tile is
+// not resident, and the parent has to cover its area.
+bool TerrainRenderer::selectNode(int level, int x, int z, bool root) {
+	float nodeSize = (float)(gridSize << level) * spacing;
+	uint16_t low;
+	uint16_t high;
+	file.tileRange(level, x, z, low, high);
+
+	Vec3 minimum = vec3(x * nodeSize, low * heights / 65535.0f, z * nodeSize);
+	Vec3 maximum = vec3(minimum.x + nodeSize, high * heights / 65535.0f, minimum.z + nodeSize);
+
+	if (!root && !boxInSphere(minimum, maximum, camera, ranges[level])) {
+		return false;
+	}
+
+	if (!boxInFrustum(frustum, minimum, maximum)) {
+		return true;
+	}
+
+	int layer = tileCache.acquire(level, x, z);
+
+	if (layer < 0) {
+		return false;
+	}
+
+	if (level == 0 || !boxInSphere(minimum, maximum, camera, ranges[level - 1])) {
+		addNode(level, x, z, layer, 0xF);
+		return true;
+	}
+
+	int quadrants = 0;
+
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		if (!selectNode(level - 1, x * 2 + (quadrant & 1), z * 2 + (quadrant >> 1), false)) {
+			quadrants |= 1 << quadrant;
+		}
+	}
+
+	if (quadrants != 0) {
+		addNode(level, x, z, layer, quadrants);
+	}
+
+	return true;
+}
+
+void TerrainRenderer::addNode(int level, int x, int z, int layer, int quadrants) {
+	float nodeSize = (float)(gridSize << level) * spacing;
+	float innerRange = level > 0 ? ranges[level - 1] : 0.0f;
+	NodeInstance instance;
+
+	instance.origin[0] = x * nodeSize;
+	instance.origin[1] = z * nodeSize;
+	instance.size = nodeSize;
+	instance.layer = (float)layer;
+	instance.morphStart = innerRange + (ranges[level] - innerRange) * morphStartRatio;
+	instance.morphEnd = ranges[level];
+
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		if ((quadrants & (1 << quadrant)) != 0) {
+			quadrantInstances[quadrant].push_back(instance);
+		}
+	}
+
+	lastStats.nodesSelected++;
+	lastStats.finestLevel = std::min(lastStats.finestLevel, level);
+}
+
+void TerrainRenderer::update(const Vec3& cameraPosition, const Mat4& viewProjection) {
+	camera = cameraPosition;
+	frustum = extractFrustum(viewProjection);
+
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		quadrantInstances[quadrant].clear();
+	}
+
+	lastStats.nodesSelected = 0;
+	lastStats.finestLevel = file.levelCount();
+
+	selectNode(file.levelCount() - 1, 0, 0, true);
+
+	// Uploads only evict layers the selection above did not use.
+	tileCache.endFrame();
+
+	instances.clear();
+
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		quadrantFirst[quadrant] = instances.size();
+		instances.insert(instances.end(), quadrantInstances[quadrant].begin(), quadrantInstances[quadrant].end());
+	}
+
+	if (!instances.empty()) {
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(NodeInstance), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(NodeInstance), instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	lastStats.quadrantsDrawn = (unsigned int)instances.size();
+	lastStats.tilesResident = tileCache.residentCount();
+	lastStats.tilesPending = tileCache.pendingCount();
+	lastStats.tilesUploaded = tileCache.uploadCount();
+}
+
+void TerrainRenderer::draw(const Mat4& viewProjection, const Vec3& lightDirection) const {
+	if (program == 0 || instances.empty()) {
+		return;
+	}
+
+	glUseProgram(program);
+	glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE, viewProjection.m);
+	glUniform3f(cameraLocation, camera.x, camera.y, camera.z);
+	glUniform3f(lightLocation, lightDirection.x, lightDirection.y, lightDirection.z);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, tileCache.texture());
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		if (quadrantInstances[quadrant].empty()) {
+			continue;
+		}
+
+		size_t offset = quadrantFirst[quadrant] * sizeof(NodeInstance);
+
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(NodeInstance), (void*)offset);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(NodeInstance), (void*)(offset + offsetof(NodeInstance, morphStart)));
+		glDrawElementsInstanced(GL_TRIANGLES, quadrantIndexCount, GL_UNSIGNED_INT, (void*)(quadrant * quadrantIndexCount * sizeof(unsigned int)),
+			(GLsizei)quadrantInstances[quadrant].size());
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+const TerrainStats& TerrainRenderer::stats() const {
+	return lastStats;
+}
+
+const TerrainTileCache& TerrainRenderer::cache() const {
+	return tileCache;
+}
+
+float TerrainRenderer::worldSize() const {
+	return file.worldQuads() * spacing;
+}
+
+float TerrainRenderer::heightAt(float x, float z) const {
+	return file.sample((int)std::floor(x / spacing + 0.5f), (int)std::floor(z / spacing + 0.5f)) * heights / 65535.0f;
+}
+
+static const int benchTileSize = 64;
+static const int benchCacheSlots = 384;
+static const float benchSampleSpacing = 1.0f;
+static const float benchHeightScale = 400.0f;
+static const float benchAltitude = 40.0f;
+
+// Rolling hills from a few octaves of sines, cheap enough to generate large worlds.
+static uint16_t benchHeight(int x, int z) {
+	float u = x * 0.0031f;
+	float v = z * 0.0027f;
+	float h = 0.5f + 0.25f * std::sin(u) * std::cos(v) + 0.12f * std::sin(u * 3.1f + v * 1.7f) + 0.06f * std::sin(u * 7.3f - v * 5.9f)
+		+ 0.03f * std::cos(u * 17.0f + v * 13.0f);
+
+	return (uint16_t)(std::min(std::max(h, 0.0f), 1.0f) * 65535.0f);
+}
+
+// Diagonal flight across the world at a fixed height above the ground.
+static Vec3 benchCameraPosition(const TerrainRenderer& terrain, float t) {
+	float world = terrain.worldSize();
+	float along = world * (0.1f + 0.8f * t);
+
+	return vec3(along, terrain.heightAt(along, along) + benchAltitude, along);
+}
+
+static int flyOverTerrain(const HeightmapFile& file, int width, int height, int frames) {
+	const int warmupFrames = 10;
+	const int settleFrames = 300;
+
+	TerrainRenderer terrain(file, benchSampleSpacing, benchHeightScale, benchCacheSlots);
+	int result = terrain.isValid() ? 0 : -1;
+
+	float world = terrain.worldSize();
+	Mat4 projection = perspective(1.0f, (float)width / height, 0.5f, world * 1.5f + benchHeightScale);
+	Vec3 lightDirection = normalize(vec3(-0.4f, -1.0f, -0.3f));
+	Mat4 viewProjection = identity();
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	RenderTextureDesc depthDesc = { width, height, GL_DEPTH_COMPONENT24 };
+	RenderGraph graph;
+	RenderGraph::Resource output = graph.importTexture("output", outputTexture, outputDesc);
+
+	graph.addPass("terrain",
+		[&](RenderGraph::Builder& builder) {
+			RenderGraph::Resource depth = builder.create("terrain.depth", depthDesc);
+
+			builder.write(output, LoadOp::Clear);
+			builder.write(depth, LoadOp::Clear);
+			builder.setClearColor(0.55f, 0.7f, 0.9f, 1.0f);
+		},
+		[&](const RenderGraph&) {
+			glEnable(GL_DEPTH_TEST);
+			glDepthMask(GL_TRUE);
+			terrain.draw(viewProjection, lightDirection);
+			glDisable(GL_DEPTH_TEST);
+		});
+
+	if (result == 0 && !graph.compile()) {
+		result = -1;
+	}
+
+	// Looks ahead along the flight and slightly down.
+	auto placeCamera = [&](float t) {
+		Vec3 eye = benchCameraPosition(terrain, t);
+		Vec3 target = vec3(eye.x + 100.0f, eye.y - 25.0f, eye.z + 100.0f);
+		viewProjection = multiply(projection, lookAt(eye, target, vec3(0.0f, 1.0f, 0.0f)));
+		return eye;
+	};
+
+	if (result == 0) {
+		GpuTimer timer(4);
+		double cpuMilliseconds = 0.0;
+		unsigned long long nodes = 0;
+		unsigned long long quadrants = 0;
+		unsigned long long uploadsBefore = 0;
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				timer.wait();
+				timer.resetAverage();
+				cpuMilliseconds = 0.0;
+				nodes = 0;
+				quadrants = 0;
+				uploadsBefore = terrain.stats().tilesUploaded;
+			}
+
+			Vec3 eye = placeCamera((float)frame / (warmupFrames + frames));
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			terrain.update(eye, viewProjection);
+
+			timer.begin();
+			graph.execute();
+			timer.end();
+
+			cpuMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			timer.poll();
+
+			nodes += terrain.stats().nodesSelected;
+			quadrants += terrain.stats().quadrantsDrawn;
+		}
+
+		timer.wait();
+
+		const TerrainStats& stats = terrain.stats();
+
+		std::cout << cpuMilliseconds / frames << " ms CPU, " << timer.averageMilliseconds() << " ms GPU, " << (double)nodes / frames
+			<< " nodes and " << (double)quadrants / frames << " quadrant instances per frame" << std::endl;
+		std::cout << stats.tilesUploaded - uploadsBefore << " tiles streamed in, " << stats.tilesResident << " resident, "
+			<< stats.tilesPending << " pending at the end, " << terrain.cache().residentBytes() / 1024 << " KB held by the "
+			<< terrain.cache().slotCount() << "-tile cache"
+			<< std::endl;
+
+		// Holds the camera still until everything around it has streamed in.
+		Vec3 eye = placeCamera(1.0f);
+		int settled = 0;
+
+		while (settled < settleFrames) {
+			terrain.update(eye, viewProjection);
+			graph.execute();
+			settled++;
+
+			if (terrain.stats().finestLevel == 0 && terrain.stats().tilesPending == 0) {
+				break;
+			}
+		}
+
+		std::cout << "camera at rest: finest level " << terrain.stats().finestLevel << " after " << settled << " frames" << std::endl;
+
+		if (terrain.stats().finestLevel != 0) {
+			std::cerr << "ERROR::TERRAIN::STREAMING_STALLED: finest level " << terrain.stats().finestLevel << std::endl;
+			result = 1;
+		}
+	}
+
+	glDeleteTextures(1, &outputTexture);
+
+	return result;
+}
+
+int runTerrainBenchmark(int width, int height, int levelCount, int frames) {
+	const char* path = "terrain_bench.heightmap";
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if (!writeHeightmapFile(path, benchTileSize, levelCount, benchHeight)) {
+		return -1;
+	}
+
+	double writeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	int result = 0;
+
+	{
+		HeightmapFile file(path);
+
+		if (!file.isValid()) {
+			result = -1;
+		}
+		else {
+			int samples = file.worldQuads() + 1;
+
+			std::cout << "TERRAIN BENCHMARK " << width << "x" << height << ", " << samples << "x" << samples << " samples in " << levelCount
+				<< " levels of " << benchTileSize << "-quad tiles, " << file.fileBytes() / 1024 << " KB mapped (written in "
+				<< writeMilliseconds << " ms), " << frames << " frames" << std::endl;
+
+			result = flyOverTerrain(file, width, height, frames);
+		}
+	}
+
+	std::remove(path);
+
+	return result;
+}
@@ -0,0 +1,233 @@
+#ifndef CUSTOM_TERRAIN_H
+#define CUSTOM_TERRAIN_H
+
+#include "culling.hpp"
+#include "vecmath.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Height of world sample (x, z), 0 lowest and 65535 highest.
+typedef std::function<uint16_t(int x, int z)> HeightFunction;
+
+// Writes a heightmap pyramid for a square world of tileSize << (levelCount - 1)
+// quads per side. Level 0 is full resolution and every following level keeps
+// every other sample, so a level 0 tile covers tileSize quads and the single
+// tile of the last level the whole world. Tiles hold tileSize + 1 samples per
+// side, sharing their border row and column with their neighbours. Writes
+// one tile at a time, so memory does not grow with the world.
+bool writeHeightmapFile(const char* path, int tileSize, int levelCount, const HeightFunction& height);
+
+// A file written by writeHeightmapFile(), memory-mapped. Tiles are read in
+// place; only the pages touched stay in memory, and the OS may drop them again.
+class HeightmapFile {
+public:
+	static const int maxLevels = 14;
+
+	HeightmapFile(const char* path);
+	~HeightmapFile();
+
+	HeightmapFile(const HeightmapFile&) = delete;
+	HeightmapFile& operator=(const HeightmapFile&) = delete;
+
+	bool isValid() const;
+
+	int tileSize() const;
+	int levelCount() const;
+	int tilesPerSide(int level) const;
+	// tileSize << (levelCount - 1).
+	int worldQuads() const;
+
+	// (tileSize + 1)^2 samples, rows of increasing z.
+	const uint16_t* tile(int level, int x, int z) const;
+
+	void tileRange(int level, int x, int z, uint16_t& minimum, uint16_t& maximum) const;
+
+	// Nearest full-resolution sample.
+	uint16_t sample(int x, int z) const;
+
+	size_t fileBytes() const;
+
+private:
+	size_t tileIndex(int level, int x, int z) const;
+
+	void* data;
+	size_t size;
+	int tileQuads;
+	int levels;
+	const uint16_t* ranges;
+	const uint16_t* tiles;
+	std::vector<size_t> firstTiles;
+};
+
+// Tiles of a HeightmapFile resident in a GL_R16 texture array with a fixed
+// number of layers, so memory stays the same whatever the size of the world.
+// A loader thread copies requested tiles out of the mapping, taking the page
+// faults off the render thread, and endFrame() uploads a bounded number of
+// them into the least recently used layers. The root tile is loaded up front
+// and never evicted.
+class TerrainTileCache {
+public:
+	TerrainTileCache(const HeightmapFile& file, int slotCount, int stagingCount, int uploadsPerFrame);
+	~TerrainTileCache();
+
+	TerrainTileCache(const TerrainTileCache&) = delete;
+	TerrainTileCache& operator=(const TerrainTileCache&) = delete;
+
+	// Layer holding the tile, marked as used this frame, or -1 when it is not
+	// resident yet, in which case it is requested.
+	int acquire(int level, int x, int z);
+
+	// Uploads finished tiles into layers not used this frame and starts the next frame.
+	void endFrame();
+
+	unsigned int texture() const;
+
+	int residentCount() const;
+	int pendingCount() const;
+	unsigned long long uploadCount() const;
+
+	// Layers of the texture array: slotCount, or fewer where
+	// GL_MAX_ARRAY_TEXTURE_LAYERS is lower.
+	int slotCount() const;
+
+	// Texture array plus staging memory; fixed at construction.
+	size_t residentBytes() const;
+
+private:
+	struct Slot {
+		uint32_t key;
+		unsigned long long lastUsed;
+	};
+
+	struct Staged {
+		uint32_t key;
+		int buffer;
+	};
+
+	void loaderLoop();
+
+	const HeightmapFile& file;
+	int samplesPerSide;
+	int uploadsPerFrame;
+	unsigned int tileTexture;
+	unsigned long long frame;
+	unsigned long long uploads;
+	int resident;
+
+	std::vector<Slot> slots;
+	// Layer of every resident tile, -1 while a tile is being loaded.
+	std::unordered_map<uint32_t, int> tiles;
+	std::vector<std::vector<uint16_t> > stagingBuffers;
+	std::vector<int> freeBuffers;
+	std::vector<Staged> uploadQueue;
+
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Staged> requests;
+	std::vector<Staged> loaded;
+	bool stopping;
+};
+
+struct TerrainStats {
+	unsigned int nodesSelected;
+	unsigned int quadrantsDrawn;
+	// Finest level selected, levelCount when nothing was.
+	int finestLevel;
+	int tilesResident;
+	int tilesPending;
+	unsigned long long tilesUploaded;
+};
+
+// Continuous distance-dependent LOD terrain (CDLOD, Strugar 2009). Quadtree
+// nodes are the tiles of the heightmap pyramid, and every node is drawn with
+// the same tileSize x tileSize grid mesh displaced in the vertex shader from
+// the node's layer of the tile cache. Level ranges double from the finest
+// level up, and vertices in the outer part of their node's range morph onto
+// the grid of the next coarser level, so neighbouring levels meet without
+// cracks or popping.
+//
+// A node whose children are not resident yet draws their quadrants itself
+// from its own tile and requests them; until they arrive a quadrant may sit
+// next to a node two levels finer, which can leave thin cracks.
+class TerrainRenderer {
+public:
+	// file must be valid and outlive the renderer. sampleSpacing is the world
+	// distance between samples and heightScale the world height of sample
+	// value 65535. The world spans [0, worldSize()] in x and z.
+	TerrainRenderer(const HeightmapFile& file, float sampleSpacing, float heightScale, int cacheSlots);
+	~TerrainRenderer();
+
+	TerrainRenderer(const TerrainRenderer&) = delete;
+	TerrainRenderer& operator=(const TerrainRenderer&) = delete;
+
+	bool isValid() const;
+
+	// Selects and culls nodes for the camera, requests missing tiles and
+	// uploads the ones that arrived.
+	void update(const Vec3& cameraPosition, const Mat4& viewProjection);
+
+	// Draws the last selection with depth testing left to the caller.
+	void draw(const Mat4& viewProjection, const Vec3& lightDirection) const;
+
+	const TerrainStats& stats() const;
+	const TerrainTileCache& cache() const;
+
+	float worldSize() const;
+	float heightAt(float x, float z) const;
+
+private:
+	// Per-instance attributes of one node quadrant.
+	struct NodeInstance {
+		float origin[2];
+		float size;
+		float layer;
+		float morphStart;
+		float morphEnd;
+	};
+
+	bool selectNode(int level, int x, int z, bool root);
+	void addNode(int level, int x, int z, int layer, int quadrants);
+
+	const HeightmapFile& file;
+	TerrainTileCache tileCache;
+	float spacing;
+	float heights;
+	int gridSize;
+	unsigned int quadrantIndexCount;
+
+	unsigned int program;
+	unsigned int vao;
+	unsigned int vertexBuffer;
+	unsigned int indexBuffer;
+	unsigned int instanceBuffer;
+	size_t instanceCapacity;
+	int viewProjectionLocation;
+	int cameraLocation;
+	int lightLocation;
+
+	std::vector<float> ranges;
+	Vec3 camera;
+	Frustum frustum;
+	std::vector<NodeInstance> quadrantInstances[4];
+	std::vector<NodeInstance> instances;
+	size_t quadrantFirst[4];
+	TerrainStats lastStats;
+};
+
+// Writes a procedural world of levelCount levels of 64-quad tiles to a
+// temporary heightmap file, then flies a camera across it at width x height
+// for frames frames. Prints file size, memory held by the tile cache, CPU
+// and GPU time per frame and streaming counters. Needs a current context.
+// Returns 0 on success, 1 when the full-resolution tiles around the camera
+// never became resident once it stopped.
+int runTerrainBenchmark(int width, int height, int levelCount, int frames);
+
+#endif // !CUSTOM_TERRAIN_H
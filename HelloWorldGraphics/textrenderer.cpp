@@ -0,0 +1,750 @@
+#include "textrenderer.hpp"
+#include "glprogram.hpp"
+#include "gputimer.hpp"
+#include "rendergraph.hpp"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static const char* textVertexShaderSource = "#version 330 core\n"
+	"layout (location = 0) in vec4 aRect;\n"
+	"layout (location = 1) in vec4 aTexRect;\n"
+	"layout (location = 2) in float aLayer;\n"
+	"uniform vec2 pixelScale;\n"
+	"uniform vec2 origin;\n"
+	"out vec3 texCoord;\n"
+	"void main() {\n"
+	"vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+	"vec2 position = origin + aRect.xy + corner * aRect.zw;\n"
+	"texCoord = vec3(mix(aTexRect.xy, aTexRect.zw, corner), aLayer);\n"
+	"gl_Position = vec4(position * pixelScale + vec2(-1.0, 1.0), 0.0, 1.0);\n"
+	"}\0";
+
+static const char* textFragmentShaderSource = "#version 330 core\n"
+	"uniform sampler2DArray atlas;\n"
+	"uniform vec4 textColor;\n"
+	"in vec3 texCoord;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"float distance = texture(atlas, texCoord).r;\n"
+	"float width = max(fwidth(distance), 0.0001);\n"
+	"FragColor = vec4(textColor.rgb, textColor.a * smoothstep(0.5 - width, 0.5 + width, distance));\n"
+	"}\0";
+
+// Stroke font on a grid four units wide: baseline at y = 0, x-height 4, cap
+// height 6, descenders to -2. Strokes are separated by ';', points by ','.
+// A stroke of one repeated point is a dot.
+static const char* strokeGlyphs[95] = {
+	/*   */ "",
+	/* ! */ "2 6, 2 1.5; 2 0, 2 0",
+	/* " */ "1.5 6, 1.5 4.5; 2.5 6, 2.5 4.5",
+	/* # */ "1 0, 1.5 6; 2.5 0, 3 6; 0 2, 4 2; 0 4, 4 4",
+	/* $ */ "4 5, 3 6, 1 6, 0 5, 0 4, 1 3, 3 3, 4 2, 4 1, 3 0, 1 0, 0 1; 2 7, 2 -1",
+	/* % */ "0 0, 4 6; 0.5 5.5, 0.5 5.5; 3.5 0.5, 3.5 0.5",
+	/* & */ "4 0, 1 4.5, 1 5.5, 1.5 6, 2.5 6, 3 5.5, 3 4.5, 0 2, 0 1, 1 0, 2.5 0, 4 2",
+	/* ' */ "2 6, 2 4.5",
+	/* ( */ "3 6.5, 2 5, 2 1, 3 -0.5",
+	/* ) */ "1 6.5, 2 5, 2 1, 1 -0.5",
+	/* * */ "2 5, 2 1; 0.5 4, 3.5 2; 0.5 2, 3.5 4",
+	/* + */ "2 5, 2 1; 0 3, 4 3",
+	/* , */ "2 0.5, 2 0, 1.5 -1",
+	/* - */ "0.5 3, 3.5 3",
+	/* . */ "2 0, 2 0",
+	/* / */ "0 0, 4 6",
+	/* 0 */ "1 0, 0 1, 0 5, 1 6, 3 6, 4 5, 4 1, 3 0, 1 0; 0.5 0.5, 3.5 5.5",
+	/* 1 */ "1 5, 2 6, 2 0; 1 0, 3 0",
+	/* 2 */ "0 5, 1 6, 3 6, 4 5, 4 4, 0 0, 4 0",
+	/* 3 */ "0 6, 4 6, 2 3.5, 3 3.5, 4 2.5, 4 1, 3 0, 1 0, 0 1",
+	/* 4 */ "3 0, 3 6, 0 2, 4 2",
+	/* 5 */ "4 6, 0 6, 0 3.5, 3 3.5, 4 2.5, 4 1, 3 0, 0 0",
+	/* 6 */ "3.5 6, 2 6, 0 4, 0 1, 1 0, 3 0, 4 1, 4 2.5, 3 3.5, 0 3.5",
+	/* 7 */ "0 6, 4 6, 1.5 0",
+	/* 8 */ "1 3.5, 0 4.5, 0 5, 1 6, 3 6, 4 5, 4 4.5, 3 3.5, 1 3.5, 0 2.5, 0 1, 1 0, 3 0, 4 1, 4 2.5, 3 3.5",
+	/* 9 */ "0.5 0, 2 0, 4 2, 4 5, 3 6, 1 6, 0 5, 0 3.5, 1 2.5, 4 2.5",
+	/* : */ "2 3.5, 2 3.5; 2 0, 2 0",
+	/* ; */ "2 3.5, 2 3.5; 2 0.5, 2 0, 1.5 -1",
+	/* < */ "4 5, 0 3, 4 1",
+	/* = */ "0.5 4, 3.5 4; 0.5 2, 3.5 2",
+	/* > */ "0 5, 4 3, 0 1",
+	/* ? */ "0 5, 1 6, 3 6, 4 5, 4 4, 2 2.5, 2 1.5; 2 0, 2 0",
+	/* @ */ "3 2, 3 4, 1.5 4, 1 3, 1.5 2, 3 2, 4 3, 4 5, 3 6, 1 6, 0 5, 0 1, 1 0, 3.5 0",
+	/* A */ "0 0, 2 6, 4 0; 0.67 2, 3.33 2",
+	/* B */ "0 0, 0 6, 3 6, 4 5, 4 4, 3 3, 0 3; 3 3, 4 2, 4 1, 3 0, 0 0",
+	/* C */ "4 5, 3 6, 1 6, 0 5, 0 1, 1 0, 3 0, 4 1",
+	/* D */ "0 0, 0 6, 2.5 6, 4 4.5, 4 1.5, 2.5 0, 0 0",
+	/* E */ "4 6, 0 6, 0 0, 4 0; 0 3, 3 3",
+	/* F */ "4 6, 0 6, 0 0; 0 3, 3 3",
+	/* G */ "4 5, 3 6, 1 6, 0 5, 0 1, 1 0, 3 0, 4 1, 4 3, 2 3",
+	/* H */ "0 0, 0 6; 4 0, 4 6; 0 3, 4 3",
+	/* I */ "1 6, 3 6; 2 6, 2 0; 1 0, 3 0",
+	/* J */ "1.5 6, 4 6; 3 6, 3 1, 2 0, 1 0, 0 1",
+	/* K */ "0 0, 0 6; 4 6, 0 2; 1.33 3.33, 4 0",
+	/* L */ "0 6, 0 0, 4 0",
+	/* M */ "0 0, 0 6, 2 3, 4 6, 4 0",
+	/* N */ "0 0, 0 6, 4 0, 4 6",
+	/* O */ "1 0, 0 1, 0 5, 1 6, 3 6, 4 5, 4 1, 3 0, 1 0",
+	/* P */ "0 0, 0 6, 3 6, 4 5, 4 4, 3 3, 0 3",
+	/* Q */ "1 0, 0 1, 0 5, 1 6, 3 6, 4 5, 4 1, 3 0, 1 0; 2.5 1.5, 4 0",
+	/* R */ "0 0, 0 6, 3 6, 4 5, 4 4, 3 3, 0 3; 2 3, 4 0",
+	/* S */ "4 5, 3 6, 1 6, 0 5, 0 4, 1 3, 3 3, 4 2, 4 1, 3 0, 1 0, 0 1",
+	/* T */ "0 6, 4 6; 2 6, 2 0",
+	/* U */ "0 6, 0 1, 1 0, 3 0, 4 1, 4 6",
+	/* V */ "0 6, 2 0, 4 6",
+	/* W */ "0 6, 1 0, 2 3, 3 0, 4 6",
+	/* X */ "0 0, 4 6; 0 6, 4 0",
+	/* Y */ "0 6, 2 3, 4 6; 2 3, 2 0",
+	/* Z */ "0 6, 4 6, 0 0, 4 0",
+	/* [ */ "3 6.5, 1.5 6.5, 1.5 -0.5, 3 -0.5",
+	/* \ */ "0 6, 4 0",
+	/* ] */ "1 6.5, 2.5 6.5, 2.5 -0.5, 1 -0.5",
+	/* ^ */ "0.5 4, 2 6, 3.5 4",
+	/* _ */ "0 -1, 4 -1",
+	/* ` */ "1.5 6, 2.5 5",
+	/* a */ "1 4, 3 4, 4 3, 4 0; 4 2.5, 1 2.5, 0 1.5, 1 0, 3 0, 4 1",
+	/* b */ "0 6, 0 0; 0 3, 1 4, 3 4, 4 3, 4 1, 3 0, 1 0, 0 1",
+	/* c */ "4 3.5, 3 4, 1 4, 0 3, 0 1, 1 0, 3 0, 4 0.5",
+	/* d */ "4 6, 4 0; 4 3, 3 4, 1 4, 0 3, 0 1, 1 0, 3 0, 4 1",
+	/* e */ "0 2, 4 2, 4 3, 3 4, 1 4, 0 3, 0 1, 1 0, 3.5 0",
+	/* f */ "3.5 6, 2.5 6, 1.5 5, 1.5 0; 0 4, 3 4",
+	/* g */ "4 4, 4 -1, 3 -2, 1 -2; 4 3, 3 4, 1 4, 0 3, 0 1, 1 0, 3 0, 4 1",
+	/* h */ "0 6, 0 0; 0 3, 1 4, 3 4, 4 3, 4 0",
+	/* i */ "1 4, 2 4, 2 0; 1 0, 3 0; 2 5.5, 2 5.5",
+	/* j */ "2 4, 3 4, 3 -1, 2 -2, 1 -2; 3 5.5, 3 5.5",
+	/* k */ "0 6, 0 0; 0 1.5, 3.5 4; 1.3 2.5, 4 0",
+	/* l */ "1 6, 2 6, 2 0; 1 0, 3 0",
+	/* m */ "0 0, 0 4; 0 3, 1 4, 2 3, 2 0; 2 3, 3 4, 4 3, 4 0",
+	/* n */ "0 0, 0 4; 0 3, 1 4, 3 4, 4 3, 4 0",
+	/* o */ "1 0, 0 1, 0 3, 1 4, 3 4, 4 3, 4 1, 3 0, 1 0",
+	/* p */ "0 4, 0 -2; 0 3, 1 4, 3 4, 4 3, 4 1, 3 0, 1 0, 0 1",
+	/* q */ "4 4, 4 -2; 4 3, 3 4, 1 4, 0 3, 0 1, 1 0, 3 0, 4 1",
+	/* r */ "0 4, 0 0; 0 2.5, 1.5 4, 3.5 4",
+	/* s */ "4 3.5, 3 4, 1 4, 0 3.2, 1 2, 3 2, 4 0.8, 3 0, 1 0, 0 0.5",
+	/* t */ "1.5 6, 1.5 1, 2.5 0, 3.5 0; 0 4, 3 4",
+	/* u */ "0 4, 0 1, 1 0, 3 0, 4 1; 4 4, 4 0",
+	/* v */ "0 4, 2 0, 4 4",
+	/* w */ "0 4, 1 0, 2 2.5, 3 0, 4 4",
+	/* x */ "0 0, 4 4; 0 4, 4 0",
+	/* y */ "0 4, 2 0; 4 4, 1 -2",
+	/* z */ "0 4, 4 4, 0 0, 4 0",
+	/* { */ "3 6.5, 2 6, 2 3.5, 1 3, 2 2.5, 2 0, 3 -0.5",
+	/* | */ "2 6.5, 2 -1",
+	/* } */ "1 6.5, 2 6, 2 3.5, 3 3, 2 2.5, 2 0, 1 -0.5",
+	/* ~ */ "0 3, 1 4, 3 3, 4 4"
+};
+
+static const char* missingGlyph = "0 0, 4 0, 4 6, 0 6, 0 0";
+
+// Glyph cells span x -3 .. 7 and y -3.5 .. 6.5 in font units; the font's
+// 8 unit line box is the size passed to drawText().
+static const float cellLeft = -3.0f;
+static const float cellTop = 6.5f;
+static const float cellUnits = 10.0f;
+static const float unitsPerSize = 8.0f;
+static const float advanceUnits = 5.0f;
+static const float lineUnits = 11.0f;
+static const float strokeHalfWidth = 0.45f;
+// Distance in font units that maps to the full 0 .. 1 range around the 0.5 edge.
+static const float distanceSpread = 3.0f;
+
+static const char* glyphStrokes(uint32_t codepoint) {
+	return codepoint >= 32 && codepoint < 127 ? strokeGlyphs[codepoint - 32] : missingGlyph;
+}
+
+// Decodes one UTF-8 sequence; malformed bytes decode as themselves.
+static uint32_t nextCodepoint(const char*& text) {
+	const unsigned char* bytes = (const unsigned char*)text;
+	uint32_t codepoint = bytes[0];
+	int length = codepoint < 0x80 ? 1 : (codepoint >> 5) == 0x6 ? 2 : (codepoint >> 4) == 0xE ? 3 : (codepoint >> 3) == 0x1E ? 4 : 1;
+
+	if (length > 1) {
+		codepoint &= 0xFF >> (length + 1);
+
+		for (int i = 1; i < length; i++) {
+			if ((bytes[i] & 0xC0) != 0x80) {
+				text += 1;
+				return bytes[0];
+			}
+
+			codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+		}
+	}
+
+	text += length;
+
+	return codepoint;
+}
+
+GlyphAtlas::GlyphAtlas(int cellSize, int pageSize, int pageCount)
+	: cell((std::max(cellSize, 8) + 3) & ~3), size(std::max(pageSize, cell)), pages(std::min(std::max(pageCount, 1), (int)maxPages)),
+	cellsPerRow(size / cell), frame(0), evictions(0), rasterized(0), glyphs(), pageGlyphs(pages), pageLastUsed(pages, 0),
+	pageEvictedAt(pages, 0), scratch((size_t)cell * cell), atlasTexture(0) {
+	glGenTextures(1, &atlasTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, atlasTexture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, size, size, pages, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+GlyphAtlas::~GlyphAtlas() {
+	glDeleteTextures(1, &atlasTexture);
+}
+
+void GlyphAtlas::beginFrame() {
+	frame++;
+}
+
+void GlyphAtlas::rasterize(uint32_t codepoint, unsigned char* pixels) const {
+	std::vector<float> points;
+	std::vector<int> strokeEnds;
+	const char* cursor = glyphStrokes(codepoint);
+
+	while (*cursor != '\0') {
+		char* end;
+		float x = std::strtof(cursor, &end);
+		float y = std::strtof(end, &end);
+
+		points.push_back(x);
+		points.push_back(y);
+		cursor = end;
+
+		while (*cursor == ' ' || *cursor == ',') {
+			cursor++;
+		}
+
+		if (*cursor == ';' || *cursor == '\0') {
+			strokeEnds.push_back((int)points.size() / 2);
+
+			if (*cursor == ';') {
+				cursor++;
+			}
+		}
+	}
+
+	float unitsPerPixel = cellUnits / cell;
+
+	for (int row = 0; row < cell; row++) {
+		for (int column = 0; column < cell; column++) {
+			float px = cellLeft + (column + 0.5f) * unitsPerPixel;
+			float py = cellTop - (row + 0.5f) * unitsPerPixel;
+			float nearest = 1e30f;
+			int first = 0;
+
+			for (size_t s = 0; s < strokeEnds.size(); s++) {
+				// A single point still counts as a segment of length zero.
+				for (int i = first; i < std::max(strokeEnds[s] - 1, first + 1); i++) {
+					int j = std::min(i + 1, strokeEnds[s] - 1);
+					float ax = points[i * 2];
+					float ay = points[i * 2 + 1];
+					float dx = points[j * 2] - ax;
+					float dy = points[j * 2 + 1] - ay;
+					float lengthSquared = dx * dx + dy * dy;
+					float t = lengthSquared > 0.0f ? std::min(std::max(((px - ax) * dx + (py - ay) * dy) / lengthSquared, 0.0f), 1.0f) : 0.0f;
+					float ex = px - (ax + t * dx);
+					float ey = py - (ay + t * dy);
+
+					nearest = std::min(nearest, ex * ex + ey * ey);
+				}
+
+				first = strokeEnds[s];
+			}
+
+			float distance = std::sqrt(nearest) - strokeHalfWidth;
+			float value = std::min(std::max(0.5f - distance / distanceSpread, 0.0f), 1.0f);
+
+			pixels[row * cell + column] = (unsigned char)(value * 255.0f + 0.5f);
+		}
+	}
+}
+
+void GlyphAtlas::evictPage(int page) {
+	for (size_t i = 0; i < pageGlyphs[page].size(); i++) {
+		glyphs.erase(pageGlyphs[page][i]);
+	}
+
+	pageGlyphs[page].clear();
+	evictions++;
+	pageEvictedAt[page] = evictions;
+}
+
+bool GlyphAtlas::acquire(uint32_t codepoint, GlyphSlot& slot) {
+	int cellsPerPage = cellsPerRow * cellsPerRow;
+	std::unordered_map<uint32_t, uint32_t>::iterator found = glyphs.find(codepoint);
+	uint32_t location;
+
+	if (found != glyphs.end()) {
+		location = found->second;
+	}
+	else {
+		int page = -1;
+
+		for (int p = 0; p < pages && page < 0; p++) {
+			if ((int)pageGlyphs[p].size() < cellsPerPage) {
+				page = p;
+			}
+		}
+
+		if (page < 0) {
+			for (int p = 0; p < pages; p++) {
+				if (pageLastUsed[p] != frame && (page < 0 || pageLastUsed[p] < pageLastUsed[page])) {
+					page = p;
+				}
+			}
+
+			if (page < 0) {
+				std::cerr << "ERROR::GLYPH_ATLAS::FULL" << std::endl;
+				return false;
+			}
+
+			evictPage(page);
+		}
+
+		int index = (int)pageGlyphs[page].size();
+		location = (uint32_t)(page * cellsPerPage + index);
+
+		rasterize(codepoint, scratch.data());
+		glBindTexture(GL_TEXTURE_2D_ARRAY, atlasTexture);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, (index % cellsPerRow) * cell, (index / cellsPerRow) * cell, page, cell, cell, 1,
+			GL_RED, GL_UNSIGNED_BYTE, scratch.data());
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		pageGlyphs[page].push_back(codepoint);
+		glyphs[codepoint] = location;
+		rasterized++;
+	}
+
+	int page = (int)(location / cellsPerPage);
+	int index = (int)(location % cellsPerPage);
+
+	pageLastUsed[page] = frame;
+	slot.page = page;
+	slot.u0 = (float)((index % cellsPerRow) * cell) / size;
+	slot.v0 = (float)((index / cellsPerRow) * cell) / size;
+	slot.u1 = slot.u0 + (float)cell / size;
+	slot.v1 = slot.v0 + (float)cell / size;
+
+	return true;
+}
+
+void GlyphAtlas::touchPages(uint64_t pageMask) {
+	for (int p = 0; pageMask != 0; p++, pageMask >>= 1) {
+		if (pageMask & 1) {
+			pageLastUsed[p] = frame;
+		}
+	}
+}
+
+bool GlyphAtlas::pagesIntact(uint64_t pageMask, unsigned int serial) const {
+	for (int p = 0; pageMask != 0; p++, pageMask >>= 1) {
+		if ((pageMask & 1) && pageEvictedAt[p] > serial) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+unsigned int GlyphAtlas::evictionCount() const {
+	return evictions;
+}
+
+unsigned int GlyphAtlas::rasterizedCount() const {
+	return rasterized;
+}
+
+unsigned int GlyphAtlas::texture() const {
+	return atlasTexture;
+}
+
+TextRenderer::TextRenderer(BufferAllocator& buffers, int cellSize, int pageSize, int pageCount)
+	: buffers(buffers), glyphAtlas(cellSize, pageSize, pageCount), caching(true), frame(0), scaleX(0.0f), scaleY(0.0f), stats(),
+	runs(), freeRuns(), runsByHash(), queue(), instances(), vertexArray(0), program(0) {
+	program = createProgram(textVertexShaderSource, textFragmentShaderSource);
+
+	if (program == 0) {
+		return;
+	}
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "atlas"), 0);
+
+	// Instance attributes are pointed at each run's range when it is drawn.
+	glGenVertexArrays(1, &vertexArray);
+	glBindVertexArray(vertexArray);
+
+	for (unsigned int attribute = 0; attribute < 3; attribute++) {
+		glEnableVertexAttribArray(attribute);
+		glVertexAttribDivisor(attribute, 1);
+	}
+
+	glBindVertexArray(0);
+}
+
+TextRenderer::~TextRenderer() {
+	for (size_t i = 0; i < runs.size(); i++) {
+		if (runs[i].live && !runs[i].range.isNull()) {
+			buffers.free(runs[i].range);
+		}
+	}
+
+	glDeleteVertexArrays(1, &vertexArray);
+	glDeleteProgram(program);
+}
+
+bool TextRenderer::isValid() const {
+	return program != 0;
+}
+
+void TextRenderer::setCaching(bool enabled) {
+	caching = enabled;
+}
+
+void TextRenderer::begin(int viewportWidth, int viewportHeight) {
+	frame++;
+	glyphAtlas.beginFrame();
+
+	for (uint32_t i = 0; i < runs.size(); i++) {
+		if (runs[i].live && runs[i].lastUsed + runLifetime < frame) {
+			releaseRun(i);
+		}
+	}
+
+	scaleX = 2.0f / viewportWidth;
+	scaleY = -2.0f / viewportHeight;
+	queue.clear();
+	stats.runsDrawn = 0;
+	stats.runsLaidOut = 0;
+	stats.glyphsDrawn = 0;
+}
+
+void TextRenderer::releaseRun(uint32_t index) {
+	TextRun& run = runs[index];
+
+	if (!run.range.isNull()) {
+		buffers.free(run.range);
+	}
+
+	std::unordered_map<uint64_t, uint32_t>::iterator found = runsByHash.find(run.hash);
+
+	if (found != runsByHash.end() && found->second == index) {
+		runsByHash.erase(found);
+	}
+
+	run.range.value = 0;
+	run.live = false;
+	freeRuns.push_back(index);
+}
+
+uint32_t TextRenderer::findRun(const char* text, float size, uint64_t hash) {
+	std::unordered_map<uint64_t, uint32_t>::iterator found = runsByHash.find(hash);
+
+	if (found != runsByHash.end()) {
+		if (runs[found->second].size == size && runs[found->second].text == text) {
+			return found->second;
+		}
+
+		// Hash collision; the newer text takes the slot.
+		releaseRun(found->second);
+	}
+
+	uint32_t index;
+
+	if (!freeRuns.empty()) {
+		index = freeRuns.back();
+		freeRuns.pop_back();
+	}
+	else {
+		index = (uint32_t)runs.size();
+		runs.push_back(TextRun());
+	}
+
+	TextRun& run = runs[index];
+	run.text = text;
+	run.size = size;
+	run.hash = hash;
+	run.range.value = 0;
+	run.glyphCount = 0;
+	run.pageMask = 0;
+	run.evictionSerial = 0;
+	run.lastUsed = frame;
+	run.live = true;
+	run.laidOut = false;
+	runsByHash[hash] = index;
+
+	return index;
+}
+
+void TextRenderer::layoutRun(TextRun& run) {
+	float scale = run.size / unitsPerSize;
+	float penX = 0.0f;
+	float penY = 0.0f;
+	const char* cursor = run.text.c_str();
+
+	instances.clear();
+	run.pageMask = 0;
+
+	while (*cursor != '\0') {
+		uint32_t codepoint = nextCodepoint(cursor);
+
+		if (codepoint == '\n') {
+			penX = 0.0f;
+			penY += lineUnits * scale;
+			continue;
+		}
+
+		GlyphSlot slot;
+
+		// Everything outside the font shares the box glyph.
+		if (codepoint != ' ' && glyphAtlas.acquire(codepoint >= 32 && codepoint < 127 ? codepoint : 0, slot)) {
+			GlyphInstance instance = {
+				{ penX + cellLeft * scale, penY - cellTop * scale, cellUnits * scale, cellUnits * scale },
+				{ slot.u0, slot.v0, slot.u1, slot.v1 },
+				(float)slot.page
+			};
+
+			instances.push_back(instance);
+			run.pageMask |= (uint64_t)1 << slot.page;
+		}
+
+		penX += advanceUnits * scale;
+	}
+
+	size_t bytes = instances.size() * sizeof(GlyphInstance);
+
+	if (run.glyphCount == instances.size() && !run.range.isNull()) {
+		buffers.upload(run.range, 0, bytes, instances.data());
+	}
+	else {
+		if (!run.range.isNull()) {
+			buffers.free(run.range);
+			run.range.value = 0;
+		}
+
+		if (bytes > 0) {
+			run.range = buffers.allocate(bytes, 16, instances.data());
+		}
+	}
+
+	run.glyphCount = run.range.isNull() ? 0 : (unsigned int)instances.size();
+	run.evictionSerial = glyphAtlas.evictionCount();
+	run.laidOut = true;
+	stats.runsLaidOut++;
+}
+
+void TextRenderer::drawText(const char* text, float x, float y, float size, uint32_t color) {
+	// FNV-1a over the bytes, then the size.
+	uint64_t hash = 14695981039346656037ull;
+
+	for (const char* c = text; *c != '\0'; c++) {
+		hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+	}
+
+	uint32_t sizeBits;
+	std::memcpy(&sizeBits, &size, sizeof(sizeBits));
+	hash = (hash ^ sizeBits) * 1099511628211ull;
+
+	uint32_t index = findRun(text, size, hash);
+	TextRun& run = runs[index];
+
+	if (!caching || !run.laidOut || !glyphAtlas.pagesIntact(run.pageMask, run.evictionSerial)) {
+		layoutRun(run);
+	}
+	else {
+		glyphAtlas.touchPages(run.pageMask);
+	}
+
+	run.lastUsed = frame;
+
+	QueuedText queued = { index, x, y, color };
+	queue.push_back(queued);
+	stats.runsDrawn++;
+}
+
+void TextRenderer::end() {
+	if (queue.empty()) {
+		return;
+	}
+
+	glUseProgram(program);
+	glUniform2f(glGetUniformLocation(program, "pixelScale"), scaleX, scaleY);
+	int originLocation = glGetUniformLocation(program, "origin");
+	int colorLocation = glGetUniformLocation(program, "textColor");
+
+	glBindVertexArray(vertexArray);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, glyphAtlas.texture());
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	for (size_t i = 0; i < queue.size(); i++) {
+		const TextRun& run = runs[queue[i].run];
+
+		if (run.glyphCount == 0) {
+			continue;
+		}
+
+		BufferSlice slice = buffers.slice(run.range);
+		uint32_t color = queue[i].color;
+
+		glBindBuffer(GL_ARRAY_BUFFER, slice.buffer);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void*)(slice.offset + offsetof(GlyphInstance, rect)));
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void*)(slice.offset + offsetof(GlyphInstance, uv)));
+		glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void*)(slice.offset + offsetof(GlyphInstance, layer)));
+
+		glUniform2f(originLocation, queue[i].x, queue[i].y);
+		glUniform4f(colorLocation, (color & 0xFF) / 255.0f, ((color >> 8) & 0xFF) / 255.0f, ((color >> 16) & 0xFF) / 255.0f, (color >> 24) / 255.0f);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)run.glyphCount);
+
+		stats.glyphsDrawn += run.glyphCount;
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDisable(GL_BLEND);
+}
+
+float TextRenderer::measure(const char* text, float size) {
+	int longest = 0;
+	int current = 0;
+
+	while (*text != '\0') {
+		uint32_t codepoint = nextCodepoint(text);
+		current = codepoint == '\n' ? 0 : current + 1;
+		longest = std::max(longest, current);
+	}
+
+	return longest * advanceUnits * size / unitsPerSize;
+}
+
+const TextStats& TextRenderer::lastStats() const {
+	return stats;
+}
+
+GlyphAtlas& TextRenderer::atlas() {
+	return glyphAtlas;
+}
+
+int runTextBenchmark(int width, int height, int frames) {
+	static const char* words[26] = {
+		"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel", "india", "juliet", "kilo", "lima", "mike",
+		"november", "oscar", "papa", "quebec", "romeo", "sierra", "tango", "uniform", "victor", "whiskey", "xray", "yankee", "zulu"
+	};
+
+	const float labelSize = 14.0f;
+	const int columns = 4;
+	int rows = (int)((height - 120) / (labelSize * lineUnits / unitsPerSize));
+	std::vector<std::string> labels;
+
+	for (int i = 0; i < columns * rows; i++) {
+		char label[64];
+		std::snprintf(label, sizeof(label), "NODE %03d: LOAD %02d%% TEMP %02dC", i, (i * 37) % 100, 30 + (i * 13) % 50);
+		labels.push_back(label);
+	}
+
+	unsigned int outputTexture;
+	glGenTextures(1, &outputTexture);
+	glBindTexture(GL_TEXTURE_2D, outputTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	RenderTextureDesc outputDesc = { width, height, GL_RGBA8 };
+	const int warmupFrames = 10;
+	const int telemetryLines = 4;
+	int result = 0;
+
+	std::cout << "TEXT BENCHMARK " << width << "x" << height << ", " << labels.size() << " static labels, " << telemetryLines
+		<< " telemetry lines, " << frames << " frames" << std::endl;
+
+	for (int cached = 1; cached >= 0; cached--) {
+		BufferAllocator buffers(1 << 20);
+		// A small atlas, so the rotating telemetry words push out pages.
+		TextRenderer text(buffers, 32, 128, 4);
+
+		if (!text.isValid()) {
+			result = -1;
+			break;
+		}
+
+		text.setCaching(cached != 0);
+
+		RenderGraph graph;
+		RenderGraph::Resource output = graph.importTexture("output", outputTexture, outputDesc);
+
+		graph.addPass("text",
+			[&](RenderGraph::Builder& builder) {
+				builder.write(output, LoadOp::Clear);
+				builder.setClearColor(0.1f, 0.1f, 0.12f, 1.0f);
+			},
+			[&text](const RenderGraph&) {
+				text.end();
+			});
+
+		if (!graph.compile()) {
+			result = -1;
+			break;
+		}
+
+		GpuTimer timer(4);
+		double cpuMilliseconds = 0.0;
+		unsigned long long runsLaidOut = 0;
+		unsigned int evictionsBefore = 0;
+		unsigned int rasterizedBefore = 0;
+
+		for (int frame = 0; frame < warmupFrames + frames; frame++) {
+			if (frame == warmupFrames) {
+				timer.wait();
+				timer.resetAverage();
+				cpuMilliseconds = 0.0;
+				runsLaidOut = 0;
+				evictionsBefore = text.atlas().evictionCount();
+				rasterizedBefore = text.atlas().rasterizedCount();
+			}
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			text.begin(width, height);
+
+			for (size_t i = 0; i < labels.size(); i++) {
+				float x = 16.0f + (i % columns) * (width - 32.0f) / columns;
+				float y = 120.0f + (i / columns) * labelSize * lineUnits / unitsPerSize;
+				text.drawText(labels[i].c_str(), x, y, labelSize, 0xFFD0D0D0u);
+			}
+
+			for (int line = 0; line < telemetryLines; line++) {
+				char telemetry[128];
+				int word = line * 7 + frame / 60;
+				std::snprintf(telemetry, sizeof(telemetry), "%s %s frame %d cpu %.2f ms", words[word % 26], words[(word + 11) % 26], frame,
+					cpuMilliseconds / std::max(frame - warmupFrames, 1));
+				text.drawText(telemetry, 16.0f, 32.0f + line * 24.0f, 20.0f, 0xFF40E0FFu);
+			}
+
+			timer.begin();
+			graph.execute();
+			timer.end();
+
+			cpuMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			runsLaidOut += text.lastStats().runsLaidOut;
+			timer.poll();
+		}
+
+		timer.wait();
+
+		std::cout << (cached != 0 ? "cached runs: " : "uncached: ") << cpuMilliseconds / frames << " ms CPU, " << timer.averageMilliseconds()
+			<< " ms GPU, " << (double)runsLaidOut / frames << " of " << text.lastStats().runsDrawn << " runs laid out per frame, "
+			<< text.lastStats().glyphsDrawn << " glyphs, " << text.atlas().rasterizedCount() - rasterizedBefore << " glyphs rasterized and "
+			<< text.atlas().evictionCount() - evictionsBefore << " atlas pages evicted after warm-up" << std::endl;
+	}
+
+	glDeleteTextures(1, &outputTexture);
+
+	return result;
+}
@@ -0,0 +1,164 @@
+#ifndef CUSTOM_TEXTRENDERER_H
+#define CUSTOM_TEXTRENDERER_H
+
+#include "bufferallocator.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct GlyphSlot {
+	int page;
+	float u0, v0, u1, v1;
+};
+
+// Signed distance field glyphs of the built-in stroke font, packed into
+// equal cells of a GL_TEXTURE_2D_ARRAY with one layer per page. Glyphs are
+// rasterized on first use. When every page is full, the least recently used
+// page is evicted whole; pages used in the current frame are never evicted.
+//
+// The font covers printable ASCII; other codepoints draw as a box.
+class GlyphAtlas {
+public:
+	static const int maxPages = 64;
+
+	GlyphAtlas(int cellSize, int pageSize, int pageCount);
+	~GlyphAtlas();
+
+	GlyphAtlas(const GlyphAtlas&) = delete;
+	GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+	void beginFrame();
+
+	// Returns false when the glyph could not be placed.
+	bool acquire(uint32_t codepoint, GlyphSlot& slot);
+
+	// Marks pages, one bit each, as used this frame.
+	void touchPages(uint64_t pageMask);
+
+	// True when none of the pages was evicted after evictionCount() returned serial.
+	bool pagesIntact(uint64_t pageMask, unsigned int serial) const;
+
+	unsigned int evictionCount() const;
+	unsigned int rasterizedCount() const;
+	unsigned int texture() const;
+
+private:
+	void evictPage(int page);
+	void rasterize(uint32_t codepoint, unsigned char* pixels) const;
+
+	int cell;
+	int size;
+	int pages;
+	int cellsPerRow;
+	unsigned long long frame;
+	unsigned int evictions;
+	unsigned int rasterized;
+
+	// Codepoint to page * cells per page + cell.
+	std::unordered_map<uint32_t, uint32_t> glyphs;
+	std::vector<std::vector<uint32_t> > pageGlyphs;
+	std::vector<unsigned long long> pageLastUsed;
+	std::vector<unsigned int> pageEvictedAt;
+	std::vector<unsigned char> scratch;
+
+	unsigned int atlasTexture;
+};
+
+struct TextStats {
+	unsigned int runsDrawn;
+	unsigned int runsLaidOut;
+	unsigned int glyphsDrawn;
+};
+
+// Draws UTF-8 strings as instanced SDF glyph quads in pixel coordinates,
+// origin top left, y of the first baseline at y. A string laid out at one
+// size is a run: its glyph instances stay in a BufferAllocator range across
+// frames, so drawing the same string again costs one draw call and no layout
+// or upload, wherever and in whatever color it is drawn. Runs unused for
+// runLifetime frames are released, as are runs whose glyphs were evicted.
+class TextRenderer {
+public:
+	static const int runLifetime = 120;
+
+	TextRenderer(BufferAllocator& buffers, int cellSize, int pageSize, int pageCount);
+	~TextRenderer();
+
+	TextRenderer(const TextRenderer&) = delete;
+	TextRenderer& operator=(const TextRenderer&) = delete;
+
+	bool isValid() const;
+
+	// Lays out every draw again; for comparison.
+	void setCaching(bool enabled);
+
+	void begin(int viewportWidth, int viewportHeight);
+
+	// size is the height of a line's glyph box in pixels; color is RGBA8 with red in the lowest byte.
+	void drawText(const char* text, float x, float y, float size, uint32_t color);
+
+	// Blends over the bound framebuffer. Leaves blending disabled.
+	void end();
+
+	// Width in pixels of the widest line of text at size.
+	static float measure(const char* text, float size);
+
+	const TextStats& lastStats() const;
+	GlyphAtlas& atlas();
+
+private:
+	struct GlyphInstance {
+		float rect[4];
+		float uv[4];
+		float layer;
+	};
+
+	struct TextRun {
+		std::string text;
+		float size;
+		uint64_t hash;
+		BufferRange range;
+		unsigned int glyphCount;
+		uint64_t pageMask;
+		unsigned int evictionSerial;
+		unsigned long long lastUsed;
+		bool live;
+		bool laidOut;
+	};
+
+	struct QueuedText {
+		uint32_t run;
+		float x;
+		float y;
+		uint32_t color;
+	};
+
+	uint32_t findRun(const char* text, float size, uint64_t hash);
+	void layoutRun(TextRun& run);
+	void releaseRun(uint32_t index);
+
+	BufferAllocator& buffers;
+	GlyphAtlas glyphAtlas;
+	bool caching;
+	unsigned long long frame;
+	float scaleX;
+	float scaleY;
+	TextStats stats;
+
+	std::vector<TextRun> runs;
+	std::vector<uint32_t> freeRuns;
+	std::unordered_map<uint64_t, uint32_t> runsByHash;
+	std::vector<QueuedText> queue;
+	std::vector<GlyphInstance> instances;
+
+	unsigned int vertexArray;
+	unsigned int program;
+};
+
+// Draws a screen of static labels plus a few lines of telemetry that change
+// every frame at width x height, with run caching on and off, and prints CPU
+// and GPU time, runs laid out per frame and atlas evictions. Needs a
+// current context. Returns 0 on success.
+int runTextBenchmark(int width, int height, int frames);
+
+#endif // !CUSTOM_TEXTRENDERER_H
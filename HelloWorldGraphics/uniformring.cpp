@@ -0,0 +1,141 @@
+#include "uniformring.hpp"
+#include <GL/glew.h>
+#include <cstring>
+#include <iostream>
+
+UniformRing::UniformRing(size_t frameSize, int framesInFlight)
+	: uniformBuffer(0), alignment(256), regionSize(0), regionCount(framesInFlight), currentRegion(0), head(0), flushed(0),
+	persistent(false), mapped(NULL), fences(framesInFlight, (void*)NULL) {
+	int offsetAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+
+	if (offsetAlignment > 0) {
+		alignment = (size_t)offsetAlignment;
+	}
+
+	regionSize = (frameSize + alignment - 1) / alignment * alignment;
+
+	GLsizeiptr totalSize = (GLsizeiptr)(regionSize * regionCount);
+
+	glGenBuffers(1, &uniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+
+	if (GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glBufferStorage(GL_UNIFORM_BUFFER, totalSize, NULL, flags);
+		mapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, totalSize, flags);
+		persistent = mapped != NULL;
+	}
+
+	if (!persistent) {
+		glBufferData(GL_UNIFORM_BUFFER, totalSize, NULL, GL_STREAM_DRAW);
+		shadow.resize(regionSize);
+	}
+}
+
+UniformRing::~UniformRing() {
+	for (size_t i = 0; i < fences.size(); i++) {
+		if (fences[i] != NULL) {
+			glDeleteSync((GLsync)fences[i]);
+		}
+	}
+
+	if (persistent) {
+		glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}
+
+	glDeleteBuffers(1, &uniformBuffer);
+}
+
+void UniformRing::beginFrame() {
+	currentRegion = (currentRegion + 1) % regionCount;
+
+	// Only blocks when the GPU is still reading a region from framesInFlight frames ago.
+	GLsync fence = (GLsync)fences[currentRegion];
+
+	if (fence != NULL) {
+		GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+		while (status == GL_TIMEOUT_EXPIRED) {
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+
+		// The region may still be read, so wait for everything instead.
+		if (status == GL_WAIT_FAILED) {
+			std::cerr << "ERROR::UNIFORM_RING::FENCE_WAIT_FAILED" << std::endl;
+			glFinish();
+		}
+
+		glDeleteSync(fence);
+		fences[currentRegion] = NULL;
+	}
+
+	head = 0;
+	flushed = 0;
+}
+
+UniformAllocation UniformRing::allocate(size_t size) {
+	UniformAllocation allocation = { NULL, 0, 0 };
+	size_t start = (head + alignment - 1) / alignment * alignment;
+
+	if (start + size > regionSize) {
+		std::cerr << "ERROR::UNIFORM_RING::OUT_OF_SPACE" << std::endl;
+		return allocation;
+	}
+
+	size_t regionBase = (size_t)currentRegion * regionSize;
+
+	allocation.data = persistent ? mapped + regionBase + start : &shadow[start];
+	allocation.offset = (unsigned int)(regionBase + start);
+	allocation.size = (unsigned int)size;
+
+	head = start + size;
+
+	return allocation;
+}
+
+void UniformRing::flush() {
+	if (persistent || head <= flushed) {
+		return;
+	}
+
+	size_t regionBase = (size_t)currentRegion * regionSize;
+
+	// The fence in beginFrame() already guarantees the GPU is done with this region.
+	glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+	void* destination = glMapBufferRange(GL_UNIFORM_BUFFER, (GLintptr)(regionBase + flushed), (GLsizeiptr)(head - flushed),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+	if (destination == NULL) {
+		std::cerr << "ERROR::UNIFORM_RING::MAP_FAILED" << std::endl;
+		return;
+	}
+
+	std::memcpy(destination, &shadow[flushed], head - flushed);
+	glUnmapBuffer(GL_UNIFORM_BUFFER);
+
+	flushed = head;
+}
+
+void UniformRing::bind(unsigned int bindingPoint, const UniformAllocation& allocation) const {
+	glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, uniformBuffer, allocation.offset, allocation.size);
+}
+
+void UniformRing::endFrame() {
+	flush();
+	fences[currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+unsigned int UniformRing::buffer() const {
+	return uniformBuffer;
+}
+
+size_t UniformRing::bytesUsed() const {
+	return head;
+}
+
+size_t UniformRing::frameCapacity() const {
+	return regionSize;
+}
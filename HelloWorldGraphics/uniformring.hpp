@@ -0,0 +1,70 @@
+#ifndef CUSTOM_UNIFORMRING_H
+#define CUSTOM_UNIFORMRING_H
+
+#include <vector>
+#include <cstddef>
+
+struct UniformAllocation {
+	void* data;
+	unsigned int offset;
+	unsigned int size;
+};
+
+// One large uniform buffer split into a region per frame in flight. Constants
+// are bump-allocated from the current region at GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+// and bound with glBindBufferRange, so per-draw constants cost a pointer bump
+// instead of a glUniform* call.
+//
+// With GL_ARB_buffer_storage the buffer stays persistently mapped and writes
+// land directly in it. Otherwise they go to a CPU copy of the region that
+// flush() uploads with a single mapped write; call it after allocating and
+// before the draws that read the constants.
+class UniformRing {
+public:
+	UniformRing(size_t frameSize, int framesInFlight);
+	~UniformRing();
+
+	UniformRing(const UniformRing&) = delete;
+	UniformRing& operator=(const UniformRing&) = delete;
+
+	void beginFrame();
+
+	// Returns an allocation with data == NULL when the frame region is full.
+	UniformAllocation allocate(size_t size);
+
+	template <typename T>
+	UniformAllocation push(const T& value) {
+		UniformAllocation allocation = allocate(sizeof(T));
+
+		if (allocation.data != NULL) {
+			*(T*)allocation.data = value;
+		}
+
+		return allocation;
+	}
+
+	void flush();
+
+	void bind(unsigned int bindingPoint, const UniformAllocation& allocation) const;
+
+	void endFrame();
+
+	unsigned int buffer() const;
+	size_t bytesUsed() const;
+	size_t frameCapacity() const;
+
+private:
+	unsigned int uniformBuffer;
+	size_t alignment;
+	size_t regionSize;
+	int regionCount;
+	int currentRegion;
+	size_t head;
+	size_t flushed;
+	bool persistent;
+	char* mapped;
+	std::vector<char> shadow;
+	std::vector<void*> fences;
+};
+
+#endif // !CUSTOM_UNIFORMRING_H
@@ -0,0 +1,249 @@
+#ifndef CUSTOM_VECMATH_H
+#define CUSTOM_VECMATH_H
+
+#include <cmath>
+
+struct Vec3 {
+	float x, y, z;
+};
+
+struct Vec4 {
+	float x, y, z, w;
+};
+
+// Column-major, same layout glUniformMatrix4fv expects with transpose = GL_FALSE.
+struct Mat4 {
+	float m[16];
+};
+
+inline Vec3 vec3(float x, float y, float z) {
+	Vec3 v = { x, y, z };
+	return v;
+}
+
+inline Vec4 vec4(float x, float y, float z, float w) {
+	Vec4 v = { x, y, z, w };
+	return v;
+}
+
+inline Vec3 add(const Vec3& a, const Vec3& b) {
+	return vec3(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+inline Vec3 sub(const Vec3& a, const Vec3& b) {
+	return vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+inline Vec3 scale(const Vec3& a, float s) {
+	return vec3(a.x * s, a.y * s, a.z * s);
+}
+
+inline float dot(const Vec3& a, const Vec3& b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline Vec3 cross(const Vec3& a, const Vec3& b) {
+	return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+inline float length(const Vec3& a) {
+	return std::sqrt(dot(a, a));
+}
+
+inline Vec3 normalize(const Vec3& a) {
+	float len = length(a);
+
+	if (len == 0.0f) {
+		return a;
+	}
+
+	return scale(a, 1.0f / len);
+}
+
+inline Mat4 identity() {
+	Mat4 r = {};
+	r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+	return r;
+}
+
+inline Mat4 multiply(const Mat4& a, const Mat4& b) {
+	Mat4 r;
+
+	for (int column = 0; column < 4; column++) {
+		for (int row = 0; row < 4; row++) {
+			float sum = 0.0f;
+
+			for (int k = 0; k < 4; k++) {
+				sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+			}
+
+			r.m[column * 4 + row] = sum;
+		}
+	}
+
+	return r;
+}
+
+inline Vec4 transform(const Mat4& a, const Vec4& v) {
+	return vec4(
+		a.m[0] * v.x + a.m[4] * v.y + a.m[8] * v.z + a.m[12] * v.w,
+		a.m[1] * v.x + a.m[5] * v.y + a.m[9] * v.z + a.m[13] * v.w,
+		a.m[2] * v.x + a.m[6] * v.y + a.m[10] * v.z + a.m[14] * v.w,
+		a.m[3] * v.x + a.m[7] * v.y + a.m[11] * v.z + a.m[15] * v.w
+	);
+}
+
+inline Mat4 translation(const Vec3& t) {
+	Mat4 r = identity();
+	r.m[12] = t.x;
+	r.m[13] = t.y;
+	r.m[14] = t.z;
+	return r;
+}
+
+inline Mat4 perspective(float fovY, float aspect, float nearPlane, float farPlane) {
+	float f = 1.0f / std::tan(fovY * 0.5f);
+	Mat4 r = {};
+
+	r.m[0] = f / aspect;
+	r.m[5] = f;
+	r.m[10] = (farPlane + nearPlane) / (nearPlane - farPlane);
+	r.m[11] = -1.0f;
+	r.m[14] = (2.0f * farPlane * nearPlane) / (nearPlane - farPlane);
+
+	return r;
+}
+
+inline Mat4 orthographic(float left, float right, float bottom, float top, float nearPlane, float farPlane) {
+	Mat4 r = identity();
+
+	r.m[0] = 2.0f / (right - left);
+	r.m[5] = 2.0f / (top - bottom);
+	r.m[10] = -2.0f / (farPlane - nearPlane);
+	r.m[12] = -(right + left) / (right - left);
+	r.m[13] = -(top + bottom) / (top - bottom);
+	r.m[14] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+
+	return r;
+}
+
+inline Mat4 lookAt(const Vec3& eye, const Vec3& center, const Vec3& up) {
+	Vec3 f = normalize(sub(center, eye));
+	Vec3 s = normalize(cross(f, up));
+	Vec3 u = cross(s, f);
+	Mat4 r = identity();
+
+	r.m[0] = s.x;
+	r.m[4] = s.y;
+	r.m[8] = s.z;
+	r.m[1] = u.x;
+	r.m[5] = u.y;
+	r.m[9] = u.z;
+	r.m[2] = -f.x;
+	r.m[6] = -f.y;
+	r.m[10] = -f.z;
+	r.m[12] = -dot(s, eye);
+	r.m[13] = -dot(u, eye);
+	r.m[14] = dot(f, eye);
+
+	return r;
+}
+
+// Quaternions are Vec4 with the vector part in xyz and the scalar in w.
+inline Vec4 multiplyQuaternions(const Vec4& a, const Vec4& b) {
+	return vec4(
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+	);
+}
+
+inline Vec4 axisAngleQuaternion(const Vec3& axis, float radians) {
+	Vec3 v = scale(normalize(axis), std::sin(radians * 0.5f));
+	return vec4(v.x, v.y, v.z, std::cos(radians * 0.5f));
+}
+
+// Rotation part of a matrix without scale.
+inline Vec4 quaternionFromMatrix(const Mat4& a) {
+	const float* m = a.m;
+	float trace = m[0] + m[5] + m[10];
+
+	if (trace > 0.0f) {
+		float s = std::sqrt(trace + 1.0f) * 2.0f;
+		return vec4((m[6] - m[9]) / s, (m[8] - m[2]) / s, (m[1] - m[4]) / s, 0.25f * s);
+	}
+
+	if (m[0] > m[5] && m[0] > m[10]) {
+		float s = std::sqrt(1.0f + m[0] - m[5] - m[10]) * 2.0f;
+		return vec4(0.25f * s, (m[4] + m[1]) / s, (m[8] + m[2]) / s, (m[6] - m[9]) / s);
+	}
+
+	if (m[5] > m[10]) {
+		float s = std::sqrt(1.0f + m[5] - m[0] - m[10]) * 2.0f;
+		return vec4((m[4] + m[1]) / s, 0.25f * s, (m[9] + m[6]) / s, (m[8] - m[2]) / s);
+	}
+
+	float s = std::sqrt(1.0f + m[10] - m[0] - m[5]) * 2.0f;
+	return vec4((m[8] + m[2]) / s, (m[9] + m[6]) / s, 0.25f * s, (m[1] - m[4]) / s);
+}
+
+// Rotation by a unit quaternion followed by a translation.
+inline Mat4 rigidTransform(const Vec4& q, const Vec3& t) {
+	Mat4 r = identity();
+
+	r.m[0] = 1.0f - 2.0f * (q.y * q.y + q.z * q.z);
+	r.m[1] = 2.0f * (q.x * q.y + q.z * q.w);
+	r.m[2] = 2.0f * (q.x * q.z - q.y * q.w);
+	r.m[4] = 2.0f * (q.x * q.y - q.z * q.w);
+	r.m[5] = 1.0f - 2.0f * (q.x * q.x + q.z * q.z);
+	r.m[6] = 2.0f * (q.y * q.z + q.x * q.w);
+	r.m[8] = 2.0f * (q.x * q.z + q.y * q.w);
+	r.m[9] = 2.0f * (q.y * q.z - q.x * q.w);
+	r.m[10] = 1.0f - 2.0f * (q.x * q.x + q.y * q.y);
+	r.m[12] = t.x;
+	r.m[13] = t.y;
+	r.m[14] = t.z;
+
+	return r;
+}
+
+// General inverse by cofactors; returns the identity for singular matrices.
+inline Mat4 inverse(const Mat4& a) {
+	const float* m = a.m;
+	Mat4 r;
+	float* inv = r.m;
+
+	inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+	inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+	inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+	inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+	inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+	inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+	inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+	inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+	float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+
+	if (det == 0.0f) {
+		return identity();
+	}
+
+	float invDet = 1.0f / det;
+
+	for (int i = 0; i < 16; i++) {
+		inv[i] *= invDet;
+	}
+
+	return r;
+}
+
+#endif // !CUSTOM_VECMATH_H